@@ -4,6 +4,9 @@ import pandas as pd
 import matplotlib.pyplot as plt
 from mpl_toolkits.mplot3d import Axes3D
 import os
+import mmap
+import struct
+import time
 
 
 
@@ -34,12 +37,67 @@ def visualize(data: np.ndarray, save_path: str, frame: int)-> None:
     return None
 
 
+# Live snapshots from the shared-memory ring (shm_name = ... in the run
+# config); the layout is described in include/shm_ring.hpp.
+RING_HEADER = struct.Struct('<8sIIQQQ')   # magic, version, slots, capacity, slot_bytes, published
+SLOT_HEADER = struct.Struct('<QQdQQQ')    # sequence, step, time, rows, stars, total_stars
+RING_COLUMNS = ['x', 'y', 'z', 'vx', 'vy', 'vz', 'temperature', 'density', 'pressure']
+
+
+def align64(n: int) -> int:
+    return (n + 63) & ~63
+
+
+def read_ring(ring: mmap.mmap):
+    """Newest consistent snapshot as (step, dict of columns), or None."""
+    magic, version, slots, capacity, slot_bytes, published = RING_HEADER.unpack_from(ring, 0)
+    if magic != b'SFRING1\0' or published == 0:
+        return None
+    base = 64 + ((published - 1) % slots) * slot_bytes
+    before, step, t, rows, stars, total_stars = SLOT_HEADER.unpack_from(ring, base)
+    if before % 2 == 1:
+        return None  # being written
+    rows = min(rows, capacity)
+    column_bytes = align64(capacity * 4)
+    data = {name: np.frombuffer(ring, np.float32, rows, base + 64 + c * column_bytes).copy()
+            for c, name in enumerate(RING_COLUMNS)}
+    # keep the copy only if the writer did not start on this slot meanwhile
+    if struct.unpack_from('<Q', ring, base)[0] != before:
+        return None
+    return step, data
+
+
+def watch(name: str) -> None:
+    with open(os.path.join('/dev/shm', name.lstrip('/')), 'rb') as f:
+        ring = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    fig = plt.figure()
+    ax = fig.add_subplot(111, projection='3d')
+    shown = None
+    while plt.fignum_exists(fig.number):
+        snap = read_ring(ring)
+        if snap is not None and snap[0] != shown:
+            shown, data = snap
+            ax.cla()
+            ax.scatter(data['x'], data['y'], data['z'], s=1, c=np.log10(data['density'] + 1e-30))
+            ax.set_xlabel('X-axis')
+            ax.set_ylabel('Y-axis')
+            ax.set_zlabel('Z-axis')
+            ax.set_title(f"Step {shown}")
+        plt.pause(0.05)
+        time.sleep(0.05)
+
+
 def main():
     parser = argparse.ArgumentParser()
     parser.add_argument('--path_to_frames')
     parser.add_argument('--path_to_save')
+    parser.add_argument('--shm', help='watch the live snapshots of a run with shm_name = SHM')
     args = parser.parse_args()
 
+    if args.shm:
+        watch(args.shm)
+        return
+
     num_frames = len(list(os.listdir(args.path_to_frames)))
 
     for i in range(num_frames):
@@ -0,0 +1,119 @@
+// arena.hpp
+// Per-step scratch memory for the step pipeline.
+//
+// Temporaries that live for one step (velocity divergences, candidate
+// flags, accretion targets, ...) are bump-allocated from a slab and freed
+// all at once by reset() at the start of the next step. Every thread of
+// the team allocates from its own slab, so parallel stages need no locks.
+// A slab that runs out chains an overflow block; reset() folds the
+// overflow into one bigger slab, so after a warm-up step or two the step
+// loop stops touching the heap.
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <type_traits>
+#include "parallel.hpp"
+
+class ScratchArena {
+public:
+    // One slab per thread of the current team size, allocated on the
+    // thread's first request; create the arena after the thread count is set.
+    // The arena belongs to the creating thread: serial code there uses slab
+    // 0 and parallel regions below it use their thread numbers, also when
+    // the creator is itself one thread of an outer team (ensemble members).
+    explicit ScratchArena(size_t slab_bytes = size_t(1) << 16)
+        : slabs_(size_t(std::max(par_max_threads(), 1))), level_(par_active_level())
+    {
+        for (Slab& s : slabs_) s.size = slab_bytes;
+    }
+
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    // n uninitialised elements from the calling thread's slab, valid until
+    // the next reset(). T must be trivially destructible.
+    template <class T>
+    T* alloc(size_t n) {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "scratch memory is released without running destructors");
+        const size_t t = par_active_level() > level_ ? size_t(par_thread_id()) : 0;
+        assert(t < slabs_.size());
+        return static_cast<T*>(slabs_[t].take(n * sizeof(T), alignof(T)));
+    }
+
+    // n elements set to value
+    template <class T>
+    T* alloc(size_t n, const T& value) {
+        T* p = alloc<T>(n);
+        std::fill(p, p + n, value);
+        return p;
+    }
+
+    // Release everything allocated since the last reset (call serially).
+    void reset() {
+        for (Slab& s : slabs_) s.reset();
+    }
+
+    // bytes reserved over all slabs
+    size_t capacity() const {
+        size_t total = 0;
+        for (const Slab& s : slabs_) if (s.base) total += s.size;
+        return total;
+    }
+
+private:
+    static constexpr size_t kAlign = 64;
+
+    struct alignas(64) Slab {
+        std::unique_ptr<unsigned char[]> base;
+        size_t size = 0;
+        size_t used = 0;
+        size_t overflow_bytes = 0;
+        std::vector<std::unique_ptr<unsigned char[]>> overflow;
+
+        void grow(size_t bytes) {
+            base.reset(new unsigned char[bytes + kAlign]);
+            size = bytes;
+            used = 0;
+        }
+
+        void* take(size_t bytes, size_t align) {
+            if (!base) grow(size);
+            align = std::max(align, size_t(16));
+            unsigned char* aligned_base = align_up(base.get());
+            size_t offset = (used + align - 1) & ~(align - 1);
+            if (offset + bytes <= size) {
+                used = offset + bytes;
+                return aligned_base + offset;
+            }
+            // out of room: private block for this request, folded into the
+            // slab on the next reset
+            overflow.emplace_back(new unsigned char[bytes + kAlign]);
+            overflow_bytes += bytes + align;
+            return align_up(overflow.back().get());
+        }
+
+        void reset() {
+            if (!overflow.empty()) {
+                const size_t need = used + overflow_bytes;
+                overflow.clear();
+                overflow_bytes = 0;
+                grow(need + need / 4);
+            }
+            used = 0;
+        }
+
+        static unsigned char* align_up(unsigned char* p) {
+            const uintptr_t v = reinterpret_cast<uintptr_t>(p);
+            return reinterpret_cast<unsigned char*>((v + kAlign - 1) & ~uintptr_t(kAlign - 1));
+        }
+    };
+
+    std::vector<Slab> slabs_;
+    int level_; // active parallel level of the owner
+};
@@ -0,0 +1,51 @@
+// async_output.hpp
+// Background writer for step output.
+//
+// submit() copies the particles and stars into the writer's buffer and
+// returns; a worker thread then runs the write job on the copy while the
+// next step computes. One frame is in flight at a time: a submit waits for
+// the previous frame to finish, so output never queues up unboundedly and
+// the copy buffer is reused (no allocation once it has grown to size).
+#pragma once
+
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "particles.hpp"
+#include "stars.hpp"
+
+class AsyncFrameWriter {
+public:
+    using Job = std::function<void(const Particles&, const SinkParticles&)>;
+
+    AsyncFrameWriter();
+    ~AsyncFrameWriter(); // finishes the pending frame
+
+    AsyncFrameWriter(const AsyncFrameWriter&) = delete;
+    AsyncFrameWriter& operator=(const AsyncFrameWriter&) = delete;
+
+    // Snapshot P and S and run job(copy_of_P, copy_of_S) in the background.
+    void submit(const Particles& P, const SinkParticles& S, Job job);
+
+    // Block until the pending frame is written.
+    void wait();
+
+    // seconds the step loop spent blocked on the writer
+    double stall_seconds() const { return stall_; }
+
+private:
+    Particles P_{0};
+    SinkParticles S_;
+    Job job_;
+    bool pending_ = false;
+    bool stop_ = false;
+    double stall_ = 0.0;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread worker_;
+
+    void loop();
+};
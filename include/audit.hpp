@@ -0,0 +1,37 @@
+// audit.hpp
+// Force-accuracy audit: exact direct-sum gravity on a random sample of
+// particles, compared with the accelerations of the active solver.
+// O(N * samples) per audit.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include "particles.hpp"
+
+struct ForceAudit {
+    size_t step = 0;
+    size_t samples = 0;
+    double rms = 0.0;   // RMS of |a - a_exact| / |a_exact|
+    double p99 = 0.0;   // 99th percentile of the same
+    double max = 0.0;
+};
+
+// Compare the gas self-gravity accelerations (ax, ay, az), as written by a
+// solver, with a double-precision direct sum for `samples` alive particles
+// drawn at random (deterministic in seed and step).
+ForceAudit audit_forces(const Particles& P,
+                        const real_t* ax, const real_t* ay, const real_t* az,
+                        size_t samples, uint64_t seed, size_t step,
+                        real_t G = 1.0f, real_t softening = 0.01f);
+
+// CSV log of audits, tagged with the solver that was audited.
+class ForceAuditLog {
+public:
+    bool open(const std::string& filename);
+    void write(const ForceAudit& a, const std::string& solver);
+
+private:
+    std::ofstream out_;
+};
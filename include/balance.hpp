@@ -0,0 +1,127 @@
+// balance.hpp
+// Cost-balanced parallel loops for irregular per-item work.
+//
+// Items are visited in a spatially sorted order (Morton keys, grid cells),
+// so neighbouring items have similar work and touch the same data. The
+// order is cut into contiguous chunks of equal predicted cost, using
+// per-item costs measured on the previous pass (interaction counts), and
+// every thread owns an equal-cost run of chunks. A thread that runs out of
+// work steals chunks from the others, so a poor prediction (first step,
+// particles moved, fewer threads than planned) degrades to dynamic
+// scheduling instead of idle threads.
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+#include "parallel.hpp"
+
+class BalancedLoop {
+public:
+    BalancedLoop() = default;
+    // scheduling state is per object and rebuilt on every run; copies
+    // (of solvers that own a loop) start fresh
+    BalancedLoop(const BalancedLoop&) {}
+    BalancedLoop& operator=(const BalancedLoop&) { return *this; }
+
+    // Call body(begin, end) for disjoint ranges covering [0, n), in parallel.
+    // costs[k] is the predicted work of item k; null means uniform.
+    template <class Body>
+    void run(size_t n, const uint32_t* costs, Body&& body) {
+        const int T = std::max(par_max_threads(), 1);
+        plan(n, costs, T);
+
+        #pragma omp parallel num_threads(T)
+        {
+            const int t = par_thread_id();
+            const double t0 = par_wtime();
+            size_t stolen = 0;
+
+            // own chunks first, then steal from the others in turn; threads
+            // the runtime did not start are emptied by the rest
+            for (int v = 0; v < T; ++v) {
+                Slot& s = slots_[(t + v) % T];
+                for (size_t c; (c = s.next.fetch_add(1, std::memory_order_relaxed)) < s.end;) {
+                    body(bounds_[c], bounds_[c + 1]);
+                    if (v > 0) stolen++;
+                }
+            }
+            slots_[t].busy = par_wtime() - t0;
+            slots_[t].stolen = stolen;
+            slots_[t].ran = true;
+        }
+
+        double max = 0, sum = 0;
+        int ran = 0;
+        steals_ = 0;
+        for (int t = 0; t < T; ++t) {
+            if (!slots_[t].ran) continue;
+            max = std::max(max, slots_[t].busy);
+            sum += slots_[t].busy;
+            steals_ += slots_[t].stolen;
+            ran++;
+        }
+        imbalance_ = sum > 0 ? max / (sum / ran) : 1.0;
+    }
+
+    // max / mean thread busy time of the last run (1 = perfectly balanced)
+    double imbalance() const { return imbalance_; }
+    // chunks taken from another thread's share in the last run
+    size_t steals() const { return steals_; }
+
+private:
+    static constexpr size_t kChunksPerThread = 16;
+
+    struct alignas(64) Slot {
+        std::atomic<size_t> next{0};
+        size_t end = 0;
+        double busy = 0;
+        size_t stolen = 0;
+        bool ran = false;
+    };
+
+    std::vector<size_t> bounds_;      // chunk c covers [bounds_[c], bounds_[c+1])
+    std::unique_ptr<Slot[]> slots_;
+    int num_slots_ = 0;
+    double imbalance_ = 1.0;
+    size_t steals_ = 0;
+
+    // weighted prefix partition into equal-cost chunks, dealt out to threads
+    void plan(size_t n, const uint32_t* costs, int T) {
+        const size_t chunks = std::max<size_t>(1, std::min(n, size_t(T) * kChunksPerThread));
+        // sized for the whole machine: step-graph stages run with varying
+        // thread shares and must not reallocate each time a share grows
+        const int room = std::max(T, par_num_procs());
+        if (bounds_.capacity() < size_t(room) * kChunksPerThread + 1)
+            bounds_.reserve(size_t(room) * kChunksPerThread + 1);
+        bounds_.assign(chunks + 1, n);
+        bounds_[0] = 0;
+        if (costs) {
+            double total = 0;
+            for (size_t k = 0; k < n; ++k) total += double(costs[k]) + 1.0; // +1: loop overhead
+            double running = 0;
+            size_t c = 1;
+            for (size_t k = 0; k < n && c < chunks; ++k) {
+                running += double(costs[k]) + 1.0;
+                while (c < chunks && running >= total * double(c) / double(chunks))
+                    bounds_[c++] = k + 1;
+            }
+        } else {
+            for (size_t c = 1; c < chunks; ++c) bounds_[c] = n * c / chunks;
+        }
+
+        if (num_slots_ < T) {
+            slots_.reset(new Slot[room]);
+            num_slots_ = room;
+        }
+        for (int t = 0; t < T; ++t) {
+            slots_[t].next.store(chunks * size_t(t) / size_t(T), std::memory_order_relaxed);
+            slots_[t].end = chunks * size_t(t + 1) / size_t(T);
+            slots_[t].busy = 0;
+            slots_[t].stolen = 0;
+            slots_[t].ran = false;
+        }
+    }
+};
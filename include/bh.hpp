@@ -1,14 +1,33 @@
 // barnes_hut.hpp
-// Simple Barnes-Hut octree gravity solver (single-file).
+// Barnes-Hut octree gravity solver (single-file).
 // Usage:
 //   Particles P = ...; // fill x,y,z,m and N
 //   BarnesHutSolver bh(P, /*theta=*/0.6, /*eps=*/1e-3);
-//   bh.build();
+//   bh.build(P);
 //   bh.compute_accelerations(P); // writes to P.ax,P.ay,P.az
 //
-// Note: This implementation uses heap allocation for nodes and deletes them
-// at the end of build(). It's simple and clear; replace with a pool allocator
-// for performance if desired.
+// The tree lives in a flat node pool and is built in parallel (OpenMP):
+//   1. Morton keys of all alive particles are computed in parallel and
+//      sorted with a parallel LSD radix sort (per-thread histograms).
+//   2. The top of the octree is split serially until every open node holds
+//      at most a task grain of particles; each such node roots an independent
+//      subtree over a contiguous key range.
+//   3. Every subtree is built (children + multipoles) by its own task into a
+//      private node pool; idle threads pick up pending subtree tasks.
+//   4. The subtree pools are spliced into the flat pool and the few top
+//      nodes get their multipoles from their children.
+// The force walk runs over the key order in chunks of equal predicted cost
+// (interaction counts of the previous walk, see balance.hpp), so clustered
+// regions do not pile up on one thread.
+//
+// In short-range mode (set_short_range, the tree half of TreePM, see
+// pm.hpp) every interaction is weighted by the complement of the mesh's
+// long-range force, nodes farther than the cutoff are skipped, and in a
+// periodic box separations use the nearest image.
+//
+// With fixed-point positions (fixedpoint.hpp) the root box is the
+// particles' frame, Morton keys are the top bits of the integer coordinates
+// and leaf (near-field) interactions use exact integer separations.
 
 #ifndef BARNES_HUT_HPP
 #define BARNES_HUT_HPP
@@ -21,105 +40,264 @@
 #include <algorithm>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include "particles.hpp"
 #include "vec3.hpp"
+#include "parallel.hpp"
+#include "balance.hpp"
 
-// Barnes-Hut solver
-class BarnesHutSolver {
+// Barnes-Hut solver. Real is the particle storage type, Acc the type used to
+// accumulate multipoles and accelerations.
+template <typename Real, typename Acc = Real>
+class BarnesHutSolverT {
 public:
-    BarnesHutSolver(const Particles& P,
-                    float theta = 0.6,
-                    float eps = 1e-3)
-        : theta_(theta), eps2_(eps*eps), root_(nullptr)
+    using Parts = BasicParticles<Real>;
+    using V = Vec3T<Real>;
+    using VA = Vec3T<Acc>;
+
+    BarnesHutSolverT(const Parts& P,
+                     Real theta = Real(0.6),
+                     Real eps = Real(1e-3))
+        : theta_(theta), eps2_(eps*eps)
     {
         build_bbox(P);
     }
 
-    ~BarnesHutSolver() { clear_tree(); }
-
     // Build tree from particle set P (makes a fresh tree).
-    void build(const Particles& P) {
-        clear_tree();
+    void build(const Parts& P) {
         build_bbox(P);
-        root_ = new Node(bbox_center_, bbox_half_);
-        // insert particles
-        for (size_t i = 0; i < P.N; ++i) {
-            if (P.alive.empty() || P.alive[i]) {
-                insert(root_, P, i);
+        compute_keys(P);
+        sort_by_key();
+        gather_sorted(P);
+
+        nodes_.clear();
+        jobs_.clear();
+        top_count_ = 0;
+        if (keys_.empty()) return;
+
+        Node root(bbox_center_, bbox_half_);
+        root.first = 0;
+        root.count = static_cast<uint32_t>(keys_.size());
+        nodes_.push_back(root);
+
+        const size_t grain = std::max<size_t>(
+            kMinTaskGrain, keys_.size() / (kTasksPerThread * par_max_threads()));
+        split_top(0, 0, grain);
+
+        // build independent subtrees in parallel; each task owns its pool
+        // (pools are kept across builds so their capacity is reused)
+        if (pools_.size() < jobs_.size()) pools_.resize(jobs_.size());
+        #pragma omp parallel
+        #pragma omp single
+        {
+            for (size_t s = 0; s < jobs_.size(); ++s) {
+                #pragma omp task firstprivate(s)
+                {
+                    Node& root_s = jobs_[s].root;
+                    pools_[s].clear();
+                    build_subtree(pools_[s], root_s, jobs_[s].level);
+                }
             }
         }
-        // compute multipoles (mass and center-of-mass)
-        // P_ptr_ = &P;
-        // compute_multipoles(root_);
-        // P_ptr_ = nullptr; // clear after multipoles computed
 
-        // after inserting particles
-        compute_multipoles(root_, P);   // call the overload that accepts Particles directly
+        splice(pools_);
+
+        // top nodes were appended parent-before-child: a reverse sweep sees
+        // every child's multipole before its parent's
+        for (size_t k = top_count_; k-- > 0;) {
+            if (nodes_[k].first_child >= 0) sum_children(nodes_, nodes_[k]);
+        }
     }
 
     // Compute accelerations and write into P.ax,ay,az (overwrites).
     // G is gravitational constant (default 1.0 in code units).
-    void compute_accelerations(Particles& P, float G = 1.0) const {
-        if (!root_) return;
-        for (size_t i = 0; i < P.N; ++i) {
-            if (!P.alive.empty() && !P.alive[i]) continue;
-            Vec3 pos{P.x[i], P.y[i], P.z[i]};
-            Vec3 acc = compute_acc_on_particle(root_, P, i, pos, G);
-            P.ax[i] = acc.x;
-            P.ay[i] = acc.y;
-            P.az[i] = acc.z;
+    // If potential is given (size P.N), the same walk also writes each
+    // particle's softened potential into it.
+    void compute_accelerations(Parts& P, Real G = Real(1), Real* potential = nullptr) const {
+        if (nodes_.empty()) return;
+        const bool split = split_ > 0;
+        if (potential) split ? accelerate<true, true>(P, Acc(G), potential)
+                             : accelerate<true, false>(P, Acc(G), potential);
+        else           split ? accelerate<false, true>(P, Acc(G), nullptr)
+                             : accelerate<false, false>(P, Acc(G), nullptr);
+    }
+
+    // Restrict the walk to the short-range TreePM force for split radius
+    // rs: pair force times erfc(r/2rs) + r/(rs sqrt(pi)) exp(-r^2/4rs^2),
+    // potential times erfc(r/2rs), nothing beyond kCutoff * rs. period > 0
+    // applies the nearest image (positions must lie in [0, period)).
+    // rs = 0 restores the full Newtonian walk.
+    void set_short_range(Real rs, Real period = Real(0)) {
+        split_ = rs > 0 ? rs : Real(0);
+        period_ = period > 0 ? period : Real(0);
+        if (split_ == 0) return;
+        cut2_ = Real(kCutoff * kCutoff) * split_ * split_;
+        inv_split_ = Real(1) / split_;
+        if (split_force_.empty()) {
+            // tabulated in u = r / rs, so a new radius needs no new table
+            split_force_.resize(kSplitTable + 2);
+            split_pot_.resize(kSplitTable + 2);
+            for (size_t t = 0; t < kSplitTable + 2; ++t) {
+                const double u = kCutoff * double(t) / double(kSplitTable);
+                split_force_[t] = Acc(std::erfc(0.5 * u) + u / std::sqrt(M_PI) * std::exp(-0.25 * u * u));
+                split_pot_[t] = Acc(std::erfc(0.5 * u));
+            }
+        }
+    }
+
+    // Locally essential tree export: call emit(x, y, z, m) for point masses
+    // that stand in for this tree at every point of the box [lo, hi].
+    // A node that every point of the box would accept (opening criterion
+    // at the nearest point of the box) is emitted as its monopole; leaves
+    // that some point would open are emitted particle by particle.
+    template <class Emit>
+    void export_essential(const Real lo[3], const Real hi[3], Emit&& emit) const {
+        if (nodes_.empty()) return;
+        std::vector<int32_t> stack(1, 0);
+        while (!stack.empty()) {
+            const Node& node = nodes_[stack.back()];
+            stack.pop_back();
+            if (node.mass == 0) continue;
+
+            const Real c[3] = {node.com.x, node.com.y, node.com.z};
+            Real d2 = eps2_;
+            for (int a = 0; a < 3; ++a) {
+                const Real e = std::max(std::max(lo[a] - c[a], c[a] - hi[a]), Real(0));
+                d2 += e * e;
+            }
+            if (node.half * Real(2) / std::sqrt(d2) < theta_) {
+                emit(c[0], c[1], c[2], node.mass);
+            } else if (node.first_child < 0) {
+                for (uint32_t j = node.first; j < node.first + node.count; ++j)
+                    emit(sx_[j], sy_[j], sz_[j], sm_[j]);
+            } else {
+                for (int ch = 0; ch < node.num_children; ++ch)
+                    stack.push_back(node.first_child + ch);
+            }
         }
     }
 
     // Accessors
-    float theta() const { return theta_; }
-    float softening2() const { return eps2_; }
+    Real theta() const { return theta_; }
+    Real softening2() const { return eps2_; }
+    size_t num_nodes() const { return nodes_.size(); }
+    // max / mean thread busy time of the last force walk
+    double load_imbalance() const { return loop_.imbalance(); }
+    // Depth-first walk over the nodes, children in octant order, so the
+    // sequence does not depend on how the build was split into tasks:
+    // visit(center, half, mass, com, first, count, num_children).
+    template <class Visit>
+    void for_each_node(Visit&& visit) const {
+        if (nodes_.empty()) return;
+        std::vector<int32_t> stack(1, 0);
+        while (!stack.empty()) {
+            const Node& node = nodes_[stack.back()];
+            stack.pop_back();
+            visit(node.center, node.half, node.mass, node.com, node.first, node.count,
+                  int(node.num_children));
+            for (int ch = node.num_children; ch-- > 0;) stack.push_back(node.first_child + ch);
+        }
+    }
+
+    // monopoles and particles used by the last force walk, per particle
+    // (original index) and summed
+    const std::vector<uint32_t>& interaction_counts() const { return interactions_; }
+    uint64_t interactions() const {
+        uint64_t total = 0;
+        for (uint32_t c : interactions_) total += c;
+        return total;
+    }
 
 private:
     struct Node {
-        Vec3 center;     // geometric center of this node's cube
-        float half;     // half side length of the cube
-        float mass;     // total mass in node
-        Vec3 com;        // center of mass
-        int particle_idx; // if leaf and contains single particle, index>=0, else -1
-        std::array<Node*,8> children;
-        Node(const Vec3& c, float h)
-            : center(c), half(h), mass(0.0), com(0.0,0.0,0.0), particle_idx(-1)
-        {
-            children.fill(nullptr);
-        }
+        V center;             // geometric center of this node's cube
+        Real half;            // half side length of the cube
+        Real mass;            // total mass in node
+        V com;                // center of mass
+        uint32_t first;       // first particle (sorted order) in this node
+        uint32_t count;       // number of particles in this node
+        int32_t first_child;  // index of first child in the pool, -1 for leaf
+        uint8_t num_children; // children are stored contiguously
+        Node() : half(0), mass(0), first(0), count(0),
+                 first_child(-1), num_children(0) {}
+        Node(const V& c, Real h)
+            : center(c), half(h), mass(0), com(0,0,0),
+              first(0), count(0), first_child(-1), num_children(0) {}
+    };
+
+    // a subtree handed to a worker task
+    struct SubtreeJob {
+        size_t node;   // index of the subtree root in the top pool
+        int level;     // octree level of the root
+        Node root;     // working copy, written back on splice
     };
 
-    float theta_;
-    float eps2_; // softening squared
-    Node* root_;
+    static constexpr int kMaxLevel = 21;          // Morton bits per axis
+    static constexpr int kWalkStack = 7 * kMaxLevel + 8; // max pending nodes in a walk
+    static constexpr uint32_t kLeafSize = 8;      // particles per leaf
+    static constexpr size_t kMinTaskGrain = 2048; // smallest subtree task
+    static constexpr size_t kTasksPerThread = 8;  // over-decomposition
+    static constexpr int kRadixBits = 11;
+    static constexpr int kRadixPasses = 6;        // 6 * 11 >= 3 * 21
+    static constexpr size_t kRadix = size_t(1) << kRadixBits;
+    static constexpr double kCutoff = 5.0;        // short-range cutoff in split radii
+    static constexpr size_t kSplitTable = 1024;   // short-range factor table size
+
+    Real theta_;
+    Real eps2_; // softening squared
 
     // bounding box
-    Vec3 bbox_center_;
-    float bbox_half_;
+    V bbox_center_;
+    Real bbox_half_;
 
-    // helpers
-    void clear_tree() {
-        if (root_) delete_subtree(root_);
-        root_ = nullptr;
-    }
+    // particles in Morton order
+    std::vector<uint64_t> keys_, tmp_keys_;
+    std::vector<uint32_t> order_, tmp_order_;
+    std::vector<Real> sx_, sy_, sz_, sm_;
+    std::vector<uint32_t> sqx_, sqy_, sqz_; // fixed-point positions, key order
+    bool fixed_ = false;
+    Real cell_ = Real(0);
+    std::vector<size_t> hist_;
 
-    void delete_subtree(Node* n) {
-        if (!n) return;
-        for (int i=0;i<8;++i) if (n->children[i]) delete_subtree(n->children[i]);
-        delete n;
-    }
+    // flat node pool; the first top_count_ entries form the serial top
+    std::vector<Node> nodes_;
+    std::vector<SubtreeJob> jobs_;
+    std::vector<std::vector<Node>> pools_; // per-job subtree pools
+    size_t top_count_ = 0;
+
+    // force-walk load balancing: interactions per particle (original
+    // index) from the last walk, their key-order copy and the scheduler
+    mutable std::vector<uint32_t> interactions_;
+    mutable std::vector<uint32_t> cost_;
+    mutable BalancedLoop loop_;
 
-    void build_bbox(const Particles& P) {
+    // short-range (TreePM) mode, see set_short_range
+    Real split_ = Real(0), inv_split_ = Real(0), cut2_ = Real(0), period_ = Real(0);
+    std::vector<Acc> split_force_, split_pot_; // factors at u = r / rs
+
+    void build_bbox(const Parts& P) {
+        fixed_ = P.fixed_positions();
+        if (fixed_) {
+            const Real half = Real(0.5 * P.frame.box());
+            bbox_center_ = V(Real(P.frame.origin[0]) + half,
+                             Real(P.frame.origin[1]) + half,
+                             Real(P.frame.origin[2]) + half);
+            bbox_half_ = half;
+            cell_ = Real(P.frame.cell);
+            return;
+        }
         // find an axis-aligned cubic bounding box that contains particles (with padding)
-        float xmin = std::numeric_limits<float>::infinity();
-        float ymin = xmin; float zmin = xmin;
-        float xmax = -xmin, ymax = -xmin, zmax = -xmin;
-        bool any = false;
-        for (size_t i = 0; i < P.N; ++i) {
+        Real xmin = std::numeric_limits<Real>::infinity();
+        Real ymin = xmin, zmin = xmin;
+        Real xmax = -xmin, ymax = -xmin, zmax = -xmin;
+        long any = 0;
+        const long n = static_cast<long>(P.N);
+        #pragma omp parallel for reduction(min:xmin,ymin,zmin) \
+                                 reduction(max:xmax,ymax,zmax) reduction(+:any)
+        for (long i = 0; i < n; ++i) {
             if (!P.alive.empty() && !P.alive[i]) continue;
-            any = true;
+            any++;
             xmin = std::min(xmin, P.x[i]);
             ymin = std::min(ymin, P.y[i]);
             zmin = std::min(zmin, P.z[i]);
@@ -128,192 +306,421 @@ private:
             zmax = std::max(zmax, P.z[i]);
         }
         if (!any) {
-            bbox_center_ = Vec3(0.0,0.0,0.0);
-            bbox_half_ = 1.0;
+            bbox_center_ = V(0,0,0);
+            bbox_half_ = Real(1);
             return;
         }
-        float cx = 0.5*(xmin+xmax);
-        float cy = 0.5*(ymin+ymax);
-        float cz = 0.5*(zmin+zmax);
-        float dx = xmax - xmin;
-        float dy = ymax - ymin;
-        float dz = zmax - zmin;
-        float half = 0.5 * std::max({dx,dy,dz});
-        if (half <= 0) half = 1e-6; // degenerate case
+        Real cx = Real(0.5)*(xmin+xmax);
+        Real cy = Real(0.5)*(ymin+ymax);
+        Real cz = Real(0.5)*(zmin+zmax);
+        Real dx = xmax - xmin;
+        Real dy = ymax - ymin;
+        Real dz = zmax - zmin;
+        Real half = Real(0.5) * std::max({dx,dy,dz});
+        if (half <= 0) half = Real(1e-6); // degenerate case
         // pad box slightly
-        half *= 1.0001;
-        bbox_center_ = Vec3(cx,cy,cz);
+        half *= Real(1.0001);
+        bbox_center_ = V(cx,cy,cz);
         bbox_half_ = half;
     }
 
-    // Octant index for position p relative to node
-    inline int octant(const Node* n, const Vec3& p) const {
-        int idx = 0;
-        if (p.x >= n->center.x) idx |= 1;
-        if (p.y >= n->center.y) idx |= 2;
-        if (p.z >= n->center.z) idx |= 4;
-        return idx;
+    // spread the low 21 bits of v so that there are two zero bits between each
+    static inline uint64_t spread_bits(uint64_t v) {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffULL;
+        v = (v | v << 16) & 0x1f0000ff0000ffULL;
+        v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+        v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+        v = (v | v << 2)  & 0x1249249249249249ULL;
+        return v;
     }
 
-    // Insert particle i into subtree rooted at n
-    void insert(Node* n, const Particles& P, size_t i) {
-        Vec3 pos{P.x[i], P.y[i], P.z[i]};
-        // if node is empty leaf
-        if (n->particle_idx == -1 && all_children_null(n)) {
-            // if node has no particle and no children -> store particle
-            n->particle_idx = static_cast<int>(i);
-            return;
+    // Morton key of every alive particle; bit 0 -> x, bit 1 -> y, bit 2 -> z
+    // at each level, matching the octant numbering used for child centers.
+    void compute_keys(const Parts& P) {
+        order_.clear();
+        for (size_t i = 0; i < P.N; ++i) {
+            if (P.alive.empty() || P.alive[i]) order_.push_back(static_cast<uint32_t>(i));
         }
+        const long n = static_cast<long>(order_.size());
+        keys_.resize(n);
+
+        const double cells = double(uint64_t(1) << kMaxLevel);
+        const double scale = cells / (2.0 * bbox_half_);
+        const double x0 = bbox_center_.x - bbox_half_;
+        const double y0 = bbox_center_.y - bbox_half_;
+        const double z0 = bbox_center_.z - bbox_half_;
+        const double cmax = cells - 1.0;
 
-        // If node is a leaf but already contains a particle, subdivide
-        if (n->particle_idx >= 0 && all_children_null(n)) {
-            int old_idx = n->particle_idx;
-            n->particle_idx = -1;
-            // create children and re-insert old particle
-            subdivide(n);
-            int oct_old = octant(n, Vec3{P.x[old_idx], P.y[old_idx], P.z[old_idx]});
-            insert(n->children[oct_old], P, old_idx);
+        if (fixed_) {
+            // the top 21 bits of a fixed-point coordinate are its key digit
+            const int drop = 32 - kMaxLevel;
+            #pragma omp parallel for schedule(static)
+            for (long k = 0; k < n; ++k) {
+                const uint32_t i = order_[k];
+                keys_[k] = spread_bits(P.qx[i] >> drop)
+                         | (spread_bits(P.qy[i] >> drop) << 1)
+                         | (spread_bits(P.qz[i] >> drop) << 2);
+            }
+            return;
         }
 
-        // now insert new particle into appropriate child, creating child if necessary
-        int oct = octant(n, pos);
-        if (!n->children[oct]) {
-            // make child centered appropriately
-            Vec3 c = child_center(n->center, n->half, oct);
-            n->children[oct] = new Node(c, n->half * 0.5);
+        #pragma omp parallel for schedule(static)
+        for (long k = 0; k < n; ++k) {
+            const uint32_t i = order_[k];
+            uint64_t ix = uint64_t(std::clamp((P.x[i] - x0) * scale, 0.0, cmax));
+            uint64_t iy = uint64_t(std::clamp((P.y[i] - y0) * scale, 0.0, cmax));
+            uint64_t iz = uint64_t(std::clamp((P.z[i] - z0) * scale, 0.0, cmax));
+            keys_[k] = spread_bits(ix) | (spread_bits(iy) << 1) | (spread_bits(iz) << 2);
         }
-        insert(n->children[oct], P, i);
     }
 
-    inline bool all_children_null(const Node* n) const {
-        for (int i=0;i<8;++i) if (n->children[i]) return false;
-        return true;
-    }
+    // parallel LSD radix sort of (keys_, order_)
+    void sort_by_key() {
+        const size_t n = keys_.size();
+        tmp_keys_.resize(n);
+        tmp_order_.resize(n);
+        const size_t room = size_t(std::max(par_max_threads(), par_num_procs()));
+        if (hist_.capacity() < room * kRadix) hist_.reserve(room * kRadix);
+        hist_.assign(size_t(par_max_threads()) * kRadix, 0);
+
+        for (int pass = 0; pass < kRadixPasses; ++pass) {
+            const int shift = pass * kRadixBits;
+            #pragma omp parallel
+            {
+                const size_t t = par_thread_id();
+                const size_t T = par_num_threads();
+                const size_t lo = n * t / T;
+                const size_t hi = n * (t + 1) / T;
+                size_t* h = &hist_[t * kRadix];
+                std::fill(h, h + kRadix, 0);
+                for (size_t i = lo; i < hi; ++i) h[(keys_[i] >> shift) & (kRadix - 1)]++;
 
-    inline void subdivide(Node* n) {
-        // allocate 8 children (lazy allocation also OK; here we create only as needed)
-        for (int oct=0; oct<8; ++oct) {
-            if (!n->children[oct]) {
-                Vec3 c = child_center(n->center, n->half, oct);
-                n->children[oct] = new Node(c, n->half*0.5);
+                #pragma omp barrier
+                #pragma omp single
+                {
+                    // digit-major, thread-minor offsets keep the sort stable
+                    size_t sum = 0;
+                    for (size_t d = 0; d < kRadix; ++d) {
+                        for (size_t u = 0; u < T; ++u) {
+                            size_t c = hist_[u * kRadix + d];
+                            hist_[u * kRadix + d] = sum;
+                            sum += c;
+                        }
+                    }
+                }
+
+                for (size_t i = lo; i < hi; ++i) {
+                    size_t dst = h[(keys_[i] >> shift) & (kRadix - 1)]++;
+                    tmp_keys_[dst] = keys_[i];
+                    tmp_order_[dst] = order_[i];
+                }
             }
+            keys_.swap(tmp_keys_);
+            order_.swap(tmp_order_);
+        }
+    }
+
+    // copy positions and masses into key order for cache-friendly walks
+    void gather_sorted(const Parts& P) {
+        const long n = static_cast<long>(order_.size());
+        sx_.resize(n); sy_.resize(n); sz_.resize(n); sm_.resize(n);
+        #pragma omp parallel for schedule(static)
+        for (long k = 0; k < n; ++k) {
+            const uint32_t i = order_[k];
+            sx_[k] = P.x[i];
+            sy_[k] = P.y[i];
+            sz_[k] = P.z[i];
+            sm_[k] = P.mass[i];
+        }
+        if (!fixed_) return;
+        sqx_.resize(n); sqy_.resize(n); sqz_.resize(n);
+        #pragma omp parallel for schedule(static)
+        for (long k = 0; k < n; ++k) {
+            const uint32_t i = order_[k];
+            sqx_[k] = P.qx[i];
+            sqy_[k] = P.qy[i];
+            sqz_[k] = P.qz[i];
         }
     }
 
-    inline Vec3 child_center(const Vec3& c, float half, int oct) const {
-        float q = half * 0.5;
+    inline V child_center(const V& c, Real half, int oct) const {
+        Real q = half * Real(0.5);
         // bit 0 -> +x, bit1 -> +y, bit2 -> +z
-        return Vec3(
+        return V(
             c.x + ((oct & 1) ? q : -q),
             c.y + ((oct & 2) ? q : -q),
             c.z + ((oct & 4) ? q : -q)
         );
     }
-    // Overloaded compute_multipoles that accepts Particles
-    void compute_multipoles(Node* n, const Particles& P) {
-        if (!n) return;
-        // if leaf with single particle
-        if (n->particle_idx >= 0) {
-            int idx = n->particle_idx;
-            n->mass = P.mass[idx];
-            n->com = Vec3{P.x[idx], P.y[idx], P.z[idx]};
+
+    inline int octant_of(uint64_t key, int level) const {
+        return static_cast<int>((key >> (3 * (kMaxLevel - 1 - level))) & 7);
+    }
+
+    // Append the non-empty children of n (at `level`) to pool. Keys in n's
+    // range are sorted, so each child is a contiguous sub-range.
+    void make_children(std::vector<Node>& pool, Node& n, int level) const {
+        const uint64_t* begin = keys_.data() + n.first;
+        const uint64_t* end = begin + n.count;
+        n.first_child = static_cast<int32_t>(pool.size());
+        n.num_children = 0;
+        const uint64_t* lo = begin;
+        for (int oct = 0; oct < 8 && lo != end; ++oct) {
+            const uint64_t* hi = std::partition_point(lo, end,
+                [&](uint64_t k) { return octant_of(k, level) <= oct; });
+            if (hi == lo) continue;
+            Node c(child_center(n.center, n.half, oct), n.half * Real(0.5));
+            c.first = n.first + static_cast<uint32_t>(lo - begin);
+            c.count = static_cast<uint32_t>(hi - lo);
+            pool.push_back(c);
+            n.num_children++;
+            lo = hi;
+        }
+    }
+
+    inline bool is_leaf(const Node& n, int level) const {
+        return n.count <= kLeafSize || level >= kMaxLevel;
+    }
+
+    // Serially open the top of the tree. Nodes small enough become jobs.
+    void split_top(size_t idx, int level, size_t grain) {
+        if (is_leaf(nodes_[idx], level)) {
+            leaf_multipole(nodes_[idx]);
             return;
         }
-        // otherwise sum children
-        float mass_sum = 0.0;
-        Vec3 com_sum{0.0,0.0,0.0};
-        for (int c=0;c<8;++c) {
-            if (!n->children[c]) continue;
-            compute_multipoles(n->children[c], P);
-            mass_sum += n->children[c]->mass;
-            com_sum.x += n->children[c]->mass * n->children[c]->com.x;
-            com_sum.y += n->children[c]->mass * n->children[c]->com.y;
-            com_sum.z += n->children[c]->mass * n->children[c]->com.z;
+        if (nodes_[idx].count <= grain) {
+            jobs_.push_back(SubtreeJob{idx, level, nodes_[idx]});
+            return;
         }
-        n->mass = mass_sum;
-        if (mass_sum > 0.0) {
-            n->com = Vec3{ com_sum.x / mass_sum, com_sum.y / mass_sum, com_sum.z / mass_sum };
-        } else {
-            n->com = n->center; // fallback
+        Node n = nodes_[idx];
+        make_children(nodes_, n, level);
+        nodes_[idx] = n;
+        for (int c = 0; c < n.num_children; ++c)
+            split_top(n.first_child + c, level + 1, grain);
+        if (idx == 0) top_count_ = nodes_.size();
+    }
+
+    // Build everything below `root` into pool (pool-local child indices).
+    void build_subtree(std::vector<Node>& pool, Node& root, int level) const {
+        pool.reserve(2 * root.count / kLeafSize + 8);
+        make_children(pool, root, level);
+        build_children(pool, root, level);
+        sum_children(pool, root);
+    }
+
+    void build_children(std::vector<Node>& pool, const Node& parent, int level) const {
+        const int32_t first = parent.first_child;
+        const int nc = parent.num_children;
+        for (int c = 0; c < nc; ++c) {
+            Node n = pool[first + c];
+            if (is_leaf(n, level + 1)) {
+                leaf_multipole(n);
+            } else {
+                make_children(pool, n, level + 1);
+                build_children(pool, n, level + 1);
+                sum_children(pool, n);
+            }
+            pool[first + c] = n;
+        }
+    }
+
+    void leaf_multipole(Node& n) const {
+        Acc mass_sum = 0;
+        VA com_sum{0,0,0};
+        for (uint32_t k = n.first; k < n.first + n.count; ++k) {
+            mass_sum += sm_[k];
+            com_sum.x += sm_[k] * sx_[k];
+            com_sum.y += sm_[k] * sy_[k];
+            com_sum.z += sm_[k] * sz_[k];
         }
+        set_multipole(n, mass_sum, com_sum);
     }
 
-    // top-level compute multipoles wrapper (public build uses this)
-    void compute_multipoles(Node* root) {
-        // we need access to Particles used to fill tree; easiest is to store a pointer to P
-        // in the class during build(). To keep the implementation self-contained, we'll instead
-        // require the build() call to store P_ptr_ temporarily. To keep this file small and clear,
-        // we'll use a private member P_ptr_.
-        // (See full implementation below where P_ptr_ is set during build.)
-        if (!P_ptr_) return;
-        compute_multipoles(root, *P_ptr_);
+    void sum_children(const std::vector<Node>& pool, Node& n) const {
+        Acc mass_sum = 0;
+        VA com_sum{0,0,0};
+        for (int c = 0; c < n.num_children; ++c) {
+            const Node& ch = pool[n.first_child + c];
+            mass_sum += ch.mass;
+            com_sum.x += ch.mass * ch.com.x;
+            com_sum.y += ch.mass * ch.com.y;
+            com_sum.z += ch.mass * ch.com.z;
+        }
+        set_multipole(n, mass_sum, com_sum);
     }
 
-    // compute acceleration on particle i by traversing the tree
-    Vec3 compute_acc_on_particle(const Node* n, const Particles& P, size_t i, const Vec3& pos, float G) const {
-        Vec3 acc{0.0,0.0,0.0};
-        if (!n) return acc;
-        // stack for iterative traversal (avoid recursion depth issues)
-        struct StackItem { const Node* node; };
-        std::vector<const Node*> stack;
-        stack.reserve(64);
-        stack.push_back(n);
+    static void set_multipole(Node& n, Acc mass_sum, const VA& com_sum) {
+        n.mass = Real(mass_sum);
+        if (mass_sum > 0) {
+            n.com = V(com_sum / mass_sum);
+        } else {
+            n.com = n.center; // fallback
+        }
+    }
 
-        while (!stack.empty()) {
-            const Node* node = stack.back();
-            stack.pop_back();
-            if (node->mass == 0.0) continue;
-
-            // If node is a leaf with one particle, and it is the same particle, skip
-            if (node->particle_idx >= 0) {
-                size_t j = static_cast<size_t>(node->particle_idx);
-                if (j == i) continue; // skip self
-                Vec3 r{ P.x[j] - pos.x, P.y[j] - pos.y, P.z[j] - pos.z };
-                float r2 = r.x*r.x + r.y*r.y + r.z*r.z + eps2_;
-                float inv_r3 = 1.0 / (std::sqrt(r2) * r2);
-                float s = G * P.mass[j] * inv_r3;
-                acc.x += s * r.x;
-                acc.y += s * r.y;
-                acc.z += s * r.z;
-                continue;
+    // Append subtree pools behind the top nodes and rebase child indices.
+    void splice(const std::vector<std::vector<Node>>& pools) {
+        if (top_count_ == 0) top_count_ = nodes_.size();
+        size_t total = nodes_.size();
+        for (size_t s = 0; s < jobs_.size(); ++s) total += pools[s].size();
+        // headroom so small changes in node count do not reallocate
+        if (total > nodes_.capacity()) nodes_.reserve(total + total / 8);
+        for (size_t s = 0; s < jobs_.size(); ++s) {
+            const int32_t offset = static_cast<int32_t>(nodes_.size());
+            for (Node n : pools[s]) {
+                if (n.first_child >= 0) n.first_child += offset;
+                nodes_.push_back(n);
             }
+            Node root = jobs_[s].root;
+            if (root.first_child >= 0) root.first_child += offset;
+            nodes_[jobs_[s].node] = root;
+        }
+    }
+
+    template <bool kPotential, bool kSplit>
+    void accelerate(Parts& P, Acc G, Real* potential) const {
+        const size_t n = order_.size();
+        // cost of each walk predicted from the interaction count of the
+        // same particle last time (uniform until one has been measured)
+        const uint32_t* costs = nullptr;
+        if (interactions_.size() == P.N) {
+            cost_.resize(n);
+            for (size_t k = 0; k < n; ++k) cost_[k] = interactions_[order_[k]];
+            costs = cost_.data();
+        } else {
+            interactions_.assign(P.N, 0);
+        }
+        // walk in key order so neighbouring iterations touch the same nodes
+        loop_.run(n, costs, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                V pos{sx_[k], sy_[k], sz_[k]};
+                Acc phi = 0;
+                uint32_t count = 0;
+                VA acc = compute_acc_on_particle<kPotential, kSplit>(static_cast<uint32_t>(k), pos,
+                                                                     G, phi, count);
+                const uint32_t i = order_[k];
+                P.ax[i] = Real(acc.x);
+                P.ay[i] = Real(acc.y);
+                P.az[i] = Real(acc.z);
+                if (kPotential) potential[i] = Real(phi);
+                interactions_[i] = count;
+            }
+        });
+    }
+
+    // compute acceleration (and optionally potential) on sorted particle k
+    // by traversing the tree; count is incremented per monopole/particle used
+    template <bool kPotential, bool kSplit>
+    VA compute_acc_on_particle(uint32_t k, const V& pos, Acc G, Acc& phi,
+                               uint32_t& count) const {
+        VA acc{0,0,0};
+        // stack for iterative traversal (avoid recursion depth issues); each
+        // level pops one node and pushes at most 8, so depth bounds its size
+        int32_t stack[kWalkStack];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0) {
+            const Node& node = nodes_[stack[--top]];
+            if (node.mass == 0) continue;
 
             // distance from particle to node COM
-            Vec3 d{ node->com.x - pos.x, node->com.y - pos.y, node->com.z - pos.z };
-            float dist2 = d.x*d.x + d.y*d.y + d.z*d.z + eps2_;
-            float dist = std::sqrt(dist2);
+            V d{ node.com.x - pos.x, node.com.y - pos.y, node.com.z - pos.z };
+            if (kSplit) {
+                if (beyond_cutoff(node, pos)) continue;
+                nearest_image(d);
+            }
+            Real dist2 = d.x*d.x + d.y*d.y + d.z*d.z + eps2_;
+            Real dist = std::sqrt(dist2);
 
-            // size = node->half * 2 (side length)
-            float size = node->half * 2.0;
+            // size = node.half * 2 (side length)
+            Real size = node.half * Real(2);
+            const bool contains_self = k >= node.first && k < node.first + node.count;
 
             // opening criterion: size / dist < theta  (or dist > size/theta)
-            if (size / dist < theta_) {
+            if (!contains_self && size / dist < theta_) {
                 // approximate by multipole (monopole only)
-                float inv_r3 = 1.0 / (dist2 * dist);
-                float s = G * node->mass * inv_r3;
+                Acc inv_r3 = Acc(1) / (Acc(dist2) * dist);
+                Acc s = G * node.mass * inv_r3;
+                Acc wp = Acc(1);
+                if (kSplit) s *= split_weights(dist, wp);
                 acc.x += s * d.x;
                 acc.y += s * d.y;
                 acc.z += s * d.z;
+                if (kPotential) phi -= wp * G * node.mass / Acc(dist);
+                count++;
+            } else if (node.first_child < 0) {
+                count += node.count;
+                // leaf: direct sum over its particles, skipping self
+                for (uint32_t j = node.first; j < node.first + node.count; ++j) {
+                    if (j == k) continue;
+                    V r = fixed_ ? fixed_delta(k, j)
+                                 : V{ sx_[j] - pos.x, sy_[j] - pos.y, sz_[j] - pos.z };
+                    if (kSplit) nearest_image(r);
+                    Real r2 = r.x*r.x + r.y*r.y + r.z*r.z + eps2_;
+                    if (kSplit && r2 >= cut2_) continue;
+                    Acc inv_r = Acc(1) / std::sqrt(Acc(r2));
+                    Acc s = G * sm_[j] * inv_r * inv_r * inv_r;
+                    Acc wp = Acc(1);
+                    if (kSplit) s *= split_weights(Real(std::sqrt(r2)), wp);
+                    acc.x += s * r.x;
+                    acc.y += s * r.y;
+                    acc.z += s * r.z;
+                    if (kPotential) phi -= wp * G * sm_[j] * inv_r;
+                }
             } else {
                 // open node: traverse children
-                for (int c = 0; c < 8; ++c) {
-                    if (node->children[c]) stack.push_back(node->children[c]);
-                }
+                for (int c = 0; c < node.num_children; ++c)
+                    stack[top++] = node.first_child + c;
             }
         }
         return acc;
     }
 
-    // we store pointer to particles used to build the tree (needed when computing multipoles)
-    const Particles* P_ptr_ = nullptr;
+    inline void nearest_image(V& d) const {
+        if (period_ == 0) return;
+        d.x -= period_ * std::nearbyint(d.x / period_);
+        d.y -= period_ * std::nearbyint(d.y / period_);
+        d.z -= period_ * std::nearbyint(d.z / period_);
+    }
+
+    // true if no point of the node's cube lies within the cutoff of pos
+    inline bool beyond_cutoff(const Node& node, const V& pos) const {
+        V c{ node.center.x - pos.x, node.center.y - pos.y, node.center.z - pos.z };
+        nearest_image(c);
+        const Real ex = std::max(std::abs(c.x) - node.half, Real(0));
+        const Real ey = std::max(std::abs(c.y) - node.half, Real(0));
+        const Real ez = std::max(std::abs(c.z) - node.half, Real(0));
+        return ex*ex + ey*ey + ez*ez >= cut2_;
+    }
+
+    // short-range force factor at separation r (linear in the table); the
+    // potential factor goes to wp
+    inline Acc split_weights(Real r, Acc& wp) const {
+        const Real t = r * inv_split_ * Real(double(kSplitTable) / kCutoff);
+        if (t >= Real(kSplitTable)) { wp = Acc(0); return Acc(0); }
+        const size_t i = static_cast<size_t>(t);
+        const Acc f = Acc(t - Real(i));
+        wp = split_pot_[i] + f * (split_pot_[i + 1] - split_pot_[i]);
+        return split_force_[i] + f * (split_force_[i + 1] - split_force_[i]);
+    }
+
+    inline V fixed_delta(uint32_t k, uint32_t j) const {
+        return V{ Real(int64_t(sqx_[j]) - int64_t(sqx_[k])) * cell_,
+                  Real(int64_t(sqy_[j]) - int64_t(sqy_[k])) * cell_,
+                  Real(int64_t(sqz_[j]) - int64_t(sqz_[k])) * cell_ };
+    }
 
 public:
-    // Modified build that saves pointer to P for multipole computation
-    void build_with_particles(const Particles& P) {
-        P_ptr_ = &P;
+    // Kept for callers written against the pointer-based tree; the flat
+    // pool needs no extra state, so this is just build().
+    void build_with_particles(const Parts& P) {
         build(P);
-        P_ptr_ = nullptr; // clear after multipoles computed
     }
 };
 
+// solver at the build's precision (see precision.hpp)
+using BarnesHutSolver = BarnesHutSolverT<real_t, acc_t>;
+
 #endif // BARNES_HUT_HPP
@@ -0,0 +1,126 @@
+// codec.hpp
+// Compressed frame output (output_format = compressed).
+//
+// A frame holds the same rows as the CSV frames: alive gas particles in
+// index order, then stars. Each row has a key (2 * id + is_star) and nine
+// value columns (x y z vx vy vz temperature density pressure). Per column:
+//   1. quantize: q = round(v / step), step = 2 * output_tolerance, so every
+//      value is within the tolerance. A column is never quantized finer
+//      than the storage precision of its largest value (real_t epsilon),
+//      since the digits below that are rounding noise;
+//   2. predict q and keep the residual. Keyframes predict 0. Delta frames
+//      predict from the same key in the previous frames: positions move
+//      with the previous velocity and acceleration, the other columns
+//      continue their last rate of change. Keys are delta-coded against
+//      the row before;
+//   3. zigzag the residuals and shuffle their bytes into planes (all low
+//      bytes, then all second bytes, ...), so the mostly-zero high bytes
+//      sit together;
+//   4. entropy-code each plane with a static order-0 rANS coder, or store
+//      it raw or as a single repeated byte, whichever is smallest.
+// Every keyframe_interval-th frame is a keyframe; decoding any frame needs
+// the frames since the last keyframe, read in order.
+//
+// File layout: a FrameHeader, then per column (keys first) a width byte
+// and one coded plane per byte of width. A plane is a mode byte, then
+// nothing (zero), the byte (constant), n raw bytes, or a frequency table
+// and the rANS stream.
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "particles.hpp"
+#include "stars.hpp"
+
+struct FrameHeader {
+    char magic[8];       // "SFFRAME"
+    uint32_t version;
+    uint32_t keyframe;   // 1 if decodable on its own
+    uint64_t sequence;   // frame number within the run
+    uint64_t rows;
+    double time;
+    double step[9];      // quantization step of each value column
+};
+
+// Order-0 rANS over bytes (12-bit probabilities, 32-bit state). The
+// frequency table is stored in front of the stream.
+void rans_encode(const uint8_t* in, size_t n, std::vector<uint8_t>& out);
+// Decode n bytes starting at *p, advancing *p; false on malformed input.
+bool rans_decode(const uint8_t*& p, const uint8_t* end, uint8_t* out, size_t n);
+
+// A decoded frame: the CSV rows.
+struct FrameTable {
+    static constexpr int kColumns = 9; // x y z vx vy vz temperature density pressure
+
+    double time = 0.0;
+    std::vector<uint64_t> id;
+    std::vector<uint8_t> is_star;
+    std::vector<double> col[kColumns];
+
+    size_t rows() const { return id.size(); }
+    // same columns and order as Particles::write_csv + SinkParticles::append_csv
+    bool write_csv(const std::string& filename) const;
+};
+
+// Previous-frame state for the delta prediction. Encoder and decoder run
+// it on the same dequantized values, so their predictions agree exactly.
+class FramePredictor {
+public:
+    // pair the new frame's rows with the previous frame's (none for a
+    // keyframe, which also drops the history)
+    void match(const std::vector<uint64_t>& keys, bool keyframe);
+    // predicted value of column c of row r at the new frame's time
+    double predict(size_t r, int c, double time) const;
+    // the new frame becomes the previous one (keys and values are consumed)
+    void advance(std::vector<uint64_t>& keys, std::vector<double>* values, double time);
+
+private:
+    double time_ = 0.0;
+    std::vector<uint64_t> keys_;
+    std::vector<double> value_[FrameTable::kColumns]; // previous frame
+    std::vector<double> rate_[FrameTable::kColumns];  // d/dt over the last interval
+    std::vector<int64_t> prev_row_;                   // new row -> previous row or -1
+    std::vector<std::pair<uint64_t, int64_t>> index_; // sorted (key, previous row)
+};
+
+// Encodes the frames of one run in order.
+class FrameEncoder {
+public:
+    FrameEncoder(double tolerance, int keyframe_interval);
+
+    bool write(const std::string& filename, const Particles& P, const SinkParticles& S,
+               double time);
+
+    // total bytes written and rows encoded so far
+    size_t bytes() const { return bytes_; }
+    size_t rows() const { return rows_; }
+
+private:
+    double tolerance_;
+    int keyframe_interval_;
+    uint64_t sequence_ = 0;
+    size_t bytes_ = 0, rows_ = 0;
+
+    FramePredictor predictor_;
+    std::vector<uint64_t> keys_, zz_;
+    std::vector<double> value_[FrameTable::kColumns];
+    std::vector<uint8_t> out_, plane_, tmp_;
+};
+
+// Decodes the frames of one run in order (starting at a keyframe).
+class FrameDecoder {
+public:
+    bool read(const std::string& filename, FrameTable& frame);
+
+private:
+    bool have_prev_ = false;
+    uint64_t prev_sequence_ = 0;
+    FramePredictor predictor_;
+    std::vector<uint64_t> keys_, zz_;
+    std::vector<uint8_t> data_, plane_;
+};
+
+// Decode every frame_<t>.sfz in dir (in step order) to frame_<t>.csv.
+bool decompress_frames(const std::string& dir);
@@ -2,14 +2,100 @@
 #include <string>
 #include <unordered_map>
 
+// Run configuration. Every field can be set from a config file
+// (`key = value` lines, `#` comments) and overridden on the command line
+// with `--key=value`; see configs/default.cfg for the full list.
 struct Config {
-    double timestep;
-    int num_steps;
-    int grid_points;
-    double initial_density;
-    double initial_temperature;
-    double G;
-    int output_interval;
+    // grid solver (Simulation class)
+    double timestep = 0.001;
+    int num_steps = 100;
+    int grid_points = 100;
+    double initial_density = 1.0;
+    double initial_temperature = 1.0;
+    double G = 1.0;
+    int output_interval = 1;        // steps between snapshots, 0 = none
+
+    // particles
+    size_t num_particles = 1000;
+    int init_type = 2;              // see init.hpp (1-7)
+    size_t seed = 123;              // initial-condition random seed
+    bool fixed_positions = false;
+    std::string ic_input = "";      // start from this snapshot instead
+    std::string ic_output = "";     // stream initial conditions here and exit
+    size_t ic_chunk = 1 << 20;      // particles per streamed chunk
+
+    // physics
+    double smoothing_length = 0.03;
+    double softening = 0.01;
+    double neighbor_radius = 0.05;
+    double density_threshold = 100.0;
+    int min_neighbors = 5;
+    double accretion_radius = 0.02;
+    std::string eos = "ideal";               // ideal | barotropic (see eos.hpp)
+    double eos_rho_crit = 1e5;               // barotropic: stiffening density
+    std::string cooling = "constant";        // constant | molecular
+    double cooling_coefficient = 1e-3;       // molecular: rate = c rho T^1.7 / (1 + rho / rho_crit)
+    double cooling_floor = 0.1;              // molecular: temperature floor
+
+    // solver backends
+    bool use_cached = false;                 // optimized SoA kernels
+    std::string gravity_solver = "direct";   // direct | barnes_hut | pm | treepm (cached path)
+    double theta = 0.6;                      // Barnes-Hut opening angle
+    int pm_grid = 32;                        // PM mesh cells per side (power of two)
+    double pm_split = 1.25;                  // TreePM split radius in mesh cells
+    double box_size = 0.0;                   // periodic box side (pm/treepm), 0 = open
+    std::string density_kernel = "sph";      // sph | knn
+    int knn_neighbors = 32;                  // knn: neighbours per particle (2 h = r_k)
+    int num_threads = 0;                     // 0 = OpenMP default
+    bool task_graph = true;                  // overlap independent stages (cached path)
+    int compact_interval = 10;               // steps between compactions
+    int diagnostics_interval = 0;            // energy/momentum log every K steps, 0 = off
+    int audit_interval = 0;                  // force-accuracy audit every K steps, 0 = off
+    size_t audit_samples = 256;              // particles checked per audit
+    bool profile = false;                    // per-phase counters and roofline report
+    double profile_peak_gflops = 0.0;        // roofline compute ceiling, 0 = measure
+    double profile_peak_bandwidth = 0.0;     // roofline memory ceiling in GB/s, 0 = measure
+
+    // distributed runs (make MPI=1)
+    int mpi_rebalance_interval = 10;         // steps between balance checks
+    double mpi_imbalance_tolerance = 1.1;    // rebalance above this max/mean time
+
+    // ensemble: "key:v1,v2;key2:v1,v2" runs every combination on copies of
+    // the same initial conditions, ensemble_groups members at a time
+    std::string sweep = "";
+    int ensemble_groups = 0;                 // 0 = one member per core
+
+    // output / verification
+    std::string output_dir = "frames";
+    std::string output_format = "csv";      // csv | compressed (see codec.hpp)
+    double output_tolerance = 5e-6;         // compressed: max absolute error (or real_t rounding)
+    int keyframe_interval = 10;             // compressed: frames between keyframes
+    std::string decompress_frames = "";     // decode <dir>/frame_*.sfz to CSV and exit
+    int render_interval = 0;                // in-situ image every K steps, 0 = off
+    int render_size = 512;                  // image side in pixels
+    std::string render_axis = "z";          // line of sight: x | y | z
+    std::string render_quantity = "density"; // density | temperature
+    std::string render_format = "png";      // png | ppm
+    double render_extent = 0.0;             // view side, 0 = fit the first image
+    std::string shm_name = "";              // live snapshots in /dev/shm/<name>, "" = off
+    int shm_interval = 1;                   // publish every K steps
+    int shm_slots = 3;                      // snapshots kept in the ring
+    int shm_capacity = 0;                   // gas rows per snapshot, 0 = initial N
+    bool verify = false;
+    int verify_interval = 0;        // in-line profile check every K steps, 0 = off
+    double verify_abort_l2 = 0.0;   // stop the run when L2 exceeds this, 0 = never
+    std::string reference_csv = "reference_data/reference_profile.csv";
 };
 
 Config load_config(const std::string &filename);
+
+// Set one field by key; returns false (and warns) for unknown keys or
+// unparsable values.
+bool set_config_value(Config& cfg, const std::string& key, const std::string& value);
+
+// Apply command line arguments on top of cfg: `--config=<file>` (or
+// `--config <file>`) loads a file first, `--key=value` overrides a field,
+// and a bare `--flag` sets a boolean field to true.
+bool apply_cli_overrides(Config& cfg, int argc, char** argv);
+
+void print_config(const Config& cfg);
@@ -1,10 +1,21 @@
 #pragma once
 #include "particles.hpp"
+#include "kdtree.hpp"
 
 // Compute density using SPH cubic-spline kernel with fixed smoothing length h
 // This is O(N^2). kNeighbors unused here (kept for compatibility).
-void compute_density_sph(Particles& P, float h);
+// The same sweep fills P.divv and P.curlv (velocity divergence and curl
+// magnitude) from a gradient-corrected SPH estimate.
+void compute_density_sph(Particles& P, real_t h);
 
-// Compute densities for all particles using k-nearest neighbors
-// Default k=32 neighbors
-// void compute_density_kNN(Particles& P, int k = 32);
+// Compute densities for all alive particles from their k nearest
+// neighbours (at most kMaxNeighbors): each particle gets its own smoothing
+// length h_i = r_k / 2, so the kernel support just reaches the k-th
+// neighbour, and rho_i = sum_j m_j W(r_ij, h_i) over the k neighbours
+// (itself included). divv and curlv come from the same neighbours. The
+// neighbours come from a k-d tree, O(N log N) instead of O(N^2); pass a
+// tree kept between steps to reuse its buffers. Dead particles keep their
+// previous values.
+constexpr size_t kMaxNeighbors = 256;
+void compute_density_kNN(Particles& P, KdTree& tree, int k = 32);
+void compute_density_kNN(Particles& P, int k = 32);
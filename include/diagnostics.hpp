@@ -0,0 +1,51 @@
+// diagnostics.hpp
+// Conservation diagnostics: energies and total momenta of gas + stars.
+//
+// The gas self-potential comes from the gravity stage itself: the solvers
+// fill a per-particle potential array in the same pass that computes the
+// forces (tree walk or direct sum), so a diagnostics step costs no extra
+// O(N^2) or tree pass. Star-gas and star-star terms are summed directly.
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include "particles.hpp"
+#include "stars.hpp"
+
+struct Diagnostics {
+    size_t step = 0;
+    double time = 0.0;
+    double kinetic = 0.0;     // 1/2 m v^2, gas and stars
+    double thermal = 0.0;     // m T / (gamma - 1), gas
+    double potential = 0.0;   // softened, gas-gas + gas-star + star-star
+    Vec3T<double> momentum;          // sum m v
+    Vec3T<double> angular_momentum;  // sum m r x v, about the origin
+
+    double total() const { return kinetic + thermal + potential; }
+};
+
+// phi is the gas potential from the gravity stage (size P.N, gas only).
+Diagnostics compute_diagnostics(const Particles& P,
+                                const SinkParticles& S,
+                                const std::vector<real_t>& phi,
+                                real_t G = 1.0f,
+                                real_t softening = 0.01f);
+
+// CSV log of diagnostics with the relative energy drift against the
+// first record. With energy_drift off (periodic boxes, whose potential has
+// zero mean) the drift column is left empty and max_energy_drift() is NaN.
+class DiagnosticsLog {
+public:
+    bool open(const std::string& filename, bool energy_drift = true);
+    void write(const Diagnostics& d);
+
+    double max_energy_drift() const;
+
+private:
+    std::ofstream out_;
+    bool energy_drift_ = true;
+    bool have_reference_ = false;
+    double e0_ = 0.0;
+    double max_drift_ = 0.0;
+};
@@ -0,0 +1,78 @@
+// domain.hpp
+// Distributed-memory domain decomposition (build with `make MPI=1`).
+//
+// Every rank owns the particles of a contiguous range of Morton keys over
+// the global bounding cube. Ranges are cut so each rank carries about the
+// same total cost, where a particle's cost is its share of the measured
+// compute time of its rank, in proportion to its tree-walk interactions.
+// A step then needs two kinds of remote data, both appended to the local
+// Particles as ghosts and dropped again:
+//   - gravity: the locally essential tree (LET). Each rank walks its own
+//     tree against every other rank's domain box and sends the monopoles
+//     and particles that box needs (BarnesHutSolver::export_essential).
+//   - SPH: a halo of real particles within 2h of the receiving domain. The
+//     owners refresh the halo densities once they are computed.
+#pragma once
+
+#ifdef STARFORM_USE_MPI
+
+#include <mpi.h>
+#include <vector>
+#include <cstdint>
+#include "particles.hpp"
+#include "bh.hpp"
+
+class DomainDecomposition {
+public:
+    explicit DomainDecomposition(MPI_Comm comm = MPI_COMM_WORLD);
+
+    int rank() const { return rank_; }
+    int size() const { return size_; }
+    MPI_Comm comm() const { return comm_; }
+
+    // Redistribute the alive particles of P so every rank owns a
+    // cost-balanced Morton key range. cost holds one weight per local
+    // particle and travels with it. Dead particles are dropped.
+    void decompose(Particles& P, std::vector<real_t>& cost);
+
+    // Bounding box of every rank's alive particles (empty ranks get an
+    // inverted box). Call after particles moved.
+    void update_boxes(const Particles& P);
+    const std::vector<double>& boxes() const { return boxes_; } // 6 per rank
+
+    // Append the LET of every other rank to P (massive ghosts with zero
+    // velocity). tree must be built over the local particles only.
+    // Returns the number of ghosts appended.
+    size_t import_essential_tree(Particles& P, const BarnesHutSolver& tree);
+
+    // Append copies of the remote particles within `radius` of the local
+    // domain box and remember where they came from.
+    size_t import_halo(Particles& P, real_t radius);
+
+    // Overwrite the halo ghosts' densities with their owners' values.
+    // first_ghost is P.N at the time import_halo was called.
+    void refresh_halo_density(Particles& P, size_t first_ghost);
+
+    // max / mean of a per-rank value (1 = perfectly balanced)
+    double imbalance(double local_value) const;
+
+    // Morton key of a position in the current global cube (21 bits/axis).
+    uint64_t key_of(double x, double y, double z) const;
+
+    // global particle count (alive)
+    size_t global_count(const Particles& P) const;
+
+private:
+    MPI_Comm comm_;
+    int rank_ = 0;
+    int size_ = 1;
+
+    double cube_lo_[3] = {0, 0, 0};
+    double cube_inv_ = 1.0;
+
+    std::vector<double> boxes_;                  // lo[3], hi[3] per rank
+    std::vector<std::vector<uint32_t>> halo_send_; // local indices per dest rank
+    std::vector<int> halo_recv_counts_;          // ghosts received per source
+};
+
+#endif // STARFORM_USE_MPI
@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "config.hpp"
+#include "particles.hpp"
+#include "verify.hpp"
+
+// One swept parameter and the values it takes.
+struct SweepAxis {
+    std::string key;
+    std::vector<std::string> values;
+};
+
+struct EnsembleMember {
+    Config cfg;
+    std::vector<std::string> values;   // one per axis, as written in the sweep
+    size_t stars = 0;
+    real_t star_mass_fraction = 0;
+    bool verified = false;
+    ErrorMetrics error = {0, 0, 0};
+    double runtime_ms = 0.0;
+    bool aborted = false;              // stopped early (diverged)
+};
+
+// Parse "key:v1,v2;key2:v1,v2". Returns false (and warns) on a malformed
+// sweep or on keys that would change the shared initial conditions, the
+// ensemble or its scheduling.
+bool parse_sweep(const std::string& sweep, std::vector<SweepAxis>& axes);
+
+// Run every combination of the sweep axes on a copy of the initialised
+// particles P. Members run concurrently in cfg.ensemble_groups OpenMP
+// thread groups that split the cores between them; members write no
+// snapshots. Prints the summary table and writes it to
+// <output_dir>/ensemble.csv.
+std::vector<EnsembleMember> run_ensemble(const Particles& P, const Config& cfg);
@@ -0,0 +1,160 @@
+// eos.hpp
+// Tabulated equation of state and cooling (eos = barotropic, cooling =
+// molecular).
+//
+// Pressure, sound speed and cooling rate are sampled once on a grid in
+// (log2 rho, log2 T) and looked up by bilinear interpolation, so the step
+// loop calls no pow, exp or log. The grid coordinates come from the float
+// exponent bits plus a polynomial in the mantissa (fast_log2), and the cooling rate,
+// which spans many decades, is stored as log2 and decoded with fast_exp2.
+// Pressure and sound speed are stored as the smooth factors P / (rho T)
+// and c^2 / T, so they need no decoding and stay exact for T = 0.
+//
+// Outside the grid the lookup clamps to its edge.
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "precision.hpp"
+
+// log2(x) for x > 0 to about 4e-7, without a libm call or a branch.
+// The sign bit is dropped, so x < 0 gives log2|x|; x = 0 gives about -127.
+inline float fast_log2(float x) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    bits &= 0x7fffffffu;
+    // x = (1 + t) 2^e with t in [0, 1); e as a float from the bits of
+    // 2^23 + biased exponent (an int to float conversion would carry a
+    // false dependency from one loop iteration to the next)
+    const uint32_t mbits = (bits & 0x7fffffu) | 0x3f800000u;
+    const uint32_t ebits = 0x4b000000u | (bits >> 23);
+    float m, e;
+    std::memcpy(&m, &mbits, sizeof(m));
+    std::memcpy(&e, &ebits, sizeof(e));
+    const float t = m - 1.0f;
+    // least-squares fit of log2(1 + t) / t on [0, 1)
+    const float p = 1.4426640f + t * (-0.72051548f + t * (0.47311312f + t * (-0.32461572f +
+                    t * (0.19238405f + t * (-0.078157467f + t * 0.015127702f)))));
+    return (e - (8388608.0f + 127.0f)) + t * p;
+}
+
+// 2^y for y in [-126, 127] to about 1e-7 relative, without a libm call or
+// a branch
+inline float fast_exp2(float y) {
+    y = y > -126.0f ? y : -126.0f;
+    y = y < 127.0f ? y : 127.0f;
+    // y = i + f with f in [-0.5, 0.5]; adding 1.5 * 2^23 rounds to integer
+    const float i = (y + 12582912.0f) - 12582912.0f;
+    const float f = (y - i) * 0.6931471805599453f;
+    const float p = 1.0f + f * (1.0f + f * (1.0f / 2 + f * (1.0f / 6 + f * (1.0f / 24 +
+                    f * (1.0f / 120 + f * (1.0f / 720))))));
+    const uint32_t bits = uint32_t(int(i) + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+
+struct EosSample {
+    real_t pressure, cooling_rate;
+};
+
+class EosTable {
+public:
+    // barotropic: P = rho T (1 + (rho / rho_crit)^(gamma - 1)) with
+    // gamma = 7/5, isothermal below rho_crit and adiabatic above; otherwise
+    // the ideal gas P = rho T. molecular: dT/dt = -rate (T - T_floor) with
+    // rate = coefficient rho T^1.7 / (1 + rho / rho_crit), line cooling that
+    // fades as the gas turns optically thick; otherwise no rate (the
+    // constant per-step cooling factor applies).
+    EosTable(bool barotropic, double rho_crit, bool molecular, double coefficient,
+             double floor_temperature);
+
+    bool molecular() const { return molecular_; }
+    real_t floor_temperature() const { return floor_; }
+
+    // pressure and cooling rate at (rho, T) from the table. Without
+    // molecular cooling the rate is about 0 (the table holds 1e-30).
+    inline EosSample lookup(real_t rho, real_t T) const {
+        const Stencil st = stencil(rho, T);
+        EosSample s;
+        s.pressure = rho * T * real_t(st.mix(&Node::pressure));
+        s.cooling_rate = real_t(fast_exp2(st.mix(&Node::log_rate)));
+        return s;
+    }
+
+    // the pressure alone, for the constant cooling factor
+    inline real_t pressure(real_t rho, real_t T) const {
+        return rho * T * real_t(stencil(rho, T).mix(&Node::pressure));
+    }
+
+    // sound speed at (rho, T); the step loop does not need it
+    real_t sound_speed(real_t rho, real_t T) const {
+        return real_t(std::sqrt(float(T) * stencil(rho, T).mix(&Node::sound)));
+    }
+
+    // the closed forms the table is built from
+    double exact_pressure(double rho, double T) const;
+    double exact_sound_speed(double rho, double T) const;
+    double exact_cooling_rate(double rho, double T) const;
+
+    // grid: log2 rho in [-10, 30], log2 T in [-10, 17]
+    static constexpr float kLogRhoMin = -10.0f, kLogTMin = -10.0f;
+    static constexpr int kNodesPerOctave = 2;
+    static constexpr int kRhoNodes = 40 * kNodesPerOctave + 1;
+    static constexpr int kTNodes = 27 * kNodesPerOctave + 1;
+
+private:
+    // x limited to [0, hi], as min/max instructions rather than branches
+    static inline float clamp(float x, float hi) {
+        x = x > 0.0f ? x : 0.0f;
+        return x < hi ? x : hi;
+    }
+
+    // the grid cell of 0 <= x < 2^22: round(x - 0.5) by the float rounding
+    // trick. At integer x this may give x - 1 (then x - cell = 1), which
+    // interpolates to the same node, so no correction branch is needed.
+    static inline float cell(float x) {
+        return (x - 0.5f + 8388608.0f) - 8388608.0f;
+    }
+
+    // P / (rho T), c^2 / T, log2 rate
+    struct Node {
+        float pressure, sound, log_rate, pad;
+    };
+
+    // the four nodes around a point and their bilinear weights
+    struct Stencil {
+        const Node* a;
+        float w00, w10, w01, w11;
+
+        float mix(float Node::*column) const {
+            return w00 * a->*column + w10 * a[1].*column + w01 * a[kRhoNodes].*column +
+                   w11 * a[kRhoNodes + 1].*column;
+        }
+    };
+
+    inline Stencil stencil(real_t rho, real_t T) const {
+        float u = (fast_log2(float(rho)) - kLogRhoMin) * kNodesPerOctave;
+        float v = (fast_log2(float(T)) - kLogTMin) * kNodesPerOctave;
+        u = clamp(u, float(kRhoNodes - 1) - 1e-3f);
+        v = clamp(v, float(kTNodes - 1) - 1e-3f);
+        const float cu = cell(u), cv = cell(v);
+        const int iu = int(cu), iv = int(cv);
+        const float fu = u - cu, fv = v - cv;
+        Stencil s;
+        s.a = &nodes_[size_t(iv) * kRhoNodes + iu];
+        s.w00 = (1.0f - fu) * (1.0f - fv);
+        s.w10 = fu * (1.0f - fv);
+        s.w01 = (1.0f - fu) * fv;
+        s.w11 = fu * fv;
+        return s;
+    }
+
+    bool barotropic_, molecular_;
+    double rho_crit_, coefficient_;
+    real_t floor_;
+    std::vector<Node> nodes_; // row-major, one row per T node
+};
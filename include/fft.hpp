@@ -0,0 +1,54 @@
+// fft.hpp
+// In-house complex FFT for the particle-mesh gravity solver.
+//
+// Iterative radix-2 Cooley-Tukey on power-of-two lengths, with the
+// bit-reversal permutation and twiddle factors precomputed per length.
+// Fft3D applies it along x, y and z of an n^3 row-major grid (x fastest),
+// one line per iteration of a parallel loop; lines along y and z are
+// gathered into a per-thread buffer so the butterflies run on contiguous
+// memory.
+#pragma once
+
+#include <vector>
+#include <complex>
+#include <cstddef>
+
+using cplx = std::complex<double>;
+
+class Fft1D {
+public:
+    explicit Fft1D(size_t n = 1);
+
+    size_t size() const { return n_; }
+
+    // in-place transform of a[0..n); the inverse is unnormalised (the
+    // caller divides by n), matching the usual exp(-2 pi i jk/n) forward
+    void transform(cplx* a, bool inverse) const;
+
+private:
+    size_t n_;
+    std::vector<size_t> rev_;   // bit-reversed index
+    std::vector<cplx> twiddle_; // exp(-2 pi i k / n), k < n/2
+};
+
+class Fft3D {
+public:
+    explicit Fft3D(size_t n = 1);
+
+    size_t size() const { return n_; }
+
+    // forward or inverse transform of an n^3 grid in place; inverse divides
+    // by n^3 so inverse(forward(g)) == g
+    void forward(cplx* grid) const { transform(grid, false); }
+    void inverse(cplx* grid) const { transform(grid, true); }
+
+private:
+    size_t n_;
+    Fft1D line_;
+    mutable std::vector<std::vector<cplx>> buffers_; // one line per thread
+
+    void transform(cplx* grid, bool inverse) const;
+};
+
+// true if n is a power of two (>= 1)
+inline bool is_pow2(size_t n) { return n && !(n & (n - 1)); }
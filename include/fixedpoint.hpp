@@ -0,0 +1,126 @@
+// fixedpoint.hpp
+// Optional fixed-point position encoding.
+//
+// Positions are stored as unsigned 32-bit integer coordinates on a uniform
+// grid spanning a cubic root box. The spacing is 2^-32 of the box on every
+// axis, so a pair separation is an exact integer difference no matter how
+// far the pair sits from the origin -- unlike float, whose resolution
+// degrades to ~1e-7 of the coordinate value inside dense cores. Storage is
+// the same 4 bytes per coordinate as float, and the top 21 bits of each
+// coordinate are directly a Morton-key digit.
+//
+// Kernels convert only *differences* back to real_t (see the separation
+// functors below), keeping the inner loops in float arithmetic.
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include "precision.hpp"
+
+struct FixedFrame {
+    static constexpr double kSteps = 4294967296.0; // 2^32 grid steps per axis
+
+    double origin[3] = {0.0, 0.0, 0.0}; // world position of integer 0
+    double cell = 1.0 / kSteps;          // world length of one integer step
+
+    // Fit a cube around [lo, hi] on every axis, grown by `pad` times its
+    // half width on each side so particles can drift before a refit.
+    void fit(const double lo[3], const double hi[3], double pad) {
+        double half = 0.0;
+        for (int a = 0; a < 3; ++a) half = std::max(half, 0.5 * (hi[a] - lo[a]));
+        if (half <= 0.0) half = 1e-6; // degenerate case
+        half *= (1.0 + pad);
+        for (int a = 0; a < 3; ++a) origin[a] = 0.5 * (lo[a] + hi[a]) - half;
+        cell = 2.0 * half / kSteps;
+    }
+
+    double box() const { return cell * kSteps; }
+
+    uint32_t encode(double v, int axis) const {
+        double s = std::floor((v - origin[axis]) / cell + 0.5);
+        return static_cast<uint32_t>(std::clamp(s, 0.0, kSteps - 1.0));
+    }
+
+    double decode(uint32_t q, int axis) const {
+        return origin[axis] + double(q) * cell;
+    }
+
+    // signed separation b - a in world units
+    real_t delta(uint32_t a, uint32_t b) const {
+        return real_t(int64_t(b) - int64_t(a)) * real_t(cell);
+    }
+
+    // integer displacement for a world-space step
+    int64_t steps(double d) const {
+        return static_cast<int64_t>(std::llround(d / cell));
+    }
+};
+
+// Pair separation from float coordinates: d = x_j - x_i.
+template <class PS>
+struct FloatSeparation {
+    const typename PS::real* x;
+    const typename PS::real* y;
+    const typename PS::real* z;
+
+    explicit FloatSeparation(const PS& P)
+        : x(P.x.data()), y(P.y.data()), z(P.z.data()) {}
+
+    inline void operator()(size_t i, size_t j, real_t& dx, real_t& dy, real_t& dz) const {
+        dx = x[j] - x[i];
+        dy = y[j] - y[i];
+        dz = z[j] - z[i];
+    }
+};
+
+// Pair separation from fixed-point coordinates: exact integer difference,
+// converted to real_t once.
+template <class PS>
+struct FixedSeparation {
+    const uint32_t* qx;
+    const uint32_t* qy;
+    const uint32_t* qz;
+    real_t cell;
+
+    explicit FixedSeparation(const PS& P)
+        : qx(P.qx.data()), qy(P.qy.data()), qz(P.qz.data()),
+          cell(real_t(P.frame.cell)) {}
+
+    inline void operator()(size_t i, size_t j, real_t& dx, real_t& dy, real_t& dz) const {
+        dx = real_t(int64_t(qx[j]) - int64_t(qx[i])) * cell;
+        dy = real_t(int64_t(qy[j]) - int64_t(qy[i])) * cell;
+        dz = real_t(int64_t(qz[j]) - int64_t(qz[i])) * cell;
+    }
+};
+
+// Pair separation in a periodic box of side P.period: the nearest image.
+template <class PS>
+struct PeriodicSeparation {
+    const typename PS::real* x;
+    const typename PS::real* y;
+    const typename PS::real* z;
+    real_t L, inv_L;
+
+    explicit PeriodicSeparation(const PS& P)
+        : x(P.x.data()), y(P.y.data()), z(P.z.data()),
+          L(real_t(P.period)), inv_L(real_t(1.0 / P.period)) {}
+
+    inline void operator()(size_t i, size_t j, real_t& dx, real_t& dy, real_t& dz) const {
+        dx = x[j] - x[i];
+        dy = y[j] - y[i];
+        dz = z[j] - z[i];
+        dx -= L * std::nearbyint(dx * inv_L);
+        dy -= L * std::nearbyint(dy * inv_L);
+        dz -= L * std::nearbyint(dz * inv_L);
+    }
+};
+
+// Call f(sep) with the separation functor matching P's position encoding
+// and boundaries (fixed-point positions are never periodic).
+template <class PS, class F>
+inline void with_separation(const PS& P, F&& f) {
+    if (P.fixed_positions()) f(FixedSeparation<PS>(P));
+    else if (P.periodic())   f(PeriodicSeparation<PS>(P));
+    else                     f(FloatSeparation<PS>(P));
+}
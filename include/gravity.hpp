@@ -4,12 +4,30 @@
 #include <vector>
 
 void compute_gravity(const Particles& P,
-                     std::vector<float>& ax,
-                     std::vector<float>& ay,
-                     std::vector<float>& az,
-                     float G = 1.0f,
-                     float softening = 0.01f);
+                     std::vector<real_t>& ax,
+                     std::vector<real_t>& ay,
+                     std::vector<real_t>& az,
+                     real_t G = 1.0f,
+                     real_t softening = 0.01f,
+                     std::vector<real_t>* potential = nullptr);
 
+// Direct O(N^2) sum in gather form: each particle accumulates its own
+// acceleration in acc_t and writes P.ax/ay/az once (threaded over i).
+// If potential (size P.N) is given, the softened gravitational potential
+// of every particle is written there in the same pass.
 void compute_gravity_cached_optimized(Particles& P,
-                     float G = 1.0f,
-                     float softening = 0.01f);
\ No newline at end of file
+                     real_t G = 1.0f,
+                     real_t softening = 0.01f,
+                     real_t* potential = nullptr);
+
+// Direct gravity between stars (sinks) and everything else: adds the pull
+// of every star to the gas accelerations ax/ay/az, and fills S.acc with the
+// pull of the gas and of the other stars. O(N * S + S^2). In a periodic
+// box every pair uses the nearest image.
+void compute_sink_gravity(const Particles& P,
+                          SinkParticles& S,
+                          std::vector<real_t>& ax,
+                          std::vector<real_t>& ay,
+                          std::vector<real_t>& az,
+                          real_t G = 1.0f,
+                          real_t softening = 0.01f);
@@ -3,13 +3,13 @@
 #include <vector>
 
 // Compute pressure from density and temperature or polytropic EOS
-void compute_pressure(Particles& P, float K = 1.0f, float gamma = 5.0f/3.0f);
+void compute_pressure(Particles& P, real_t K = 1.0f, real_t gamma = 5.0f/3.0f);
 
 // Compute hydrodynamic acceleration from pressure gradients (SPH symmetric form).
 // Writes into ax,ay,az which should be pre-filled with gravity contributions.
-void compute_pressure_forces(Particles& P, float h,
-                             std::vector<float>& ax,
-                             std::vector<float>& ay,
-                             std::vector<float>& az);
+void compute_pressure_forces(Particles& P, real_t h,
+                             std::vector<real_t>& ax,
+                             std::vector<real_t>& ay,
+                             std::vector<real_t>& az);
 
-void compute_pressure_forces_cached(Particles& P, float h);
+void compute_pressure_forces_cached(Particles& P, real_t h);
@@ -1,10 +1,32 @@
 // init.hpp
 #pragma once
+#include <cstdint>
 #include "particles.hpp"
 
+// Initial-condition types (Config::init_type):
+//   1 uniform lattice      2 clustered           3 spherical cloud
+//   4 identity (debugging) 5 glass (jittered lattice)
+//   6 Plummer sphere       7 Bonnor-Ebert sphere
+
+struct InitState {
+    real_t x, y, z;
+    real_t vx, vy, vz;
+};
+
+// Position and velocity of particle i of N. Depends only on
+// (version_type, i, N, seed), never on generation order.
+InitState init_state(int version_type, size_t i, size_t N, uint64_t seed);
+
 void init_uniform(Particles& P);
 void init_clustered(Particles& P);
 void init_spherical(Particles& P);
 void identity_for_debugging(Particles& P);
 
-void init_particles(Particles& P, int version_type);
+// Fill P in parallel; prints the chosen type.
+void init_particles(Particles& P, int version_type, uint64_t seed = 123);
+
+// Fill P with particles first .. first + P.N - 1 of an N_total particle
+// set (IDs included), e.g. one rank's share of a distributed run.
+void init_particle_range(Particles& P, int version_type, uint64_t seed,
+                         size_t first, size_t N_total);
+const char* init_name(int version_type);
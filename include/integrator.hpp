@@ -1,13 +1,62 @@
 #pragma once
 
 #include "particles.hpp"
+#include "pipeline.hpp"
+#include "thermo.hpp"
+#include "physics.hpp"
 #include <vector>
 
 // Velocity-Verlet integrator for N-body particles
 void velocity_verlet(Particles& P,
-                     const std::vector<float>& ax,
-                     const std::vector<float>& ay,
-                     const std::vector<float>& az,
-                     float dt);
+                     const std::vector<real_t>& ax,
+                     const std::vector<real_t>& ay,
+                     const std::vector<real_t>& az,
+                     real_t dt);
 
-void velocity_verlet_cached(Particles& P, float dt);
+// Half-step velocity update from the current accelerations (fused op).
+struct Kick {
+    static constexpr uint32_t kReads = kFieldVel | kFieldAcc;
+    static constexpr uint32_t kWrites = kFieldVel;
+
+    real_t dt;
+
+    void operator()(ParticleState& p) const {
+        p.vx += real_t(0.5) * p.ax * dt;
+        p.vy += real_t(0.5) * p.ay * dt;
+        p.vz += real_t(0.5) * p.az * dt;
+    }
+};
+
+// Full-step position update of floating-point positions (fused op).
+struct Drift {
+    static constexpr uint32_t kReads = kFieldPos | kFieldVel;
+    static constexpr uint32_t kWrites = kFieldPos;
+
+    real_t dt;
+
+    void operator()(ParticleState& p) const {
+        p.x += p.vx * dt;
+        p.y += p.vy * dt;
+        p.z += p.vz * dt;
+    }
+};
+
+void velocity_verlet_cached(Particles& P, real_t dt);
+
+// Every gas update after the forces in one sweep: kick + drift,
+// compressional heating, cooling. Fixed-point positions drift in a pass of
+// their own (the frame may have to be refit first).
+// With a tabulated EOS (eos != nullptr) the cooling op is TabulatedCooling,
+// or MolecularCooling with the cooling curve; all variants touch the same
+// fields.
+using GasUpdate = FusedUpdate<Kick, Drift, CompressionalHeating, Cooling>;
+using TabulatedGasUpdate = FusedUpdate<Kick, Drift, CompressionalHeating, TabulatedCooling>;
+using MolecularGasUpdate = FusedUpdate<Kick, Drift, CompressionalHeating, MolecularCooling>;
+static_assert(GasUpdate::kReads == TabulatedGasUpdate::kReads &&
+              GasUpdate::kWrites == TabulatedGasUpdate::kWrites &&
+              GasUpdate::kReads == MolecularGasUpdate::kReads &&
+              GasUpdate::kWrites == MolecularGasUpdate::kWrites);
+void update_gas(Particles& P, real_t dt, const EosTable* eos = nullptr);
+
+// Same kick + drift as velocity_verlet_cached, for stars (uses S.acc)
+void velocity_verlet_sinks(SinkParticles& S, real_t dt);
@@ -0,0 +1,151 @@
+// kdtree.hpp
+// Implicit k-d tree over the alive particles, for k-nearest-neighbour
+// queries (density_kernel = knn).
+//
+// The tree has no node structs. The points are copied into one array and
+// ordered so that every range [lo, hi) is a node: its median point at
+// mid = lo + (hi - lo) / 2 splits it along axis_[mid] into the children
+// [lo, mid) and [mid + 1, hi). Ranges of at most kLeafSize points are
+// leaves and are scanned linearly. A query walks the tree with a bounded
+// max-heap of the k best points found so far and skips every node whose
+// box lies farther away than the current k-th distance. Node boxes are not
+// stored; the walk narrows the root box at each split.
+//
+// The array order is spatially coherent, so queries issued in that order
+// (items()) touch the same leaves one after another. In a periodic box
+// (P.period > 0) distances use the nearest image.
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include "particles.hpp"
+
+class KdTree {
+public:
+    static constexpr uint32_t kLeafSize = 8;
+
+    struct Neighbor {
+        real_t d2;      // squared distance
+        uint32_t index; // particle index
+    };
+
+    // Build over the alive particles of P (buffers are reused between
+    // builds).
+    void build(const Particles& P);
+
+    size_t size() const { return points_.size(); }
+
+    // Particle index of every tree point, in tree order.
+    const std::vector<uint32_t>& items() const { return items_; }
+
+    // The k nearest tree points of (x, y, z), a point at the same position
+    // included, into out[0 .. k). Returns how many were found
+    // (min(k, size())); out is a max-heap on d2, so out[0] is the farthest.
+    size_t nearest(real_t x, real_t y, real_t z, size_t k, Neighbor* out) const {
+        if (points_.empty() || k == 0) return 0;
+        Query q{{x, y, z}, k, out, 0};
+        real_t lo[3] = {lo_[0], lo_[1], lo_[2]};
+        real_t hi[3] = {hi_[0], hi_[1], hi_[2]};
+        if (period_ > real_t(0)) search<true>(0, uint32_t(points_.size()), lo, hi, q);
+        else                     search<false>(0, uint32_t(points_.size()), lo, hi, q);
+        return q.n;
+    }
+
+private:
+    struct Point {
+        real_t p[3];
+        uint32_t index;
+    };
+
+    struct Query {
+        real_t x[3];
+        size_t k;
+        Neighbor* heap;
+        size_t n;
+    };
+
+    std::vector<Point> points_;   // tree order
+    std::vector<uint8_t> axis_;   // split axis of the node whose median is at this slot
+    std::vector<uint32_t> items_; // points_[s].index, for callers
+    real_t lo_[3] = {0, 0, 0}, hi_[3] = {0, 0, 0};
+    real_t period_ = 0, inv_period_ = 0;
+
+    void build_range(uint32_t lo, uint32_t hi, real_t box_lo[3], real_t box_hi[3]);
+
+    static bool farther(const Neighbor& a, const Neighbor& b) { return a.d2 < b.d2; }
+
+    static inline void offer(Query& q, real_t d2, uint32_t index) {
+        if (q.n < q.k) {
+            q.heap[q.n++] = Neighbor{d2, index};
+            std::push_heap(q.heap, q.heap + q.n, farther);
+        } else if (d2 < q.heap[0].d2) {
+            std::pop_heap(q.heap, q.heap + q.n, farther);
+            q.heap[q.n - 1] = Neighbor{d2, index};
+            std::push_heap(q.heap, q.heap + q.n, farther);
+        }
+    }
+
+    // separation along one axis (nearest image when periodic)
+    template <bool Periodic>
+    inline real_t delta(real_t d) const {
+        if (Periodic) d -= period_ * std::nearbyint(d * inv_period_);
+        return d;
+    }
+
+    template <bool Periodic>
+    inline real_t point_d2(const Point& p, const Query& q) const {
+        const real_t dx = delta<Periodic>(p.p[0] - q.x[0]);
+        const real_t dy = delta<Periodic>(p.p[1] - q.x[1]);
+        const real_t dz = delta<Periodic>(p.p[2] - q.x[2]);
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    // squared distance from the query to the box [lo, hi]
+    template <bool Periodic>
+    inline real_t box_d2(const real_t lo[3], const real_t hi[3], const Query& q) const {
+        real_t d2 = 0;
+        for (int a = 0; a < 3; ++a) {
+            real_t g = std::max(std::max(lo[a] - q.x[a], q.x[a] - hi[a]), real_t(0));
+            if (Periodic) {
+                // the images one period to either side
+                const real_t up = q.x[a] + period_, down = q.x[a] - period_;
+                g = std::min(g, std::max(std::max(lo[a] - up, up - hi[a]), real_t(0)));
+                g = std::min(g, std::max(std::max(lo[a] - down, down - hi[a]), real_t(0)));
+            }
+            d2 += g * g;
+        }
+        return d2;
+    }
+
+    template <bool Periodic>
+    void search(uint32_t lo, uint32_t hi, real_t box_lo[3], real_t box_hi[3], Query& q) const {
+        if (hi - lo <= kLeafSize) {
+            for (uint32_t s = lo; s < hi; ++s) {
+                offer(q, point_d2<Periodic>(points_[s], q), points_[s].index);
+            }
+            return;
+        }
+        const uint32_t mid = lo + (hi - lo) / 2;
+        const int a = axis_[mid];
+        const real_t split = points_[mid].p[a];
+        offer(q, point_d2<Periodic>(points_[mid], q), points_[mid].index);
+
+        // near child first, then the far one if it can still hold a better point
+        const bool left = q.x[a] < split;
+        const real_t saved_lo = box_lo[a], saved_hi = box_hi[a];
+        if (left) { box_hi[a] = split; search<Periodic>(lo, mid, box_lo, box_hi, q); box_hi[a] = saved_hi; }
+        else      { box_lo[a] = split; search<Periodic>(mid + 1, hi, box_lo, box_hi, q); box_lo[a] = saved_lo; }
+
+        if (left) box_lo[a] = split;
+        else      box_hi[a] = split;
+        if (q.n < q.k || box_d2<Periodic>(box_lo, box_hi, q) < q.heap[0].d2) {
+            if (left) search<Periodic>(mid + 1, hi, box_lo, box_hi, q);
+            else      search<Periodic>(lo, mid, box_lo, box_hi, q);
+        }
+        box_lo[a] = saved_lo;
+        box_hi[a] = saved_hi;
+    }
+};
@@ -0,0 +1,64 @@
+// neighbors.hpp
+// Uniform-grid neighbour index (cell list) over the alive particles.
+//
+// Particles are binned into cubic cells at least as large as the search
+// radius, so every neighbour of a point lies in the 27 cells around it.
+// Particle indices are stored sorted by cell (counting sort), which makes a
+// fixed-radius query O(k) instead of O(N).
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include "particles.hpp"
+
+class NeighborGrid {
+public:
+    // Bin the alive particles of P into cells of side >= cell_size. The cell
+    // is enlarged if needed to keep the grid at most ~2 cells per particle.
+    // Returns false, and leaves the grid empty, if an alive particle has a
+    // non-finite position (the run has diverged).
+    bool build(const Particles& P, real_t cell_size);
+
+    real_t cell_size() const { return cell_; }
+
+    // Alive particle indices sorted by cell (a spatially coherent order).
+    const std::vector<uint32_t>& items() const { return items_; }
+
+    // Call f(j) for every alive particle j in the 27 cells around (x, y, z).
+    // Callers test the actual distance; valid for radii <= cell_size().
+    template <class F>
+    void for_each_candidate(real_t x, real_t y, real_t z, F&& f) const {
+        if (items_.empty()) return;
+        const int cx = cell_coord(x, 0);
+        const int cy = cell_coord(y, 1);
+        const int cz = cell_coord(z, 2);
+        for (int k = std::max(cz - 1, 0); k <= std::min(cz + 1, dims_[2] - 1); ++k) {
+            for (int j = std::max(cy - 1, 0); j <= std::min(cy + 1, dims_[1] - 1); ++j) {
+                const size_t row = (size_t(k) * dims_[1] + j) * dims_[0];
+                const int i0 = std::max(cx - 1, 0);
+                const int i1 = std::min(cx + 1, dims_[0] - 1);
+                // cells along x are adjacent in the sorted list
+                const uint32_t begin = cell_start_[row + i0];
+                const uint32_t end = cell_start_[row + i1 + 1];
+                for (uint32_t s = begin; s < end; ++s) f(items_[s]);
+            }
+        }
+    }
+
+private:
+    real_t cell_ = 1;
+    real_t inv_cell_ = 1;
+    real_t lo_[3] = {0, 0, 0};
+    int dims_[3] = {1, 1, 1};
+    std::vector<uint32_t> cell_start_; // size ncells + 1
+    std::vector<uint32_t> items_;      // particle indices sorted by cell
+    std::vector<uint32_t> cell_of_;    // cell of each particle (build scratch)
+    std::vector<uint32_t> cursor_;     // next free slot per cell (build scratch)
+
+    inline int cell_coord(real_t v, int axis) const {
+        const int c = static_cast<int>((v - lo_[axis]) * inv_cell_);
+        return std::clamp(c, 0, dims_[axis] - 1);
+    }
+};
@@ -0,0 +1,88 @@
+// parallel.hpp
+// Thin wrappers around the OpenMP runtime so headers and sources still
+// compile (serially) when built without -fopenmp.
+#pragma once
+
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#include <chrono>
+#endif
+
+inline int par_max_threads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+inline int par_num_threads() {
+#ifdef _OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
+// Processors available to the program (sizes per-thread buffers that must
+// not grow when a loop runs with more threads than the last time).
+inline int par_num_procs() {
+#ifdef _OPENMP
+    return omp_get_num_procs();
+#else
+    return 1;
+#endif
+}
+
+inline int par_thread_id() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+inline void par_set_num_threads(int n) {
+#ifdef _OPENMP
+    omp_set_num_threads(n);
+#else
+    (void)n;
+#endif
+}
+
+// Allow parallel regions nested `levels` deep (ensemble thread groups).
+inline void par_set_max_active_levels(int levels) {
+#ifdef _OPENMP
+    omp_set_max_active_levels(levels);
+#else
+    (void)levels;
+#endif
+}
+
+inline int par_max_active_levels() {
+#ifdef _OPENMP
+    return omp_get_max_active_levels();
+#else
+    return 1;
+#endif
+}
+
+// Number of enclosing active parallel regions (0 in serial code).
+inline int par_active_level() {
+#ifdef _OPENMP
+    return omp_get_active_level();
+#else
+    return 0;
+#endif
+}
+
+// Wall-clock seconds (per-thread timing inside parallel regions).
+inline double par_wtime() {
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    return double(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count()) * 1e-9;
+#endif
+}
@@ -7,23 +7,36 @@
 #include <iomanip>
 #include <iostream>
 
+#include "precision.hpp"
 #include "vec3.hpp"
+#include "fixedpoint.hpp"
 #include "stars.hpp"
 #include <cstdint>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+// Structure-of-arrays particle storage, templated on the field type so the
+// same code serves float (bandwidth) and double (validation) runs.
+template <typename Real>
+struct BasicParticles {
+    using real = Real;
 
-struct Particles {
     size_t N = 0;
 
     // particle properties
-    std::vector<float> mass;
-    std::vector<float> x, y, z;
-    std::vector<float> vx, vy, vz;
-    std::vector<float> ax, ay, az; // caching for reuse and O(N log N) gravity computation
-    std::vector<float> temperature;
+    std::vector<Real> mass;
+    std::vector<Real> x, y, z;
+    std::vector<Real> vx, vy, vz;
+    std::vector<Real> ax, ay, az; // caching for reuse and O(N log N) gravity computation
+    std::vector<Real> temperature;
 
     // thermodynamic
-    std::vector<float> density;
-    std::vector<float> pressure;
+    std::vector<Real> density;
+    std::vector<Real> pressure;
+
+    // velocity divergence and curl magnitude, from the density pass
+    std::vector<Real> divv, curlv;
 
     // Optimization 1: 
     
@@ -34,36 +47,186 @@ struct Particles {
     std::vector<uint8_t> is_star;   // true if particle is a star / sink
     std::vector<uint8_t> alive;
 
+    // persistent particle ID, unchanged by compaction (index i is not)
+    std::vector<uint64_t> id;
+
+    // optional fixed-point positions (see fixedpoint.hpp). When enabled they
+    // are authoritative and x/y/z are a decoded mirror kept for output and
+    // for kernels that do not need the extra precision.
+    std::vector<uint32_t> qx, qy, qz;
+    FixedFrame frame;
 
-    Particles(size_t n)
+    // side of the periodic box [0, period)^3, 0 for open boundaries. Pair
+    // kernels then use the nearest image (see with_separation).
+    double period = 0.0;
+
+
+    BasicParticles(size_t n)
         : N(n),
-          mass(n, 1.0f),
-          x(n, 0.0f), y(n, 0.0f), z(n, 0.0f),
-          vx(n, 0.0f), vy(n, 0.0f), vz(n, 0.0f),
-          ax(n, 0.0f), ay(n, 0.0f), az(n, 0.0f),
-          temperature(n, 1.0f),
-          density(n, 0.0f),
-          pressure(n, 0.0f),
+          mass(n, Real(1)),
+          x(n, Real(0)), y(n, Real(0)), z(n, Real(0)),
+          vx(n, Real(0)), vy(n, Real(0)), vz(n, Real(0)),
+          ax(n, Real(0)), ay(n, Real(0)), az(n, Real(0)),
+          temperature(n, Real(1)),
+          density(n, Real(0)),
+          pressure(n, Real(0)),
+          divv(n, Real(0)), curlv(n, Real(0)),
           is_star(n, false),
-          alive(n, true)
-    {}
+          alive(n, true),
+          id(n)
+    {
+        std::iota(id.begin(), id.end(), uint64_t(0));
+    }
+
+    size_t num_dead() const {
+        size_t dead = 0;
+        for (size_t i = 0; i < N; ++i) dead += alive[i] ? 0 : 1;
+        return dead;
+    }
+
+    // Squeeze dead particles out of every SoA array, preserving the order of
+    // the survivors. If remap is given, remap[old] is the new index or -1.
+    // Returns the number of particles removed.
+    size_t compact(std::vector<int64_t>* remap = nullptr) {
+        if (remap) remap->assign(N, -1);
+        size_t w = 0;
+        for (size_t i = 0; i < N; ++i) {
+            if (!alive[i]) continue;
+            if (remap) (*remap)[i] = static_cast<int64_t>(w);
+            if (w != i) move_particle(i, w);
+            ++w;
+        }
+        const size_t removed = N - w;
+        if (removed) resize(w);
+        return removed;
+    }
+
+    bool fixed_positions() const { return !qx.empty(); }
 
-    // write CSV of *alive* particles only
+    bool periodic() const { return period > 0.0; }
+
+    // map positions back into the periodic box after a drift
+    void wrap_periodic() {
+        if (!periodic()) return;
+        const Real L = Real(period);
+        for (size_t i = 0; i < N; ++i) {
+            x[i] -= L * std::floor(x[i] / L);
+            y[i] -= L * std::floor(y[i] / L);
+            z[i] -= L * std::floor(z[i] / L);
+            // rounding can land a tiny negative coordinate on L itself
+            if (x[i] >= L) x[i] = Real(0);
+            if (y[i] >= L) y[i] = Real(0);
+            if (z[i] >= L) z[i] = Real(0);
+        }
+    }
+
+    // switch to fixed-point positions, fitting the root box around the alive
+    // particles with `pad` half-widths of room on each side
+    void enable_fixed_positions(double pad = 1.0) {
+        double lo[3], hi[3];
+        bounds(lo, hi);
+        frame.fit(lo, hi, pad);
+        qx.resize(N); qy.resize(N); qz.resize(N);
+        for (size_t i = 0; i < N; ++i) {
+            qx[i] = frame.encode(x[i], 0);
+            qy[i] = frame.encode(y[i], 1);
+            qz[i] = frame.encode(z[i], 2);
+        }
+        sync_float_positions();
+    }
+
+    // refresh x/y/z from the fixed-point coordinates
+    void sync_float_positions() {
+        for (size_t i = 0; i < N; ++i) {
+            x[i] = Real(frame.decode(qx[i], 0));
+            y[i] = Real(frame.decode(qy[i], 1));
+            z[i] = Real(frame.decode(qz[i], 2));
+        }
+    }
+
+    // re-encode onto a new root box covering [lo, hi] (positions keep their
+    // current decoded values; only used when particles approach the edge)
+    void refit_frame(const double lo[3], const double hi[3], double pad = 1.0) {
+        FixedFrame next;
+        next.fit(lo, hi, pad);
+        for (size_t i = 0; i < N; ++i) {
+            qx[i] = next.encode(frame.decode(qx[i], 0), 0);
+            qy[i] = next.encode(frame.decode(qy[i], 1), 1);
+            qz[i] = next.encode(frame.decode(qz[i], 2), 2);
+        }
+        frame = next;
+    }
+
+    // axis-aligned bounds of the alive particles
+    void bounds(double lo[3], double hi[3]) const {
+        for (int a = 0; a < 3; ++a) { lo[a] = 1e300; hi[a] = -1e300; }
+        for (size_t i = 0; i < N; ++i) {
+            if (!alive[i]) continue;
+            const double p[3] = {double(x[i]), double(y[i]), double(z[i])};
+            for (int a = 0; a < 3; ++a) {
+                lo[a] = std::min(lo[a], p[a]);
+                hi[a] = std::max(hi[a], p[a]);
+            }
+        }
+        if (lo[0] > hi[0]) for (int a = 0; a < 3; ++a) { lo[a] = 0.0; hi[a] = 1.0; }
+    }
+
+    // write CSV of *alive* particles only (id is the persistent particle ID)
     void write_csv(const std::string& filename) const {
         std::ofstream file(filename);
         if (!file.is_open()) return;
-        file << "x,y,z,vx,vy,vz,temperature,density,pressure,is_star\n";
+        file << "x,y,z,vx,vy,vz,temperature,density,pressure,is_star,id\n";
         file << std::fixed << std::setprecision(5);
         for (size_t i = 0; i < N; ++i) {
             if (!alive[i]) continue;
             file << x[i] << "," << y[i] << "," << z[i] << ","
                  << vx[i] << "," << vy[i] << "," << vz[i] << ","
                  << temperature[i] << "," << density[i] << "," << pressure[i] << ","
-                 << (is_star[i] ? 1 : 0) << "\n";
+                 << (is_star[i] ? 1 : 0) << "," << id[i] << "\n";
         }
         file.close();
     }
 
+private:
+    // copy every per-particle field of src into dst
+    void move_particle(size_t src, size_t dst) {
+        mass[dst] = mass[src];
+        x[dst] = x[src]; y[dst] = y[src]; z[dst] = z[src];
+        vx[dst] = vx[src]; vy[dst] = vy[src]; vz[dst] = vz[src];
+        ax[dst] = ax[src]; ay[dst] = ay[src]; az[dst] = az[src];
+        temperature[dst] = temperature[src];
+        density[dst] = density[src];
+        pressure[dst] = pressure[src];
+        divv[dst] = divv[src]; curlv[dst] = curlv[src];
+        is_star[dst] = is_star[src];
+        alive[dst] = alive[src];
+        id[dst] = id[src];
+        if (fixed_positions()) {
+            qx[dst] = qx[src]; qy[dst] = qy[src]; qz[dst] = qz[src];
+        }
+    }
+
+public:
+    // grow or truncate every per-particle array (used when ghost particles
+    // from other ranks are appended for a step and dropped again)
+    void resize(size_t n) {
+        N = n;
+        mass.resize(n);
+        x.resize(n); y.resize(n); z.resize(n);
+        vx.resize(n); vy.resize(n); vz.resize(n);
+        ax.resize(n); ay.resize(n); az.resize(n);
+        temperature.resize(n);
+        density.resize(n);
+        pressure.resize(n);
+        divv.resize(n); curlv.resize(n);
+        is_star.resize(n);
+        alive.resize(n);
+        id.resize(n);
+        if (fixed_positions()) {
+            qx.resize(n); qy.resize(n); qz.resize(n);
+        }
+    }
+
     size_t count_particles_in_stars() const {
         size_t count = 0;
         for (size_t i = 0; i < N; i++) {
@@ -72,4 +235,7 @@ struct Particles {
         return count;
     }
 
-};
\ No newline at end of file
+};
+
+// particle set at the build's storage precision (see precision.hpp)
+using Particles = BasicParticles<real_t>;
\ No newline at end of file
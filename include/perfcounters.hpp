@@ -0,0 +1,132 @@
+// perfcounters.hpp
+// Per-phase hardware counters and a roofline report (profile = true).
+//
+// PerfCounters opens Linux perf_event counters (cycles, instructions,
+// last-level cache misses, branch misses, and the task clock as CPU time)
+// for every thread of the OpenMP team, user space only. Each event that
+// cannot be opened is left out on its own: in containers and VMs without a
+// PMU, or with kernel.perf_event_paranoid > 2, the hardware events are
+// missing. The report then shows what remains, down to wall time and the
+// analytic model.
+//
+// PhaseProfiler brackets the phases of a step with counter reads. Each
+// phase can carry an analytic model of its flops and memory traffic
+// (KernelCost) that is evaluated every call. The report puts every phase on
+// a roofline: the arithmetic intensity (flop/byte) against the ridge point
+// of the machine's compute and bandwidth ceilings says whether the phase
+// is memory- or compute-bound, and how close it comes to the ceiling. With
+// LLC-miss counts the measured memory traffic (misses x 64 B) is shown next
+// to the modelled traffic.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+enum PerfEvent {
+    kPerfCycles,
+    kPerfInstructions,
+    kPerfLLCMisses,
+    kPerfBranchMisses,
+    kPerfTaskClock, // nanoseconds of CPU time, summed over threads
+    kNumPerfEvents
+};
+
+const char* perf_event_name(int event);
+
+class PerfCounters {
+public:
+    // Open the counters for the threads of an OpenMP team of `threads`.
+    explicit PerfCounters(int threads);
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available(int event) const { return available_[event]; }
+    bool any_hardware() const;
+
+    // why the hardware events are missing ("" if they are not)
+    const std::string& unavailable_reason() const { return reason_; }
+
+    // current counts summed over the threads (scaled up when the kernel
+    // multiplexed the counters); 0 for missing events
+    void read(double out[kNumPerfEvents]) const;
+
+private:
+    std::vector<int> fds_; // [thread * kNumPerfEvents + event], -1 if missing
+    bool available_[kNumPerfEvents] = {};
+    std::string reason_;
+};
+
+// Modelled work of one call of a kernel
+struct KernelCost {
+    double flops = 0.0;
+    double bytes = 0.0; // main-memory traffic
+};
+
+// Pairwise sweep of n targets over n sources: flops_per_pair for every
+// pair. The sources are streamed once if they fit in `cache_bytes` and once
+// per target otherwise.
+KernelCost pair_sweep_cost(double n, double pairs, double flops_per_pair,
+                           double bytes_per_source, double bytes_per_target,
+                           double cache_bytes);
+
+// One pass over n items. Items that fit in `cache_bytes` are still there
+// from the phase before, so, as for the sources of a pair sweep, only a
+// pass over more than the cache reaches main memory.
+inline KernelCost stream_cost(double n, double flops_per_item, double bytes_per_item,
+                              double cache_bytes) {
+    const double bytes = n * bytes_per_item;
+    return KernelCost{n * flops_per_item, bytes <= cache_bytes ? 0.0 : bytes};
+}
+
+// Size of the last-level cache (8 MB if the system does not report it)
+double last_level_cache_bytes();
+
+// Compute and bandwidth ceilings of the roofline
+struct MachinePeaks {
+    double gflops = 0.0;        // GFLOP/s
+    double bandwidth = 0.0;     // GB/s
+    double cache_bytes = 0.0;   // last-level cache
+};
+
+// Measure the ceilings this build reaches with all threads: a vectorisable
+// multiply-add loop held in registers, and a STREAM-style triad over
+// arrays larger than the last-level cache. Values > 0 in gflops and
+// bandwidth are taken as given instead.
+MachinePeaks measure_peaks(double gflops = 0.0, double bandwidth = 0.0);
+
+class PhaseProfiler {
+public:
+    explicit PhaseProfiler(int threads);
+
+    // Register a phase; model (optional) gives the work of one call.
+    size_t add(const std::string& name, std::function<KernelCost()> model = {});
+
+    void begin(size_t phase);
+    void end(size_t phase);
+
+    const PerfCounters& counters() const { return counters_; }
+
+    void report(std::ostream& out, const MachinePeaks& peaks) const;
+    bool write_csv(const std::string& filename, const MachinePeaks& peaks) const;
+
+private:
+    struct Phase {
+        std::string name;
+        std::function<KernelCost()> model;
+        size_t calls = 0;
+        double seconds = 0.0, flops = 0.0, bytes = 0.0;
+        double counts[kNumPerfEvents] = {};
+        double t0 = 0.0;
+        double start[kNumPerfEvents] = {};
+    };
+
+    int threads_;
+    PerfCounters counters_;
+    std::vector<Phase> phases_;
+};
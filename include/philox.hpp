@@ -0,0 +1,71 @@
+// philox.hpp
+// Counter-based random numbers (Philox4x32-10, Salmon et al. 2011).
+//
+// Each draw is a pure function of (key, counter), so a particle's random
+// numbers depend only on (seed, particle index) and never on which thread
+// generated it or in what order. That makes initialisation parallel and
+// lets a chunk of particles be regenerated without touching the rest.
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cmath>
+
+struct Philox4x32 {
+    using Counter = std::array<uint32_t, 4>;
+    using Key = std::array<uint32_t, 2>;
+
+    static Counter generate(Counter c, Key k) {
+        for (int r = 0; r < 10; ++r) {
+            if (r > 0) {
+                k[0] += 0x9E3779B9u;
+                k[1] += 0xBB67AE85u;
+            }
+            const uint64_t p0 = uint64_t(0xD2511F53u) * c[0];
+            const uint64_t p1 = uint64_t(0xCD9E8D57u) * c[2];
+            c = {uint32_t(p1 >> 32) ^ c[1] ^ k[0], uint32_t(p1),
+                 uint32_t(p0 >> 32) ^ c[3] ^ k[1], uint32_t(p0)};
+        }
+        return c;
+    }
+};
+
+// The random stream of one particle: counter = (index, block), key = seed.
+// Blocks of four 32-bit words are generated on demand.
+class CounterRng {
+public:
+    CounterRng(uint64_t seed, uint64_t index)
+        : key_{uint32_t(seed), uint32_t(seed >> 32)},
+          index_(index) {}
+
+    uint32_t next_u32() {
+        if (used_ == 4) {
+            buf_ = Philox4x32::generate({uint32_t(index_), uint32_t(index_ >> 32),
+                                         block_++, 0u}, key_);
+            used_ = 0;
+        }
+        return buf_[used_++];
+    }
+
+    // uniform in the open interval (0, 1)
+    double uniform() { return (double(next_u32()) + 0.5) * (1.0 / 4294967296.0); }
+
+    double uniform(double lo, double hi) { return lo + (hi - lo) * uniform(); }
+
+    // standard normal (Box-Muller; the second value is discarded so each
+    // call consumes a fixed number of words)
+    double normal() {
+        const double u1 = uniform();
+        const double u2 = uniform();
+        return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+    }
+
+    double normal(double mean, double sigma) { return mean + sigma * normal(); }
+
+private:
+    Philox4x32::Key key_;
+    uint64_t index_;
+    uint32_t block_ = 0;
+    Philox4x32::Counter buf_ = {0, 0, 0, 0};
+    int used_ = 4;
+};
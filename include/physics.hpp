@@ -1,20 +1,79 @@
 #pragma once
 #include "particles.hpp"
+#include "pipeline.hpp"
+#include "eos.hpp"
 
-inline void update_physics(Particles& P, float dt) {
-    // simple cooling (damp velocities slightly) and update pressure from ideal gas
-    const float cooling_alpha = 0.001f; // tune: 1e-3 .. 1e-2
-    for (size_t i = 0; i < P.N; ++i) {
-        if (!P.alive[i]) continue;
+// Simple cooling (damp velocities slightly), pressure from the ideal gas
+// and gentle radiative cooling, as a fused op (pipeline.hpp).
+struct Cooling {
+    static constexpr uint32_t kReads = kFieldVel | kFieldDensity | kFieldTemperature;
+    static constexpr uint32_t kWrites = kFieldVel | kFieldPressure | kFieldTemperature;
+
+    static constexpr real_t kDamping = real_t(0.001); // tune: 1e-3 .. 1e-2
+    static constexpr real_t kRadiative = real_t(0.9995);
+
+    void operator()(ParticleState& p) const {
         // damping velocities (very simple cooling)
-        P.vx[i] *= (1.0f - cooling_alpha);
-        P.vy[i] *= (1.0f - cooling_alpha);
-        P.vz[i] *= (1.0f - cooling_alpha);
+        p.vx *= (real_t(1) - kDamping);
+        p.vy *= (real_t(1) - kDamping);
+        p.vz *= (real_t(1) - kDamping);
 
         // update pressure using ideal gas law P = rho * T
-        P.pressure[i] = P.density[i] * P.temperature[i];
+        p.pressure = p.density * p.temperature;
 
         // optional temperature change (small radiative cooling)
-        P.temperature[i] *= 0.9995f; // very gentle cooling
+        p.temperature *= kRadiative;
+    }
+};
+
+// Cooling with the tabulated EOS (eos.hpp) but no cooling curve: the same
+// velocity damping and constant radiative factor, the table's pressure.
+struct TabulatedCooling {
+    static constexpr uint32_t kReads = kFieldVel | kFieldDensity | kFieldTemperature;
+    static constexpr uint32_t kWrites = kFieldVel | kFieldPressure | kFieldTemperature;
+
+    const EosTable* eos;
+
+    void operator()(ParticleState& p) const {
+        p.vx *= (real_t(1) - Cooling::kDamping);
+        p.vy *= (real_t(1) - Cooling::kDamping);
+        p.vz *= (real_t(1) - Cooling::kDamping);
+
+        p.pressure = eos->pressure(p.density, p.temperature);
+        p.temperature *= Cooling::kRadiative;
     }
+};
+
+// Molecular cooling (cooling=molecular): the same velocity damping, the
+// table's pressure, and the table's cooling rate towards the floor
+// temperature (implicit, so it cannot overshoot).
+struct MolecularCooling {
+    static constexpr uint32_t kReads = kFieldVel | kFieldDensity | kFieldTemperature;
+    static constexpr uint32_t kWrites = kFieldVel | kFieldPressure | kFieldTemperature;
+
+    const EosTable* eos;
+    real_t dt;
+    real_t floor;
+
+    MolecularCooling(const EosTable* eos, real_t dt)
+        : eos(eos), dt(dt), floor(eos->floor_temperature()) {}
+
+    void operator()(ParticleState& p) const {
+        p.vx *= (real_t(1) - Cooling::kDamping);
+        p.vy *= (real_t(1) - Cooling::kDamping);
+        p.vz *= (real_t(1) - Cooling::kDamping);
+
+        const EosSample s = eos->lookup(p.density, p.temperature);
+        p.pressure = s.pressure;
+        const real_t excess = std::max(p.temperature - floor, real_t(0));
+        p.temperature -= excess - excess / (real_t(1) + s.cooling_rate * dt);
+    }
+};
+
+// eos: tabulated EOS and cooling, nullptr for the ideal gas and the
+// constant cooling factor
+inline void update_physics(Particles& P, real_t dt, const EosTable* eos = nullptr) {
+    if (!eos) fuse(Cooling{}).run(P);
+    else if (eos->molecular()) fuse(MolecularCooling(eos, dt)).run(P);
+    else fuse(TabulatedCooling{eos}).run(P);
 }
@@ -0,0 +1,117 @@
+// pipeline.hpp
+// Fused per-particle updates.
+//
+// The updates after the force pass (kick, drift, heating, cooling, ...)
+// each touch a handful of fields of one particle. Run one after the other
+// they sweep the arrays once each. Written as small functors and fused,
+// they share one sweep: every field an op touches is loaded once into a
+// ParticleState, the ops run in order on it, and the written fields are
+// stored once.
+//
+// An op is a copyable struct with
+//   static constexpr uint32_t kReads, kWrites;   // StepField masks
+//   void operator()(ParticleState& p) const;
+// and must only use the fields in its masks; the others are not loaded.
+// The masks of a fused update are the union of its ops', so the fused
+// stage declares its task-graph dependencies without repeating them.
+//
+// Dead particles are skipped. The loop stores `alive ? new : old` instead
+// of branching, and `omp simd` tells the compiler that the iterations (and
+// so the arrays) are independent, so GCC vectorizes the sweep at -O2 (for
+// PRECISION=double it needs SSE4.1 or later for the 64-bit masks). An op
+// keeps that only if its own body is straight-line too: clamp with blend()
+// rather than ?:, which GCC turns into a branch.
+#pragma once
+
+#include <tuple>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "particles.hpp"
+#include "taskgraph.hpp"
+
+// The fields an op can see. Only kPos, kVel, kAcc, kDensity, kPressure,
+// kTemperature and kVelGrad are loaded.
+struct ParticleState {
+    real_t x, y, z;
+    real_t vx, vy, vz;
+    real_t ax, ay, az;
+    real_t density, pressure, temperature;
+    real_t divv, curlv;
+};
+
+// live ? a : b by bit masks. A plain ?: that may store back the value just
+// loaded gets turned into a conditional store, which does not vectorize.
+inline real_t blend(bool live, real_t a, real_t b) {
+    using Bits = std::conditional_t<sizeof(real_t) == 4, uint32_t, uint64_t>;
+    Bits ua, ub;
+    std::memcpy(&ua, &a, sizeof(a));
+    std::memcpy(&ub, &b, sizeof(b));
+    const Bits mask = Bits(0) - Bits(live);
+    const Bits r = (ua & mask) | (ub & ~mask);
+    real_t out;
+    std::memcpy(&out, &r, sizeof(out));
+    return out;
+}
+
+template <class... Ops>
+class FusedUpdate {
+public:
+    static constexpr uint32_t kReads = (Ops::kReads | ... | 0u) | kFieldAlive;
+    static constexpr uint32_t kWrites = (Ops::kWrites | ... | 0u);
+    static_assert((kWrites & ~(kFieldPos | kFieldVel | kFieldDensity | kFieldPressure |
+                               kFieldTemperature)) == 0,
+                  "fused ops can only write positions, velocities and thermodynamic fields");
+
+    explicit FusedUpdate(Ops... ops) : ops_(ops...) {}
+
+    void run(Particles& P) const {
+        constexpr uint32_t touch = kReads | kWrites;
+        const long N = static_cast<long>(P.N);
+        real_t* x = P.x.data();            real_t* y = P.y.data();            real_t* z = P.z.data();
+        real_t* vx = P.vx.data();          real_t* vy = P.vy.data();          real_t* vz = P.vz.data();
+        const real_t* ax = P.ax.data();    const real_t* ay = P.ay.data();    const real_t* az = P.az.data();
+        real_t* rho = P.density.data();    real_t* pre = P.pressure.data();   real_t* T = P.temperature.data();
+        const real_t* divv = P.divv.data(); const real_t* curlv = P.curlv.data();
+        const uint8_t* alive = P.alive.data();
+
+        // a private copy of the ops: their parameters cannot alias the
+        // arrays, so they stay in registers
+        std::tuple<Ops...> ops = ops_;
+        #pragma omp parallel for simd schedule(static) firstprivate(ops)
+        for (long i = 0; i < N; ++i) {
+            ParticleState p{};
+            if constexpr (bool(touch & kFieldPos)) { p.x = x[i]; p.y = y[i]; p.z = z[i]; }
+            if constexpr (bool(touch & kFieldVel)) { p.vx = vx[i]; p.vy = vy[i]; p.vz = vz[i]; }
+            if constexpr (bool(touch & kFieldAcc)) { p.ax = ax[i]; p.ay = ay[i]; p.az = az[i]; }
+            if constexpr (bool(touch & kFieldDensity)) p.density = rho[i];
+            if constexpr (bool(touch & kFieldPressure)) p.pressure = pre[i];
+            if constexpr (bool(touch & kFieldTemperature)) p.temperature = T[i];
+            if constexpr (bool(touch & kFieldVelGrad)) { p.divv = divv[i]; p.curlv = curlv[i]; }
+
+            std::apply([&p](const Ops&... op) { (op(p), ...); }, ops);
+
+            // dead particles store back the value still in the array
+            const bool live = alive[i] != 0;
+            if constexpr (bool(kWrites & kFieldPos)) {
+                x[i] = blend(live, p.x, x[i]); y[i] = blend(live, p.y, y[i]); z[i] = blend(live, p.z, z[i]);
+            }
+            if constexpr (bool(kWrites & kFieldVel)) {
+                vx[i] = blend(live, p.vx, vx[i]); vy[i] = blend(live, p.vy, vy[i]); vz[i] = blend(live, p.vz, vz[i]);
+            }
+            if constexpr (bool(kWrites & kFieldDensity)) rho[i] = blend(live, p.density, rho[i]);
+            if constexpr (bool(kWrites & kFieldPressure)) pre[i] = blend(live, p.pressure, pre[i]);
+            if constexpr (bool(kWrites & kFieldTemperature)) T[i] = blend(live, p.temperature, T[i]);
+        }
+    }
+
+private:
+    std::tuple<Ops...> ops_;
+};
+
+// fuse(Kick{dt}, Drift{dt}, ...): the ops run in the order given
+template <class... Ops>
+FusedUpdate<Ops...> fuse(Ops... ops) {
+    return FusedUpdate<Ops...>(ops...);
+}
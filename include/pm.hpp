@@ -0,0 +1,77 @@
+// pm.hpp
+// Particle-mesh gravity, standalone or as the long-range half of TreePM.
+//
+// One solve:
+//   1. cloud-in-cell (CIC) assignment of the particle masses to a mesh,
+//   2. FFT, multiply by the Green's function, inverse FFT (fft.hpp),
+//   3. four-point finite-difference gradient of the mesh potential,
+//      CIC-interpolated back to the particles.
+//
+// Periodic boxes (period > 0) use an n^3 mesh over [0, period) and the
+// k-space Green's function -4 pi G / k^2. Open boundaries use a cube fitted
+// around the particles each step, zero-padded to (2n)^3 so the cyclic
+// convolution equals the free-space one (Hockney & Eastwood); the Green's
+// function is the FFT of the real-space kernel.
+//
+// With a split radius r_s (TreePM) the mesh only carries the long-range
+// part of the force: the Green's function is multiplied by exp(-k^2 r_s^2)
+// (open boundaries: kernel erf(r / 2 r_s) / r) and the tree adds the
+// complementary short-range part within a few r_s (bh.hpp,
+// set_short_range). In both cases the CIC window is deconvolved. Pure PM on
+// open boundaries softens the kernel over one mesh cell instead.
+//
+// Every kernel is fixed in mesh-cell units, so the Green's function is
+// built once; only the mesh spacing (open boundaries) changes per step.
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include "particles.hpp"
+#include "fft.hpp"
+
+class PMSolver {
+public:
+    // n: mesh cells per side (a power of two), period: periodic box side or
+    // 0 for open boundaries, split: TreePM split radius in mesh cells or 0
+    // for pure PM.
+    explicit PMSolver(size_t n = 32, double period = 0.0, double split = 0.0);
+
+    // Place the mesh for P (open boundaries: around the alive particles).
+    // Call before compute_accelerations and split_radius.
+    void fit(const Particles& P);
+
+    // Mesh gravity on every alive particle. Overwrites P.ax/ay/az, or adds
+    // to them when add is true (the tree's short-range part already there).
+    // If potential (size P.N) is given, the mesh potential is written (or
+    // added) there, minus the particle's own mesh self-energy.
+    void compute_accelerations(Particles& P, real_t G = real_t(1),
+                               real_t* potential = nullptr, bool add = false);
+
+    size_t grid() const { return n_; }
+    double cell() const { return h_; }
+    bool periodic() const { return period_ > 0.0; }
+    // TreePM split radius r_s in length units (0 for pure PM)
+    double split_radius() const { return split_ * h_; }
+
+private:
+    size_t n_;       // mesh cells per side covering the particles
+    size_t m_;       // FFT size: n (periodic) or 2n (zero-padded)
+    double period_;
+    double split_;   // r_s in cells
+    double h_ = 1.0; // cell size
+    double origin_[3] = {0.0, 0.0, 0.0};
+
+    Fft3D fft_;
+    std::vector<double> green_; // Green's function in cell units, k-space
+    double self_ = 0.0;         // mesh potential of a unit mass on its own node
+    std::vector<cplx> mesh_;    // mass, then potential
+
+    // particles bucketed by mesh plane (z) for race-free parallel assignment
+    std::vector<uint32_t> plane_start_, plane_items_, plane_of_, cursor_;
+
+    void build_green();
+    void assign_mass(const Particles& P);
+    size_t wrap(long i) const { return size_t(((i % long(m_)) + long(m_)) % long(m_)); }
+    inline size_t index(size_t i, size_t j, size_t k) const { return i + m_ * (j + m_ * k); }
+    inline void mesh_coords(const Particles& P, size_t p, double u[3]) const;
+};
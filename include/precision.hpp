@@ -0,0 +1,29 @@
+// precision.hpp
+// Build-wide floating point types.
+//   real_t : storage type of particle fields (bandwidth)
+//   acc_t  : type used to accumulate sums in force/density loops (accuracy)
+//
+// Select with the Makefile PRECISION variable:
+//   make                    -> float storage, double accumulators (default)
+//   make PRECISION=single   -> float storage, float accumulators
+//   make PRECISION=double   -> double everywhere (validation runs)
+//
+// Header-only types (BasicParticles, Vec3T, BarnesHutSolverT) are templates,
+// so tests can mix precisions in one binary regardless of the build setting.
+#pragma once
+
+#if defined(STARFORM_DOUBLE)
+using real_t = double;
+using acc_t = double;
+#elif defined(STARFORM_SINGLE)
+using real_t = float;
+using acc_t = float;
+#else
+using real_t = float;
+using acc_t = double;
+#endif
+
+inline const char* precision_name() {
+    if (sizeof(real_t) == sizeof(double)) return "double";
+    return sizeof(acc_t) == sizeof(double) ? "mixed" : "single";
+}
@@ -0,0 +1,66 @@
+// render.hpp
+// In-situ images of the gas (render_interval > 0).
+//
+// Every gas particle is splatted onto a size x size pixel grid with the
+// cubic spline integrated along the line of sight, giving the column
+// density Sigma(x, y) = sum_j m_j F(|r - r_j| / h) / h^2. In temperature
+// mode the image is the mass-weighted temperature along the line of sight.
+// Pixels are log-scaled and color-mapped; stars are drawn on top as white
+// discs. The view is fixed by the first rendered frame, so a series of
+// images makes a steady movie.
+//
+// The image rows are cut into bands and each thread owns whole bands: it
+// splats every particle whose footprint overlaps its band, clipped to the
+// band, so no pixel is written by two threads.
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "particles.hpp"
+#include "stars.hpp"
+
+class FrameRenderer {
+public:
+    // axis: line of sight (x, y or z); quantity: density or temperature;
+    // extent: side of the view, 0 = fit the first rendered frame
+    FrameRenderer(int size, char axis, bool temperature, double extent);
+
+    void render(const Particles& P, const SinkParticles& S, real_t h);
+
+    // PNG or PPM, by the file extension
+    bool write(const std::string& filename) const;
+
+    int size() const { return size_; }
+    // column density of every pixel (row-major, first row at the top)
+    const std::vector<double>& sigma() const { return sigma_; }
+    const std::vector<uint8_t>& rgb() const { return rgb_; }
+    // pixel side in simulation units (0 before the first frame)
+    double pixel() const { return pixel_; }
+
+    // line-of-sight integral of the 3D cubic spline at q = R / h, times h^2
+    static double projected_kernel(double q);
+
+private:
+    int size_;
+    int u_axis_, v_axis_;          // image x and y in simulation axes
+    bool temperature_;
+    double extent_;
+    double origin_[2] = {0.0, 0.0}; // simulation coordinates of pixel (0, 0)
+    double pixel_ = 0.0;
+
+    std::vector<double> sigma_, weighted_;  // sum m F, sum m T F
+    std::vector<uint8_t> rgb_;
+
+    // per-frame splat lists, reused between frames
+    std::vector<uint32_t> band_start_, band_items_, cursor_;
+    std::vector<double> norm_;
+
+    void fit_view(const Particles& P, real_t h);
+    void splat(const Particles& P, real_t h);
+    void colorize(const SinkParticles& S);
+};
+
+// 8-bit RGB images
+bool write_ppm(const std::string& filename, const uint8_t* rgb, int width, int height);
+bool write_png(const std::string& filename, const uint8_t* rgb, int width, int height);
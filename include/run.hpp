@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include "config.hpp"
+#include "particles.hpp"
+#include "stars.hpp"
+#include "verify.hpp"
+#include "audit.hpp"
+#include "eos.hpp"
+#include <vector>
+#include <functional>
+#include <memory>
+
+struct RunResult {
+    SinkParticles sinks;          // stars formed during the run
+    double runtime_ms = 0.0;      // wall time of the step loop
+    real_t star_mass_fraction = 0; // accreted gas mass / initial gas mass
+    size_t gas_particles = 0;     // alive gas particles at the end
+    size_t steps = 0;             // steps completed
+    bool aborted = false;         // stopped early: diverged or over verify_abort_l2
+    double max_energy_drift = 0;  // max |E - E0| / |E0| over diagnostics steps, NaN if periodic
+    double load_imbalance = 1.0;  // mean max/mean rank compute time (MPI runs)
+    size_t rebalances = 0;        // domain decompositions performed (MPI runs)
+    double tree_imbalance = 1.0;  // mean max/mean thread time of the tree walk
+    double starform_imbalance = 1.0; // same for the star-candidate search
+    std::vector<VerificationSample> verification; // every verify_interval steps
+    std::vector<ForceAudit> audits;               // every audit_interval steps
+};
+
+// Called with the step index at the end of every completed step (tests use
+// it to check per-step invariants such as heap allocations).
+using StepHook = std::function<void(size_t)>;
+
+// Evolve the (already initialised) particles P for cfg.num_steps steps with
+// the backends selected in cfg. Snapshots go to cfg.output_dir every
+// cfg.output_interval steps (0 disables output).
+RunResult run_simulation(Particles& P, const Config& cfg, const StepHook& on_step = {});
+
+// Initialise P from cfg (ic_input or init_type/seed, then fixed_positions).
+// Returns false if ic_input is set but cannot be read.
+bool init_from_config(Particles& P, const Config& cfg);
+
+// Tabulated EOS and cooling for cfg.eos / cfg.cooling, or nullptr for the
+// ideal gas with constant cooling (warns about unknown values).
+std::unique_ptr<EosTable> make_eos_table(const Config& cfg);
+
+#ifdef STARFORM_USE_MPI
+#include "domain.hpp"
+
+// Distributed step loop: P holds this rank's particles. Gas dynamics only
+// (gravity via the locally essential tree, SPH with a 2h halo); star
+// formation is not distributed yet.
+RunResult run_simulation_mpi(Particles& P, const Config& cfg, DomainDecomposition& dd);
+
+// Whole distributed run for main(): each rank generates its share of the
+// initial conditions, runs, and rank 0 prints the summary. Returns the
+// process exit code.
+int run_distributed(const Config& cfg);
+#endif
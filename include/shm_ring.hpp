@@ -0,0 +1,126 @@
+// shm_ring.hpp
+// Live snapshots in a POSIX shared-memory ring (shm_name = ...).
+//
+// The simulation publishes every shm_interval-th step into one slot of a
+// ring in /dev/shm/<name>, overwriting the oldest slot. A viewer on the
+// same machine maps the segment read-only and picks up the newest slot;
+// nothing touches the disk and the writer never waits for readers.
+//
+// Layout (little endian, every block 64-byte aligned):
+//   RingHeader                                  64 bytes
+//   slot 0 .. slots-1, slot_bytes each:
+//     SlotHeader                                64 bytes
+//     x y z vx vy vz temperature density pressure
+//                                              float32[capacity] each
+//     id                                        uint64[capacity]
+//     star x y z mass                           float32[kRingStars] each
+// A slot holds the alive gas particles (rows of them) and the first
+// kRingStars stars.
+//
+// Each slot carries a sequence counter (a seqlock): it is odd while the
+// slot is being written and advances by 2 per write. A reader copies the
+// slot and accepts the copy only if the counter was even and unchanged
+// around it; otherwise it retries or moves on to the newest slot.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "particles.hpp"
+#include "stars.hpp"
+
+constexpr char kRingMagic[8] = {'S', 'F', 'R', 'I', 'N', 'G', '1', '\0'};
+constexpr uint32_t kRingColumns = 9;       // float32 gas columns, in layout order
+constexpr uint32_t kRingStars = 1024;      // star rows per slot
+
+struct RingHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t slots;
+    uint64_t capacity;                     // gas rows per slot
+    uint64_t slot_bytes;
+    std::atomic<uint64_t> published;       // snapshots written; the newest is slot (published - 1) % slots
+    uint8_t pad[24];
+};
+
+struct SlotHeader {
+    std::atomic<uint64_t> sequence;        // odd while the slot is written
+    uint64_t step;
+    double time;
+    uint64_t rows;                         // gas rows in this snapshot
+    uint64_t stars;                        // star rows (at most kRingStars)
+    uint64_t total_stars;                  // stars in the run
+    uint8_t pad[16];
+};
+
+static_assert(sizeof(RingHeader) == 64 && sizeof(SlotHeader) == 64,
+              "ring headers are one cache line");
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "the sequence counters must be usable across processes");
+
+// A snapshot as read back from the ring
+struct RingSnapshot {
+    uint64_t step = 0;
+    double time = 0.0;
+    uint64_t total_stars = 0;
+    std::vector<float> columns[kRingColumns];  // x y z vx vy vz temperature density pressure
+    std::vector<uint64_t> id;
+    std::vector<float> star_x, star_y, star_z, star_mass;
+
+    size_t rows() const { return id.size(); }
+};
+
+// Writer side: creates (or replaces) the segment, removes it when destroyed.
+class SnapshotRing {
+public:
+    SnapshotRing(const std::string& name, size_t capacity, uint32_t slots);
+    ~SnapshotRing();
+
+    SnapshotRing(const SnapshotRing&) = delete;
+    SnapshotRing& operator=(const SnapshotRing&) = delete;
+
+    bool ok() const { return base_ != nullptr; }
+    size_t capacity() const { return capacity_; }
+
+    // Write the alive particles and the stars into the next slot. Particles
+    // past the capacity are left out (returns false if any were).
+    bool publish(const Particles& P, const SinkParticles& S, uint64_t step, double time);
+
+    // bytes of a segment with these dimensions
+    static size_t segment_bytes(size_t capacity, uint32_t slots);
+
+private:
+    std::string name_;
+    size_t capacity_;
+    uint32_t slots_;
+    size_t bytes_ = 0;
+    uint8_t* base_ = nullptr;
+    std::vector<uint32_t> rows_; // alive indices, reused between publishes
+};
+
+// Reader side: maps an existing segment read-only.
+class SnapshotRingReader {
+public:
+    explicit SnapshotRingReader(const std::string& name);
+    ~SnapshotRingReader();
+
+    SnapshotRingReader(const SnapshotRingReader&) = delete;
+    SnapshotRingReader& operator=(const SnapshotRingReader&) = delete;
+
+    bool ok() const { return base_ != nullptr; }
+
+    // snapshots published so far (0 = none yet)
+    uint64_t published() const;
+
+    // Copy the newest consistent snapshot into out. Returns false if there
+    // is none yet or the writer kept overwriting it for `attempts` tries.
+    bool read_latest(RingSnapshot& out, int attempts = 100) const;
+
+private:
+    size_t bytes_ = 0;
+    const uint8_t* base_ = nullptr;
+
+    bool read_slot(uint32_t slot, RingSnapshot& out) const;
+};
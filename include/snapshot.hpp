@@ -0,0 +1,33 @@
+// snapshot.hpp
+// Binary structure-of-arrays snapshots.
+//
+// Layout (native little-endian): a SnapshotHeader, then N float32 values
+// for each of mass, x, y, z, vx, vy, vz, temperature in turn, then N
+// uint64 particle IDs. Only alive gas particles are stored.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "particles.hpp"
+
+struct SnapshotHeader {
+    char magic[8];        // "SFSNAP1"
+    uint32_t version;
+    uint32_t num_fields;  // float32 blocks before the ID block
+    uint64_t N;
+    uint64_t seed;        // generator seed, 0 if not generated
+    double time;
+};
+
+bool write_snapshot(const Particles& P, const std::string& filename, double time = 0.0);
+
+// Replace P with the contents of a snapshot. Returns false (and warns) if
+// the file is missing or malformed.
+bool read_snapshot(const std::string& filename, Particles& P, double* time = nullptr);
+
+// Generate N particles of the given init type straight into a snapshot,
+// chunk particles at a time, without holding the whole set in memory.
+// Chunks are generated in parallel; the particle data is identical to
+// init_particles(P, version_type, seed) followed by write_snapshot.
+bool stream_initial_conditions(const std::string& filename, int version_type,
+                               size_t N, uint64_t seed, size_t chunk = size_t(1) << 20);
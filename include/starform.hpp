@@ -4,27 +4,91 @@
 #include "particles.hpp"
 #include "vec3.hpp"
 #include "stars.hpp"
+#include "neighbors.hpp"
+#include "balance.hpp"
+#include "arena.hpp"
+
+// Particle indices of one cluster, held in the step's scratch arena.
+struct MemberList {
+    const int* first = nullptr;
+    size_t count = 0;
+
+    const int* begin() const { return first; }
+    const int* end() const { return first + count; }
+    size_t size() const { return count; }
+    int front() const { return first[0]; }
+};
+
+// A friends-of-friends group of star-forming gas particles.
+struct StarCluster {
+    real_t mass;
+    Vec3 com;              // centre of mass
+    Vec3 velocity;         // centre-of-mass velocity
+    MemberList members;    // valid until the scratch arena is reset
+};
 
 class StarFormation {
 public:
-    float neighbor_radius;
+    real_t neighbor_radius;
     size_t min_neighbors;
-    float min_density;
+    real_t min_density;
+    real_t accretion_radius; // gas inside this distance of a star is accreted
+
+    StarFormation(real_t R = 0.5f, size_t k = 8, real_t rho = 5.0f, real_t r_acc = 0.0f)
+        : neighbor_radius(R), min_neighbors(k), min_density(rho),
+          accretion_radius(r_acc > 0 ? r_acc : R) {}
 
-    StarFormation(float R = 0.5f, size_t k = 8, float rho = 5.0f)
-        : neighbor_radius(R), min_neighbors(k), min_density(rho) {}
+    // Gas particles with at least min_neighbors neighbours and local mass
+    // density >= min_density inside neighbor_radius. O(N k) via a cell list,
+    // visited in cell order and balanced on last call's per-particle cost.
+    // Per-particle temporaries come from the step's scratch arena; the
+    // returned list is reused by the next call.
+    const std::vector<int>& detect_star_candidates(const Particles& P, ScratchArena& scratch) const;
 
-    std::vector<int> detect_star_candidates(const Particles& P) const;
+    // Candidates grouped friends-of-friends with linking length
+    // neighbor_radius (parallel union-find over the same cell list).
+    std::vector<StarCluster> detect_star_clusters(const Particles& P, ScratchArena& scratch) const;
+
+    // The two halves of detect_star_clusters: group membership (reads
+    // positions and masses only) and the members' mass, centre of mass and
+    // velocity. The step graph runs them at different points of the step.
+    // find_star_groups refills clusters, so a kept vector stops allocating.
+    void find_star_groups(const Particles& P, ScratchArena& scratch,
+                          std::vector<StarCluster>& clusters) const;
+    void measure_clusters(const Particles& P, std::vector<StarCluster>& clusters) const;
+
+    // max / mean thread busy time of the last candidate search
+    double load_imbalance() const { return loop_.imbalance(); }
+
+    // the last candidate search met a non-finite position and found nothing
+    bool diverged() const { return diverged_; }
 
 private:
-    int count_neighbors(const Particles& P, int idx) const;
-    float compute_local_density(const Particles& P, int idx) const;
+    mutable NeighborGrid grid_; // rebuilt per call, kept to reuse its buffers
+    mutable std::vector<uint32_t> visits_; // cell-list candidates per particle, last call
+    mutable std::vector<uint32_t> cost_;   // visits_ in cell order
+    mutable std::vector<int> candidates_;  // last call's candidates
+    std::vector<size_t> order_;            // form_stars' cluster order
+    mutable BalancedLoop loop_;
+    mutable bool diverged_ = false;
+
+    // returns the number of cell-list candidates visited
+    uint32_t neighbor_stats(const Particles& P, int idx, int& count, real_t& rho) const;
 
 public:
-    // convert gas particles to stars (keeps them in the array)
+    // Turn each cluster into one star holding all of its mass, biggest
+    // cluster first. A cluster whose centre of mass is closer than
+    // accretion_radius to an existing star is left for accretion instead.
+    // Converted gas particles are marked dead (and is_star) in P.
     void form_stars(
         Particles& P,
-        const std::vector<int>& to_convert,
-        float current_time
+        SinkParticles& sinks,
+        const std::vector<StarCluster>& clusters,
+        real_t current_time
     );
+
+    // Each alive gas particle within accretion_radius of a star is absorbed
+    // by the nearest one (mass, momentum and centre of mass conserved) and
+    // removed from the gas. Returns the number of particles accreted.
+    size_t accrete(Particles& P, SinkParticles& sinks, ScratchArena& scratch) const;
 };
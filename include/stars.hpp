@@ -1,13 +1,64 @@
 // stars.hpp
 #pragma once
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iomanip>
+#include <cstdint>
+#include <cmath>
 #include "vec3.hpp"
 
 struct Star {
-    float mass;
+    real_t mass;
     Vec3 position;
     Vec3 velocity;
-    float formation_time;
+    real_t formation_time;
+    uint64_t id;          // ID of the gas particle that seeded the star
 
-    Star(float m, const Vec3& pos, const Vec3& vel, float t)
-        : mass(m), position(pos), velocity(vel), formation_time(t) {}
+    Star(real_t m, const Vec3& pos, const Vec3& vel, real_t t, uint64_t id_ = 0)
+        : mass(m), position(pos), velocity(vel), formation_time(t), id(id_) {}
+};
+
+// Sink particles, kept out of the gas arrays so SPH loops never see them.
+// Stars interact with gas only through gravity and accretion.
+struct SinkParticles {
+    std::vector<Star> stars;
+    std::vector<Vec3> acc; // gravitational acceleration of each star
+
+    size_t size() const { return stars.size(); }
+
+    void add(const Star& s) {
+        stars.push_back(s);
+        acc.push_back(Vec3{});
+    }
+
+    // map star positions back into a periodic box [0, period)^3
+    void wrap_periodic(double period) {
+        if (period <= 0.0) return;
+        const real_t L = real_t(period);
+        for (Star& s : stars) {
+            s.position.x -= L * std::floor(s.position.x / L);
+            s.position.y -= L * std::floor(s.position.y / L);
+            s.position.z -= L * std::floor(s.position.z / L);
+        }
+    }
+
+    real_t total_mass() const {
+        real_t m = 0;
+        for (const Star& s : stars) m += s.mass;
+        return m;
+    }
+
+    // append stars to a particle snapshot as rows with is_star = 1
+    void append_csv(const std::string& filename) const {
+        std::ofstream file(filename, std::ios::app);
+        if (!file.is_open()) return;
+        file << std::fixed << std::setprecision(5);
+        for (const Star& s : stars) {
+            file << s.position.x << "," << s.position.y << "," << s.position.z << ","
+                 << s.velocity.x << "," << s.velocity.y << "," << s.velocity.z << ","
+                 << 0.0 << "," << 0.0 << "," << 0.0 << ","
+                 << 1 << "," << s.id << "\n";
+        }
+    }
 };
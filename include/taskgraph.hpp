@@ -0,0 +1,187 @@
+// taskgraph.hpp
+// Dependency-aware scheduler for the stages of one step.
+//
+// Each stage declares the Particles fields (and other shared state) it
+// reads and writes as bit masks. Stages are added in program order; a stage
+// must run after every earlier stage it conflicts with (read-after-write,
+// write-after-read, write-after-write), and is otherwise free. The graph is
+// levelled once: every stage goes to the first level after all of its
+// conflicting predecessors, so each level holds mutually independent
+// stages (e.g. gravity and SPH density, which both only read positions).
+//
+// run() executes the levels in order. A level with several stages splits
+// the thread pool between them in proportion to their last measured run
+// times and runs them in a nested parallel region, so each stage's own
+// parallel loops get a share of the cores instead of running one after
+// the other. Stages that run concurrently must not use the same
+// ScratchArena.
+//
+// An observer (set_observer) is called around every stage, e.g. to read
+// performance counters per stage.
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include "parallel.hpp"
+
+// State a stage can touch. Particle arrays plus the non-particle state the
+// step shares between stages.
+enum StepField : uint32_t {
+    kFieldPos         = 1u << 0,  // x, y, z (and fixed-point qx, qy, qz)
+    kFieldVel         = 1u << 1,
+    kFieldAcc         = 1u << 2,
+    kFieldMass        = 1u << 3,
+    kFieldDensity     = 1u << 4,
+    kFieldPressure    = 1u << 5,
+    kFieldTemperature = 1u << 6,
+    kFieldAlive       = 1u << 7,  // alive, is_star
+    kFieldPotential   = 1u << 8,  // per-particle potential (diagnostics)
+    kFieldSinks       = 1u << 9,  // stars and their accelerations
+    kFieldClusters    = 1u << 10, // star-forming groups found this step
+    kFieldLog         = 1u << 11, // stdout and the CSV logs
+    kFieldVelGrad     = 1u << 12, // divv, curlv
+};
+
+class StepGraph {
+public:
+    void add(std::string name, uint32_t reads, uint32_t writes, std::function<void()> run) {
+        Stage s{std::move(name), reads, writes, std::move(run), 0, 0.0};
+        for (const Stage& prev : stages_) {
+            const bool conflict = (prev.writes & (s.reads | s.writes)) || (prev.reads & s.writes);
+            if (conflict) s.level = std::max(s.level, prev.level + 1);
+        }
+        stages_.push_back(std::move(s));
+        levels_.clear();
+    }
+
+    // Run every stage once, respecting the declared dependencies. With
+    // concurrent = false the stages run one after the other in the order
+    // they were added (the plain sequential step).
+    void run(bool concurrent = true) {
+        if (!concurrent) {
+            for (size_t s = 0; s < stages_.size(); ++s) timed(s);
+            return;
+        }
+        if (levels_.empty()) plan();
+        const int T = par_max_threads();
+        for (const std::vector<size_t>& level : levels_) {
+            const int k = static_cast<int>(level.size());
+            if (k == 1 || T < 2) {
+                for (size_t s : level) timed(s);
+                continue;
+            }
+            split_threads(level, T);
+            #pragma omp parallel num_threads(std::min(k, T))
+            {
+                // with fewer threads than stages, thread u runs every
+                // stage u, u + n, ... in turn
+                const int n = par_num_threads();
+                for (int u = par_thread_id(); u < k; u += n) {
+                    par_set_num_threads(share_[u]);
+                    timed(level[u]);
+                }
+            }
+        }
+    }
+
+    // Called before (done = false) and after (done = true) each stage with
+    // its index in add order. Concurrent stages call it from their own
+    // threads.
+    void set_observer(std::function<void(size_t stage, bool done)> observer) {
+        observer_ = std::move(observer);
+    }
+
+    size_t size() const { return stages_.size(); }
+    const std::string& name(size_t s) const { return stages_[s].name; }
+
+    // stages per level (for reports)
+    std::string describe() const {
+        std::vector<std::vector<size_t>> levels = levels_;
+        if (levels.empty()) levels = group();
+        std::string out;
+        for (size_t l = 0; l < levels.size(); ++l) {
+            out += (l ? " -> " : "");
+            if (levels[l].size() > 1) out += "{";
+            for (size_t u = 0; u < levels[l].size(); ++u) {
+                out += (u ? " | " : "") + stages_[levels[l][u]].name;
+            }
+            if (levels[l].size() > 1) out += "}";
+        }
+        return out;
+    }
+
+private:
+    struct Stage {
+        std::string name;
+        uint32_t reads, writes;
+        std::function<void()> fn;
+        int level;
+        double seconds; // last run time, sets the thread share
+    };
+
+    std::vector<Stage> stages_;
+    std::vector<std::vector<size_t>> levels_;
+    std::vector<int> share_;
+    std::function<void(size_t, bool)> observer_;
+
+    std::vector<std::vector<size_t>> group() const {
+        std::vector<std::vector<size_t>> levels;
+        for (size_t s = 0; s < stages_.size(); ++s) {
+            const size_t l = size_t(stages_[s].level);
+            if (levels.size() <= l) levels.resize(l + 1);
+            levels[l].push_back(s);
+        }
+        return levels;
+    }
+
+    void plan() {
+        levels_ = group();
+        size_t widest = 1;
+        for (const auto& level : levels_) widest = std::max(widest, level.size());
+        share_.assign(widest, 1);
+        // concurrent stages open a nested team below the current level
+        par_set_max_active_levels(std::max(par_max_active_levels(), par_active_level() + 2));
+    }
+
+    void timed(size_t index) {
+        Stage& s = stages_[index];
+        if (observer_) observer_(index, false);
+        const double t0 = par_wtime();
+        s.fn();
+        s.seconds = par_wtime() - t0;
+        if (observer_) observer_(index, true);
+    }
+
+    // threads per stage of a level, proportional to last run time (equal
+    // until every stage has been timed), at least one each
+    void split_threads(const std::vector<size_t>& level, int T) {
+        const int k = static_cast<int>(level.size());
+        double total = 0;
+        bool timed_all = true;
+        for (size_t s : level) {
+            total += stages_[s].seconds;
+            timed_all = timed_all && stages_[s].seconds > 0;
+        }
+        int given = 0;
+        for (int u = 0; u < k; ++u) {
+            const double w = timed_all ? stages_[level[u]].seconds / total : 1.0 / k;
+            share_[u] = std::max(1, static_cast<int>(w * T));
+            given += share_[u];
+        }
+        // hand the rounding remainder to (or take the excess from) the
+        // largest shares
+        auto largest = [&] {
+            return int(std::max_element(share_.begin(), share_.begin() + k) - share_.begin());
+        };
+        while (given < T) { share_[largest()]++; given++; }
+        while (given > T) {
+            const int u = largest();
+            if (share_[u] == 1) break;
+            share_[u]--;
+            given--;
+        }
+    }
+};
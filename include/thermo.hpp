@@ -1,22 +1,18 @@
 #pragma once
 #include "particles.hpp"
+#include "pipeline.hpp"
 
-void update_thermodynamics(Particles& P, float dt) {
+// Compressional heating of an ideal gas, dT/dt = -(gamma - 1) T div v, with
+// div v from the density pass (compute_density_sph)
+inline void update_thermodynamics(Particles& P, real_t dt) {
     size_t N = P.N;
-    float gamma = 5.0f / 3.0f;
-
-    // Need velocity divergence (cheap finite difference)
-    std::vector<float> divv(N, 0.0f);
-
-    for (size_t i = 0; i < N; ++i) {
-        divv[i] = P.vx[i] + P.vy[i] + P.vz[i]; // simple stand-in placeholder
-    }
+    real_t gamma = real_t(5.0 / 3.0);
 
     // Update temperature
     for (size_t i = 0; i < N; ++i) {
-        float T = P.temperature[i];
-        P.temperature[i] = T - (gamma - 1.0f) * T * divv[i] * dt;
-        if (P.temperature[i] < 0.0f) P.temperature[i] = 0.0f;
+        real_t T = P.temperature[i];
+        P.temperature[i] = T - (gamma - real_t(1)) * T * P.divv[i] * dt;
+        if (P.temperature[i] < real_t(0)) P.temperature[i] = real_t(0);
     }
 
     // Update pressure using ideal gas
@@ -25,25 +21,23 @@ void update_thermodynamics(Particles& P, float dt) {
     }
 }
 
-void update_thermodynamics_cached(Particles& P, float dt) {
-    size_t N = P.N;
-    const float gamma = 5.0f / 3.0f;
-    const float coef = (gamma - 1.0f) * dt;
-
-    for (size_t i = 0; i < N; ++i) {
-        // Cache velocity in a Vec3 (assuming you have P.velocity(i))
-        float divv = P.vx[i] + P.vy[i] + P.vz[i];
+// Compressional heating of an ideal gas and its pressure, as a fused op
+// (pipeline.hpp).
+struct CompressionalHeating {
+    static constexpr uint32_t kReads = kFieldVelGrad | kFieldDensity | kFieldTemperature;
+    static constexpr uint32_t kWrites = kFieldTemperature | kFieldPressure;
 
-        // Cache temperature and density
-        float T = P.temperature[i];
-        float rho = P.density[i];
+    real_t coef; // (gamma - 1) dt
 
-        // Update temperature
-        float T_new = T - coef * T * divv;
-        if (T_new < 0.0f) T_new = 0.0f;
-        P.temperature[i] = T_new;
+    explicit CompressionalHeating(real_t dt) : coef((real_t(5.0 / 3.0) - real_t(1)) * dt) {}
 
-        // Update pressure
-        P.pressure[i] = rho * T_new;
+    void operator()(ParticleState& p) const {
+        const real_t T_new = p.temperature - coef * p.temperature * p.divv;
+        p.temperature = blend(!(T_new < real_t(0)), T_new, real_t(0)); // clamp at 0
+        p.pressure = p.density * p.temperature;
     }
+};
+
+inline void update_thermodynamics_cached(Particles& P, real_t dt) {
+    fuse(CompressionalHeating(dt)).run(P);
 }
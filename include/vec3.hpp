@@ -1,39 +1,48 @@
-#include <cmath> 
+#include <cmath>
 
 #pragma once
 
-struct Vec3 {
-    float x, y, z;
+#include "precision.hpp"
 
-    Vec3() : x(0), y(0), z(0) {}
-    Vec3(float x_, float y_, float z_) : x(x_), y(y_), z(z_) {}
+template <typename T>
+struct Vec3T {
+    T x, y, z;
 
-    Vec3& operator+=(const Vec3& other) {
+    Vec3T() : x(0), y(0), z(0) {}
+    Vec3T(T x_, T y_, T z_) : x(x_), y(y_), z(z_) {}
+
+    // convert between precisions (e.g. float storage -> double accumulator)
+    template <typename U>
+    explicit Vec3T(const Vec3T<U>& o) : x(T(o.x)), y(T(o.y)), z(T(o.z)) {}
+
+    Vec3T& operator+=(const Vec3T& other) {
         x += other.x; y += other.y; z += other.z;
         return *this;
     }
 
-    Vec3& operator-=(const Vec3& other) {
+    Vec3T& operator-=(const Vec3T& other) {
         x -= other.x; y -= other.y; z -= other.z;
         return *this;
     }
 
         // Multiply Vec3 by scalar
-    Vec3 operator*(float s) const {
-        return Vec3{x * s, y * s, z * s};
+    Vec3T operator*(T s) const {
+        return Vec3T{x * s, y * s, z * s};
     }
 
     // Add this operator
-    Vec3 operator/(float s) const {
-        return Vec3(x/s, y/s, z/s);
+    Vec3T operator/(T s) const {
+        return Vec3T(x/s, y/s, z/s);
     }
 
-    Vec3 operator-(const Vec3& v) const {
-    return Vec3(x - v.x, y - v.y, z - v.z);
+    Vec3T operator-(const Vec3T& v) const {
+    return Vec3T(x - v.x, y - v.y, z - v.z);
     }
 
 
-    float length2() const {
+    T length2() const {
         return x*x + y*y + z*z;
     }
 };
+
+using Vec3 = Vec3T<real_t>;
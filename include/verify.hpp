@@ -1,5 +1,6 @@
 #pragma once
 #include <vector>
+#include <limits>
 #include<iostream>
 #include "particles.hpp"
 
@@ -8,10 +9,22 @@ bool load_reference_csv(const std::string& filename,
                         std::vector<float>& density);
 
 
+// Mass-weighted centre of the alive particles (parallel reduction).
+Vec3 center_of_mass(const Particles& P);
+
+// Shell densities in `bins` radial bins out to max_r around center
+// (default: the centre of mass). Parallel, with per-thread bins. Particles
+// at a non-finite radius are left out and counted in *non_finite.
 std::vector<float> compute_radial_profile(const Particles& P,
                                           int bins,
                                           float max_r);
 
+std::vector<float> compute_radial_profile(const Particles& P,
+                                          int bins,
+                                          float max_r,
+                                          const Vec3& center,
+                                          size_t* non_finite = nullptr);
+
 
 
 
@@ -25,4 +38,47 @@ struct ErrorMetrics {
 };
 
 ErrorMetrics compute_error_metrics(const std::vector<float>& sim,
-                                   const std::vector<float>& ref);
\ No newline at end of file
+                                   const std::vector<float>& ref);
+
+// Radial profile errors of P against reference_csv without printing;
+// returns false if the reference cannot be read.
+bool compute_verification_metrics(const Particles& P,
+                                  const std::string& reference_csv,
+                                  ErrorMetrics& E,
+                                  int* bins_out = nullptr);
+
+// A reference profile loaded once and compared against repeatedly, for
+// in-line verification during a run.
+struct ReferenceProfile {
+    std::vector<float> radius;
+    std::vector<float> density;
+
+    bool load(const std::string& filename) {
+        radius.clear();
+        density.clear();
+        return load_reference_csv(filename, radius, density) && !radius.empty();
+    }
+
+    // A diverged run (non-finite positions) has an infinite error, so
+    // verify_abort_l2 stops it.
+    ErrorMetrics compare(const Particles& P) const {
+        size_t non_finite = 0;
+        const std::vector<float> profile = compute_radial_profile(
+            P, int(radius.size()), radius.back(), center_of_mass(P), &non_finite);
+        if (non_finite > 0) {
+            const float inf = std::numeric_limits<float>::infinity();
+            return {inf, inf, inf};
+        }
+        return compute_error_metrics(profile, density);
+    }
+};
+
+// One in-line verification result.
+struct VerificationSample {
+    size_t step;
+    double time;
+    ErrorMetrics error;
+};
+
+bool write_verification_series(const std::vector<VerificationSample>& series,
+                               const std::string& filename);
@@ -0,0 +1,51 @@
+#include "../include/async_output.hpp"
+#include "../include/parallel.hpp"
+
+
+AsyncFrameWriter::AsyncFrameWriter() : worker_([this] { loop(); }) {}
+
+AsyncFrameWriter::~AsyncFrameWriter() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return !pending_; });
+        stop_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+}
+
+void AsyncFrameWriter::submit(const Particles& P, const SinkParticles& S, Job job) {
+    const double t0 = par_wtime();
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !pending_; });
+    stall_ += par_wtime() - t0;
+
+    // vector assignment reuses the buffers' capacity
+    P_ = P;
+    S_ = S;
+    job_ = std::move(job);
+    pending_ = true;
+    lock.unlock();
+    cv_.notify_all();
+}
+
+void AsyncFrameWriter::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !pending_; });
+}
+
+void AsyncFrameWriter::loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        cv_.wait(lock, [this] { return pending_ || stop_; });
+        if (!pending_) return; // stop requested and nothing left to write
+
+        // the step loop waits for !pending_ before touching the buffers,
+        // so the job can read them without the lock
+        lock.unlock();
+        job_(P_, S_);
+        lock.lock();
+        pending_ = false;
+        cv_.notify_all();
+    }
+}
@@ -0,0 +1,80 @@
+#include "../include/audit.hpp"
+#include "../include/philox.hpp"
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+ForceAudit audit_forces(const Particles& P,
+                        const real_t* ax, const real_t* ay, const real_t* az,
+                        size_t samples, uint64_t seed, size_t step,
+                        real_t G, real_t softening)
+{
+    ForceAudit result;
+    result.step = step;
+
+    std::vector<uint32_t> alive;
+    alive.reserve(P.N);
+    for (size_t i = 0; i < P.N; ++i)
+        if (P.alive[i]) alive.push_back(static_cast<uint32_t>(i));
+    const size_t n = std::min(samples, alive.size());
+    if (n == 0) return result;
+
+    // partial Fisher-Yates: the first n entries become the sample
+    CounterRng rng(seed, step);
+    for (size_t k = 0; k < n; ++k) {
+        const size_t pick = k + static_cast<size_t>(rng.uniform() * double(alive.size() - k));
+        std::swap(alive[k], alive[std::min(pick, alive.size() - 1)]);
+    }
+
+    const double soft2 = double(softening) * softening;
+    const long N = static_cast<long>(P.N);
+    std::vector<double> err(n);
+
+    #pragma omp parallel for schedule(dynamic, 4)
+    for (long s = 0; s < static_cast<long>(n); ++s) {
+        const uint32_t i = alive[s];
+        const double xi = P.x[i], yi = P.y[i], zi = P.z[i];
+        double ex = 0, ey = 0, ez = 0;
+        for (long j = 0; j < N; ++j) {
+            if (!P.alive[j] || j == long(i)) continue;
+            const double dx = P.x[j] - xi;
+            const double dy = P.y[j] - yi;
+            const double dz = P.z[j] - zi;
+            const double r2 = dx*dx + dy*dy + dz*dz + soft2;
+            const double f = double(G) * P.mass[j] / (r2 * std::sqrt(r2));
+            ex += f * dx;
+            ey += f * dy;
+            ez += f * dz;
+        }
+        const double dax = ax[i] - ex, day = ay[i] - ey, daz = az[i] - ez;
+        const double norm = std::sqrt(ex*ex + ey*ey + ez*ez);
+        err[s] = norm > 0 ? std::sqrt(dax*dax + day*day + daz*daz) / norm : 0.0;
+    }
+
+    double sum2 = 0;
+    for (double e : err) sum2 += e * e;
+    std::sort(err.begin(), err.end());
+
+    result.samples = n;
+    result.rms = std::sqrt(sum2 / double(n));
+    result.p99 = err[std::min(n - 1, static_cast<size_t>(std::ceil(0.99 * double(n))) - 1)];
+    result.max = err.back();
+    return result;
+}
+
+
+bool ForceAuditLog::open(const std::string& filename) {
+    out_.open(filename);
+    if (!out_.is_open()) {
+        std::cerr << "ERROR: Could not open file for writing: " << filename << "\n";
+        return false;
+    }
+    out_ << "step,solver,samples,rms,p99,max\n";
+    return true;
+}
+
+void ForceAuditLog::write(const ForceAudit& a, const std::string& solver) {
+    if (!out_.is_open()) return;
+    out_ << a.step << "," << solver << "," << a.samples << ","
+         << a.rms << "," << a.p99 << "," << a.max << "\n";
+}
@@ -0,0 +1,450 @@
+#include "../include/codec.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <filesystem>
+#include <utility>
+#include <limits>
+
+namespace {
+
+constexpr char kMagic[8] = "SFFRAME";
+constexpr uint32_t kVersion = 1;
+
+constexpr int kProbBits = 12;
+constexpr uint32_t kProbScale = 1u << kProbBits;
+constexpr uint32_t kRansL = 1u << 23; // lower bound of the normalized state
+
+enum PlaneMode : uint8_t { kPlaneZero = 0, kPlaneConstant = 1, kPlaneRaw = 2, kPlaneRans = 3 };
+
+void put_varint(std::vector<uint8_t>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(uint8_t(v) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(uint8_t(v));
+}
+
+bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end) return false;
+        const uint8_t b = *p++;
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+inline uint64_t zigzag(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+inline int64_t unzigzag(uint64_t u) { return int64_t(u >> 1) ^ -int64_t(u & 1); }
+
+// quantize onto the step grid; non-finite values are stored as 0
+inline int64_t quantize(double v, double step) {
+    if (!std::isfinite(v)) return 0;
+    const double q = std::clamp(v / step, -4.0e18, 4.0e18);
+    return std::llround(q);
+}
+
+// scale symbol counts to frequencies summing to kProbScale, keeping every
+// present symbol at least 1
+void normalize_freqs(const uint32_t count[256], size_t total, uint32_t freq[256]) {
+    uint32_t sum = 0;
+    for (int s = 0; s < 256; ++s) {
+        freq[s] = count[s] ? std::max<uint32_t>(1, uint32_t(uint64_t(count[s]) * kProbScale / total)) : 0;
+        sum += freq[s];
+    }
+    while (sum != kProbScale) {
+        const int best = int(std::max_element(freq, freq + 256) - freq);
+        if (sum < kProbScale) {
+            freq[best] += kProbScale - sum;
+            sum = kProbScale;
+        } else {
+            const uint32_t take = std::min(sum - kProbScale, freq[best] - 1);
+            freq[best] -= take;
+            sum -= take;
+        }
+    }
+}
+
+// smallest of zero / constant / raw / rANS for one byte plane
+void encode_plane(const uint8_t* plane, size_t n, std::vector<uint8_t>& out,
+                  std::vector<uint8_t>& tmp) {
+    if (std::all_of(plane, plane + n, [&](uint8_t b) { return b == plane[0]; })) {
+        if (plane[0] == 0) {
+            out.push_back(kPlaneZero);
+        } else {
+            out.push_back(kPlaneConstant);
+            out.push_back(plane[0]);
+        }
+        return;
+    }
+    tmp.clear();
+    rans_encode(plane, n, tmp);
+    if (tmp.size() < n) {
+        out.push_back(kPlaneRans);
+        out.insert(out.end(), tmp.begin(), tmp.end());
+    } else {
+        out.push_back(kPlaneRaw);
+        out.insert(out.end(), plane, plane + n);
+    }
+}
+
+bool decode_plane(const uint8_t*& p, const uint8_t* end, uint8_t* plane, size_t n) {
+    if (p == end) return false;
+    switch (*p++) {
+    case kPlaneZero:
+        std::fill(plane, plane + n, uint8_t(0));
+        return true;
+    case kPlaneConstant:
+        if (p == end) return false;
+        std::fill(plane, plane + n, *p++);
+        return true;
+    case kPlaneRaw:
+        if (size_t(end - p) < n) return false;
+        std::memcpy(plane, p, n);
+        p += n;
+        return true;
+    case kPlaneRans:
+        return rans_decode(p, end, plane, n);
+    default:
+        return false;
+    }
+}
+
+// width byte, then the byte planes of the zigzagged residuals
+void encode_column(const std::vector<uint64_t>& zz, std::vector<uint8_t>& out,
+                   std::vector<uint8_t>& plane, std::vector<uint8_t>& tmp) {
+    const size_t n = zz.size();
+    uint64_t all = 0;
+    for (uint64_t v : zz) all |= v;
+    uint8_t width = 0;
+    while (width < 8 && (all >> (8 * width))) ++width;
+    out.push_back(width);
+    plane.resize(n);
+    for (int b = 0; b < width; ++b) {
+        for (size_t i = 0; i < n; ++i) plane[i] = uint8_t(zz[i] >> (8 * b));
+        encode_plane(plane.data(), n, out, tmp);
+    }
+}
+
+bool decode_column(const uint8_t*& p, const uint8_t* end, size_t n, std::vector<uint64_t>& zz,
+                   std::vector<uint8_t>& plane) {
+    if (p == end) return false;
+    const uint8_t width = *p++;
+    if (width > 8) return false;
+    zz.assign(n, 0);
+    plane.resize(n);
+    for (int b = 0; b < width; ++b) {
+        if (!decode_plane(p, end, plane.data(), n)) return false;
+        for (size_t i = 0; i < n; ++i) zz[i] |= uint64_t(plane[i]) << (8 * b);
+    }
+    return true;
+}
+
+} // namespace
+
+
+void rans_encode(const uint8_t* in, size_t n, std::vector<uint8_t>& out) {
+    uint32_t count[256] = {0};
+    for (size_t i = 0; i < n; ++i) count[in[i]]++;
+    uint32_t freq[256], cum[257];
+    normalize_freqs(count, std::max<size_t>(n, 1), freq);
+    cum[0] = 0;
+    for (int s = 0; s < 256; ++s) cum[s + 1] = cum[s] + freq[s];
+
+    // frequency table: symbol count, then (symbol, frequency) pairs
+    put_varint(out, uint64_t(std::count_if(freq, freq + 256, [](uint32_t f) { return f > 0; })));
+    for (int s = 0; s < 256; ++s) {
+        if (!freq[s]) continue;
+        out.push_back(uint8_t(s));
+        put_varint(out, freq[s]);
+    }
+
+    // rANS codes last symbol first; the stream is built backwards
+    std::vector<uint8_t> rev;
+    rev.reserve(n + 4);
+    uint32_t x = kRansL;
+    for (size_t i = n; i-- > 0;) {
+        const uint32_t f = freq[in[i]];
+        const uint32_t x_max = ((kRansL >> kProbBits) << 8) * f;
+        while (x >= x_max) {
+            rev.push_back(uint8_t(x));
+            x >>= 8;
+        }
+        x = ((x / f) << kProbBits) + (x % f) + cum[in[i]];
+    }
+    for (int b = 0; b < 4; ++b) {
+        rev.push_back(uint8_t(x));
+        x >>= 8;
+    }
+    put_varint(out, rev.size());
+    out.insert(out.end(), rev.rbegin(), rev.rend());
+}
+
+bool rans_decode(const uint8_t*& p, const uint8_t* end, uint8_t* out, size_t n) {
+    uint64_t used;
+    if (!get_varint(p, end, used) || used == 0 || used > 256) return false;
+    uint32_t freq[256] = {0}, cum[256] = {0};
+    uint32_t total = 0;
+    for (uint64_t u = 0; u < used; ++u) {
+        uint64_t f;
+        if (p == end) return false;
+        const uint8_t s = *p++;
+        if (!get_varint(p, end, f) || f == 0 || f > kProbScale) return false;
+        freq[s] = uint32_t(f);
+        total += uint32_t(f);
+    }
+    if (total != kProbScale) return false;
+    uint8_t symbol[kProbScale];
+    for (uint32_t s = 0, c = 0; s < 256; ++s) {
+        cum[s] = c;
+        for (uint32_t k = 0; k < freq[s]; ++k) symbol[c++] = uint8_t(s);
+    }
+
+    uint64_t len;
+    if (!get_varint(p, end, len) || len < 4 || uint64_t(end - p) < len) return false;
+    const uint8_t* s = p;
+    const uint8_t* s_end = p + len;
+    uint32_t x = uint32_t(s[0]) << 24 | uint32_t(s[1]) << 16 | uint32_t(s[2]) << 8 | uint32_t(s[3]);
+    s += 4;
+    for (size_t i = 0; i < n; ++i) {
+        const uint32_t slot = x & (kProbScale - 1);
+        const uint8_t sym = symbol[slot];
+        out[i] = sym;
+        x = freq[sym] * (x >> kProbBits) + slot - cum[sym];
+        while (x < kRansL) {
+            if (s == s_end) return false;
+            x = (x << 8) | *s++;
+        }
+    }
+    p = s_end;
+    return true;
+}
+
+
+bool FrameTable::write_csv(const std::string& filename) const {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Could not open file for writing: " << filename << "\n";
+        return false;
+    }
+    file << "x,y,z,vx,vy,vz,temperature,density,pressure,is_star,id\n";
+    file << std::fixed << std::setprecision(5);
+    for (size_t r = 0; r < rows(); ++r) {
+        for (int c = 0; c < kColumns; ++c) file << col[c][r] << ",";
+        file << int(is_star[r]) << "," << id[r] << "\n";
+    }
+    return bool(file);
+}
+
+
+void FramePredictor::match(const std::vector<uint64_t>& keys, bool keyframe) {
+    prev_row_.assign(keys.size(), -1);
+    if (keyframe) {
+        keys_.clear();
+        return;
+    }
+    index_.resize(keys_.size());
+    for (size_t j = 0; j < keys_.size(); ++j) index_[j] = {keys_[j], int64_t(j)};
+    if (!std::is_sorted(index_.begin(), index_.end())) std::sort(index_.begin(), index_.end());
+    for (size_t r = 0; r < keys.size(); ++r) {
+        auto it = std::lower_bound(index_.begin(), index_.end(), std::make_pair(keys[r], int64_t(-1)));
+        if (it != index_.end() && it->first == keys[r]) prev_row_[r] = it->second;
+    }
+}
+
+double FramePredictor::predict(size_t r, int c, double time) const {
+    const int64_t j = prev_row_[r];
+    if (j < 0) return 0.0;
+    const double dt = time - time_;
+    // positions: x + v dt + a dt^2 / 2, with a from the last velocity change
+    if (c < 3) return value_[c][j] + (value_[c + 3][j] + 0.5 * rate_[c + 3][j] * dt) * dt;
+    return value_[c][j] + rate_[c][j] * dt;
+}
+
+void FramePredictor::advance(std::vector<uint64_t>& keys, std::vector<double>* values, double time) {
+    const double dt = time - time_;
+    for (int c = 0; c < FrameTable::kColumns; ++c) {
+        rate_[c].resize(keys.size());
+        for (size_t r = 0; r < keys.size(); ++r) {
+            const int64_t j = prev_row_[r];
+            rate_[c][r] = (j >= 0 && dt > 0.0) ? (values[c][r] - value_[c][j]) / dt : 0.0;
+        }
+        value_[c].swap(values[c]);
+    }
+    keys_.swap(keys);
+    time_ = time;
+}
+
+
+FrameEncoder::FrameEncoder(double tolerance, int keyframe_interval)
+    : tolerance_(tolerance), keyframe_interval_(keyframe_interval) {}
+
+bool FrameEncoder::write(const std::string& filename, const Particles& P,
+                         const SinkParticles& S, double time) {
+    // rows: alive gas in index order, then stars
+    keys_.clear();
+    for (auto& v : value_) v.clear();
+    for (size_t i = 0; i < P.N; ++i) {
+        if (!P.alive[i]) continue;
+        keys_.push_back(2 * P.id[i]);
+        const real_t v[FrameTable::kColumns] = {P.x[i], P.y[i], P.z[i], P.vx[i], P.vy[i], P.vz[i],
+                                                P.temperature[i], P.density[i], P.pressure[i]};
+        for (int c = 0; c < FrameTable::kColumns; ++c) value_[c].push_back(double(v[c]));
+    }
+    for (const Star& s : S.stars) {
+        keys_.push_back(2 * s.id + 1);
+        const real_t v[FrameTable::kColumns] = {s.position.x, s.position.y, s.position.z,
+                                                s.velocity.x, s.velocity.y, s.velocity.z, 0, 0, 0};
+        for (int c = 0; c < FrameTable::kColumns; ++c) value_[c].push_back(double(v[c]));
+    }
+    const size_t n = keys_.size();
+    const bool keyframe = sequence_ == 0 || keyframe_interval_ <= 1 ||
+                          sequence_ % uint64_t(keyframe_interval_) == 0;
+
+    FrameHeader h;
+    std::memcpy(h.magic, kMagic, sizeof(h.magic));
+    h.version = kVersion;
+    h.keyframe = keyframe ? 1 : 0;
+    h.sequence = sequence_;
+    h.rows = n;
+    h.time = time;
+    for (int c = 0; c < FrameTable::kColumns; ++c) {
+        double largest = 0.0;
+        for (double v : value_[c]) {
+            if (std::isfinite(v)) largest = std::max(largest, std::abs(v));
+        }
+        h.step[c] = std::max(2.0 * tolerance_, largest * double(std::numeric_limits<real_t>::epsilon()));
+    }
+    out_.assign(reinterpret_cast<const uint8_t*>(&h), reinterpret_cast<const uint8_t*>(&h) + sizeof(h));
+
+    zz_.resize(n);
+    for (size_t r = 0; r < n; ++r) zz_[r] = zigzag(int64_t(keys_[r] - (r ? keys_[r - 1] : 0)));
+    encode_column(zz_, out_, plane_, tmp_);
+
+    // residuals against the prediction; the values become what the
+    // decoder will see, so the next prediction matches on both sides
+    predictor_.match(keys_, keyframe);
+    for (int c = 0; c < FrameTable::kColumns; ++c) {
+        const double step = h.step[c];
+        for (size_t r = 0; r < n; ++r) {
+            const int64_t q = quantize(value_[c][r], step);
+            zz_[r] = zigzag(q - quantize(predictor_.predict(r, c, time), step));
+            value_[c][r] = double(q) * step;
+        }
+        encode_column(zz_, out_, plane_, tmp_);
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Could not open file for writing: " << filename << "\n";
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(out_.data()), std::streamsize(out_.size()));
+
+    predictor_.advance(keys_, value_, time);
+    sequence_++;
+    bytes_ += out_.size();
+    rows_ += n;
+    return bool(file);
+}
+
+
+bool FrameDecoder::read(const std::string& filename, FrameTable& frame) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Could not open frame: " << filename << "\n";
+        return false;
+    }
+    data_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    FrameHeader h;
+    if (data_.size() < sizeof(h)) {
+        std::cerr << "ERROR: Truncated frame: " << filename << "\n";
+        return false;
+    }
+    std::memcpy(&h, data_.data(), sizeof(h));
+    if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 || h.version != kVersion) {
+        std::cerr << "ERROR: Not a version " << kVersion << " compressed frame: " << filename << "\n";
+        return false;
+    }
+    if (!h.keyframe && (!have_prev_ || h.sequence != prev_sequence_ + 1)) {
+        std::cerr << "ERROR: " << filename << " is a delta frame; decode the frames in order "
+                     "starting from a keyframe\n";
+        return false;
+    }
+
+    const size_t n = size_t(h.rows);
+    const uint8_t* p = data_.data() + sizeof(h);
+    const uint8_t* end = data_.data() + data_.size();
+    auto malformed = [&] {
+        std::cerr << "ERROR: Corrupt frame: " << filename << "\n";
+        have_prev_ = false;
+        return false;
+    };
+
+    if (!decode_column(p, end, n, zz_, plane_)) return malformed();
+    keys_.resize(n);
+    for (size_t r = 0; r < n; ++r) keys_[r] = (r ? keys_[r - 1] : 0) + uint64_t(unzigzag(zz_[r]));
+
+    frame.time = h.time;
+    frame.id.resize(n);
+    frame.is_star.resize(n);
+    for (size_t r = 0; r < n; ++r) {
+        frame.id[r] = keys_[r] >> 1;
+        frame.is_star[r] = uint8_t(keys_[r] & 1);
+    }
+    predictor_.match(keys_, h.keyframe != 0);
+    for (int c = 0; c < FrameTable::kColumns; ++c) {
+        const double step = h.step[c];
+        if (!(step > 0.0) || !decode_column(p, end, n, zz_, plane_)) return malformed();
+        frame.col[c].resize(n);
+        for (size_t r = 0; r < n; ++r) {
+            const int64_t q = unzigzag(zz_[r]) + quantize(predictor_.predict(r, c, h.time), step);
+            frame.col[c][r] = double(q) * step;
+        }
+    }
+
+    // the predictor keeps its own copy of the values
+    std::vector<double> values[FrameTable::kColumns];
+    for (int c = 0; c < FrameTable::kColumns; ++c) values[c] = frame.col[c];
+    predictor_.advance(keys_, values, h.time);
+    prev_sequence_ = h.sequence;
+    have_prev_ = true;
+    return true;
+}
+
+
+bool decompress_frames(const std::string& dir) {
+    namespace fs = std::filesystem;
+    std::vector<std::pair<long long, fs::path>> frames;
+    std::error_code ec;
+    for (const fs::directory_entry& e : fs::directory_iterator(dir, ec)) {
+        const std::string name = e.path().filename().string();
+        if (name.rfind("frame_", 0) != 0 || e.path().extension() != ".sfz") continue;
+        try {
+            frames.emplace_back(std::stoll(name.substr(6)), e.path());
+        } catch (...) {
+            continue;
+        }
+    }
+    if (ec) {
+        std::cerr << "ERROR: Could not read directory: " << dir << "\n";
+        return false;
+    }
+    std::sort(frames.begin(), frames.end());
+
+    FrameDecoder decoder;
+    FrameTable frame;
+    for (const auto& f : frames) {
+        fs::path csv = f.second;
+        csv.replace_extension(".csv");
+        if (!decoder.read(f.second.string(), frame) || !frame.write_csv(csv.string())) return false;
+    }
+    std::cout << "Decompressed " << frames.size() << " frames in " << dir << "\n";
+    return true;
+}
@@ -8,76 +8,186 @@
 #endif
 
 
-// void compute_density_kNN(Particles& P, int k) {
-//     size_t N = P.N;
-//     if (N == 0 || k <= 0) return;
-
-//     P.density.assign(N, 0.0f);
-
-//     // For each particle, compute distances to all others
-//     for (size_t i = 0; i < N; i++) {
-//         std::vector<float> dists;
-//         dists.reserve(N-1);
-
-//         for (size_t j = 0; j < N; j++) {
-//             if (i == j) continue;
+// cubic spline kernel W(r, h) for 3D
+// returns W (not derivative)
+static inline real_t cubic_spline_W(real_t r, real_t h) {
+    const real_t q = r / h;
+    const real_t inv_h3 = real_t(1) / (h*h*h);
+    const real_t sigma = real_t(1.0 / M_PI) * inv_h3; // normalization for 3D
+    if (q < real_t(0)) return real_t(0);
+    if (q < real_t(1)) {
+        return sigma * (real_t(1) - real_t(1.5)*q*q + real_t(0.75)*q*q*q);
+    } else if (q < real_t(2)) {
+        real_t t = real_t(2) - q;
+        return sigma * (real_t(0.25) * t*t*t);
+    } else {
+        return real_t(0);
+    }
+}
 
-//             float dx = P.x[j] - P.x[i];
-//             float dy = P.y[j] - P.y[i];
-//             float dz = P.z[j] - P.z[i];
-//             float dist2 = dx*dx + dy*dy + dz*dz;
+// cubic spline kernel derivative dW/dr for 3D (as in hydro.cpp)
+static inline real_t cubic_spline_dWdr(real_t r, real_t h) {
+    const real_t q = r / h;
+    const real_t inv_h4 = real_t(1) / (h*h*h*h);
+    const real_t sigma = real_t(1.0 / M_PI) * inv_h4;
+    if (r <= real_t(0)) return real_t(0);
+    if (q < real_t(1)) {
+        return sigma * (real_t(-3) * q + real_t(2.25) * q * q);
+    } else if (q < real_t(2)) {
+        real_t t = real_t(2) - q;
+        return sigma * (real_t(-0.75) * t * t);
+    } else {
+        return real_t(0);
+    }
+}
 
-//             dists.push_back(std::sqrt(dist2));
-//         }
+// Velocity gradient A = dv_a/dx_b from the pair sums of the density loop:
+//   G_ab = sum_j w_j (v_j - v_i)_a d_b,   M_cb = sum_j w_j d_c d_b,
+// with d = x_j - x_i and w_j = -m_j W'(r) / r. For a linear velocity field
+// G = A M, so A = G M^-1 is exact whatever the neighbour distribution
+// (M is the kernel-gradient correction). Where M is close to singular
+// (too few or coplanar neighbours) the uncorrected estimate A = G / (tr M / 3)
+// is used; for an even distribution M ~ rho I and both agree.
+static void velocity_gradient(const double G[3][3], const double M[6], real_t& divv,
+                              real_t& curlv) {
+    // M = [[m0 m1 m2] [m1 m3 m4] [m2 m4 m5]]
+    const double tr = M[0] + M[3] + M[5];
+    if (!(tr > 0.0)) { divv = curlv = real_t(0); return; }
+    double inv[3][3];
+    const double c00 = M[3] * M[5] - M[4] * M[4];
+    const double c01 = M[2] * M[4] - M[1] * M[5];
+    const double c02 = M[1] * M[4] - M[2] * M[3];
+    const double det = M[0] * c00 + M[1] * c01 + M[2] * c02;
+    const double s = tr / 3.0;
+    if (det > 1e-3 * s * s * s) {
+        const double id = 1.0 / det;
+        inv[0][0] = c00 * id;
+        inv[0][1] = inv[1][0] = c01 * id;
+        inv[0][2] = inv[2][0] = c02 * id;
+        inv[1][1] = (M[0] * M[5] - M[2] * M[2]) * id;
+        inv[1][2] = inv[2][1] = (M[1] * M[2] - M[0] * M[4]) * id;
+        inv[2][2] = (M[0] * M[3] - M[1] * M[1]) * id;
+    } else {
+        for (int a = 0; a < 3; ++a)
+            for (int b = 0; b < 3; ++b) inv[a][b] = a == b ? 1.0 / s : 0.0;
+    }
+    double A[3][3];
+    for (int a = 0; a < 3; ++a)
+        for (int b = 0; b < 3; ++b)
+            A[a][b] = G[a][0] * inv[0][b] + G[a][1] * inv[1][b] + G[a][2] * inv[2][b];
+    const double wx = A[2][1] - A[1][2];
+    const double wy = A[0][2] - A[2][0];
+    const double wz = A[1][0] - A[0][1];
+    divv = real_t(A[0][0] + A[1][1] + A[2][2]);
+    curlv = real_t(std::sqrt(wx * wx + wy * wy + wz * wz));
+}
 
-//         // Find the k-th neighbor distance
-//         std::nth_element(dists.begin(), dists.begin()+k, dists.end());
-//         float r_k = dists[k];
+template <class Sep>
+static void density_sph_impl(Particles& P, const Sep& sep, real_t h) {
+    const long N = static_cast<long>(P.N);
+    const real_t support = real_t(2) * h;
 
-//         // Estimate density: rho ≈ k / (4/3 π r_k³)
-//         float volume = (4.0f / 3.0f) * M_PI * r_k * r_k * r_k;
-//         P.density[i] = k / volume;
-//     }
-// }
+    // O(N^2), each density summed in acc_t. The pairs inside the kernel
+    // support also feed the velocity gradient, so divv and curlv come with
+    // the same sweep.
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < N; ++i) {
+        acc_t rho_i = 0;
+        acc_t G[3][3] = {}, M[6] = {};
+        // include self-contribution (commonly included)
+        for (long j = 0; j < N; ++j) {
+            real_t dx, dy, dz;
+            sep(i, j, dx, dy, dz);
+            real_t r = std::sqrt(dx*dx + dy*dy + dz*dz);
+            real_t w = cubic_spline_W(r, h);
+            rho_i += acc_t(P.mass[j] * w);
 
+            // the gradient only sees live neighbours
+            if (r > real_t(0) && r < support && P.alive[j]) {
+                const real_t wj = -P.mass[j] * cubic_spline_dWdr(r, h) / r;
+                const real_t d[3] = {dx, dy, dz};
+                const real_t dv[3] = {P.vx[j] - P.vx[i], P.vy[j] - P.vy[i], P.vz[j] - P.vz[i]};
+                for (int a = 0; a < 3; ++a)
+                    for (int b = 0; b < 3; ++b) G[a][b] += acc_t(wj * dv[a] * d[b]);
+                M[0] += acc_t(wj * dx * dx); M[1] += acc_t(wj * dx * dy); M[2] += acc_t(wj * dx * dz);
+                M[3] += acc_t(wj * dy * dy); M[4] += acc_t(wj * dy * dz); M[5] += acc_t(wj * dz * dz);
+            }
+        }
+        P.density[i] = real_t(rho_i);
 
-// cubic spline kernel W(r, h) for 3D
-// returns W (not derivative)
-static inline float cubic_spline_W(float r, float h) {
-    const float q = r / h;
-    const float inv_h3 = 1.0f / (h*h*h);
-    const float sigma = 1.0f / (M_PI) * inv_h3; // normalization for 3D
-    if (q < 0.0f) return 0.0f;
-    if (q < 1.0f) {
-        return sigma * (1.0f - 1.5f*q*q + 0.75f*q*q*q);
-    } else if (q < 2.0f) {
-        float t = 2.0f - q;
-        return sigma * (0.25f * t*t*t);
-    } else {
-        return 0.0f;
+        double Gd[3][3], Md[6];
+        for (int a = 0; a < 3; ++a)
+            for (int b = 0; b < 3; ++b) Gd[a][b] = double(G[a][b]);
+        for (int k = 0; k < 6; ++k) Md[k] = double(M[k]);
+        velocity_gradient(Gd, Md, P.divv[i], P.curlv[i]);
     }
 }
 
-void compute_density_sph(Particles& P, float h) {
-    size_t N = P.N;
-    if (N == 0) return;
-    if (P.density.size() != N) P.density.assign(N, 0.0f);
+void compute_density_sph(Particles& P, real_t h) {
+    if (P.N == 0) return;
+    if (P.density.size() != P.N) P.density.assign(P.N, real_t(0));
+    if (P.divv.size() != P.N) P.divv.assign(P.N, real_t(0));
+    if (P.curlv.size() != P.N) P.curlv.assign(P.N, real_t(0));
+    with_separation(P, [&](const auto& sep) { density_sph_impl(P, sep, h); });
+}
 
-    // zero densities
-    for (size_t i = 0; i < N; ++i) P.density[i] = 0.0f;
+template <class Sep>
+static void density_knn_impl(Particles& P, const KdTree& tree, const Sep& sep, size_t k) {
+    const std::vector<uint32_t>& order = tree.items();
+    const long n = static_cast<long>(order.size());
 
-    // O(N^2)
-    for (size_t i = 0; i < N; ++i) {
-        float rho_i = 0.0f;
-        // include self-contribution (commonly included)
-        for (size_t j = 0; j < N; ++j) {
-            float dx = P.x[i] - P.x[j];
-            float dy = P.y[i] - P.y[j];
-            float dz = P.z[i] - P.z[j];
-            float r = std::sqrt(dx*dx + dy*dy + dz*dz);
-            float w = cubic_spline_W(r, h);
-            rho_i += P.mass[j] * w;
+    // queries in tree order: consecutive particles share most of their walk
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (long s = 0; s < n; ++s) {
+        const uint32_t i = order[s];
+        KdTree::Neighbor nb[kMaxNeighbors];
+        const size_t found = tree.nearest(P.x[i], P.y[i], P.z[i], k, nb);
+
+        // the k-th neighbour sits at the edge of the support, r = 2 h
+        real_t r2max = 0;
+        for (size_t m = 0; m < found; ++m) r2max = std::max(r2max, nb[m].d2);
+        if (!(r2max > real_t(0))) continue; // all neighbours coincide
+        const real_t h = real_t(0.5) * std::sqrt(r2max);
+
+        acc_t rho_i = 0;
+        acc_t G[3][3] = {}, M[6] = {};
+        for (size_t m = 0; m < found; ++m) {
+            const uint32_t j = nb[m].index;
+            real_t dx, dy, dz;
+            sep(i, j, dx, dy, dz);
+            const real_t r = std::sqrt(dx*dx + dy*dy + dz*dz);
+            rho_i += acc_t(P.mass[j] * cubic_spline_W(r, h));
+            if (r > real_t(0)) {
+                const real_t wj = -P.mass[j] * cubic_spline_dWdr(r, h) / r;
+                const real_t d[3] = {dx, dy, dz};
+                const real_t dv[3] = {P.vx[j] - P.vx[i], P.vy[j] - P.vy[i], P.vz[j] - P.vz[i]};
+                for (int a = 0; a < 3; ++a)
+                    for (int b = 0; b < 3; ++b) G[a][b] += acc_t(wj * dv[a] * d[b]);
+                M[0] += acc_t(wj * dx * dx); M[1] += acc_t(wj * dx * dy); M[2] += acc_t(wj * dx * dz);
+                M[3] += acc_t(wj * dy * dy); M[4] += acc_t(wj * dy * dz); M[5] += acc_t(wj * dz * dz);
+            }
         }
-        P.density[i] = rho_i;
+        P.density[i] = real_t(rho_i);
+
+        double Gd[3][3], Md[6];
+        for (int a = 0; a < 3; ++a)
+            for (int b = 0; b < 3; ++b) Gd[a][b] = double(G[a][b]);
+        for (int c = 0; c < 6; ++c) Md[c] = double(M[c]);
+        velocity_gradient(Gd, Md, P.divv[i], P.curlv[i]);
     }
 }
+
+void compute_density_kNN(Particles& P, KdTree& tree, int k) {
+    if (P.N == 0 || k <= 0) return;
+    if (P.density.size() != P.N) P.density.assign(P.N, real_t(0));
+    if (P.divv.size() != P.N) P.divv.assign(P.N, real_t(0));
+    if (P.curlv.size() != P.N) P.curlv.assign(P.N, real_t(0));
+    tree.build(P);
+    const size_t kk = std::min(size_t(k), kMaxNeighbors);
+    with_separation(P, [&](const auto& sep) { density_knn_impl(P, tree, sep, kk); });
+}
+
+void compute_density_kNN(Particles& P, int k) {
+    KdTree tree;
+    compute_density_kNN(P, tree, k);
+}
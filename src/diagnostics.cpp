@@ -0,0 +1,105 @@
+#include "../include/diagnostics.hpp"
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+
+Diagnostics compute_diagnostics(const Particles& P,
+                                const SinkParticles& S,
+                                const std::vector<real_t>& phi,
+                                real_t G,
+                                real_t softening)
+{
+    const real_t gamma = real_t(5.0 / 3.0); // as in update_thermodynamics
+    const double soft2 = double(softening) * softening;
+    const long N = static_cast<long>(P.N);
+    const long NS = static_cast<long>(S.size());
+
+    double ke = 0, th = 0, pot = 0;
+    double px = 0, py = 0, pz = 0, lx = 0, ly = 0, lz = 0;
+
+    // gas: the self-potential counts each pair twice, hence the 1/2
+    #pragma omp parallel for reduction(+:ke,th,pot,px,py,pz,lx,ly,lz) schedule(static)
+    for (long i = 0; i < N; ++i) {
+        if (!P.alive[i]) continue;
+        const double m = P.mass[i];
+        const double x = P.x[i], y = P.y[i], z = P.z[i];
+        const double vx = P.vx[i], vy = P.vy[i], vz = P.vz[i];
+        ke += 0.5 * m * (vx*vx + vy*vy + vz*vz);
+        th += m * P.temperature[i] / (gamma - 1);
+        pot += 0.5 * m * phi[i];
+        px += m * vx; py += m * vy; pz += m * vz;
+        lx += m * (y * vz - z * vy);
+        ly += m * (z * vx - x * vz);
+        lz += m * (x * vy - y * vx);
+
+        // gas-star pairs, counted once (from the gas side)
+        for (long s = 0; s < NS; ++s) {
+            const Star& st = S.stars[s];
+            const double dx = st.position.x - x;
+            const double dy = st.position.y - y;
+            const double dz = st.position.z - z;
+            pot -= double(G) * m * st.mass / std::sqrt(dx*dx + dy*dy + dz*dz + soft2);
+        }
+    }
+
+    for (long s = 0; s < NS; ++s) {
+        const Star& st = S.stars[s];
+        const double m = st.mass;
+        const Vec3T<double> r(st.position);
+        const Vec3T<double> v(st.velocity);
+        ke += 0.5 * m * v.length2();
+        px += m * v.x; py += m * v.y; pz += m * v.z;
+        lx += m * (r.y * v.z - r.z * v.y);
+        ly += m * (r.z * v.x - r.x * v.z);
+        lz += m * (r.x * v.y - r.y * v.x);
+        for (long t = s + 1; t < NS; ++t) {
+            const Vec3T<double> d = Vec3T<double>(S.stars[t].position) - r;
+            pot -= double(G) * m * S.stars[t].mass / std::sqrt(d.length2() + soft2);
+        }
+    }
+
+    Diagnostics d;
+    d.kinetic = ke;
+    d.thermal = th;
+    d.potential = pot;
+    d.momentum = Vec3T<double>(px, py, pz);
+    d.angular_momentum = Vec3T<double>(lx, ly, lz);
+    return d;
+}
+
+
+bool DiagnosticsLog::open(const std::string& filename, bool energy_drift) {
+    energy_drift_ = energy_drift;
+    out_.open(filename);
+    if (!out_.is_open()) {
+        std::cerr << "ERROR: Could not open file for writing: " << filename << "\n";
+        return false;
+    }
+    out_ << "step,time,kinetic,thermal,potential,total,energy_drift,"
+            "px,py,pz,Lx,Ly,Lz\n";
+    out_ << std::setprecision(10);
+    return true;
+}
+
+void DiagnosticsLog::write(const Diagnostics& d) {
+    if (!have_reference_) {
+        e0_ = d.total();
+        have_reference_ = true;
+    }
+    const double drift = e0_ != 0.0 ? (d.total() - e0_) / std::abs(e0_) : 0.0;
+    max_drift_ = std::max(max_drift_, std::abs(drift));
+
+    if (!out_.is_open()) return;
+    out_ << d.step << "," << d.time << "," << d.kinetic << "," << d.thermal << ","
+         << d.potential << "," << d.total() << ",";
+    if (energy_drift_) out_ << drift;
+    out_ << ","
+         << d.momentum.x << "," << d.momentum.y << "," << d.momentum.z << ","
+         << d.angular_momentum.x << "," << d.angular_momentum.y << ","
+         << d.angular_momentum.z << "\n";
+}
+
+double DiagnosticsLog::max_energy_drift() const {
+    return energy_drift_ ? max_drift_ : std::numeric_limits<double>::quiet_NaN();
+}
@@ -0,0 +1,280 @@
+#include "../include/domain.hpp"
+
+#ifdef STARFORM_USE_MPI
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+constexpr int kKeyBits = 21;                    // Morton bits per axis
+constexpr int kSplitBits = 18;                  // key prefix used to cut ranges
+constexpr size_t kBuckets = size_t(1) << kSplitBits;
+
+// everything a particle carries when it changes owner or is sent as halo
+struct ParticleRecord {
+    double x, y, z, vx, vy, vz;
+    double mass, temperature, density, pressure, cost;
+    uint64_t id;
+};
+
+// a point mass of the locally essential tree
+struct GhostMass {
+    double x, y, z, m;
+};
+
+uint64_t spread_bits(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+    v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2)  & 0x1249249249249249ULL;
+    return v;
+}
+
+// MPI_Alltoallv of POD records; send[r] goes to rank r. The result is
+// ordered by source rank; recv_counts (if given) gets the per-source counts.
+template <class T>
+std::vector<T> alltoall_records(MPI_Comm comm, const std::vector<std::vector<T>>& send,
+                                std::vector<int>* recv_counts = nullptr) {
+    const int size = static_cast<int>(send.size());
+    std::vector<int> scount(size), rcount(size), sdisp(size), rdisp(size);
+    for (int r = 0; r < size; ++r) scount[r] = static_cast<int>(send[r].size() * sizeof(T));
+    MPI_Alltoall(scount.data(), 1, MPI_INT, rcount.data(), 1, MPI_INT, comm);
+
+    size_t stotal = 0, rtotal = 0;
+    for (int r = 0; r < size; ++r) {
+        sdisp[r] = static_cast<int>(stotal);
+        rdisp[r] = static_cast<int>(rtotal);
+        stotal += scount[r];
+        rtotal += rcount[r];
+    }
+
+    std::vector<T> sbuf;
+    sbuf.reserve(stotal / sizeof(T));
+    for (const auto& v : send) sbuf.insert(sbuf.end(), v.begin(), v.end());
+    std::vector<T> rbuf(rtotal / sizeof(T));
+
+    MPI_Alltoallv(sbuf.data(), scount.data(), sdisp.data(), MPI_BYTE,
+                  rbuf.data(), rcount.data(), rdisp.data(), MPI_BYTE, comm);
+
+    if (recv_counts) {
+        recv_counts->resize(size);
+        for (int r = 0; r < size; ++r) (*recv_counts)[r] = rcount[r] / int(sizeof(T));
+    }
+    return rbuf;
+}
+
+ParticleRecord pack(const Particles& P, size_t i, real_t cost) {
+    return ParticleRecord{P.x[i], P.y[i], P.z[i], P.vx[i], P.vy[i], P.vz[i],
+                          P.mass[i], P.temperature[i], P.density[i], P.pressure[i],
+                          cost, P.id[i]};
+}
+
+void unpack(Particles& P, size_t i, const ParticleRecord& r) {
+    P.x[i] = real_t(r.x);   P.y[i] = real_t(r.y);   P.z[i] = real_t(r.z);
+    P.vx[i] = real_t(r.vx); P.vy[i] = real_t(r.vy); P.vz[i] = real_t(r.vz);
+    P.ax[i] = P.ay[i] = P.az[i] = real_t(0);
+    P.mass[i] = real_t(r.mass);
+    P.temperature[i] = real_t(r.temperature);
+    P.density[i] = real_t(r.density);
+    P.pressure[i] = real_t(r.pressure);
+    P.is_star[i] = 0;
+    P.alive[i] = 1;
+    P.id[i] = r.id;
+}
+
+// squared distance from a point to an axis-aligned box (0 inside)
+double box_dist2(const double* box, double x, double y, double z) {
+    const double p[3] = {x, y, z};
+    double d2 = 0;
+    for (int a = 0; a < 3; ++a) {
+        const double e = std::max(std::max(box[a] - p[a], p[a] - box[3 + a]), 0.0);
+        d2 += e * e;
+    }
+    return d2;
+}
+
+bool box_empty(const double* box) { return box[0] > box[3]; }
+
+} // namespace
+
+
+DomainDecomposition::DomainDecomposition(MPI_Comm comm) : comm_(comm) {
+    MPI_Comm_rank(comm_, &rank_);
+    MPI_Comm_size(comm_, &size_);
+    boxes_.assign(6 * size_, 0.0);
+    halo_send_.resize(size_);
+    halo_recv_counts_.assign(size_, 0);
+}
+
+uint64_t DomainDecomposition::key_of(double x, double y, double z) const {
+    const double scale = cube_inv_ * double(1 << kKeyBits);
+    const int64_t hi = (int64_t(1) << kKeyBits) - 1;
+    const uint64_t ix = uint64_t(std::clamp(int64_t((x - cube_lo_[0]) * scale), int64_t(0), hi));
+    const uint64_t iy = uint64_t(std::clamp(int64_t((y - cube_lo_[1]) * scale), int64_t(0), hi));
+    const uint64_t iz = uint64_t(std::clamp(int64_t((z - cube_lo_[2]) * scale), int64_t(0), hi));
+    return spread_bits(ix) | (spread_bits(iy) << 1) | (spread_bits(iz) << 2);
+}
+
+void DomainDecomposition::decompose(Particles& P, std::vector<real_t>& cost) {
+    cost.resize(P.N, real_t(1));
+
+    // global bounding cube
+    double lo[3], hi[3];
+    for (int a = 0; a < 3; ++a) {
+        lo[a] = std::numeric_limits<double>::max();
+        hi[a] = std::numeric_limits<double>::lowest();
+    }
+    for (size_t i = 0; i < P.N; ++i) {
+        if (!P.alive[i]) continue;
+        const double p[3] = {double(P.x[i]), double(P.y[i]), double(P.z[i])};
+        for (int a = 0; a < 3; ++a) {
+            lo[a] = std::min(lo[a], p[a]);
+            hi[a] = std::max(hi[a], p[a]);
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, lo, 3, MPI_DOUBLE, MPI_MIN, comm_);
+    MPI_Allreduce(MPI_IN_PLACE, hi, 3, MPI_DOUBLE, MPI_MAX, comm_);
+    if (lo[0] > hi[0]) for (int a = 0; a < 3; ++a) { lo[a] = 0.0; hi[a] = 1.0; }
+    double side = 0;
+    for (int a = 0; a < 3; ++a) side = std::max(side, hi[a] - lo[a]);
+    side = side * (1.0 + 1e-9) + 1e-30;
+    for (int a = 0; a < 3; ++a) cube_lo_[a] = lo[a];
+    cube_inv_ = 1.0 / side;
+
+    // cost histogram over the key prefix, summed over all ranks
+    const long N = static_cast<long>(P.N);
+    std::vector<uint32_t> bucket(P.N);
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < N; ++i) {
+        if (P.alive[i])
+            bucket[i] = uint32_t(key_of(P.x[i], P.y[i], P.z[i]) >> (3 * kKeyBits - kSplitBits));
+    }
+    std::vector<double> hist(kBuckets, 0.0);
+    for (long i = 0; i < N; ++i)
+        if (P.alive[i]) hist[bucket[i]] += cost[i];
+    MPI_Allreduce(MPI_IN_PLACE, hist.data(), int(kBuckets), MPI_DOUBLE, MPI_SUM, comm_);
+
+    // cut the key line into equal-cost ranges: a bucket belongs to the rank
+    // whose share contains the bucket's cost midpoint
+    double total = 0;
+    for (double c : hist) total += c;
+    std::vector<int> owner(kBuckets);
+    double running = 0;
+    for (size_t b = 0; b < kBuckets; ++b) {
+        const double mid = total > 0 ? (running + 0.5 * hist[b]) / total : 0.0;
+        owner[b] = std::min(size_ - 1, static_cast<int>(mid * size_));
+        running += hist[b];
+    }
+
+    std::vector<std::vector<ParticleRecord>> send(size_);
+    for (long i = 0; i < N; ++i) {
+        if (P.alive[i]) send[owner[bucket[i]]].push_back(pack(P, i, cost[i]));
+    }
+    const std::vector<ParticleRecord> recv = alltoall_records(comm_, send);
+
+    Particles Q(recv.size());
+    cost.resize(recv.size());
+    for (size_t k = 0; k < recv.size(); ++k) {
+        unpack(Q, k, recv[k]);
+        cost[k] = real_t(recv[k].cost);
+    }
+    P = std::move(Q);
+}
+
+void DomainDecomposition::update_boxes(const Particles& P) {
+    double box[6] = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+                     std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(),
+                     std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
+    for (size_t i = 0; i < P.N; ++i) {
+        if (!P.alive[i]) continue;
+        const double p[3] = {double(P.x[i]), double(P.y[i]), double(P.z[i])};
+        for (int a = 0; a < 3; ++a) {
+            box[a] = std::min(box[a], p[a]);
+            box[3 + a] = std::max(box[3 + a], p[a]);
+        }
+    }
+    MPI_Allgather(box, 6, MPI_DOUBLE, boxes_.data(), 6, MPI_DOUBLE, comm_);
+}
+
+size_t DomainDecomposition::import_essential_tree(Particles& P, const BarnesHutSolver& tree) {
+    std::vector<std::vector<GhostMass>> send(size_);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int r = 0; r < size_; ++r) {
+        const double* box = &boxes_[6 * r];
+        if (r == rank_ || box_empty(box)) continue;
+        const real_t lo[3] = {real_t(box[0]), real_t(box[1]), real_t(box[2])};
+        const real_t hi[3] = {real_t(box[3]), real_t(box[4]), real_t(box[5])};
+        tree.export_essential(lo, hi, [&](real_t x, real_t y, real_t z, real_t m) {
+            send[r].push_back(GhostMass{x, y, z, m});
+        });
+    }
+    const std::vector<GhostMass> recv = alltoall_records(comm_, send);
+
+    const size_t first = P.N;
+    P.resize(first + recv.size());
+    for (size_t k = 0; k < recv.size(); ++k) {
+        const size_t i = first + k;
+        P.x[i] = real_t(recv[k].x); P.y[i] = real_t(recv[k].y); P.z[i] = real_t(recv[k].z);
+        P.vx[i] = P.vy[i] = P.vz[i] = real_t(0);
+        P.ax[i] = P.ay[i] = P.az[i] = real_t(0);
+        P.mass[i] = real_t(recv[k].m);
+        P.temperature[i] = P.density[i] = P.pressure[i] = real_t(0);
+        P.is_star[i] = 0;
+        P.alive[i] = 1;
+        P.id[i] = std::numeric_limits<uint64_t>::max(); // not a real particle
+    }
+    return recv.size();
+}
+
+size_t DomainDecomposition::import_halo(Particles& P, real_t radius) {
+    const double r2 = double(radius) * radius;
+    std::vector<std::vector<ParticleRecord>> send(size_);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int r = 0; r < size_; ++r) {
+        halo_send_[r].clear();
+        const double* box = &boxes_[6 * r];
+        if (r == rank_ || box_empty(box)) continue;
+        for (size_t i = 0; i < P.N; ++i) {
+            if (!P.alive[i] || box_dist2(box, P.x[i], P.y[i], P.z[i]) >= r2) continue;
+            halo_send_[r].push_back(static_cast<uint32_t>(i));
+            send[r].push_back(pack(P, i, real_t(0)));
+        }
+    }
+    const std::vector<ParticleRecord> recv = alltoall_records(comm_, send, &halo_recv_counts_);
+
+    const size_t first = P.N;
+    P.resize(first + recv.size());
+    for (size_t k = 0; k < recv.size(); ++k) unpack(P, first + k, recv[k]);
+    return recv.size();
+}
+
+void DomainDecomposition::refresh_halo_density(Particles& P, size_t first_ghost) {
+    std::vector<std::vector<double>> send(size_);
+    for (int r = 0; r < size_; ++r) {
+        send[r].reserve(halo_send_[r].size());
+        for (uint32_t i : halo_send_[r]) send[r].push_back(P.density[i]);
+    }
+    // arrives in the same (source rank, send) order as import_halo
+    const std::vector<double> recv = alltoall_records(comm_, send);
+    for (size_t k = 0; k < recv.size() && first_ghost + k < P.N; ++k)
+        P.density[first_ghost + k] = real_t(recv[k]);
+}
+
+double DomainDecomposition::imbalance(double local_value) const {
+    double max = local_value, sum = local_value;
+    MPI_Allreduce(MPI_IN_PLACE, &max, 1, MPI_DOUBLE, MPI_MAX, comm_);
+    MPI_Allreduce(MPI_IN_PLACE, &sum, 1, MPI_DOUBLE, MPI_SUM, comm_);
+    return sum > 0 ? max / (sum / size_) : 1.0;
+}
+
+size_t DomainDecomposition::global_count(const Particles& P) const {
+    unsigned long long n = P.N - P.num_dead();
+    MPI_Allreduce(MPI_IN_PLACE, &n, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, comm_);
+    return static_cast<size_t>(n);
+}
+
+#endif // STARFORM_USE_MPI
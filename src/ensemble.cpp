@@ -0,0 +1,178 @@
+#include "../include/ensemble.hpp"
+#include "../include/run.hpp"
+#include "../include/parallel.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+
+namespace {
+
+std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, sep)) {
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t") + 1);
+        if (!item.empty()) out.push_back(item);
+    }
+    return out;
+}
+
+// Keys that would change the shared initial conditions or the ensemble
+// itself cannot be swept, nor can scheduling: run_ensemble sets the member
+// thread counts and profiling, and the task graph does not change results.
+bool sweepable(const std::string& key) {
+    static const char* fixed[] = {"num_particles", "init_type", "seed", "fixed_positions",
+                                  "ic_input", "ic_output",
+                                  "sweep", "ensemble_groups", "output_dir",
+                                  "num_threads", "task_graph", "profile",
+                                  "output_interval", "render_interval", "shm_name",
+                                  "diagnostics_interval", "audit_interval", "verify_interval"};
+    return std::none_of(std::begin(fixed), std::end(fixed),
+                        [&](const char* k) { return key == k; });
+}
+
+} // namespace
+
+bool parse_sweep(const std::string& sweep, std::vector<SweepAxis>& axes) {
+    axes.clear();
+    for (const std::string& axis : split(sweep, ';')) {
+        size_t colon = axis.find(':');
+        if (colon == std::string::npos) {
+            std::cerr << "ERROR: sweep axis needs key:v1,v2,... : " << axis << "\n";
+            return false;
+        }
+        SweepAxis a;
+        a.key = axis.substr(0, colon);
+        a.key.erase(a.key.find_last_not_of(" \t") + 1);
+        a.values = split(axis.substr(colon + 1), ',');
+        if (!sweepable(a.key)) {
+            std::cerr << "ERROR: " << a.key << " cannot be swept (initial conditions, ensemble or "
+                         "scheduling setting)\n";
+            return false;
+        }
+        if (a.values.empty()) {
+            std::cerr << "ERROR: sweep axis " << a.key << " has no values\n";
+            return false;
+        }
+        // reject unknown keys and bad values before anything runs
+        Config probe;
+        for (const std::string& v : a.values)
+            if (!set_config_value(probe, a.key, v)) return false;
+        axes.push_back(a);
+    }
+    return !axes.empty();
+}
+
+std::vector<EnsembleMember> run_ensemble(const Particles& P, const Config& cfg) {
+    std::vector<SweepAxis> axes;
+    if (!parse_sweep(cfg.sweep, axes)) {
+        std::cerr << "Ensemble aborted — invalid sweep: '" << cfg.sweep << "'\n";
+        return {};
+    }
+
+    // cartesian product of the axes, last axis varying fastest
+    size_t count = 1;
+    for (const SweepAxis& a : axes) count *= a.values.size();
+    std::vector<EnsembleMember> members(count);
+    for (size_t m = 0; m < count; ++m) {
+        EnsembleMember& em = members[m];
+        em.cfg = cfg;
+        em.cfg.output_interval = 0; // members write no snapshots
+        em.cfg.render_interval = 0; // or images
+        em.cfg.shm_name = "";       // or live snapshots
+        em.cfg.profile = false;     // members share the cores, counters would mix
+        // the logs go to fixed names in output_dir; concurrent members
+        // would truncate and interleave each other's
+        em.cfg.diagnostics_interval = 0;
+        em.cfg.audit_interval = 0;
+        em.cfg.verify_interval = 0; // each member is verified once at the end
+        em.values.resize(axes.size());
+        size_t rest = m;
+        for (size_t a = axes.size(); a-- > 0;) {
+            em.values[a] = axes[a].values[rest % axes[a].values.size()];
+            rest /= axes[a].values.size();
+            set_config_value(em.cfg, axes[a].key, em.values[a]);
+        }
+    }
+
+    // split the cores into groups; each group runs one member at a time
+    const int cores = cfg.num_threads > 0 ? cfg.num_threads : par_max_threads();
+    int groups = cfg.ensemble_groups > 0 ? cfg.ensemble_groups : cores;
+    groups = std::max(1, std::min<int>(groups, static_cast<int>(count)));
+    const int threads_per_member = std::max(1, cores / groups);
+    par_set_max_active_levels(2);
+
+    std::cout << "Ensemble: " << count << " members, " << groups << " groups x "
+              << threads_per_member << " threads\n";
+
+    #pragma omp parallel for num_threads(groups) schedule(dynamic, 1)
+    for (long m = 0; m < static_cast<long>(count); ++m) {
+        EnsembleMember& em = members[m];
+        em.cfg.num_threads = threads_per_member;
+
+        Particles Q = P; // every member starts from the same state
+        RunResult r = run_simulation(Q, em.cfg);
+
+        em.stars = r.sinks.size();
+        em.star_mass_fraction = r.star_mass_fraction;
+        em.runtime_ms = r.runtime_ms;
+        em.aborted = r.aborted;
+        if (r.aborted) {
+            #pragma omp critical
+            std::cerr << "WARNING: ensemble member " << m << " stopped after " << r.steps
+                      << " steps (diverged)\n";
+        }
+        em.verified = compute_verification_metrics(Q, em.cfg.reference_csv, em.error);
+    }
+
+    // ----------------------------------------------------
+    // Summary table (stdout and <output_dir>/ensemble.csv)
+    // ----------------------------------------------------
+    std::cout << "\n=== Ensemble Summary ===\n";
+    std::cout << std::setw(6) << "member";
+    for (const SweepAxis& a : axes) std::cout << std::setw(20) << a.key;
+    std::cout << std::setw(7) << "stars" << std::setw(12) << "star_frac"
+              << std::setw(12) << "L1" << std::setw(12) << "L2"
+              << std::setw(12) << "Linf" << std::setw(12) << "runtime_ms" << "\n";
+    for (size_t m = 0; m < count; ++m) {
+        const EnsembleMember& em = members[m];
+        std::cout << std::setw(6) << m;
+        for (const std::string& v : em.values) std::cout << std::setw(20) << v;
+        std::cout << std::setw(7) << em.stars << std::setw(12) << em.star_mass_fraction;
+        if (em.verified) {
+            std::cout << std::setw(12) << em.error.L1 << std::setw(12) << em.error.L2
+                      << std::setw(12) << em.error.Linf;
+        } else {
+            std::cout << std::setw(12) << "-" << std::setw(12) << "-" << std::setw(12) << "-";
+        }
+        std::cout << std::setw(12) << static_cast<long long>(em.runtime_ms) << "\n";
+    }
+
+    std::filesystem::create_directories(cfg.output_dir);
+    const std::string fname = cfg.output_dir + "/ensemble.csv";
+    std::ofstream out(fname);
+    if (!out.is_open()) {
+        std::cerr << "ERROR: Could not open file for writing: " << fname << "\n";
+        return members;
+    }
+    out << "member";
+    for (const SweepAxis& a : axes) out << "," << a.key;
+    out << ",stars,star_mass_fraction,L1,L2,Linf,runtime_ms\n";
+    for (size_t m = 0; m < count; ++m) {
+        const EnsembleMember& em = members[m];
+        out << m;
+        for (const std::string& v : em.values) out << "," << v;
+        out << "," << em.stars << "," << em.star_mass_fraction;
+        if (em.verified) out << "," << em.error.L1 << "," << em.error.L2 << "," << em.error.Linf;
+        else             out << ",,,";
+        out << "," << em.runtime_ms << "\n";
+    }
+    std::cout << "Wrote " << fname << "\n";
+    return members;
+}
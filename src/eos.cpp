@@ -0,0 +1,44 @@
+#include "../include/eos.hpp"
+
+namespace {
+
+constexpr double kGamma = 7.0 / 5.0;   // stiffening of the barotropic EOS
+constexpr double kCoolingSlope = 1.7;  // rate ~ T^1.7 (line cooling ~ T^2.7)
+
+}
+
+EosTable::EosTable(bool barotropic, double rho_crit, bool molecular, double coefficient,
+                   double floor_temperature)
+    : barotropic_(barotropic), molecular_(molecular), rho_crit_(rho_crit),
+      coefficient_(coefficient), floor_(real_t(floor_temperature)),
+      nodes_(size_t(kRhoNodes) * kTNodes) {
+    for (int iv = 0; iv < kTNodes; ++iv) {
+        const double T = std::exp2(double(kLogTMin) + double(iv) / kNodesPerOctave);
+        for (int iu = 0; iu < kRhoNodes; ++iu) {
+            const double rho = std::exp2(double(kLogRhoMin) + double(iu) / kNodesPerOctave);
+            const double c = exact_sound_speed(rho, T);
+            Node& n = nodes_[size_t(iv) * kRhoNodes + iu];
+            n.pressure = float(exact_pressure(rho, T) / (rho * T));
+            n.sound = float(c * c / T);
+            n.log_rate = float(std::log2(std::max(exact_cooling_rate(rho, T), 1e-30)));
+            n.pad = 0.0f;
+        }
+    }
+}
+
+double EosTable::exact_pressure(double rho, double T) const {
+    if (!barotropic_) return rho * T;
+    return rho * T * (1.0 + std::pow(rho / rho_crit_, kGamma - 1.0));
+}
+
+double EosTable::exact_sound_speed(double rho, double T) const {
+    // c^2 = dP/drho at fixed T
+    if (!barotropic_) return std::sqrt(T);
+    const double x = std::pow(rho / rho_crit_, kGamma - 1.0);
+    return std::sqrt(T * (1.0 + kGamma * x));
+}
+
+double EosTable::exact_cooling_rate(double rho, double T) const {
+    if (!molecular_) return 0.0;
+    return coefficient_ * rho * std::pow(T, kCoolingSlope) / (1.0 + rho / rho_crit_);
+}
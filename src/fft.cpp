@@ -0,0 +1,79 @@
+#include "../include/fft.hpp"
+#include "../include/parallel.hpp"
+#include <cmath>
+#include <stdexcept>
+
+
+Fft1D::Fft1D(size_t n) : n_(n), rev_(n), twiddle_(n / 2) {
+    if (!is_pow2(n)) throw std::invalid_argument("FFT length must be a power of two");
+    int bits = 0;
+    while ((size_t(1) << bits) < n) ++bits;
+    for (size_t i = 0; i < n; ++i) {
+        size_t r = 0;
+        for (int b = 0; b < bits; ++b) r |= ((i >> b) & 1) << (bits - 1 - b);
+        rev_[i] = r;
+    }
+    for (size_t k = 0; k < n / 2; ++k) {
+        const double a = -2.0 * M_PI * double(k) / double(n);
+        twiddle_[k] = cplx(std::cos(a), std::sin(a));
+    }
+}
+
+void Fft1D::transform(cplx* a, bool inverse) const {
+    for (size_t i = 0; i < n_; ++i) {
+        if (i < rev_[i]) std::swap(a[i], a[rev_[i]]);
+    }
+    for (size_t len = 2; len <= n_; len <<= 1) {
+        const size_t half = len / 2;
+        const size_t stride = n_ / len; // twiddle step for this stage
+        for (size_t start = 0; start < n_; start += len) {
+            for (size_t k = 0; k < half; ++k) {
+                cplx w = twiddle_[k * stride];
+                if (inverse) w = std::conj(w);
+                const cplx u = a[start + k];
+                const cplx v = a[start + k + half] * w;
+                a[start + k] = u + v;
+                a[start + k + half] = u - v;
+            }
+        }
+    }
+}
+
+
+Fft3D::Fft3D(size_t n) : n_(n), line_(n) {}
+
+void Fft3D::transform(cplx* grid, bool inverse) const {
+    const size_t n = n_;
+    const long lines = static_cast<long>(n * n);
+    if (buffers_.size() < size_t(par_max_threads())) buffers_.resize(par_max_threads());
+
+    // x: lines are contiguous
+    #pragma omp parallel for schedule(static)
+    for (long l = 0; l < lines; ++l) line_.transform(grid + size_t(l) * n, inverse);
+
+    // y and z: gather each line, transform, scatter back
+    for (int axis = 1; axis <= 2; ++axis) {
+        const size_t stride = axis == 1 ? n : n * n;
+        #pragma omp parallel
+        {
+            std::vector<cplx>& buf = buffers_[par_thread_id()];
+            buf.resize(n);
+            #pragma omp for schedule(static)
+            for (long l = 0; l < lines; ++l) {
+                // l enumerates the two other axes
+                const size_t a = size_t(l) % n, b = size_t(l) / n;
+                const size_t base = axis == 1 ? a + b * n * n : a + b * n;
+                for (size_t k = 0; k < n; ++k) buf[k] = grid[base + k * stride];
+                line_.transform(buf.data(), inverse);
+                for (size_t k = 0; k < n; ++k) grid[base + k * stride] = buf[k];
+            }
+        }
+    }
+
+    if (inverse) {
+        const double scale = 1.0 / double(n * n * n);
+        const long total = static_cast<long>(n * n * n);
+        #pragma omp parallel for schedule(static)
+        for (long i = 0; i < total; ++i) grid[i] *= scale;
+    }
+}
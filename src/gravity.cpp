@@ -2,96 +2,198 @@
 #include <vector>
 #include <cstddef>
 #include <cmath>
+#include <algorithm>
 
 void compute_gravity(const Particles& P,
-                     std::vector<float>& ax,
-                     std::vector<float>& ay,
-                     std::vector<float>& az,
-                     float G,
-                     float softening)
+                     std::vector<real_t>& ax,
+                     std::vector<real_t>& ay,
+                     std::vector<real_t>& az,
+                     real_t G,
+                     real_t softening,
+                     std::vector<real_t>* potential)
 {
     size_t N = P.N;
-    std::fill(ax.begin(), ax.end(), 0.0f);
-    std::fill(ay.begin(), ay.end(), 0.0f);
-    std::fill(az.begin(), az.end(), 0.0f);
+    std::fill(ax.begin(), ax.end(), real_t(0));
+    std::fill(ay.begin(), ay.end(), real_t(0));
+    std::fill(az.begin(), az.end(), real_t(0));
+    if (potential) potential->assign(N, real_t(0));
 
     for (size_t i = 0; i < N; ++i) {
         if (!P.alive[i]) continue;
         for (size_t j = i+1; j < N; ++j) {
             if (!P.alive[j]) continue;
-            float dx = P.x[j] - P.x[i];
-            float dy = P.y[j] - P.y[i];
-            float dz = P.z[j] - P.z[i];
-            float r2 = dx*dx + dy*dy + dz*dz;
-            float denom = std::sqrt(r2 + softening*softening);
-            float inv_r3 = 1.0f / (denom * denom * denom + 1e-20f);
-            float f = G * P.mass[i] * P.mass[j] * inv_r3;
+            real_t dx = P.x[j] - P.x[i];
+            real_t dy = P.y[j] - P.y[i];
+            real_t dz = P.z[j] - P.z[i];
+            real_t r2 = dx*dx + dy*dy + dz*dz;
+            real_t denom = std::sqrt(r2 + softening*softening);
+            real_t inv_r3 = real_t(1) / (denom * denom * denom + real_t(1e-20f));
+            real_t f = G * P.mass[i] * P.mass[j] * inv_r3;
             // acceleration contributions
-            float aix = f * dx / P.mass[i]; // f/m_i = G m_j / r^3 * dx
-            float ajx = -f * dx / P.mass[j];
+            real_t aix = f * dx / P.mass[i]; // f/m_i = G m_j / r^3 * dx
+            real_t ajx = -f * dx / P.mass[j];
             ax[i] += aix; ax[j] += ajx;
-            float aiy = f * dy / P.mass[i];
-            float ajy = -f * dy / P.mass[j];
+            real_t aiy = f * dy / P.mass[i];
+            real_t ajy = -f * dy / P.mass[j];
             ay[i] += aiy; ay[j] += ajy;
-            float aiz = f * dz / P.mass[i];
-            float ajz = -f * dz / P.mass[j];
+            real_t aiz = f * dz / P.mass[i];
+            real_t ajz = -f * dz / P.mass[j];
             az[i] += aiz; az[j] += ajz;
+            if (potential) {
+                (*potential)[i] -= G * P.mass[j] / denom;
+                (*potential)[j] -= G * P.mass[i] / denom;
+            }
         }
     }
 }
 
 
-// Optimized O(N²) gravity computation
-void compute_gravity_cached_optimized(Particles& P,
-                                      float G,
-                                      float softening)
+// Optimized O(N²) gravity computation.
+// Gather form: particle i sums all j into acc_t registers, so there are no
+// scattered writes (threads never share an output) and the inner loop is
+// branch-free; the self term vanishes because dx = dy = dz = 0.
+// Sep supplies pair separations from float or fixed-point positions.
+// With kPotential the same loop also sums the softened potential.
+template <bool kPotential, class Sep>
+static void gravity_gather(Particles& P, const Sep& sep,
+                           real_t G, real_t softening, real_t* potential)
 {
-    const size_t N = P.N;
-    const float soft2 = softening * softening;
+    const long N = static_cast<long>(P.N);
+    const real_t soft2 = softening * softening;
 
-    // zero accelerations
-    float* ax = P.ax.data();
-    float* ay = P.ay.data();
-    float* az = P.az.data();
-    for (size_t i = 0; i < N; ++i) {
-        ax[i] = 0.0f;
-        ay[i] = 0.0f;
-        az[i] = 0.0f;
-    }
+    const real_t* mass = P.mass.data();
+    const uint8_t* alive = P.alive.data();
 
-    // main O(N²) loop
-    for (size_t i = 0; i < N; ++i) {
-        if (!P.alive[i]) continue;
-        const float xi = P.x[i];
-        const float yi = P.y[i];
-        const float zi = P.z[i];
-        const float mi = P.mass[i];
+    real_t* ax = P.ax.data();
+    real_t* ay = P.ay.data();
+    real_t* az = P.az.data();
 
-        for (size_t j = i + 1; j < N; ++j) {
-            if (!P.alive[j]) continue;
-            const float dx = P.x[j] - xi;
-            const float dy = P.y[j] - yi;
-            const float dz = P.z[j] - zi;
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < N; ++i) {
+        if (!alive[i]) {
+            ax[i] = ay[i] = az[i] = real_t(0);
+            if (kPotential) potential[i] = real_t(0);
+            continue;
+        }
 
-            const float r2 = dx*dx + dy*dy + dz*dz + soft2;
-            const float inv_r = 1.0f / std::sqrt(r2);
-            const float inv_r3 = inv_r * inv_r * inv_r;
+        acc_t axi = 0, ayi = 0, azi = 0, phi = 0;
 
-            const float mj = P.mass[j];
-            const float f = G * inv_r3;
+        #pragma omp simd reduction(+:axi,ayi,azi,phi)
+        for (long j = 0; j < N; ++j) {
+            real_t dx, dy, dz;
+            sep(i, j, dx, dy, dz);
 
-            // apply accelerations
-            const float aix = f * mj * dx;
-            const float aiy = f * mj * dy;
-            const float aiz = f * mj * dz;
+            // the self term is masked out rather than branched around, so
+            // it stays finite with softening = 0
+            const bool self = j == i;
+            const real_t r2 = self ? real_t(1) : dx*dx + dy*dy + dz*dz + soft2;
+            const real_t inv_r = real_t(1) / std::sqrt(r2);
+            const real_t inv_r3 = inv_r * inv_r * inv_r;
 
-            ax[i] += aix;
-            ay[i] += aiy;
-            az[i] += aiz;
+            // dead particles carry no mass
+            const real_t mj = alive[j] && !self ? mass[j] : real_t(0);
+            const real_t f = G * mj * inv_r3;
 
-            ax[j] -= f * mi * dx;
-            ay[j] -= f * mi * dy;
-            az[j] -= f * mi * dz;
+            axi += acc_t(f * dx);
+            ayi += acc_t(f * dy);
+            azi += acc_t(f * dz);
+            if (kPotential) phi -= acc_t(G * mj * inv_r);
+        }
+
+        ax[i] = real_t(axi);
+        ay[i] = real_t(ayi);
+        az[i] = real_t(azi);
+        if (kPotential) potential[i] = real_t(phi);
+    }
+}
+
+void compute_gravity_cached_optimized(Particles& P,
+                                      real_t G,
+                                      real_t softening,
+                                      real_t* potential)
+{
+    with_separation(P, [&](const auto& sep) {
+        if (potential) gravity_gather<true>(P, sep, G, softening, potential);
+        else           gravity_gather<false>(P, sep, G, softening, nullptr);
+    });
+}
+
+void compute_sink_gravity(const Particles& P,
+                          SinkParticles& S,
+                          std::vector<real_t>& ax,
+                          std::vector<real_t>& ay,
+                          std::vector<real_t>& az,
+                          real_t G,
+                          real_t softening)
+{
+    const long N = static_cast<long>(P.N);
+    const long NS = static_cast<long>(S.size());
+    if (NS == 0) return;
+    const real_t soft2 = softening * softening;
+    const std::vector<Star>& stars = S.stars;
+
+    // nearest image in a periodic box
+    const bool periodic = P.periodic();
+    const real_t L = real_t(P.period), inv_L = periodic ? real_t(1.0 / P.period) : real_t(0);
+    auto image = [&](real_t& dx, real_t& dy, real_t& dz) {
+        if (!periodic) return;
+        dx -= L * std::nearbyint(dx * inv_L);
+        dy -= L * std::nearbyint(dy * inv_L);
+        dz -= L * std::nearbyint(dz * inv_L);
+    };
+
+    // stars -> gas
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < N; ++i) {
+        if (!P.alive[i]) continue;
+        acc_t axi = 0, ayi = 0, azi = 0;
+        for (long s = 0; s < NS; ++s) {
+            real_t dx = stars[s].position.x - P.x[i];
+            real_t dy = stars[s].position.y - P.y[i];
+            real_t dz = stars[s].position.z - P.z[i];
+            image(dx, dy, dz);
+            const real_t r2 = dx*dx + dy*dy + dz*dz + soft2;
+            const real_t inv_r = real_t(1) / std::sqrt(r2);
+            const real_t f = G * stars[s].mass * inv_r * inv_r * inv_r;
+            axi += acc_t(f * dx);
+            ayi += acc_t(f * dy);
+            azi += acc_t(f * dz);
+        }
+        ax[i] += real_t(axi);
+        ay[i] += real_t(ayi);
+        az[i] += real_t(azi);
+    }
+
+    // gas + other stars -> stars
+    S.acc.resize(NS);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (long s = 0; s < NS; ++s) {
+        const Vec3 xs = stars[s].position;
+        acc_t axs = 0, ays = 0, azs = 0;
+        for (long j = 0; j < N; ++j) {
+            if (!P.alive[j]) continue;
+            real_t dx = P.x[j] - xs.x;
+            real_t dy = P.y[j] - xs.y;
+            real_t dz = P.z[j] - xs.z;
+            image(dx, dy, dz);
+            const real_t r2 = dx*dx + dy*dy + dz*dz + soft2;
+            const real_t inv_r = real_t(1) / std::sqrt(r2);
+            const real_t f = G * P.mass[j] * inv_r * inv_r * inv_r;
+            axs += acc_t(f * dx);
+            ays += acc_t(f * dy);
+            azs += acc_t(f * dz);
+        }
+        for (long t = 0; t < NS; ++t) {
+            if (t == s) continue;
+            Vec3 d = stars[t].position - xs;
+            image(d.x, d.y, d.z);
+            const real_t r2 = d.length2() + soft2;
+            const real_t inv_r = real_t(1) / std::sqrt(r2);
+            const real_t f = G * stars[t].mass * inv_r * inv_r * inv_r;
+            axs += acc_t(f * d.x);
+            ays += acc_t(f * d.y);
+            azs += acc_t(f * d.z);
         }
+        S.acc[s] = Vec3(real_t(axs), real_t(ays), real_t(azs));
     }
 }
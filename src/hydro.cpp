@@ -7,29 +7,29 @@
 #endif
 
 // cubic spline kernel derivative dW/dr for 3D; returns dWdr
-static inline float cubic_spline_dWdr(float r, float h) {
-    const float q = r / h;
-    const float inv_h4 = 1.0f / (h*h*h*h);
-    const float sigma = 1.0f / (M_PI) * inv_h4; // normalization for derivative in 3D
-    if (r <= 0.0f) return 0.0f;
-    if (q < 1.0f) {
+static inline real_t cubic_spline_dWdr(real_t r, real_t h) {
+    const real_t q = r / h;
+    const real_t inv_h4 = real_t(1) / (h*h*h*h);
+    const real_t sigma = real_t(1.0 / M_PI) * inv_h4; // normalization for derivative in 3D
+    if (r <= real_t(0)) return real_t(0);
+    if (q < real_t(1)) {
         // d/dr [1 - 1.5 q^2 + 0.75 q^3] = (-3 q + (9/4) q^2) * (1/h)
-        return sigma * (-3.0f * q + 2.25f * q * q);
-    } else if (q < 2.0f) {
-        float t = 2.0f - q;
+        return sigma * (real_t(-3) * q + real_t(2.25) * q * q);
+    } else if (q < real_t(2)) {
+        real_t t = real_t(2) - q;
         // d/dr[0.25 t^3] = 0.25 * 3 * t^2 * (-1/h) = -0.75 * t^2 / h
-        return sigma * (-0.75f * t * t);
+        return sigma * (real_t(-0.75) * t * t);
     } else {
-        return 0.0f;
+        return real_t(0);
     }
 }
 
-void compute_pressure(Particles& P, float K, float gamma) {
+void compute_pressure(Particles& P, real_t K, real_t gamma) {
     size_t N = P.N;
-    if (P.pressure.size() != N) P.pressure.assign(N, 0.0f);
+    if (P.pressure.size() != N) P.pressure.assign(N, real_t(0));
     for (size_t i = 0; i < N; ++i) {
         // polytropic EOS (robust for collapse tests)
-        float rho = std::max(P.density[i], 1e-12f);
+        real_t rho = std::max(P.density[i], real_t(1e-12));
         P.pressure[i] = K * std::pow(rho, gamma);
     }
 }
@@ -38,30 +38,30 @@ void compute_pressure(Particles& P, float K, float gamma) {
 // Computes SPH pressure forces: a_i = sum_j -m_j (P_i/rho_i^2 + P_j/rho_j^2) grad W_ij
 void compute_pressure_forces(
     Particles& P,
-    float h,
-    std::vector<float>& ax,
-    std::vector<float>& ay,
-    std::vector<float>& az
+    real_t h,
+    std::vector<real_t>& ax,
+    std::vector<real_t>& ay,
+    std::vector<real_t>& az
 ) {
     size_t N = P.N;
 
     // resize acceleration vectors if needed
-    if (ax.size() != N) ax.assign(N, 0.0f);
-    if (ay.size() != N) ay.assign(N, 0.0f);
-    if (az.size() != N) az.assign(N, 0.0f);
+    if (ax.size() != N) ax.assign(N, real_t(0));
+    if (ay.size() != N) ay.assign(N, real_t(0));
+    if (az.size() != N) az.assign(N, real_t(0));
 
     // small epsilon to avoid division by zero
-    const float eps = 1e-12f;
+    const real_t eps = real_t(1e-12);
 
     // pairwise loop
     for (size_t i = 0; i < N; ++i) {
         if (!P.alive[i]) continue;
 
-        float rho_i = std::max(P.density[i], eps);
-        float rho_i2_inv = 1.0f / (rho_i * rho_i);
-        float P_i_rho2 = P.pressure[i] * rho_i2_inv;
+        real_t rho_i = std::max(P.density[i], eps);
+        real_t rho_i2_inv = real_t(1) / (rho_i * rho_i);
+        real_t P_i_rho2 = P.pressure[i] * rho_i2_inv;
 
-        float xi = P.x[i]; float yi = P.y[i]; float zi = P.z[i];
+        real_t xi = P.x[i]; real_t yi = P.y[i]; real_t zi = P.z[i];
 
         // Vec3 xi(P.x[i], P.y[i], P.z[i]);
 
@@ -70,23 +70,23 @@ void compute_pressure_forces(
 
             // Vec3 xj(P.x[j], P.y[j], P.z[j]);
             // Vec3 dx = xj - xi;
-            // float r2 = dx.length2();
-            // float r = std::sqrt(r2);
+            // real_t r2 = dx.length2();
+            // real_t r = std::sqrt(r2);
 
-            float xj = P.x[j]; float yj = P.y[j]; float zj = P.z[j];
-            float dx = (xj - xi); float dy = (yj - yi); float dz = (zj - zi);
-            float r = std::sqrt( dx*dx + dy*dy + dz*dz );
+            real_t xj = P.x[j]; real_t yj = P.y[j]; real_t zj = P.z[j];
+            real_t dx = (xj - xi); real_t dy = (yj - yi); real_t dz = (zj - zi);
+            real_t r = std::sqrt( dx*dx + dy*dy + dz*dz );
 
-            if (r > 2.0f * h || r < eps) continue;
+            if (r > real_t(2) * h || r < eps) continue;
 
-            float dWdr = cubic_spline_dWdr(r, h);
-            if (dWdr == 0.0f) continue;
+            real_t dWdr = cubic_spline_dWdr(r, h);
+            if (dWdr == real_t(0)) continue;
 
-            float rho_j = std::max(P.density[j], eps);
-            float rho_j2_inv = 1.0f / (rho_j * rho_j);
-            float P_j_rho2 = P.pressure[j] * rho_j2_inv;
+            real_t rho_j = std::max(P.density[j], eps);
+            real_t rho_j2_inv = real_t(1) / (rho_j * rho_j);
+            real_t P_j_rho2 = P.pressure[j] * rho_j2_inv;
 
-            float term = -P.mass[j] * (P_i_rho2 + P_j_rho2);
+            real_t term = -P.mass[j] * (P_i_rho2 + P_j_rho2);
 
             // Vec3 gradW = dx * (dWdr / r); // grad W_ij
             // Vec3 a = gradW * term;
@@ -100,14 +100,14 @@ void compute_pressure_forces(
             // ay[j] -= a.y;
             // az[j] -= a.z;
 
-            float grad_scalar = (dWdr / r);
-            float grad_x = dx * grad_scalar;
-            float grad_y = dy * grad_scalar;
-            float grad_z = dz * grad_scalar;
+            real_t grad_scalar = (dWdr / r);
+            real_t grad_x = dx * grad_scalar;
+            real_t grad_y = dy * grad_scalar;
+            real_t grad_z = dz * grad_scalar;
 
-            float a_x = grad_x * term;
-            float a_y = grad_y * term;
-            float a_z = grad_z * term;
+            real_t a_x = grad_x * term;
+            real_t a_y = grad_y * term;
+            real_t a_z = grad_z * term;
 
             // symmetric update (momentum conserved)
             ax[i] += a_x;
@@ -121,69 +121,70 @@ void compute_pressure_forces(
     }
 }
 
-void compute_pressure_forces_cached(
+template <class Sep>
+static void pressure_forces_gather(
     Particles& P,
-    float h
+    const Sep& sep,
+    real_t h
 ) {
-    size_t N = P.N;
+    const long N = static_cast<long>(P.N);
 
     // read-only pointers
-    const float* x  = P.x.data();
-    const float* y  = P.y.data();
-    const float* z  = P.z.data();
-    const float* rho = P.density.data();
-    const float* pres = P.pressure.data();
-    const float* mass = P.mass.data();
+    const real_t* rho = P.density.data();
+    const real_t* pres = P.pressure.data();
+    const real_t* mass = P.mass.data();
     const uint8_t* alive = P.alive.data();
 
     // writable acceleration pointers
-    float* ax = P.ax.data();
-    float* ay = P.ay.data();
-    float* az = P.az.data();
+    real_t* ax = P.ax.data();
+    real_t* ay = P.ay.data();
+    real_t* az = P.az.data();
 
-    const float eps = 1e-12f;
+    const real_t eps = real_t(1e-12);
+    const real_t two_h = real_t(2) * h;
 
-    for (size_t i = 0; i < N; ++i) {
+    // gather form: each i owns its output, accumulated in acc_t
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (long i = 0; i < N; ++i) {
         if (!alive[i]) continue;
 
-        float rho_i = std::max(rho[i], eps);
-        float rho_i2_inv = 1.0f / (rho_i * rho_i);
-        float P_i_rho2 = pres[i] * rho_i2_inv;
+        real_t rho_i = std::max(rho[i], eps);
+        real_t rho_i2_inv = real_t(1) / (rho_i * rho_i);
+        real_t P_i_rho2 = pres[i] * rho_i2_inv;
 
-        float xi = x[i], yi = y[i], zi = z[i];
+        acc_t axi = 0, ayi = 0, azi = 0;
 
-        for (size_t j = i + 1; j < N; ++j) {
+        for (long j = 0; j < N; ++j) {
             if (!alive[j]) continue;
 
-            float dx = x[j] - xi;
-            float dy = y[j] - yi;
-            float dz = z[j] - zi;
-            float r = std::sqrt(dx*dx + dy*dy + dz*dz);
-
-            if (r > 2.0f*h || r < eps) continue;
+            real_t dx, dy, dz;
+            sep(i, j, dx, dy, dz);
+            real_t r = std::sqrt(dx*dx + dy*dy + dz*dz);
 
-            float dWdr = cubic_spline_dWdr(r, h);
-            if (dWdr == 0.0f) continue;
+            if (r > two_h || r < eps) continue;
 
-            float rho_j = std::max(rho[j], eps);
-            float rho_j2_inv = 1.0f / (rho_j * rho_j);
-            float P_j_rho2 = pres[j] * rho_j2_inv;
+            real_t dWdr = cubic_spline_dWdr(r, h);
+            if (dWdr == real_t(0)) continue;
 
-            float term = -mass[j] * (P_i_rho2 + P_j_rho2);
+            real_t rho_j = std::max(rho[j], eps);
+            real_t rho_j2_inv = real_t(1) / (rho_j * rho_j);
+            real_t P_j_rho2 = pres[j] * rho_j2_inv;
 
-            float grad = dWdr / r;
+            real_t term = -mass[j] * (P_i_rho2 + P_j_rho2);
 
-            float a_x = dx * grad * term;
-            float a_y = dy * grad * term;
-            float a_z = dz * grad * term;
-
-            ax[i] += a_x;
-            ay[i] += a_y;
-            az[i] += a_z;
+            real_t grad = dWdr / r;
 
-            ax[j] -= a_x;
-            ay[j] -= a_y;
-            az[j] -= a_z;
+            axi += acc_t(dx * grad * term);
+            ayi += acc_t(dy * grad * term);
+            azi += acc_t(dz * grad * term);
         }
+
+        ax[i] += real_t(axi);
+        ay[i] += real_t(ayi);
+        az[i] += real_t(azi);
     }
 }
+
+void compute_pressure_forces_cached(Particles& P, real_t h) {
+    with_separation(P, [&](const auto& sep) { pressure_forces_gather(P, sep, h); });
+}
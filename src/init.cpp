@@ -1,101 +1,220 @@
 // init.cpp
 #include "../include/init.hpp"
-#include <random>
+#include "../include/philox.hpp"
 #include <cmath>
 #include <iostream>
+#include <algorithm>
 
-static std::mt19937 gen(123);
+// Every generator below is a pure function of (particle index, N, seed):
+// random numbers come from a Philox stream keyed by the seed and indexed by
+// the particle, so particles can be generated in any order, in parallel, or
+// chunk by chunk straight into a snapshot (see stream_initial_conditions).
 
-void init_uniform(Particles& P) {
-    size_t N = P.N;
-    float spacing = 1.0f / std::cbrt(N);
+namespace {
 
-    for (size_t i = 0; i < N; ++i) {
-        float t = i * spacing;
-        P.x[i] = t;
-        P.y[i] = t;
-        P.z[i] = t;
-        P.vx[i] = P.vy[i] = P.vz[i] = 0.0f;
-    }
+// side of the smallest cubic lattice holding N sites
+size_t lattice_side(size_t N) {
+    size_t n = static_cast<size_t>(std::cbrt(double(N)));
+    while (n * n * n < N) ++n;
+    return std::max<size_t>(n, 1);
 }
 
-void init_clustered(Particles& P) {
-    std::normal_distribution<float> dist(0.0f, 0.05f);
-    std::vector<Vec3> centers = {
-        {0.3f,0.3f,0.3f},
-        {0.6f,0.5f,0.4f},
-        {0.8f,0.2f,0.7f}
-    };
-
-    for (size_t i = 0; i < P.N; ++i) {
-        Vec3 c = centers[i % centers.size()];
-        P.x[i] = c.x + dist(gen);
-        P.y[i] = c.y + dist(gen);
-        P.z[i] = c.z + dist(gen);
-        P.vx[i] = P.vy[i] = P.vz[i] = 0.0f;
-    }
+// cell-centred lattice site i of an n^3 lattice filling the unit box
+// (x fastest; a partial last layer when N is not a cube)
+void lattice_site(size_t i, size_t n, double p[3]) {
+    p[0] = (double(i % n) + 0.5) / double(n);
+    p[1] = (double((i / n) % n) + 0.5) / double(n);
+    p[2] = (double(i / (n * n)) + 0.5) / double(n);
+}
+
+// isotropic unit vector
+void random_direction(CounterRng& rng, double d[3]) {
+    const double cos_t = rng.uniform(-1.0, 1.0);
+    const double sin_t = std::sqrt(std::max(0.0, 1.0 - cos_t * cos_t));
+    const double phi = rng.uniform(0.0, 2.0 * M_PI);
+    d[0] = sin_t * std::cos(phi);
+    d[1] = sin_t * std::sin(phi);
+    d[2] = cos_t;
 }
 
-void init_spherical(Particles& P) {
-    std::uniform_real_distribution<float> r_dist(0.0f, 0.3f);
-    std::uniform_real_distribution<float> th_dist(0.0f, 2*M_PI);
-    std::uniform_real_distribution<float> ph_dist(0.0f, M_PI);
-
-    for (size_t i = 0; i < P.N; ++i) {
-        float r = r_dist(gen);
-        float th = th_dist(gen);
-        float ph = ph_dist(gen);
-        P.x[i] = r * std::sin(ph) * std::cos(th) + 0.5;
-        P.y[i] = r * std::sin(ph) * std::sin(th) + 0.5;
-        P.z[i] = r * std::cos(ph) + 0.5;
-        P.vx[i] = P.vy[i] = P.vz[i] = 0.0f;
+// Cumulative mass table of the critical Bonnor-Ebert sphere: the isothermal
+// Lane-Emden equation psi'' + 2 psi'/xi = exp(-psi), psi(0) = psi'(0) = 0,
+// integrated (RK4) out to xi_max = 6.451. The enclosed mass is
+// proportional to xi^2 psi'(xi).
+struct BonnorEbertTable {
+    static constexpr double kXiMax = 6.451;
+    static constexpr int kSteps = 4096;
+    double xi[kSteps + 1];
+    double mass[kSteps + 1];
+
+    BonnorEbertTable() {
+        const double dxi = kXiMax / kSteps;
+        auto deriv = [](double x, double psi, double dpsi, double& d2) {
+            d2 = x > 0.0 ? std::exp(-psi) - 2.0 * dpsi / x : 1.0 / 3.0;
+        };
+        double psi = 0.0, dpsi = 0.0;
+        xi[0] = 0.0;
+        mass[0] = 0.0;
+        for (int s = 0; s < kSteps; ++s) {
+            const double x = s * dxi;
+            double a1, a2, a3, a4;
+            deriv(x, psi, dpsi, a1);
+            deriv(x + 0.5 * dxi, psi + 0.5 * dxi * dpsi, dpsi + 0.5 * dxi * a1, a2);
+            deriv(x + 0.5 * dxi, psi + 0.5 * dxi * (dpsi + 0.5 * dxi * a1),
+                  dpsi + 0.5 * dxi * a2, a3);
+            deriv(x + dxi, psi + dxi * (dpsi + 0.5 * dxi * a2), dpsi + dxi * a3, a4);
+            psi += dxi * (dpsi + dxi * (a1 + a2 + a3) / 6.0);
+            dpsi += dxi * (a1 + 2.0 * a2 + 2.0 * a3 + a4) / 6.0;
+            xi[s + 1] = x + dxi;
+            mass[s + 1] = xi[s + 1] * xi[s + 1] * dpsi;
+        }
     }
+
+    // radius (in units of the outer radius) enclosing fraction u of the mass
+    double radius(double u) const {
+        const double m = u * mass[kSteps];
+        const int s = int(std::upper_bound(mass, mass + kSteps + 1, m) - mass);
+        const int hi = std::clamp(s, 1, kSteps);
+        const double f = (m - mass[hi - 1]) / (mass[hi] - mass[hi - 1]);
+        return (xi[hi - 1] + f * (xi[hi] - xi[hi - 1])) / kXiMax;
+    }
+};
+
+const BonnorEbertTable& bonnor_ebert_table() {
+    static const BonnorEbertTable table;
+    return table;
 }
 
+} // namespace
+
+
+InitState init_state(int version_type, size_t i, size_t N, uint64_t seed) {
+    CounterRng rng(seed, i);
+    double p[3] = {0.0, 0.0, 0.0};
+    double v[3] = {0.0, 0.0, 0.0};
+
+    switch (version_type) {
+        case 2: {
+            // three Gaussian clumps
+            static const double centers[3][3] = {
+                {0.3, 0.3, 0.3}, {0.6, 0.5, 0.4}, {0.8, 0.2, 0.7}};
+            const double* c = centers[i % 3];
+            for (int a = 0; a < 3; ++a) p[a] = rng.normal(c[a], 0.05);
+            break;
+        }
+        case 3: {
+            // spherical cloud of radius 0.3 (uniform in r, centrally peaked)
+            const double r = rng.uniform(0.0, 0.3);
+            const double th = rng.uniform(0.0, 2.0 * M_PI);
+            const double ph = rng.uniform(0.0, M_PI);
+            p[0] = r * std::sin(ph) * std::cos(th) + 0.5;
+            p[1] = r * std::sin(ph) * std::sin(th) + 0.5;
+            p[2] = r * std::cos(ph) + 0.5;
+            break;
+        }
+        case 4: {
+            // three unit vectors for debugging
+            if (i < 3) p[i] = 1.0;
+            break;
+        }
+        case 5: {
+            // glass-like: lattice with each site jittered inside its cell
+            const size_t n = lattice_side(N);
+            lattice_site(i, n, p);
+            for (int a = 0; a < 3; ++a) p[a] += rng.uniform(-0.4, 0.4) / double(n);
+            break;
+        }
+        case 6: {
+            // Plummer sphere, scale radius a = 0.1, in equilibrium for G = 1
+            // and unit particle masses (Aarseth, Henon & Wielen 1974)
+            const double a = 0.1;
+            const double M = double(N);
+            const double m = rng.uniform(0.0, 0.999); // truncate the far tail
+            const double r = a / std::sqrt(std::pow(m, -2.0 / 3.0) - 1.0);
+            double d[3];
+            random_direction(rng, d);
+            for (int k = 0; k < 3; ++k) p[k] = 0.5 + r * d[k];
+
+            // speed from q^2 (1 - q^2)^3.5 by rejection, as a fraction of
+            // the local escape speed
+            double q = 0.0;
+            for (;;) {
+                q = rng.uniform();
+                const double g = rng.uniform(0.0, 0.1);
+                if (g < q * q * std::pow(1.0 - q * q, 3.5)) break;
+            }
+            const double v_esc = std::sqrt(2.0 * M / std::sqrt(r * r + a * a));
+            random_direction(rng, d);
+            for (int k = 0; k < 3; ++k) v[k] = q * v_esc * d[k];
+            break;
+        }
+        case 7: {
+            // critical Bonnor-Ebert sphere of radius 0.3 (at rest)
+            const double r = 0.3 * bonnor_ebert_table().radius(rng.uniform());
+            double d[3];
+            random_direction(rng, d);
+            for (int k = 0; k < 3; ++k) p[k] = 0.5 + r * d[k];
+            break;
+        }
+        default: {
+            // uniform cubic lattice filling the unit box
+            lattice_site(i, lattice_side(N), p);
+            break;
+        }
+    }
 
-void identity_for_debugging(Particles& P){
-    P.x[0] = 1.0;
-    P.y[0] = 0.0;
-    P.z[0] = 0.0;
-    P.vx[0] = P.vy[0] = P.vz[0] = 0.0f;
+    return {real_t(p[0]), real_t(p[1]), real_t(p[2]),
+            real_t(v[0]), real_t(v[1]), real_t(v[2])};
+}
 
-    P.x[1] = 0.0;
-    P.y[1] = 1.0;
-    P.z[1] = 0.0;
-    P.vx[1] = P.vy[1] = P.vz[1] = 0.0f;
 
-    P.x[2] = 0.0;
-    P.y[2] = 0.0;
-    P.z[2] = 1.0;
-    P.vx[2] = P.vy[2] = P.vz[2] = 0.0f;
+static void init_generate(Particles& P, int version_type, uint64_t seed) {
+    const long N = static_cast<long>(P.N);
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < N; ++i) {
+        const InitState s = init_state(version_type, size_t(i), P.N, seed);
+        P.x[i] = s.x;   P.y[i] = s.y;   P.z[i] = s.z;
+        P.vx[i] = s.vx; P.vy[i] = s.vy; P.vz[i] = s.vz;
+    }
 }
 
+void init_uniform(Particles& P)        { init_generate(P, 1, 123); }
+void init_clustered(Particles& P)      { init_generate(P, 2, 123); }
+void init_spherical(Particles& P)      { init_generate(P, 3, 123); }
+void identity_for_debugging(Particles& P) { init_generate(P, 4, 123); }
 
-void init_particles(Particles& P, int version_type) {
+
+const char* init_name(int version_type) {
     switch (version_type) {
-        case 1:
-            std::cout << "Using uniform initialization\n";
-            init_uniform(P);
-            break;
+        case 1: return "uniform lattice";
+        case 2: return "clustered";
+        case 3: return "spherical cloud";
+        case 4: return "identity (debugging)";
+        case 5: return "glass (jittered lattice)";
+        case 6: return "Plummer sphere";
+        case 7: return "Bonnor-Ebert sphere";
+        default: return "unknown, defaulting to uniform lattice";
+    }
+}
 
-        case 2:
-            std::cout << "Using clustered initialization\n";
-            init_clustered(P);
-            break;
 
-        case 3:
-            std::cout << "Using spherical cloud initialization\n";
-            init_spherical(P);
-            break;
+void init_particles(Particles& P, int version_type, uint64_t seed) {
+    std::cout << "Using " << init_name(version_type) << " initialization\n";
+    if (version_type < 1 || version_type > 7) version_type = 1;
+    init_generate(P, version_type, seed);
+}
 
-        case 4:
-            std::cout << "Using identity initialization for debugging\n";
-            identity_for_debugging(P);
-            break;
 
-        default:
-            std::cout << "Unknown version, defaulting to uniform\n";
-            init_uniform(P);
-            break;
+void init_particle_range(Particles& P, int version_type, uint64_t seed,
+                         size_t first, size_t N_total) {
+    if (version_type < 1 || version_type > 7) version_type = 1;
+    const long n = static_cast<long>(P.N);
+    #pragma omp parallel for schedule(static)
+    for (long k = 0; k < n; ++k) {
+        const size_t i = first + size_t(k);
+        const InitState s = init_state(version_type, i, N_total, seed);
+        P.x[k] = s.x;   P.y[k] = s.y;   P.z[k] = s.z;
+        P.vx[k] = s.vx; P.vy[k] = s.vy; P.vz[k] = s.vz;
+        P.id[k] = i;
     }
 }
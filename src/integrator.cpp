@@ -1,23 +1,39 @@
 #include "../include/particles.hpp"
+#include "../include/integrator.hpp"
 #include "../include/gravity.hpp"
 #include "../include/vec3.hpp"
 #include "../include/density.hpp"
 #include "../include/hydro.hpp"
 #include <vector>
+#include <algorithm>
+#include <cstdint>
 
 
+static void drift_fixed(Particles& P, real_t dt);
+
 void velocity_verlet(Particles& P,
-                     const std::vector<float>& ax,
-                     const std::vector<float>& ay,
-                     const std::vector<float>& az,
-                     float dt)
+                     const std::vector<real_t>& ax,
+                     const std::vector<real_t>& ay,
+                     const std::vector<real_t>& az,
+                     real_t dt)
 {
+    // fixed-point positions are the ones the kernels read: drift those
+    if (P.fixed_positions()) {
+        for (size_t i = 0; i < P.N; i++) {
+            if (!P.alive[i]) continue;
+            P.vx[i] += real_t(0.5) * ax[i] * dt;
+            P.vy[i] += real_t(0.5) * ay[i] * dt;
+            P.vz[i] += real_t(0.5) * az[i] * dt;
+        }
+        drift_fixed(P, dt);
+        return;
+    }
 
     for (size_t i = 0; i < P.N; i++) {
         if (!P.alive[i]) continue;
-        P.vx[i] += 0.5f * ax[i] * dt;
-        P.vy[i] += 0.5f * ay[i] * dt;
-        P.vz[i] += 0.5f * az[i] * dt;
+        P.vx[i] += real_t(0.5) * ax[i] * dt;
+        P.vy[i] += real_t(0.5) * ay[i] * dt;
+        P.vz[i] += real_t(0.5) * az[i] * dt;
 
         P.x[i] += P.vx[i] * dt;
         P.y[i] += P.vy[i] * dt;
@@ -26,37 +42,95 @@ void velocity_verlet(Particles& P,
 }
 
 
-void velocity_verlet_cached(Particles& P, float dt)
+// Full-step drift of fixed-point positions. Displacements are rounded to
+// whole grid steps (2^-32 of the root box); if any particle would leave the
+// box, the frame is refit around the predicted positions first.
+static void drift_fixed(Particles& P, real_t dt)
 {
-    const size_t N = P.N;
+    const long N = static_cast<long>(P.N);
+    const double max_q = FixedFrame::kSteps - 1.0;
 
-    // Cache pointers for speed
-    float* x  = P.x.data();
-    float* y  = P.y.data();
-    float* z  = P.z.data();
+    long outside = 0;
+    #pragma omp parallel for reduction(+:outside)
+    for (long i = 0; i < N; ++i) {
+        if (!P.alive[i]) continue;
+        const double qn[3] = {
+            double(P.qx[i]) + double(P.vx[i]) * dt / P.frame.cell,
+            double(P.qy[i]) + double(P.vy[i]) * dt / P.frame.cell,
+            double(P.qz[i]) + double(P.vz[i]) * dt / P.frame.cell
+        };
+        for (int a = 0; a < 3; ++a)
+            if (qn[a] < 0.0 || qn[a] > max_q) outside++;
+    }
 
-    float* vx = P.vx.data();
-    float* vy = P.vy.data();
-    float* vz = P.vz.data();
+    if (outside) {
+        double lo[3] = {1e300, 1e300, 1e300}, hi[3] = {-1e300, -1e300, -1e300};
+        for (long i = 0; i < N; ++i) {
+            if (!P.alive[i]) continue;
+            const double p[3] = {
+                P.frame.decode(P.qx[i], 0) + double(P.vx[i]) * dt,
+                P.frame.decode(P.qy[i], 1) + double(P.vy[i]) * dt,
+                P.frame.decode(P.qz[i], 2) + double(P.vz[i]) * dt
+            };
+            for (int a = 0; a < 3; ++a) {
+                lo[a] = std::min(lo[a], p[a]);
+                hi[a] = std::max(hi[a], p[a]);
+            }
+        }
+        P.refit_frame(lo, hi);
+    }
 
-    float* ax = P.ax.data();
-    float* ay = P.ay.data();
-    float* az = P.az.data();
+    const FixedFrame& F = P.frame;
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < N; ++i) {
+        if (!P.alive[i]) continue;
+        P.qx[i] = uint32_t(int64_t(P.qx[i]) + F.steps(double(P.vx[i]) * dt));
+        P.qy[i] = uint32_t(int64_t(P.qy[i]) + F.steps(double(P.vy[i]) * dt));
+        P.qz[i] = uint32_t(int64_t(P.qz[i]) + F.steps(double(P.vz[i]) * dt));
+        P.x[i] = real_t(F.decode(P.qx[i], 0));
+        P.y[i] = real_t(F.decode(P.qy[i], 1));
+        P.z[i] = real_t(F.decode(P.qz[i], 2));
+    }
+}
 
-    const uint8_t* alive = P.alive.data();
 
-    for (size_t i = 0; i < N; ++i) {
-        if (!alive[i]) continue;
+void velocity_verlet_cached(Particles& P, real_t dt)
+{
+    if (P.fixed_positions()) {
+        fuse(Kick{dt}).run(P);
+        drift_fixed(P, dt);
+        return;
+    }
+    fuse(Kick{dt}, Drift{dt}).run(P);
+}
+
+
+void update_gas(Particles& P, real_t dt, const EosTable* eos)
+{
+    if (P.fixed_positions()) {
+        fuse(Kick{dt}).run(P);
+        drift_fixed(P, dt);
+        if (!eos) fuse(CompressionalHeating(dt), Cooling{}).run(P);
+        else if (eos->molecular()) fuse(CompressionalHeating(dt), MolecularCooling(eos, dt)).run(P);
+        else fuse(CompressionalHeating(dt), TabulatedCooling{eos}).run(P);
+        return;
+    }
+    if (!eos) GasUpdate(Kick{dt}, Drift{dt}, CompressionalHeating(dt), Cooling{}).run(P);
+    else if (eos->molecular()) MolecularGasUpdate(Kick{dt}, Drift{dt}, CompressionalHeating(dt), MolecularCooling(eos, dt)).run(P);
+    else TabulatedGasUpdate(Kick{dt}, Drift{dt}, CompressionalHeating(dt), TabulatedCooling{eos}).run(P);
+}
+
+
+
+void velocity_verlet_sinks(SinkParticles& S, real_t dt)
+{
+    for (size_t s = 0; s < S.size(); ++s) {
+        Star& st = S.stars[s];
 
         // Half-step velocity update
-        vx[i] += 0.5f * ax[i] * dt;
-        vy[i] += 0.5f * ay[i] * dt;
-        vz[i] += 0.5f * az[i] * dt;
+        st.velocity += S.acc[s] * (real_t(0.5) * dt);
 
         // Full-step position update
-        x[i] += vx[i] * dt;
-        y[i] += vy[i] * dt;
-        z[i] += vz[i] * dt;
+        st.position += st.velocity * dt;
     }
 }
-
@@ -0,0 +1,76 @@
+#include "../include/kdtree.hpp"
+#include <limits>
+
+namespace {
+
+// ranges larger than this are split in their own OpenMP task
+constexpr uint32_t kTaskGrain = 16384;
+
+}
+
+void KdTree::build(const Particles& P) {
+    const size_t N = P.N;
+    points_.clear();
+    for (size_t i = 0; i < N; ++i) {
+        if (!P.alive[i]) continue;
+        points_.push_back(Point{{P.x[i], P.y[i], P.z[i]}, uint32_t(i)});
+    }
+    period_ = real_t(P.period);
+    inv_period_ = P.period > 0.0 ? real_t(1.0 / P.period) : real_t(0);
+
+    for (int a = 0; a < 3; ++a) {
+        lo_[a] = std::numeric_limits<real_t>::max();
+        hi_[a] = std::numeric_limits<real_t>::lowest();
+    }
+    for (const Point& p : points_) {
+        for (int a = 0; a < 3; ++a) {
+            lo_[a] = std::min(lo_[a], p.p[a]);
+            hi_[a] = std::max(hi_[a], p.p[a]);
+        }
+    }
+
+    axis_.resize(points_.size());
+    if (!points_.empty()) {
+        real_t lo[3] = {lo_[0], lo_[1], lo_[2]};
+        real_t hi[3] = {hi_[0], hi_[1], hi_[2]};
+        #pragma omp parallel
+        #pragma omp single
+        build_range(0, uint32_t(points_.size()), lo, hi);
+    }
+
+    items_.resize(points_.size());
+    for (size_t s = 0; s < points_.size(); ++s) items_[s] = points_[s].index;
+}
+
+// Order [lo, hi) as a subtree: split at the median along the widest side of
+// the node's box, then order both halves.
+void KdTree::build_range(uint32_t lo, uint32_t hi, real_t box_lo[3], real_t box_hi[3]) {
+    if (hi - lo <= kLeafSize) return;
+    int a = 0;
+    for (int b = 1; b < 3; ++b) {
+        if (box_hi[b] - box_lo[b] > box_hi[a] - box_lo[a]) a = b;
+    }
+    const uint32_t mid = lo + (hi - lo) / 2;
+    std::nth_element(points_.begin() + lo, points_.begin() + mid, points_.begin() + hi,
+                     [a](const Point& p, const Point& q) { return p.p[a] < q.p[a]; });
+    axis_[mid] = uint8_t(a);
+    const real_t split = points_[mid].p[a];
+
+    real_t left_lo[3] = {box_lo[0], box_lo[1], box_lo[2]};
+    real_t left_hi[3] = {box_hi[0], box_hi[1], box_hi[2]};
+    left_hi[a] = split;
+    real_t right_lo[3] = {box_lo[0], box_lo[1], box_lo[2]};
+    real_t right_hi[3] = {box_hi[0], box_hi[1], box_hi[2]};
+    right_lo[a] = split;
+
+    // the halves are disjoint, so large ones are ordered concurrently
+    if (hi - lo > kTaskGrain) {
+        #pragma omp task firstprivate(lo, mid, left_lo, left_hi)
+        build_range(lo, mid, left_lo, left_hi);
+        build_range(mid + 1, hi, right_lo, right_hi);
+        #pragma omp taskwait
+    } else {
+        build_range(lo, mid, left_lo, left_hi);
+        build_range(mid + 1, hi, right_lo, right_hi);
+    }
+}
@@ -1,211 +1,110 @@
 #include "../include/particles.hpp"
-#include "../include/physics.hpp"
-#include "../include/integrator.hpp"
-#include "../include/gravity.hpp"
-#include "../include/density.hpp"
-#include "../include/hydro.hpp"
-#include "../include/init.hpp"
-#include "../include/thermo.hpp"
-#include "../include/starform.hpp"
-#include "../include/distance.hpp"
-#include "../include/bh.hpp"
+#include "../include/config.hpp"
+#include "../include/run.hpp"
 #include "../include/verify.hpp"
-
-
+#include "../include/ensemble.hpp"
+#include "../include/snapshot.hpp"
+#include "../include/init.hpp"
+#include "../include/parallel.hpp"
+#include "../include/codec.hpp"
 
 #include <iostream>
-#include <chrono>
+#include <cmath>
 #include <string>
 #include <filesystem>
-#include <algorithm>
-#include <fstream>
-#include <array>
-#include <iostream>
 
 
 int main(int argc, char** argv) {
-    // Physics Hyperparameters
-    float neighbor_radius = 0.05f;        
-    float density_threshold =  100.0; 
-
-	// Performance Hyperparameters
-    size_t N = 1000;  
-    size_t num_steps = 100;
-    float dt = 0.001f;
-    int version_type = 2;
-
-    const int min_neighbors = 5;
-    // bool verify = true;
-
-    // int k = 50; // for density KNN    
-
-    bool use_cached = false;
-    bool verify = false;
-
-    if (argc > 1) {
-        std::string arg1 = argv[1];
-        if (arg1 == "--use_cached") use_cached = true;
-        if (arg1 == "--verify")     verify = true;
+#ifdef STARFORM_USE_MPI
+    MPI_Init(&argc, &argv);
+#endif
+
+    // All hyperparameters come from Config (defaults in config.hpp), an
+    // optional --config=<file> and --key=value overrides.
+    Config cfg;
+    if (!apply_cli_overrides(cfg, argc, argv)) {
+        std::cerr << "ERROR: invalid configuration (see the warnings above)\n";
+#ifdef STARFORM_USE_MPI
+        MPI_Finalize();
+#endif
+        return 1;
     }
 
-    if (argc > 2) {
-        std::string arg2 = argv[2];
-        if (arg2 == "--use_cached") use_cached = true;
-        if (arg2 == "--verify")     verify = true;
+#ifdef STARFORM_USE_MPI
+    const int rc = run_distributed(cfg);
+    MPI_Finalize();
+    return rc;
+#endif
+
+    std::cout << "Precision: " << precision_name() << "\n";
+    print_config(cfg);
+
+    // initial conditions only: generated chunk by chunk, never all in memory
+    if (!cfg.ic_output.empty()) {
+        std::cout << "Streaming " << cfg.num_particles << " particles ("
+                  << init_name(cfg.init_type) << ") to " << cfg.ic_output << "\n";
+        return stream_initial_conditions(cfg.ic_output, cfg.init_type, cfg.num_particles,
+                                         cfg.seed, cfg.ic_chunk) ? 0 : 1;
     }
 
+    // compressed frames back to CSV (e.g. for figures/view_particles.py)
+    if (!cfg.decompress_frames.empty()) {
+        return decompress_frames(cfg.decompress_frames) ? 0 : 1;
+    }
 
-    Particles P(N);
+    Particles P(cfg.num_particles);
     // ----------------------------------------------------
     // Initialize particle positions
     // ----------------------------------------------------
-    init_particles(P, version_type);
-    StarFormation SF(neighbor_radius, min_neighbors, density_threshold);
-    auto start = std::chrono::high_resolution_clock::now();
-
-
-    float h = 0.03f; // smoothing length for Density
-
-    if (use_cached){
-        // BarnesHutSolver bh(P, 0., 1e-3);
-        // bh.build_with_particles(P);
-        start = std::chrono::high_resolution_clock::now();
-
-        // ----------------------------------------------------
-        // Simulation loop
-        // ----------------------------------------------------
-        for (size_t t = 0; t < num_steps; ++t) {
-            // ------------------------------------------------
-            // 1. Compute gravitational acceleration
-            // ------------------------------------------------
-            // bh.compute_accelerations(P, 1.0); // writes accelerations into P.ax,P.ay,P.az
-            compute_gravity_cached_optimized(P);
-
-
-            // ------------------------------------------------
-            // 2. Compute densities (SPH or KNN)
-            // ------------------------------------------------
-            // compute_density_kNN(P, k);
-            compute_density_sph(P, h);
-
-
-            // ------------------------------------------------
-            // 3. Compute pressure forces
-            // (This is where the thermodynamics and kinetics kiss)
-            // ------------------------------------------------
-            compute_pressure_forces_cached(P, h);
-
-            // ------------------------------------------------
-            // 4. Integrate motion
-            // ------------------------------------------------
-            velocity_verlet_cached(P, dt);
-
-            // ------------------------------------------------
-            // 5. Update thermodynamics
-            // ------------------------------------------------
-            update_thermodynamics_cached(P, dt);
-
-            // ----------------------------------------------------
-            // 6. Update thermodynamic physics
-            //    (temperature, pressure eqn of state, etc.)
-            // ----------------------------------------------------
-            update_physics(P, dt);
-
-            // ----------------------------------------------------
-            // 7. Check star formation
-            // ----------------------------------------------------
-            auto candidates = SF.detect_star_candidates(P);
-            SF.form_stars(P, candidates, t * dt);
-
-            // ----------------------------------------------------
-            // 8. Output snapshot
-            // ----------------------------------------------------
-            std::string fname = "frames/frame_" + std::to_string(t) + ".csv";
-            P.write_csv(fname);
-        }
-
-
+    if (!init_from_config(P, cfg)) {
+        std::cerr << "ERROR: could not load the initial conditions from " << cfg.ic_input << "\n";
+        return 1;
     }
 
-    else {
-        start = std::chrono::high_resolution_clock::now();
-
-        // ----------------------------------------------------
-        // Simulation loop
-        // ----------------------------------------------------
-        for (size_t t = 0; t < num_steps; ++t) {
-            // ------------------------------------------------
-            // 1. Compute gravitational acceleration
-            // ------------------------------------------------
-            std::vector<float> ax(P.N, 0.0f);
-            std::vector<float> ay(P.N, 0.0f);
-            std::vector<float> az(P.N, 0.0f);
-
-            compute_gravity(P, ax, ay, az);
-
-            // ------------------------------------------------
-            // 2. Compute densities (SPH or KNN)
-            // ------------------------------------------------
-            // compute_density_kNN(P, k);
-            compute_density_sph(P, h);
-
-
-            // ------------------------------------------------
-            // 3. Compute pressure forces
-            // (This is where the thermodynamics and kinetics kiss)
-            // ------------------------------------------------
-            compute_pressure_forces(P, h, ax, ay, az);
-
-            // ------------------------------------------------
-            // 4. Integrate motion
-            // ------------------------------------------------
-            velocity_verlet(P, ax, ay, az, dt);
-
-            // ------------------------------------------------
-            // 5. Update thermodynamics
-            // ------------------------------------------------
-            update_thermodynamics(P, dt);
-
-            // ----------------------------------------------------
-            // 6. Update thermodynamic physics
-            //    (temperature, pressure eqn of state, etc.)
-            // ----------------------------------------------------
-            update_physics(P, dt);
-
-            // ----------------------------------------------------
-            // 7. Check star formation
-            // ----------------------------------------------------
-            auto candidates = SF.detect_star_candidates(P);
-            SF.form_stars(P, candidates, t * dt);
-
-            // ----------------------------------------------------
-            // 8. Output snapshot
-            // ----------------------------------------------------
-            std::string fname = "frames/frame_" + std::to_string(t) + ".csv";
-            P.write_csv(fname);
-        }
-
+    // parameter sweep: every member starts from this same P
+    if (!cfg.sweep.empty()) {
+        return run_ensemble(P, cfg).empty() ? 1 : 0;
     }
 
-    auto end = std::chrono::high_resolution_clock::now();
+    RunResult result = run_simulation(P, cfg);
 
-    std::cout << (use_cached ? "cached" : "normal")
-              << " runtime: "
-              << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+    std::cout << (cfg.use_cached ? "cached" : "normal")
+              << " runtime: " << static_cast<long long>(result.runtime_ms)
               << " ms\n";
 
+    const SinkParticles& sinks = result.sinks;
+    float percent_stars = 100.0f * float(result.star_mass_fraction);
+
+    std::cout << sinks.size() << " stars formed; "
+              << percent_stars << "\% of the gas mass was accreted onto stars" << std::endl;
+    for (size_t s = 0; s < sinks.size(); ++s) {
+        const Star& st = sinks.stars[s];
+        std::cout << "  star " << s << ": mass " << st.mass
+                  << ", formed at t=" << st.formation_time
+                  << ", position (" << st.position.x << ", " << st.position.y
+                  << ", " << st.position.z << ")\n";
+    }
 
-    int particles_to_star_count = P.count_particles_in_stars();
+    std::cout << "thread load imbalance (max/mean busy time, " << par_max_threads()
+              << " threads):";
+    if (cfg.use_cached && (cfg.gravity_solver == "barnes_hut" || cfg.gravity_solver == "treepm"))
+        std::cout << " tree walk " << result.tree_imbalance << ",";
+    std::cout << " star-candidate search " << result.starform_imbalance << "\n";
 
-    float float_N = (float)P.N;
-    float float_particles = (float)particles_to_star_count;
-    float percent_stars = 100.0 * float_particles / float_N;
+    if (cfg.diagnostics_interval > 0 && !std::isnan(result.max_energy_drift)) {
+        std::cout << "max relative energy drift: " << result.max_energy_drift
+                  << " (see " << cfg.output_dir << "/diagnostics.csv)\n";
+    }
 
-    std::cout << percent_stars << "\% of particles became a part of the star" << std::endl;
+    // written whenever verification ran, also without snapshots
+    if (!result.verification.empty()) {
+        std::filesystem::create_directories(cfg.output_dir);
+        write_verification_series(result.verification, cfg.output_dir + "/verification.csv");
+    }
 
-    if (verify){
-        verify_against_reference(P, "reference_data/reference_profile.csv");
+    if (cfg.verify){
+        verify_against_reference(P, cfg.reference_csv);
     }
 
-    return 0;
+    return result.aborted ? 2 : 0;
 }
@@ -0,0 +1,80 @@
+#include "../include/neighbors.hpp"
+#include <cmath>
+#include <limits>
+
+bool NeighborGrid::build(const Particles& P, real_t cell_size) {
+    const long N = static_cast<long>(P.N);
+
+    real_t lo[3], hi[3];
+    for (int a = 0; a < 3; ++a) {
+        lo[a] = std::numeric_limits<real_t>::max();
+        hi[a] = std::numeric_limits<real_t>::lowest();
+    }
+    size_t alive = 0;
+    bool finite = true;
+    for (long i = 0; i < N; ++i) {
+        if (!P.alive[i]) continue;
+        alive++;
+        const real_t p[3] = {P.x[i], P.y[i], P.z[i]};
+        for (int a = 0; a < 3; ++a) {
+            finite = finite && std::isfinite(p[a]);
+            lo[a] = std::min(lo[a], p[a]);
+            hi[a] = std::max(hi[a], p[a]);
+        }
+    }
+
+    items_.clear();
+    if (alive == 0 || !finite) {
+        cell_start_.assign(2, 0);
+        dims_[0] = dims_[1] = dims_[2] = 1;
+        return finite;
+    }
+
+    // keep the grid at most ~2 cells per particle (sparse clustered runs)
+    cell_ = std::max(cell_size, real_t(1e-12));
+    const double max_cells = 2.0 * double(alive) + 27.0;
+    // (counted in double: a wide spread must coarsen the cell, not
+    // overflow the int dimensions)
+    double dims[3];
+    for (;;) {
+        double cells = 1.0;
+        for (int a = 0; a < 3; ++a) {
+            dims[a] = std::floor((double(hi[a]) - double(lo[a])) / double(cell_)) + 1.0;
+            cells *= dims[a];
+        }
+        if (cells <= max_cells) break;
+        cell_ *= real_t(std::cbrt(cells / max_cells) * 1.01);
+    }
+    for (int a = 0; a < 3; ++a) dims_[a] = static_cast<int>(dims[a]); // each <= max_cells
+    inv_cell_ = real_t(1) / cell_;
+    for (int a = 0; a < 3; ++a) lo_[a] = lo[a];
+
+    const size_t ncells = size_t(dims_[0]) * dims_[1] * dims_[2];
+    cell_of_.resize(N);
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < N; ++i) {
+        if (!P.alive[i]) continue;
+        cell_of_[i] = static_cast<uint32_t>(
+            (size_t(cell_coord(P.z[i], 2)) * dims_[1] + cell_coord(P.y[i], 1)) * dims_[0]
+            + cell_coord(P.x[i], 0));
+    }
+
+    // counting sort by cell; the cell count drifts as the gas moves, so
+    // leave headroom to keep rebuilds from reallocating every step
+    if (ncells + 1 > cell_start_.capacity()) {
+        cell_start_.reserve(ncells + 1 + ncells / 4);
+        cursor_.reserve(ncells + ncells / 4);
+    }
+    cell_start_.assign(ncells + 1, 0);
+    for (long i = 0; i < N; ++i) {
+        if (P.alive[i]) cell_start_[cell_of_[i] + 1]++;
+    }
+    for (size_t c = 0; c < ncells; ++c) cell_start_[c + 1] += cell_start_[c];
+
+    items_.resize(alive);
+    cursor_.assign(cell_start_.begin(), cell_start_.end() - 1);
+    for (long i = 0; i < N; ++i) {
+        if (P.alive[i]) items_[cursor_[cell_of_[i]]++] = static_cast<uint32_t>(i);
+    }
+    return true;
+}
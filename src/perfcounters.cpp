@@ -0,0 +1,360 @@
+#include "../include/perfcounters.hpp"
+#include "../include/parallel.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+#ifdef __linux__
+int open_event(int event) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (event) {
+        case kPerfCycles:       attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+        case kPerfInstructions: attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+        case kPerfLLCMisses:    attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+        case kPerfBranchMisses: attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+        default:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_TASK_CLOCK;
+    }
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // pid 0, cpu -1: the calling thread on any CPU
+    return int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+#endif
+
+// results of the ceiling loops end up here so they are not optimised away
+volatile double g_sink = 0.0;
+
+double measure_gflops() {
+    const int reps = 200000;
+    double best = 0.0;
+    for (int trial = 0; trial < 3; ++trial) {
+        int team = 1;
+        double sum = 0.0;
+        const double t0 = par_wtime();
+        #pragma omp parallel reduction(+:sum)
+        {
+            #pragma omp single
+            team = par_num_threads();
+            // 64 independent multiply-add chains, enough to hide the latency
+            float v[64];
+            for (int k = 0; k < 64; ++k) v[k] = 1.0f + 1e-3f * float(k);
+            const float a = 0.9999999f, b = 1e-7f;
+            for (int r = 0; r < reps; ++r) {
+                #pragma omp simd
+                for (int k = 0; k < 64; ++k) v[k] = v[k] * a + b;
+            }
+            for (int k = 0; k < 64; ++k) sum += double(v[k]);
+        }
+        const double dt = par_wtime() - t0;
+        g_sink = g_sink + sum;
+        best = std::max(best, 2.0 * 64.0 * reps * team / dt * 1e-9);
+    }
+    return best;
+}
+
+double measure_bandwidth(double cache) {
+    // each array larger than the cache, so the triad streams from memory
+    const size_t n = size_t(std::clamp(cache, 32.0e6, 256.0e6) / sizeof(float));
+    std::vector<float> a(n), b(n), c(n);
+    const long N = long(n);
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < N; ++i) { a[i] = 0.0f; b[i] = 1.0f; c[i] = 2.0f; }
+    double best = 0.0;
+    for (int trial = 0; trial < 5; ++trial) {
+        const double t0 = par_wtime();
+        #pragma omp parallel for schedule(static)
+        for (long i = 0; i < N; ++i) a[i] = b[i] + 0.5f * c[i];
+        const double dt = par_wtime() - t0;
+        best = std::max(best, 3.0 * sizeof(float) * double(n) / dt * 1e-9);
+    }
+    g_sink = g_sink + a[n / 2];
+    return best;
+}
+
+}
+
+const char* perf_event_name(int event) {
+    static const char* names[kNumPerfEvents] = {"cycles", "instructions", "llc_misses",
+                                                "branch_misses", "task_clock"};
+    return names[event];
+}
+
+PerfCounters::PerfCounters(int threads) {
+#ifdef __linux__
+    int first_error = 0;
+    int team = 1;
+    fds_.assign(size_t(std::max(threads, 1)) * kNumPerfEvents, -1);
+    // per-thread counters, opened by the threads the step loop will use
+    #pragma omp parallel num_threads(std::max(threads, 1))
+    {
+        const int t = par_thread_id();
+        #pragma omp single
+        team = par_num_threads();
+        for (int e = 0; e < kNumPerfEvents; ++e) {
+            const int fd = open_event(e);
+            fds_[size_t(t) * kNumPerfEvents + e] = fd;
+            if (fd < 0 && e != kPerfTaskClock) {
+                #pragma omp critical(perf_open)
+                if (!first_error) first_error = errno;
+            }
+        }
+    }
+    fds_.resize(size_t(team) * kNumPerfEvents);
+
+    // an event counts only if every thread has it
+    for (int e = 0; e < kNumPerfEvents; ++e) {
+        available_[e] = true;
+        for (int t = 0; t < team; ++t) available_[e] = available_[e] && fds_[t * kNumPerfEvents + e] >= 0;
+        if (available_[e]) continue;
+        for (int t = 0; t < team; ++t) {
+            int& fd = fds_[t * kNumPerfEvents + e];
+            if (fd >= 0) close(fd);
+            fd = -1;
+        }
+    }
+    if (!any_hardware()) {
+        std::ostringstream why;
+        why << std::strerror(first_error ? first_error : ENOSYS);
+        std::ifstream paranoid("/proc/sys/kernel/perf_event_paranoid");
+        int level = 0;
+        if (paranoid >> level) why << "; kernel.perf_event_paranoid = " << level;
+        reason_ = why.str();
+    }
+#else
+    (void)threads;
+    reason_ = "perf_event_open needs Linux";
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd : fds_) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+bool PerfCounters::any_hardware() const {
+    return available_[kPerfCycles] || available_[kPerfInstructions] ||
+           available_[kPerfLLCMisses] || available_[kPerfBranchMisses];
+}
+
+void PerfCounters::read(double out[kNumPerfEvents]) const {
+    for (int e = 0; e < kNumPerfEvents; ++e) out[e] = 0.0;
+    for (size_t s = 0; s < fds_.size(); ++s) {
+        if (fds_[s] < 0) continue;
+        // value, time enabled, time running
+        uint64_t v[3] = {0, 0, 0};
+        if (::read(fds_[s], v, sizeof(v)) != ssize_t(sizeof(v))) continue;
+        const double scale = v[2] > 0 ? double(v[1]) / double(v[2]) : 1.0;
+        out[s % kNumPerfEvents] += double(v[0]) * scale;
+    }
+}
+
+double last_level_cache_bytes() {
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    const long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (l3 > 0) return double(l3);
+    const long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (l2 > 0) return double(l2);
+#endif
+    return 8.0 * 1024 * 1024;
+}
+
+KernelCost pair_sweep_cost(double n, double pairs, double flops_per_pair,
+                           double bytes_per_source, double bytes_per_target,
+                           double cache_bytes) {
+    const double sources = n * bytes_per_source <= cache_bytes ? n : pairs;
+    return KernelCost{pairs * flops_per_pair, sources * bytes_per_source + n * bytes_per_target};
+}
+
+MachinePeaks measure_peaks(double gflops, double bandwidth) {
+    MachinePeaks m;
+    m.cache_bytes = last_level_cache_bytes();
+    m.gflops = gflops > 0.0 ? gflops : measure_gflops();
+    m.bandwidth = bandwidth > 0.0 ? bandwidth : measure_bandwidth(m.cache_bytes);
+    return m;
+}
+
+PhaseProfiler::PhaseProfiler(int threads) : threads_(std::max(threads, 1)), counters_(threads) {}
+
+size_t PhaseProfiler::add(const std::string& name, std::function<KernelCost()> model) {
+    Phase p;
+    p.name = name;
+    p.model = std::move(model);
+    phases_.push_back(std::move(p));
+    return phases_.size() - 1;
+}
+
+void PhaseProfiler::begin(size_t phase) {
+    Phase& p = phases_[phase];
+    counters_.read(p.start);
+    p.t0 = par_wtime();
+}
+
+void PhaseProfiler::end(size_t phase) {
+    Phase& p = phases_[phase];
+    const double t1 = par_wtime();
+    double now[kNumPerfEvents];
+    counters_.read(now);
+    p.seconds += t1 - p.t0;
+    for (int e = 0; e < kNumPerfEvents; ++e) p.counts[e] += now[e] - p.start[e];
+    if (p.model) {
+        const KernelCost c = p.model();
+        p.flops += c.flops;
+        p.bytes += c.bytes;
+    }
+    p.calls++;
+}
+
+namespace {
+
+// one report row; empty strings for what is not known
+struct Row {
+    std::string cells[13];
+};
+
+std::string fixed(double v, int digits) {
+    std::ostringstream s;
+    s << std::fixed << std::setprecision(digits) << v;
+    return s.str();
+}
+
+}
+
+static std::vector<Row> report_rows(const std::vector<std::string>& names,
+                                    const std::vector<size_t>& calls,
+                                    const std::vector<double>& seconds,
+                                    const std::vector<double>& flops,
+                                    const std::vector<double>& bytes,
+                                    const std::vector<std::vector<double>>& counts,
+                                    const PerfCounters& pc, const MachinePeaks& peaks,
+                                    int threads) {
+    double total = 0.0;
+    for (double s : seconds) total += s;
+    const double ridge = peaks.bandwidth > 0.0 ? peaks.gflops / peaks.bandwidth : 0.0;
+    std::vector<Row> rows;
+    for (size_t k = 0; k < names.size(); ++k) {
+        Row r;
+        const double s = seconds[k];
+        r.cells[0] = names[k];
+        r.cells[1] = std::to_string(calls[k]);
+        r.cells[2] = fixed(s, 3);
+        r.cells[3] = fixed(total > 0.0 ? 100.0 * s / total : 0.0, 1);
+        // (below a millisecond the clock's granularity dominates, here and
+        // for the CPU time)
+        if (s >= 1e-3 && (flops[k] > 0.0 || bytes[k] > 0.0)) {
+            const double gf = flops[k] / s * 1e-9, gb = bytes[k] / s * 1e-9;
+            // without modelled memory traffic (a sweep in cache) only the
+            // compute ceiling applies
+            const bool traffic = bytes[k] > 0.0;
+            const double ai = traffic ? flops[k] / bytes[k] : 0.0;
+            const double roof = traffic ? std::min(peaks.gflops, ai * peaks.bandwidth) : peaks.gflops;
+            r.cells[4] = fixed(gf, 2);
+            r.cells[5] = fixed(gb, 2);
+            if (traffic) r.cells[6] = fixed(ai, 2);
+            r.cells[7] = traffic && ai < ridge ? "memory" : "compute";
+            r.cells[8] = fixed(roof > 0.0 ? 100.0 * gf / roof : 0.0, 1);
+        }
+        const std::vector<double>& c = counts[k];
+        if (pc.available(kPerfCycles) && pc.available(kPerfInstructions) && c[kPerfCycles] > 0) {
+            r.cells[9] = fixed(c[kPerfInstructions] / c[kPerfCycles], 2);
+        }
+        if (pc.available(kPerfLLCMisses) && s > 0.0) {
+            r.cells[10] = fixed(c[kPerfLLCMisses] * 64.0 / s * 1e-9, 2);
+        }
+        if (pc.available(kPerfBranchMisses) && pc.available(kPerfInstructions) &&
+            c[kPerfInstructions] > 0) {
+            r.cells[11] = fixed(1000.0 * c[kPerfBranchMisses] / c[kPerfInstructions], 2);
+        }
+        if (pc.available(kPerfTaskClock) && s >= 1e-3) {
+            r.cells[12] = fixed(100.0 * c[kPerfTaskClock] * 1e-9 / (s * threads), 0);
+        }
+        rows.push_back(r);
+    }
+    return rows;
+}
+
+void PhaseProfiler::report(std::ostream& out, const MachinePeaks& peaks) const {
+    std::vector<std::string> names;
+    std::vector<size_t> calls;
+    std::vector<double> seconds, flops, bytes;
+    std::vector<std::vector<double>> counts;
+    for (const Phase& p : phases_) {
+        if (p.calls == 0) continue;
+        names.push_back(p.name);
+        calls.push_back(p.calls);
+        seconds.push_back(p.seconds);
+        flops.push_back(p.flops);
+        bytes.push_back(p.bytes);
+        counts.emplace_back(p.counts, p.counts + kNumPerfEvents);
+    }
+    const std::vector<Row> rows = report_rows(names, calls, seconds, flops, bytes, counts,
+                                              counters_, peaks, threads_);
+
+    out << "Roofline (" << threads_ << " threads): compute " << fixed(peaks.gflops, 1)
+        << " GFLOP/s, memory " << fixed(peaks.bandwidth, 1) << " GB/s, ridge at "
+        << fixed(peaks.bandwidth > 0.0 ? peaks.gflops / peaks.bandwidth : 0.0, 2)
+        << " flop/B\n";
+    if (!counters_.any_hardware()) {
+        out << "  no hardware counters (" << counters_.unavailable_reason()
+            << "): IPC, LLC and branch columns are empty\n";
+    }
+    static const char* header[13] = {"phase", "calls", "time s", "%", "GFLOP/s", "GB/s",
+                                      "flop/B", "bound", "% roof", "IPC", "LLC GB/s",
+                                      "br-miss/ki", "CPU %"};
+    size_t width[13];
+    for (int c = 0; c < 13; ++c) {
+        width[c] = std::strlen(header[c]);
+        for (const Row& r : rows) width[c] = std::max(width[c], r.cells[c].size());
+    }
+    auto line = [&](const std::string* cells) {
+        out << "  " << std::left << std::setw(int(width[0])) << cells[0] << std::right;
+        for (int c = 1; c < 13; ++c) {
+            out << "  " << std::setw(int(width[c])) << (cells[c].empty() ? "-" : cells[c]);
+        }
+        out << "\n";
+    };
+    std::string head[13];
+    for (int c = 0; c < 13; ++c) head[c] = header[c];
+    line(head);
+    for (const Row& r : rows) line(r.cells);
+}
+
+bool PhaseProfiler::write_csv(const std::string& filename, const MachinePeaks& peaks) const {
+    std::ofstream f(filename);
+    if (!f) {
+        std::cerr << "ERROR: cannot write " << filename << "\n";
+        return false;
+    }
+    f << "phase,calls,seconds,flops,bytes";
+    for (int e = 0; e < kNumPerfEvents; ++e) f << "," << perf_event_name(e);
+    f << ",peak_gflops,peak_bandwidth\n";
+    f << std::setprecision(9);
+    for (const Phase& p : phases_) {
+        if (p.calls == 0) continue;
+        f << p.name << "," << p.calls << "," << p.seconds << "," << p.flops << "," << p.bytes;
+        for (int e = 0; e < kNumPerfEvents; ++e) {
+            f << ",";
+            if (counters_.available(e)) f << p.counts[e];
+        }
+        f << "," << peaks.gflops << "," << peaks.bandwidth << "\n";
+    }
+    return true;
+}
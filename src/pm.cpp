@@ -0,0 +1,207 @@
+#include "../include/pm.hpp"
+#include "../include/parallel.hpp"
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+
+PMSolver::PMSolver(size_t n, double period, double split)
+    : n_(n), m_(period > 0.0 ? n : 2 * n), period_(period), split_(split), fft_(m_)
+{
+    // open boundaries keep 3.5 cells of margin on each side of the particles
+    if (!is_pow2(n) || (period <= 0.0 && n < 16))
+        throw std::invalid_argument("PM mesh must be a power of two (at least 16 for open boundaries)");
+    mesh_.resize(m_ * m_ * m_);
+    build_green();
+}
+
+void PMSolver::fit(const Particles& P) {
+    if (periodic()) {
+        h_ = period_ / double(n_);
+        return;
+    }
+    double lo[3], hi[3];
+    P.bounds(lo, hi);
+    double extent = 0.0;
+    for (int a = 0; a < 3; ++a) extent = std::max(extent, hi[a] - lo[a]);
+    if (extent <= 0.0) extent = 1e-6; // degenerate case
+    h_ = extent / double(n_ - 7);
+    for (int a = 0; a < 3; ++a) origin_[a] = 0.5 * (lo[a] + hi[a]) - 0.5 * double(n_) * h_;
+}
+
+inline void PMSolver::mesh_coords(const Particles& P, size_t p, double u[3]) const {
+    const double x[3] = {double(P.x[p]), double(P.y[p]), double(P.z[p])};
+    for (int a = 0; a < 3; ++a) {
+        u[a] = (x[a] - origin_[a]) / h_;
+        if (periodic()) u[a] -= double(n_) * std::floor(u[a] / double(n_));
+    }
+}
+
+// CIC window of one mesh cell at integer wavenumber kappa, per axis
+static double cic_window(long kappa, size_t m) {
+    if (kappa == 0) return 1.0;
+    const double x = M_PI * double(kappa) / double(m);
+    const double s = std::sin(x) / x;
+    return s * s;
+}
+
+void PMSolver::build_green() {
+    const size_t m = m_;
+    const long total = static_cast<long>(m * m * m);
+    green_.assign(m * m * m, 0.0);
+    auto signed_k = [m](size_t i) { return i <= m / 2 ? long(i) : long(i) - long(m); };
+
+    if (periodic()) {
+        // 4 pi / k^2 in cell units, long-range filtered for TreePM
+        const double dk = 2.0 * M_PI / double(m);
+        #pragma omp parallel for schedule(static)
+        for (long idx = 0; idx < total; ++idx) {
+            const long kx = signed_k(size_t(idx) % m);
+            const long ky = signed_k((size_t(idx) / m) % m);
+            const long kz = signed_k(size_t(idx) / (m * m));
+            const double k2 = dk * dk * double(kx * kx + ky * ky + kz * kz);
+            if (k2 == 0.0) continue; // mean density carries no force
+            double g = 4.0 * M_PI / k2;
+            if (split_ > 0.0) g *= std::exp(-k2 * split_ * split_);
+            const double w = cic_window(kx, m) * cic_window(ky, m) * cic_window(kz, m);
+            green_[idx] = g / (w * w);
+        }
+    } else {
+        // real-space kernel on the padded mesh (distances wrap at m / 2)
+        #pragma omp parallel for schedule(static)
+        for (long idx = 0; idx < total; ++idx) {
+            const double dx = double(std::labs(signed_k(size_t(idx) % m)));
+            const double dy = double(std::labs(signed_k((size_t(idx) / m) % m)));
+            const double dz = double(std::labs(signed_k(size_t(idx) / (m * m))));
+            const double r = std::sqrt(dx * dx + dy * dy + dz * dz);
+            double g;
+            if (split_ > 0.0) g = r > 0.0 ? std::erf(r / (2.0 * split_)) / r : 1.0 / (split_ * std::sqrt(M_PI));
+            else              g = 1.0 / std::sqrt(r * r + 1.0);
+            mesh_[idx] = cplx(g, 0.0);
+        }
+        fft_.forward(mesh_.data());
+        #pragma omp parallel for schedule(static)
+        for (long idx = 0; idx < total; ++idx) {
+            double g = mesh_[idx].real(); // the kernel is real and even
+            if (split_ > 0.0) {
+                const double w = cic_window(signed_k(size_t(idx) % m), m) *
+                                 cic_window(signed_k((size_t(idx) / m) % m), m) *
+                                 cic_window(signed_k(size_t(idx) / (m * m)), m);
+                g /= w * w;
+            }
+            green_[idx] = g;
+        }
+    }
+
+    double sum = 0.0;
+    for (double g : green_) sum += g;
+    self_ = sum / double(total);
+}
+
+void PMSolver::assign_mass(const Particles& P) {
+    const size_t m = m_;
+    const long N = static_cast<long>(P.N);
+    const long total = static_cast<long>(m * m * m);
+
+    #pragma omp parallel for schedule(static)
+    for (long idx = 0; idx < total; ++idx) mesh_[idx] = cplx(0.0, 0.0);
+
+    // bucket by z plane (counting sort): a particle in plane k writes planes
+    // k and k + 1, so even planes and then odd planes can deposit in parallel
+    plane_of_.resize(P.N);
+    #pragma omp parallel for schedule(static)
+    for (long p = 0; p < N; ++p) {
+        if (!P.alive[p]) continue;
+        double u[3];
+        mesh_coords(P, size_t(p), u);
+        plane_of_[p] = static_cast<uint32_t>(std::min(size_t(u[2]), m - 1));
+    }
+    plane_start_.assign(m + 1, 0);
+    for (long p = 0; p < N; ++p) {
+        if (P.alive[p]) plane_start_[plane_of_[p] + 1]++;
+    }
+    for (size_t k = 0; k < m; ++k) plane_start_[k + 1] += plane_start_[k];
+    plane_items_.resize(plane_start_[m]);
+    cursor_.assign(plane_start_.begin(), plane_start_.end() - 1);
+    for (long p = 0; p < N; ++p) {
+        if (P.alive[p]) plane_items_[cursor_[plane_of_[p]]++] = static_cast<uint32_t>(p);
+    }
+
+    for (size_t parity = 0; parity < 2; ++parity) {
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (long k = long(parity); k < long(m); k += 2) {
+            for (uint32_t s = plane_start_[k]; s < plane_start_[k + 1]; ++s) {
+                const uint32_t p = plane_items_[s];
+                double u[3];
+                mesh_coords(P, p, u);
+                const long i0 = long(std::floor(u[0])), j0 = long(std::floor(u[1]));
+                const double fx = u[0] - double(i0), fy = u[1] - double(j0);
+                const double fz = u[2] - double(k);
+                const double wx[2] = {1.0 - fx, fx}, wy[2] = {1.0 - fy, fy}, wz[2] = {1.0 - fz, fz};
+                const double mass = double(P.mass[p]);
+                for (int c = 0; c < 8; ++c) {
+                    const int a = c & 1, b = (c >> 1) & 1, d = c >> 2;
+                    mesh_[index(wrap(i0 + a), wrap(j0 + b), wrap(k + d))] +=
+                        mass * wx[a] * wy[b] * wz[d];
+                }
+            }
+        }
+    }
+}
+
+void PMSolver::compute_accelerations(Particles& P, real_t G, real_t* potential, bool add) {
+    const long N = static_cast<long>(P.N);
+    const long total = static_cast<long>(m_ * m_ * m_);
+    if (N == 0) return;
+
+    assign_mass(P);
+    fft_.forward(mesh_.data());
+    #pragma omp parallel for schedule(static)
+    for (long idx = 0; idx < total; ++idx) mesh_[idx] *= green_[idx];
+    fft_.inverse(mesh_.data());
+
+    // the mesh now holds -phi * h / G; a = -grad phi = (G / h^2) grad_cells(mesh)
+    const double acc_scale = double(G) / (h_ * h_);
+    const double phi_scale = -double(G) / h_;
+
+    #pragma omp parallel for schedule(static)
+    for (long p = 0; p < N; ++p) {
+        if (!P.alive[p]) {
+            if (!add) {
+                P.ax[p] = P.ay[p] = P.az[p] = real_t(0);
+                if (potential) potential[p] = real_t(0);
+            }
+            continue;
+        }
+        double u[3];
+        mesh_coords(P, size_t(p), u);
+        const long i0 = long(std::floor(u[0])), j0 = long(std::floor(u[1])), k0 = long(std::floor(u[2]));
+        const double fx = u[0] - double(i0), fy = u[1] - double(j0), fz = u[2] - double(k0);
+        const double wx[2] = {1.0 - fx, fx}, wy[2] = {1.0 - fy, fy}, wz[2] = {1.0 - fz, fz};
+
+        double g[3] = {0.0, 0.0, 0.0}, phi = 0.0;
+        for (int c = 0; c < 8; ++c) {
+            const long i = i0 + (c & 1), j = j0 + ((c >> 1) & 1), k = k0 + (c >> 2);
+            const double w = wx[c & 1] * wy[(c >> 1) & 1] * wz[c >> 2];
+            auto at = [&](long di, long dj, long dk) {
+                return mesh_[index(wrap(i + di), wrap(j + dj), wrap(k + dk))].real();
+            };
+            // fourth-order central differences
+            g[0] += w * (8.0 * (at(1, 0, 0) - at(-1, 0, 0)) - (at(2, 0, 0) - at(-2, 0, 0))) / 12.0;
+            g[1] += w * (8.0 * (at(0, 1, 0) - at(0, -1, 0)) - (at(0, 2, 0) - at(0, -2, 0))) / 12.0;
+            g[2] += w * (8.0 * (at(0, 0, 1) - at(0, 0, -1)) - (at(0, 0, 2) - at(0, 0, -2))) / 12.0;
+            if (potential) phi += w * at(0, 0, 0);
+        }
+
+        const real_t ax = real_t(acc_scale * g[0]);
+        const real_t ay = real_t(acc_scale * g[1]);
+        const real_t az = real_t(acc_scale * g[2]);
+        if (add) { P.ax[p] += ax; P.ay[p] += ay; P.az[p] += az; }
+        else     { P.ax[p] = ax;  P.ay[p] = ay;  P.az[p] = az; }
+        if (potential) {
+            // drop the particle's own contribution at its node
+            const real_t v = real_t(phi_scale * (phi - double(P.mass[p]) * self_));
+            potential[p] = add ? potential[p] + v : v;
+        }
+    }
+}
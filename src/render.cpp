@@ -0,0 +1,473 @@
+#include "../include/render.hpp"
+#include "../include/parallel.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <array>
+
+namespace {
+
+constexpr int kKernelTable = 256;     // projected kernel samples over q in [0, 2]
+constexpr double kDecades = 4.0;      // dynamic range of the density image
+constexpr int kStarRadius = 2;        // pixels
+
+// cubic spline without its 1 / (pi h^3) normalization
+double spline(double q) {
+    if (q < 1.0) return 1.0 - 1.5 * q * q + 0.75 * q * q * q;
+    if (q < 2.0) return 0.25 * (2.0 - q) * (2.0 - q) * (2.0 - q);
+    return 0.0;
+}
+
+// perceptually ordered dark-to-bright map (black, purple, red, orange, pale yellow)
+void colormap(double t, uint8_t* rgb) {
+    static const double stops[][3] = {{0, 0, 4},      {40, 11, 84},  {101, 21, 110},
+                                      {159, 42, 99},  {212, 72, 66}, {245, 125, 21},
+                                      {252, 255, 164}};
+    constexpr int n = int(sizeof(stops) / sizeof(stops[0])) - 1;
+    t = std::clamp(t, 0.0, 1.0) * n;
+    const int i = std::min(int(t), n - 1);
+    const double f = t - double(i);
+    for (int c = 0; c < 3; ++c)
+        rgb[c] = uint8_t(std::lround(stops[i][c] + f * (stops[i + 1][c] - stops[i][c])));
+}
+
+int axis_index(char axis) {
+    switch (axis) {
+    case 'x': return 0;
+    case 'y': return 1;
+    default:  return 2;
+    }
+}
+
+inline double coord(const Particles& P, size_t i, int a) {
+    return a == 0 ? double(P.x[i]) : a == 1 ? double(P.y[i]) : double(P.z[i]);
+}
+
+inline double coord(const Vec3& v, int a) {
+    return a == 0 ? double(v.x) : a == 1 ? double(v.y) : double(v.z);
+}
+
+} // namespace
+
+
+double FrameRenderer::projected_kernel(double q) {
+    // F(q) = 2 / pi * int_0^sqrt(4 - q^2) w(sqrt(q^2 + s^2)) ds, by Simpson's rule
+    static const std::array<double, kKernelTable + 1> table = [] {
+        std::array<double, kKernelTable + 1> f{};
+        for (int k = 0; k <= kKernelTable; ++k) {
+            const double q = 2.0 * double(k) / kKernelTable;
+            const double top = std::sqrt(std::max(0.0, 4.0 - q * q));
+            const int n = 256;
+            double sum = 0.0;
+            for (int s = 0; s <= n; ++s) {
+                const double z = top * double(s) / n;
+                const double w = (s == 0 || s == n) ? 1.0 : (s % 2 ? 4.0 : 2.0);
+                sum += w * spline(std::sqrt(q * q + z * z));
+            }
+            f[k] = 2.0 / M_PI * sum * top / (3.0 * n);
+        }
+        return f;
+    }();
+    if (!(q < 2.0)) return 0.0;
+    const double x = q * (kKernelTable / 2.0);
+    const int k = int(x);
+    return table[k] + (x - double(k)) * (table[k + 1] - table[k]);
+}
+
+
+FrameRenderer::FrameRenderer(int size, char axis, bool temperature, double extent)
+    : size_(std::max(size, 1)), temperature_(temperature), extent_(extent)
+{
+    const int los = axis_index(axis);
+    u_axis_ = los == 0 ? 1 : 0;
+    v_axis_ = los == 2 ? 1 : 2;
+    const size_t pixels = size_t(size_) * size_t(size_);
+    sigma_.resize(pixels);
+    if (temperature_) weighted_.resize(pixels);
+    rgb_.resize(3 * pixels);
+}
+
+void FrameRenderer::fit_view(const Particles& P, real_t h) {
+    double lo[2] = {1e300, 1e300}, hi[2] = {-1e300, -1e300};
+    double com[2] = {0.0, 0.0}, mass = 0.0;
+    for (size_t i = 0; i < P.N; ++i) {
+        if (!P.alive[i]) continue;
+        const double c[2] = {coord(P, i, u_axis_), coord(P, i, v_axis_)};
+        for (int a = 0; a < 2; ++a) {
+            lo[a] = std::min(lo[a], c[a]);
+            hi[a] = std::max(hi[a], c[a]);
+            com[a] += double(P.mass[i]) * c[a];
+        }
+        mass += double(P.mass[i]);
+    }
+    if (mass <= 0.0) { // nothing to fit: the unit box
+        lo[0] = lo[1] = 0.0;
+        hi[0] = hi[1] = 1.0;
+        com[0] = com[1] = 0.5;
+        mass = 1.0;
+    }
+
+    double side, center[2];
+    if (extent_ > 0.0) {
+        side = extent_;
+        for (int a = 0; a < 2; ++a) center[a] = com[a] / mass;
+    } else {
+        // the particles plus their kernel footprint (at least two pixels)
+        const double range = std::max(hi[0] - lo[0], hi[1] - lo[1]);
+        side = range + 4.0 * double(h);
+        if (size_ > 4) side = std::max(side, range * double(size_) / double(size_ - 4));
+        for (int a = 0; a < 2; ++a) center[a] = 0.5 * (lo[a] + hi[a]);
+    }
+    if (!(side > 0.0)) side = 1.0;
+    pixel_ = side / double(size_);
+    for (int a = 0; a < 2; ++a) origin_[a] = center[a] - 0.5 * side;
+}
+
+void FrameRenderer::render(const Particles& P, const SinkParticles& S, real_t h) {
+    if (pixel_ == 0.0) fit_view(P, h);
+    splat(P, h);
+    colorize(S);
+}
+
+void FrameRenderer::splat(const Particles& P, real_t h) {
+    const int n = size_;
+    const long N = static_cast<long>(P.N);
+    const long pixels = long(n) * long(n);
+    // particles smaller than a pixel are spread over about one pixel
+    const double hh = std::max(double(h), pixel_);
+    const double reach = 2.0 * hh / pixel_; // footprint radius in pixels
+    const int bands = std::min(n, 4 * par_max_threads());
+    const int band_rows = (n + bands - 1) / bands;
+
+    // pixel-centre coordinates of particle i (column, row from the top)
+    auto place = [&](long i, double& col, double& row) {
+        col = (coord(P, size_t(i), u_axis_) - origin_[0]) / pixel_ - 0.5;
+        row = double(n) - (coord(P, size_t(i), v_axis_) - origin_[1]) / pixel_ - 0.5;
+    };
+
+    // mass / (sum of the kernel over the footprint): the particle's mass
+    // lands on the grid exactly, whatever its size in pixels
+    norm_.resize(P.N);
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < N; ++i) {
+        norm_[i] = 0.0;
+        if (!P.alive[i]) continue;
+        double col, row;
+        place(i, col, row);
+        // off-screen (or non-finite) particles are left out
+        if (!(col + reach > -1.0 && col - reach < double(n) && row + reach > -1.0 &&
+              row - reach < double(n))) continue;
+        double sum = 0.0;
+        for (long r = long(std::ceil(row - reach)); r <= long(std::floor(row + reach)); ++r) {
+            for (long c = long(std::ceil(col - reach)); c <= long(std::floor(col + reach)); ++c) {
+                const double d = std::hypot(double(c) - col, double(r) - row) * pixel_;
+                sum += projected_kernel(d / hh);
+            }
+        }
+        if (sum > 0.0) norm_[i] = double(P.mass[i]) / (sum * pixel_ * pixel_);
+    }
+
+    // bucket particles by the bands their footprint overlaps (counting sort)
+    auto band_range = [&](long i, int& b0, int& b1) {
+        double col, row;
+        place(i, col, row);
+        if (norm_[i] == 0.0) { b0 = 0; b1 = -1; return; }
+        const long r0 = std::max(0L, long(std::ceil(row - reach)));
+        const long r1 = std::min(long(n) - 1, long(std::floor(row + reach)));
+        if (r0 > r1) { b0 = 0; b1 = -1; return; }
+        b0 = int(r0 / band_rows);
+        b1 = int(r1 / band_rows);
+    };
+    band_start_.assign(size_t(bands) + 1, 0);
+    for (long i = 0; i < N; ++i) {
+        int b0, b1;
+        band_range(i, b0, b1);
+        for (int b = b0; b <= b1; ++b) band_start_[b + 1]++;
+    }
+    for (int b = 0; b < bands; ++b) band_start_[b + 1] += band_start_[b];
+    band_items_.resize(band_start_[bands]);
+    cursor_.assign(band_start_.begin(), band_start_.end() - 1);
+    for (long i = 0; i < N; ++i) {
+        int b0, b1;
+        band_range(i, b0, b1);
+        for (int b = b0; b <= b1; ++b) band_items_[cursor_[b]++] = uint32_t(i);
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (long k = 0; k < pixels; ++k) {
+        sigma_[k] = 0.0;
+        if (temperature_) weighted_[k] = 0.0;
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int b = 0; b < bands; ++b) {
+        const long top = long(b) * band_rows, bottom = std::min(long(n), top + band_rows) - 1;
+        for (uint32_t s = band_start_[b]; s < band_start_[b + 1]; ++s) {
+            const long i = band_items_[s];
+            double col, row;
+            place(i, col, row);
+            const long r0 = std::max(top, long(std::ceil(row - reach)));
+            const long r1 = std::min(bottom, long(std::floor(row + reach)));
+            const long c0 = std::max(0L, long(std::ceil(col - reach)));
+            const long c1 = std::min(long(n) - 1, long(std::floor(col + reach)));
+            const double T = temperature_ ? double(P.temperature[i]) : 0.0;
+            for (long r = r0; r <= r1; ++r) {
+                for (long c = c0; c <= c1; ++c) {
+                    const double d = std::hypot(double(c) - col, double(r) - row) * pixel_;
+                    const double w = norm_[i] * projected_kernel(d / hh);
+                    sigma_[r * n + c] += w;
+                    if (temperature_) weighted_[r * n + c] += w * T;
+                }
+            }
+        }
+    }
+}
+
+void FrameRenderer::colorize(const SinkParticles& S) {
+    const int n = size_;
+    const long pixels = long(n) * long(n);
+
+    double peak = 0.0;
+    for (double s : sigma_) peak = std::max(peak, s);
+    const double floor_sigma = peak * std::pow(10.0, -kDecades);
+
+    // temperature range over the pixels that show gas
+    double t_lo = 0.0, t_hi = 0.0;
+    if (temperature_) {
+        t_lo = 1e300;
+        t_hi = -1e300;
+        for (long k = 0; k < pixels; ++k) {
+            if (!(sigma_[k] > floor_sigma)) continue;
+            const double T = weighted_[k] / sigma_[k];
+            if (T > 0.0) {
+                t_lo = std::min(t_lo, T);
+                t_hi = std::max(t_hi, T);
+            }
+        }
+    }
+    const double t_span = t_hi > t_lo ? std::log(t_hi / t_lo) : 1.0;
+
+    #pragma omp parallel for schedule(static)
+    for (long k = 0; k < pixels; ++k) {
+        double t = 0.0;
+        if (sigma_[k] > floor_sigma) {
+            if (temperature_) {
+                const double T = weighted_[k] / sigma_[k];
+                t = T > 0.0 && t_hi > 0.0 ? std::log(T / t_lo) / t_span : 0.0;
+                t = 0.1 + 0.9 * t; // keep cold gas visible against empty pixels
+            } else {
+                t = std::log10(sigma_[k] / floor_sigma) / kDecades;
+            }
+        }
+        colormap(t, &rgb_[3 * k]);
+    }
+
+    for (const Star& s : S.stars) {
+        const double col = (coord(s.position, u_axis_) - origin_[0]) / pixel_ - 0.5;
+        const double row = double(n) - (coord(s.position, v_axis_) - origin_[1]) / pixel_ - 0.5;
+        const long ci = std::lround(col), ri = std::lround(row);
+        for (long r = ri - kStarRadius; r <= ri + kStarRadius; ++r) {
+            for (long c = ci - kStarRadius; c <= ci + kStarRadius; ++c) {
+                if (r < 0 || r >= n || c < 0 || c >= n) continue;
+                if ((r - ri) * (r - ri) + (c - ci) * (c - ci) > kStarRadius * kStarRadius) continue;
+                std::fill_n(&rgb_[3 * (r * n + c)], 3, uint8_t(255));
+            }
+        }
+    }
+}
+
+bool FrameRenderer::write(const std::string& filename) const {
+    const bool ppm = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".ppm") == 0;
+    return ppm ? write_ppm(filename, rgb_.data(), size_, size_)
+               : write_png(filename, rgb_.data(), size_, size_);
+}
+
+
+bool write_ppm(const std::string& filename, const uint8_t* rgb, int width, int height) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Could not open file for writing: " << filename << "\n";
+        return false;
+    }
+    file << "P6\n" << width << " " << height << "\n255\n";
+    file.write(reinterpret_cast<const char*>(rgb), std::streamsize(3) * width * height);
+    return bool(file);
+}
+
+
+namespace {
+
+// ---- PNG: zlib stream with one fixed-Huffman deflate block ----
+
+uint32_t crc32(const uint8_t* p, size_t n, uint32_t crc = 0) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < n; ++i) crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t adler32(const uint8_t* p, size_t n) {
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < n; ++i) {
+        a = (a + p[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+// deflate writes bits least-significant first; Huffman codes go in
+// most-significant bit first
+struct BitWriter {
+    std::vector<uint8_t>& out;
+    uint64_t bits = 0;
+    int count = 0;
+
+    void put(uint32_t value, int n) {
+        bits |= uint64_t(value) << count;
+        count += n;
+        while (count >= 8) {
+            out.push_back(uint8_t(bits));
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+    void put_code(uint32_t code, int n) {
+        uint32_t rev = 0;
+        for (int i = 0; i < n; ++i) rev |= ((code >> i) & 1) << (n - 1 - i);
+        put(rev, n);
+    }
+    void flush() {
+        if (count > 0) out.push_back(uint8_t(bits));
+        bits = 0;
+        count = 0;
+    }
+};
+
+// fixed literal/length code (RFC 1951, 3.2.6)
+void put_symbol(BitWriter& w, int sym) {
+    if (sym < 144)      w.put_code(0x30 + sym, 8);
+    else if (sym < 256) w.put_code(0x190 + sym - 144, 9);
+    else if (sym < 280) w.put_code(sym - 256, 7);
+    else                w.put_code(0xC0 + sym - 280, 8);
+}
+
+void put_match(BitWriter& w, int length, int distance) {
+    static const int len_base[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                   35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const int len_extra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const int dist_base[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                    193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                    6145, 8193, 12289, 16385, 24577};
+    int l = 28;
+    while (len_base[l] > length) --l;
+    put_symbol(w, 257 + l);
+    w.put(uint32_t(length - len_base[l]), len_extra[l]);
+    int d = 29;
+    while (dist_base[d] > distance) --d;
+    w.put_code(uint32_t(d), 5);
+    w.put(uint32_t(distance - dist_base[d]), d < 4 ? 0 : d / 2 - 1);
+}
+
+// greedy LZ77 with one candidate per 3-byte hash
+void deflate_fixed(const std::vector<uint8_t>& in, std::vector<uint8_t>& out) {
+    constexpr int kHashBits = 15;
+    constexpr size_t kWindow = 32768, kMaxMatch = 258;
+    std::vector<int64_t> head(size_t(1) << kHashBits, -1);
+    auto hash = [&](size_t i) {
+        const uint32_t v = uint32_t(in[i]) | uint32_t(in[i + 1]) << 8 | uint32_t(in[i + 2]) << 16;
+        return (v * 2654435761u) >> (32 - kHashBits);
+    };
+
+    BitWriter w{out};
+    w.put(1, 1); // final block
+    w.put(1, 2); // fixed Huffman codes
+    const size_t n = in.size();
+    size_t i = 0;
+    while (i < n) {
+        size_t best = 0, dist = 0;
+        if (i + 3 <= n) {
+            const uint32_t hv = hash(i);
+            const int64_t cand = head[hv];
+            head[hv] = int64_t(i);
+            if (cand >= 0 && i - size_t(cand) <= kWindow) {
+                const size_t limit = std::min(kMaxMatch, n - i);
+                size_t len = 0;
+                while (len < limit && in[size_t(cand) + len] == in[i + len]) ++len;
+                if (len >= 3) {
+                    best = len;
+                    dist = i - size_t(cand);
+                }
+            }
+        }
+        if (best) {
+            put_match(w, int(best), int(dist));
+            for (size_t k = i + 1; k < i + best && k + 3 <= n; ++k) head[hash(k)] = int64_t(k);
+            i += best;
+        } else {
+            put_symbol(w, in[i]);
+            ++i;
+        }
+    }
+    put_symbol(w, 256); // end of block
+    w.flush();
+}
+
+void put_be32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int s = 24; s >= 0; s -= 8) out.push_back(uint8_t(v >> s));
+}
+
+void put_chunk(std::vector<uint8_t>& png, const char* type, const std::vector<uint8_t>& data) {
+    put_be32(png, uint32_t(data.size()));
+    const size_t start = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data.begin(), data.end());
+    put_be32(png, crc32(&png[start], png.size() - start));
+}
+
+} // namespace
+
+bool write_png(const std::string& filename, const uint8_t* rgb, int width, int height) {
+    // every row uses the Sub filter: smooth gradients and flat areas become
+    // runs of small values that deflate well
+    const size_t stride = 3 * size_t(width);
+    std::vector<uint8_t> raw((stride + 1) * size_t(height));
+    for (int r = 0; r < height; ++r) {
+        uint8_t* dst = &raw[size_t(r) * (stride + 1)];
+        const uint8_t* src = rgb + size_t(r) * stride;
+        dst[0] = 1;
+        for (size_t k = 0; k < stride; ++k) dst[1 + k] = uint8_t(src[k] - (k >= 3 ? src[k - 3] : 0));
+    }
+
+    std::vector<uint8_t> z = {0x78, 0x01};
+    deflate_fixed(raw, z);
+    put_be32(z, adler32(raw.data(), raw.size()));
+
+    std::vector<uint8_t> ihdr;
+    put_be32(ihdr, uint32_t(width));
+    put_be32(ihdr, uint32_t(height));
+    ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0}); // 8-bit RGB, deflate, no interlace
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    put_chunk(png, "IHDR", ihdr);
+    put_chunk(png, "IDAT", z);
+    put_chunk(png, "IEND", {});
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Could not open file for writing: " << filename << "\n";
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(png.data()), std::streamsize(png.size()));
+    return bool(file);
+}
@@ -0,0 +1,588 @@
+#include "../include/run.hpp"
+#include "../include/physics.hpp"
+#include "../include/integrator.hpp"
+#include "../include/gravity.hpp"
+#include "../include/density.hpp"
+#include "../include/hydro.hpp"
+#include "../include/init.hpp"
+#include "../include/snapshot.hpp"
+#include "../include/thermo.hpp"
+#include "../include/starform.hpp"
+#include "../include/bh.hpp"
+#include "../include/pm.hpp"
+#include "../include/parallel.hpp"
+#include "../include/diagnostics.hpp"
+#include "../include/arena.hpp"
+#include "../include/taskgraph.hpp"
+#include "../include/async_output.hpp"
+#include "../include/codec.hpp"
+#include "../include/render.hpp"
+#include "../include/eos.hpp"
+#include "../include/shm_ring.hpp"
+#include "../include/perfcounters.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <filesystem>
+#include <numeric>
+#include <memory>
+#include <algorithm>
+
+
+bool init_from_config(Particles& P, const Config& cfg) {
+    if (!cfg.ic_input.empty()) {
+        if (!read_snapshot(cfg.ic_input, P)) return false;
+        std::cout << "Loaded " << P.N << " particles from " << cfg.ic_input << "\n";
+    } else {
+        init_particles(P, cfg.init_type, cfg.seed);
+    }
+    if (cfg.fixed_positions) {
+        // 32-bit integer coordinates: uniform precision inside dense cores
+        P.enable_fixed_positions();
+        std::cout << "Using fixed-point positions\n";
+    }
+    return true;
+}
+
+std::unique_ptr<EosTable> make_eos_table(const Config& cfg) {
+    if (cfg.eos != "ideal" && cfg.eos != "barotropic") {
+        std::cerr << "WARNING: unknown eos '" << cfg.eos << "', using ideal\n";
+    }
+    if (cfg.cooling != "constant" && cfg.cooling != "molecular") {
+        std::cerr << "WARNING: unknown cooling '" << cfg.cooling << "', using constant\n";
+    }
+    const bool barotropic = cfg.eos == "barotropic";
+    const bool molecular = cfg.cooling == "molecular";
+    if (!barotropic && !molecular) return nullptr;
+    if (!(cfg.eos_rho_crit > 0.0)) {
+        std::cerr << "WARNING: eos_rho_crit must be positive; using ideal gas and constant "
+                     "cooling\n";
+        return nullptr;
+    }
+    return std::make_unique<EosTable>(barotropic, cfg.eos_rho_crit, molecular,
+                                      std::max(cfg.cooling_coefficient, 0.0),
+                                      cfg.cooling_floor);
+}
+
+
+RunResult run_simulation(Particles& P, const Config& cfg, const StepHook& on_step) {
+    const real_t dt = real_t(cfg.timestep);
+    const real_t h = real_t(cfg.smoothing_length);   // smoothing length for Density
+    const real_t G = real_t(cfg.G);
+    const real_t soft = real_t(cfg.softening);
+    const size_t num_steps = static_cast<size_t>(std::max(cfg.num_steps, 0));
+    const size_t compact_interval = static_cast<size_t>(std::max(cfg.compact_interval, 1));
+    const bool output = cfg.output_interval > 0;
+    bool rendering = cfg.render_interval > 0;
+
+    if (cfg.num_threads > 0) par_set_num_threads(cfg.num_threads);
+    if (rendering && cfg.render_size < 1) {
+        std::cerr << "WARNING: render_size must be positive; rendering disabled\n";
+        rendering = false;
+    }
+    if (output || rendering) std::filesystem::create_directories(cfg.output_dir);
+    const std::unique_ptr<EosTable> eos = make_eos_table(cfg);
+    const bool knn = cfg.density_kernel == "knn";
+    if (!knn && cfg.density_kernel != "sph") {
+        std::cerr << "WARNING: unknown density_kernel '" << cfg.density_kernel
+                  << "', using sph\n";
+    }
+    const int knn_neighbors = std::clamp(cfg.knn_neighbors, 2, int(kMaxNeighbors));
+    if (knn && knn_neighbors != cfg.knn_neighbors) {
+        std::cerr << "WARNING: knn_neighbors must be in [2, " << kMaxNeighbors << "], using "
+                  << knn_neighbors << "\n";
+    }
+    KdTree kdtree; // kept between steps so its buffers are reused
+    auto compute_density = [&] {
+        if (knn) compute_density_kNN(P, kdtree, knn_neighbors);
+        else     compute_density_sph(P, h);
+    };
+
+    StarFormation SF(real_t(cfg.neighbor_radius), cfg.min_neighbors,
+                     real_t(cfg.density_threshold), real_t(cfg.accretion_radius));
+    RunResult result;
+    SinkParticles& sinks = result.sinks; // stars live outside the gas arrays
+    const real_t initial_gas_mass = std::accumulate(P.mass.begin(), P.mass.end(), real_t(0));
+
+    // tree and mesh solvers only for the cached path; the normal path is
+    // the reference
+    const std::string& gs = cfg.gravity_solver;
+    bool mesh = cfg.use_cached && (gs == "pm" || gs == "treepm");
+    if (gs != "direct" && gs != "barnes_hut" && gs != "pm" && gs != "treepm") {
+        std::cerr << "WARNING: unknown gravity_solver '" << gs << "', using direct\n";
+    }
+
+    // periodic boxes need the mesh (the tree and direct sums are open)
+    double period = 0.0;
+    if (cfg.box_size > 0.0) {
+        if (!mesh) {
+            std::cerr << "WARNING: box_size needs use_cached with gravity_solver = pm or "
+                         "treepm; using open boundaries\n";
+        } else if (P.fixed_positions()) {
+            std::cerr << "WARNING: fixed_positions do not support periodic boxes; "
+                         "using open boundaries\n";
+        } else {
+            period = cfg.box_size;
+        }
+    }
+    const size_t pm_grid = size_t(std::max(cfg.pm_grid, 0));
+    if (mesh && (!is_pow2(pm_grid) || (period == 0.0 && pm_grid < 16))) {
+        std::cerr << "WARNING: pm_grid must be a power of two (at least 16 with open "
+                     "boundaries), got " << cfg.pm_grid << "; using direct\n";
+        mesh = false;
+        period = 0.0;
+    }
+    P.period = period;
+    P.wrap_periodic();
+
+    std::unique_ptr<BarnesHutSolver> bh;
+    std::unique_ptr<PMSolver> pm;
+    if (mesh) {
+        pm = std::make_unique<PMSolver>(pm_grid, period, gs == "treepm" ? cfg.pm_split : 0.0);
+    }
+    if (cfg.use_cached && (gs == "barnes_hut" || (mesh && gs == "treepm"))) {
+        bh = std::make_unique<BarnesHutSolver>(P, real_t(cfg.theta), soft);
+    }
+
+    // in-line verification against the reference profile
+    ReferenceProfile reference;
+    const bool check = cfg.verify_interval > 0 && reference.load(cfg.reference_csv);
+    if (cfg.verify_interval > 0 && !check) {
+        std::cerr << "WARNING: in-line verification disabled — reference file missing.\n";
+    }
+
+    // conservation diagnostics; the gas potential comes from the gravity pass
+    DiagnosticsLog diag_log;
+    std::vector<real_t> phi;
+    const bool diagnostics = cfg.diagnostics_interval > 0;
+    if (diagnostics) {
+        if (P.periodic()) {
+            std::cerr << "WARNING: the periodic potential has zero mean, so the energy "
+                         "drift is not tracked in a periodic box\n";
+        }
+        std::filesystem::create_directories(cfg.output_dir);
+        diag_log.open(cfg.output_dir + "/diagnostics.csv", !P.periodic());
+    }
+
+    // force-accuracy audit of the active gravity solver (gas self-gravity,
+    // before the star contributions are added)
+    ForceAuditLog audit_log;
+    const bool auditing = cfg.audit_interval > 0 && !P.periodic();
+    if (cfg.audit_interval > 0 && P.periodic()) {
+        std::cerr << "WARNING: the force audit sums open boundaries; it is skipped in a "
+                     "periodic box\n";
+    }
+    std::string solver = "reference";
+    if (cfg.use_cached) solver = bh ? "barnes_hut(theta=" + std::to_string(cfg.theta) + ")" : "direct";
+    if (pm) {
+        solver = "pm(grid=" + std::to_string(pm_grid) + ")";
+        if (bh) solver = "treepm(grid=" + std::to_string(pm_grid) + ",split=" +
+                         std::to_string(cfg.pm_split) + ",theta=" + std::to_string(cfg.theta) + ")";
+        if (P.periodic()) std::cout << "Periodic box of side " << P.period << "\n";
+    }
+    if (auditing) {
+        std::filesystem::create_directories(cfg.output_dir);
+        audit_log.open(cfg.output_dir + "/force_audit.csv");
+    }
+    auto audit = [&](size_t t, const real_t* ax, const real_t* ay, const real_t* az) {
+        ForceAudit a = audit_forces(P, ax, ay, az, cfg.audit_samples, cfg.seed, t, G, soft);
+        result.audits.push_back(a);
+        audit_log.write(a, solver);
+        std::cout << "force audit step " << t << " (" << solver << "): rms " << a.rms
+                  << ", p99 " << a.p99 << ", max " << a.max << "\n";
+    };
+
+    // energies and momenta of the state the forces were just computed for
+    auto record_diagnostics = [&](size_t t) {
+        Diagnostics d = compute_diagnostics(P, sinks, phi, G, soft);
+        d.step = t;
+        d.time = double(t * dt);
+        diag_log.write(d);
+    };
+
+    // step-lifetime temporaries; the reference path's force arrays are kept
+    // across steps because its kernels take std::vector
+    ScratchArena scratch;
+    std::vector<real_t> ax, ay, az;
+
+    // thread load balance of the cost-balanced loops, averaged over steps
+    double tree_imbalance_sum = 0.0, starform_imbalance_sum = 0.0;
+
+    // per-step state shared by the stages below
+    size_t t = 0;
+    bool diag_step = false, audit_step = false;
+    real_t* phi_out = nullptr;
+    std::vector<StarCluster> clusters;
+
+    // stages shared by both paths
+    auto detect_stars = [&] {
+        // ----------------------------------------------------
+        // 7. Check star formation, then let stars accrete gas
+        // ----------------------------------------------------
+        SF.find_star_groups(P, scratch, clusters);
+        starform_imbalance_sum += SF.load_imbalance();
+    };
+    auto form_stars = [&] {
+        SF.measure_clusters(P, clusters);
+        SF.form_stars(P, sinks, clusters, t * dt);
+        SF.accrete(P, sinks, scratch);
+    };
+
+    // The cached path runs as a task graph: each stage declares what it
+    // reads and writes, and independent stages (gravity and density;
+    // diagnostics and pressure forces; gas and star integration) share the
+    // threads. Star detection needs the drifted positions, so it waits for
+    // the fused gas update (which also does the thermodynamics).
+    StepGraph graph;
+    if (cfg.use_cached) {
+        const uint32_t gas = kFieldPos | kFieldMass | kFieldAlive;
+        graph.add("gravity", gas, kFieldAcc | kFieldPotential | kFieldLog, [&] {
+            // ------------------------------------------------
+            // 1. Compute gravitational acceleration
+            // ------------------------------------------------
+            if (pm) pm->fit(P);
+            if (bh) {
+                // TreePM: the tree only carries the force inside the split
+                if (pm) bh->set_short_range(real_t(pm->split_radius()), real_t(P.period));
+                bh->build(P);
+                bh->compute_accelerations(P, G, phi_out); // writes accelerations into P.ax,P.ay,P.az
+                tree_imbalance_sum += bh->load_imbalance();
+            }
+            if (pm) {
+                pm->compute_accelerations(P, G, phi_out, bool(bh)); // long range on top
+            } else if (!bh) {
+                compute_gravity_cached_optimized(P, G, soft, phi_out);
+            }
+            if (audit_step) audit(t, P.ax.data(), P.ay.data(), P.az.data());
+        });
+        graph.add("density", gas | kFieldVel, kFieldDensity | kFieldVelGrad, [&] {
+            // ------------------------------------------------
+            // 2. Compute densities (SPH or KNN), div v and curl v
+            // ------------------------------------------------
+            compute_density();
+        });
+        graph.add("sink_gravity", gas | kFieldSinks, kFieldAcc | kFieldSinks, [&] {
+            compute_sink_gravity(P, sinks, P.ax, P.ay, P.az, G, soft);
+        });
+        graph.add("diagnostics",
+                  gas | kFieldVel | kFieldTemperature | kFieldPotential | kFieldSinks, kFieldLog,
+                  [&] { if (diag_step) record_diagnostics(t); });
+        graph.add("pressure_forces", gas | kFieldDensity | kFieldPressure, kFieldAcc, [&] {
+            // ------------------------------------------------
+            // 3. Compute pressure forces
+            // (This is where the thermodynamics and kinetics kiss)
+            // ------------------------------------------------
+            compute_pressure_forces_cached(P, h);
+        });
+        graph.add("update_gas", GasUpdate::kReads, GasUpdate::kWrites, [&] {
+            // ------------------------------------------------
+            // 4-6. Integrate motion, update thermodynamics and
+            //      cooling, fused into one sweep (pipeline.hpp)
+            // ------------------------------------------------
+            update_gas(P, dt, eos.get());
+            P.wrap_periodic();
+        });
+        graph.add("integrate_sinks", kFieldSinks, kFieldSinks, [&] {
+            velocity_verlet_sinks(sinks, dt);
+            sinks.wrap_periodic(P.period);
+        });
+        graph.add("star_detection", gas, kFieldClusters, detect_stars);
+        graph.add("star_formation", gas | kFieldVel | kFieldSinks | kFieldClusters,
+                  kFieldAlive | kFieldSinks, form_stars);
+        if (cfg.task_graph) std::cout << "Step graph: " << graph.describe() << "\n";
+    }
+
+    // compressed frames are delta-coded against the previous frame, so the
+    // encoder lives for the whole run (and outlives the writer)
+    bool compressed = output && cfg.output_format == "compressed";
+    if (cfg.output_format != "csv" && cfg.output_format != "compressed") {
+        std::cerr << "WARNING: unknown output_format '" << cfg.output_format << "', using csv\n";
+    }
+    if (compressed && !(cfg.output_tolerance > 0.0)) {
+        std::cerr << "WARNING: output_tolerance must be positive; using csv\n";
+        compressed = false;
+    }
+    FrameEncoder encoder(cfg.output_tolerance, cfg.keyframe_interval);
+
+    // in-situ images are rendered from the frame copy by the background
+    // writer; the renderer keeps its view between images
+    if (cfg.render_axis != "x" && cfg.render_axis != "y" && cfg.render_axis != "z") {
+        std::cerr << "WARNING: unknown render_axis '" << cfg.render_axis << "', using z\n";
+    }
+    if (cfg.render_quantity != "density" && cfg.render_quantity != "temperature") {
+        std::cerr << "WARNING: unknown render_quantity '" << cfg.render_quantity
+                  << "', using density\n";
+    }
+    if (cfg.render_format != "png" && cfg.render_format != "ppm") {
+        std::cerr << "WARNING: unknown render_format '" << cfg.render_format << "', using png\n";
+    }
+    const std::string image_ext = cfg.render_format == "ppm" ? ".ppm" : ".png";
+    const char axis = cfg.render_axis == "x" ? 'x' : cfg.render_axis == "y" ? 'y' : 'z';
+    FrameRenderer renderer(rendering ? cfg.render_size : 1, axis,
+                           cfg.render_quantity == "temperature", cfg.render_extent);
+
+    // frames are written by a background thread while the next step runs
+    AsyncFrameWriter writer;
+
+    // live snapshots for a local viewer, copied straight into shared memory
+    // (no disk, and the step loop never waits for readers)
+    std::unique_ptr<SnapshotRing> ring;
+    const size_t shm_interval = size_t(std::max(cfg.shm_interval, 1));
+    bool ring_clipped = false;
+    if (!cfg.shm_name.empty()) {
+        const size_t capacity = cfg.shm_capacity > 0 ? size_t(cfg.shm_capacity) : P.N;
+        ring = std::make_unique<SnapshotRing>(cfg.shm_name, std::max<size_t>(capacity, 1),
+                                              uint32_t(std::max(cfg.shm_slots, 0)));
+        if (!ring->ok()) ring.reset();
+        else std::cout << "Publishing snapshots to shared memory '" << cfg.shm_name << "'\n";
+    }
+
+    // per-phase counters and roofline accounting. Each phase carries an
+    // analytic model of its work: flops per pair or particle counted from
+    // the loop bodies (sqrt and division as one), bytes as the arrays a
+    // sweep brings in from memory.
+    std::unique_ptr<PhaseProfiler> profiler;
+    size_t ph_gravity = 0, ph_sink_gravity = 0, ph_diagnostics = 0, ph_density = 0,
+           ph_pressure = 0, ph_integrate = 0, ph_thermo = 0, ph_starform = 0,
+           ph_compact = 0, ph_output = 0;
+    if (cfg.profile) {
+        profiler = std::make_unique<PhaseProfiler>(par_max_threads());
+        const PerfCounters& pc = profiler->counters();
+        if (!pc.any_hardware()) {
+            std::cerr << "WARNING: hardware performance counters unavailable ("
+                      << pc.unavailable_reason() << "); profiling time and the model only\n";
+        }
+        const double rs = double(sizeof(real_t)), llc = last_level_cache_bytes();
+        const double pair_share = cfg.use_cached ? 1.0 : 0.5; // reference sums are symmetric
+        auto gas = [&P] { return double(P.N - P.num_dead()); };
+        auto gravity_cost = [&, rs, llc, pair_share]() -> KernelCost {
+            const double n = gas();
+            if (pm) return KernelCost{}; // mesh: no pair model
+            if (bh) return pair_sweep_cost(n, double(bh->interactions()), 21.0, 4 * rs + 1, 6 * rs, llc);
+            return pair_sweep_cost(n, pair_share * n * n, 21.0, 4 * rs + 1, 6 * rs, llc);
+        };
+        auto density_cost = [&, rs, llc]() -> KernelCost {
+            const double n = gas();
+            if (knn) return stream_cost(n, 62.0 * knn_neighbors + 100.0, 13 * rs + 5, llc);
+            return pair_sweep_cost(n, n * n, 19.0, 7 * rs + 1, 9 * rs, llc);
+        };
+        auto pressure_cost = [&, rs, llc, pair_share] {
+            const double n = gas();
+            return pair_sweep_cost(n, pair_share * n * n, 9.0, 6 * rs + 1, 8 * rs, llc);
+        };
+        auto sink_cost = [&, rs, llc] {
+            if (sinks.size() == 0) return KernelCost{};
+            return stream_cost(gas(), 21.0 * double(sinks.size()), 9 * rs + 1, llc);
+        };
+
+        if (cfg.use_cached) {
+            // graph stages, timed one after the other (run(false) below)
+            std::vector<size_t> ids;
+            for (size_t s = 0; s < graph.size(); ++s) {
+                const std::string& name = graph.name(s);
+                std::function<KernelCost()> model;
+                if (name == "gravity") model = gravity_cost;
+                if (name == "density") model = density_cost;
+                if (name == "sink_gravity") model = sink_cost;
+                if (name == "pressure_forces") model = pressure_cost;
+                if (name == "update_gas") model = [&, rs, llc] { return stream_cost(gas(), 27.0, 20 * rs + 1, llc); };
+                ids.push_back(profiler->add(name, model));
+            }
+            graph.set_observer([&profiler, ids](size_t s, bool done) {
+                if (done) profiler->end(ids[s]);
+                else profiler->begin(ids[s]);
+            });
+            if (cfg.task_graph) std::cout << "Profiling: graph stages run one after the other\n";
+        } else {
+            ph_gravity = profiler->add("gravity", gravity_cost);
+            ph_sink_gravity = profiler->add("sink_gravity", sink_cost);
+            ph_diagnostics = profiler->add("diagnostics");
+            ph_density = profiler->add("density", density_cost);
+            ph_pressure = profiler->add("pressure_forces", pressure_cost);
+            ph_integrate = profiler->add("integrate", [&, rs, llc] { return stream_cost(gas(), 15.0, 15 * rs + 1, llc); });
+            ph_thermo = profiler->add("thermodynamics", [&, rs, llc] { return stream_cost(gas(), 12.0, 16 * rs + 1, llc); });
+            ph_starform = profiler->add("star_formation");
+        }
+        ph_compact = profiler->add("compact");
+        ph_output = profiler->add("output");
+    }
+    auto begin_phase = [&](size_t phase) { if (profiler) profiler->begin(phase); };
+    auto end_phase = [&](size_t phase) { if (profiler) profiler->end(phase); };
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // ----------------------------------------------------
+    // Simulation loop
+    // ----------------------------------------------------
+    for (t = 0; t < num_steps; ++t) {
+        scratch.reset();
+        diag_step = diagnostics && t % cfg.diagnostics_interval == 0;
+        audit_step = auditing && t % cfg.audit_interval == 0;
+        if (diag_step) phi.resize(P.N);
+        phi_out = diag_step ? phi.data() : nullptr;
+
+        if (cfg.use_cached) {
+            // stages 1-7, concurrently where the data allows
+            graph.run(cfg.task_graph && !profiler);
+        } else {
+            // ------------------------------------------------
+            // 1. Compute gravitational acceleration
+            // ------------------------------------------------
+            begin_phase(ph_gravity);
+            ax.assign(P.N, real_t(0));
+            ay.assign(P.N, real_t(0));
+            az.assign(P.N, real_t(0));
+
+            compute_gravity(P, ax, ay, az, G, soft, diag_step ? &phi : nullptr);
+            end_phase(ph_gravity);
+            if (audit_step) audit(t, ax.data(), ay.data(), az.data());
+            begin_phase(ph_sink_gravity);
+            compute_sink_gravity(P, sinks, ax, ay, az, G, soft);
+            end_phase(ph_sink_gravity);
+            begin_phase(ph_diagnostics);
+            if (diag_step) record_diagnostics(t);
+            end_phase(ph_diagnostics);
+
+            // ------------------------------------------------
+            // 2. Compute densities (SPH or KNN), div v and curl v
+            // ------------------------------------------------
+            begin_phase(ph_density);
+            compute_density();
+            end_phase(ph_density);
+
+            // ------------------------------------------------
+            // 3. Compute pressure forces
+            // (This is where the thermodynamics and kinetics kiss)
+            // ------------------------------------------------
+            begin_phase(ph_pressure);
+            compute_pressure_forces(P, h, ax, ay, az);
+            end_phase(ph_pressure);
+
+            // ------------------------------------------------
+            // 4. Integrate motion
+            // ------------------------------------------------
+            begin_phase(ph_integrate);
+            velocity_verlet(P, ax, ay, az, dt);
+            velocity_verlet_sinks(sinks, dt);
+            end_phase(ph_integrate);
+
+            // ------------------------------------------------
+            // 5. Update thermodynamics
+            // ------------------------------------------------
+            begin_phase(ph_thermo);
+            update_thermodynamics(P, dt);
+
+            // ------------------------------------------------
+            // 6. Update thermodynamic physics
+            //    (temperature, pressure eqn of state, etc.)
+            // ------------------------------------------------
+            update_physics(P, dt, eos.get());
+            end_phase(ph_thermo);
+
+            begin_phase(ph_starform);
+            detect_stars();
+            form_stars();
+            end_phase(ph_starform);
+        }
+        if (SF.diverged()) {
+            std::cerr << "ERROR: non-finite positions at step " << t
+                      << " (the run has diverged); aborting run\n";
+            result.aborted = true;
+            break;
+        }
+
+        // ----------------------------------------------------
+        // 8. Squeeze out dead particles (IDs stay with particles)
+        // ----------------------------------------------------
+        begin_phase(ph_compact);
+        if ((t + 1) % compact_interval == 0 && P.num_dead() > 0) P.compact();
+        end_phase(ph_compact);
+
+        // ----------------------------------------------------
+        // 9. Output snapshot (in the background)
+        // ----------------------------------------------------
+        begin_phase(ph_output);
+        const bool frame_due = output && t % cfg.output_interval == 0;
+        const bool image_due = rendering && t % cfg.render_interval == 0;
+        if (frame_due || image_due) {
+            const std::string base = cfg.output_dir + "/frame_" + std::to_string(t);
+            const std::string image = cfg.output_dir + "/render_" + std::to_string(t) + image_ext;
+            const double time = double(t * dt);
+            writer.submit(P, sinks, [&encoder, &renderer, frame_due, image_due, compressed, base,
+                                     image, time, h](const Particles& F, const SinkParticles& S) {
+                if (frame_due && compressed) {
+                    encoder.write(base + ".sfz", F, S, time);
+                } else if (frame_due) {
+                    F.write_csv(base + ".csv");
+                    S.append_csv(base + ".csv");
+                }
+                if (image_due) {
+                    renderer.render(F, S, h);
+                    renderer.write(image);
+                }
+            });
+        }
+        if (ring && t % shm_interval == 0 &&
+            !ring->publish(P, sinks, t, double(t * dt)) && !ring_clipped) {
+            std::cerr << "WARNING: more than shm_capacity = " << ring->capacity()
+                      << " gas particles; live snapshots leave out the rest\n";
+            ring_clipped = true;
+        }
+        end_phase(ph_output);
+        result.steps = t + 1;
+
+        // ----------------------------------------------------
+        // 10. In-line verification; abort runs that diverge
+        // ----------------------------------------------------
+        if (check && (t + 1) % cfg.verify_interval == 0) {
+            const VerificationSample s{t + 1, double((t + 1) * dt), reference.compare(P)};
+            result.verification.push_back(s);
+            std::cout << "verify step " << s.step << ": L1 " << s.error.L1
+                      << ", L2 " << s.error.L2 << ", Linf " << s.error.Linf << "\n";
+            if (!std::isfinite(s.error.L2)) {
+                std::cerr << "ERROR: non-finite positions at step " << s.step
+                          << " (the run has diverged); aborting run\n";
+                result.aborted = true;
+                break;
+            }
+            if (cfg.verify_abort_l2 > 0 && s.error.L2 > cfg.verify_abort_l2) {
+                std::cerr << "ERROR: L2 error " << s.error.L2 << " exceeds verify_abort_l2 = "
+                          << cfg.verify_abort_l2 << " at step " << s.step << "; aborting run\n";
+                result.aborted = true;
+                break;
+            }
+        }
+
+        if (on_step) on_step(t);
+    }
+
+    writer.wait();
+    auto end = std::chrono::high_resolution_clock::now();
+
+    if (compressed && encoder.rows() > 0) {
+        std::cout << "Compressed frames: " << encoder.bytes() << " bytes, "
+                  << double(encoder.bytes()) / double(encoder.rows()) << " bytes per row\n";
+    }
+
+    if (profiler) {
+        // the ceilings are measured after the run so they do not disturb it
+        const MachinePeaks peaks = measure_peaks(cfg.profile_peak_gflops,
+                                                 cfg.profile_peak_bandwidth);
+        profiler->report(std::cout, peaks);
+        std::filesystem::create_directories(cfg.output_dir);
+        const std::string csv = cfg.output_dir + "/profile.csv";
+        if (profiler->write_csv(csv, peaks)) std::cout << "Profile written to " << csv << "\n";
+    }
+
+    result.runtime_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    result.star_mass_fraction = sinks.total_mass() / initial_gas_mass;
+    result.gas_particles = P.N - P.num_dead();
+    result.max_energy_drift = diag_log.max_energy_drift();
+    if (result.steps > 0) {
+        if (bh) result.tree_imbalance = tree_imbalance_sum / double(result.steps);
+        result.starform_imbalance = starform_imbalance_sum / double(result.steps);
+    }
+    return result;
+}
@@ -0,0 +1,168 @@
+#include "../include/run.hpp"
+
+#ifdef STARFORM_USE_MPI
+
+#include "../include/physics.hpp"
+#include "../include/integrator.hpp"
+#include "../include/density.hpp"
+#include "../include/hydro.hpp"
+#include "../include/init.hpp"
+#include "../include/thermo.hpp"
+#include "../include/parallel.hpp"
+
+#include <iostream>
+#include <string>
+#include <filesystem>
+
+
+RunResult run_simulation_mpi(Particles& P, const Config& cfg, DomainDecomposition& dd) {
+    const real_t dt = real_t(cfg.timestep);
+    const real_t h = real_t(cfg.smoothing_length);
+    const real_t G = real_t(cfg.G);
+    const real_t soft = real_t(cfg.softening);
+    const real_t theta = real_t(cfg.theta);
+    const size_t num_steps = static_cast<size_t>(std::max(cfg.num_steps, 0));
+    const bool output = cfg.output_interval > 0;
+
+    if (cfg.num_threads > 0) par_set_num_threads(cfg.num_threads);
+    if (output && dd.rank() == 0) std::filesystem::create_directories(cfg.output_dir);
+    MPI_Barrier(dd.comm());
+
+    const std::unique_ptr<EosTable> eos = make_eos_table(cfg);
+    RunResult result;
+    std::vector<real_t> cost(P.N, real_t(1)); // measured per-particle cost
+    double imbalance = 1.0, imbalance_sum = 0.0, tree_imbalance_sum = 0.0;
+
+    // local tree (exported to other ranks) and local + LET tree (forces)
+    BarnesHutSolver local_tree(P, theta, soft);
+    BarnesHutSolver tree(P, theta, soft);
+
+    const double start = MPI_Wtime();
+
+    for (size_t t = 0; t < num_steps; ++t) {
+        // ------------------------------------------------
+        // 0. (Re)balance: equal-cost Morton ranges
+        // ------------------------------------------------
+        const bool rebalance = t == 0 ||
+            (cfg.mpi_rebalance_interval > 0 && t % cfg.mpi_rebalance_interval == 0 &&
+             imbalance > cfg.mpi_imbalance_tolerance);
+        if (rebalance) {
+            dd.decompose(P, cost);
+            result.rebalances++;
+        }
+        dd.update_boxes(P);
+        const size_t n_local = P.N;
+        double compute = 0.0;
+
+        // ------------------------------------------------
+        // 1. Gravity: local tree + locally essential trees of the others
+        // ------------------------------------------------
+        double t0 = MPI_Wtime();
+        local_tree.build(P);
+        compute += MPI_Wtime() - t0;
+        dd.import_essential_tree(P, local_tree);
+        t0 = MPI_Wtime();
+        tree.build(P);
+        tree.compute_accelerations(P, G);
+        tree_imbalance_sum += tree.load_imbalance();
+        compute += MPI_Wtime() - t0;
+        P.resize(n_local);
+
+        // ------------------------------------------------
+        // 2-3. Densities and pressure forces with a 2h halo
+        // ------------------------------------------------
+        dd.import_halo(P, real_t(2) * h);
+        t0 = MPI_Wtime();
+        compute_density_sph(P, h);
+        compute += MPI_Wtime() - t0;
+        dd.refresh_halo_density(P, n_local);
+        t0 = MPI_Wtime();
+        compute_pressure_forces_cached(P, h);
+        P.resize(n_local);
+
+        // ------------------------------------------------
+        // 4-6. Local updates
+        // ------------------------------------------------
+        update_gas(P, dt, eos.get());
+        compute += MPI_Wtime() - t0;
+
+        // the rank's time is shared out by the particles' tree-walk
+        // interaction counts (evenly if there were none)
+        const std::vector<uint32_t>& walks = tree.interaction_counts();
+        uint64_t total = 0;
+        for (size_t i = 0; i < P.N; ++i) total += walks[i];
+        cost.resize(P.N);
+        for (size_t i = 0; i < P.N; ++i) {
+            cost[i] = real_t(total ? compute * double(walks[i]) / double(total)
+                                   : compute / double(P.N));
+        }
+        imbalance = dd.imbalance(compute);
+        imbalance_sum += imbalance;
+
+        // ------------------------------------------------
+        // 7. Output snapshot (one file per rank)
+        // ------------------------------------------------
+        if (output && t % cfg.output_interval == 0) {
+            P.write_csv(cfg.output_dir + "/frame_" + std::to_string(t) +
+                        "_rank" + std::to_string(dd.rank()) + ".csv");
+        }
+        result.steps = t + 1;
+    }
+
+    result.runtime_ms = 1000.0 * (MPI_Wtime() - start);
+    result.gas_particles = dd.global_count(P);
+    result.load_imbalance = result.steps ? imbalance_sum / double(result.steps) : 1.0;
+    result.tree_imbalance = result.steps ? tree_imbalance_sum / double(result.steps) : 1.0;
+    return result;
+}
+
+
+int run_distributed(const Config& cfg) {
+    DomainDecomposition dd(MPI_COMM_WORLD);
+    const bool root = dd.rank() == 0;
+
+    // every rank generates its own ICs; a snapshot cannot be split yet
+    if (!cfg.ic_input.empty()) {
+        if (root) std::cerr << "ERROR: MPI runs cannot load ic_input (" << cfg.ic_input << ")\n";
+        return 1;
+    }
+
+    if (root) {
+        std::cout << "Precision: " << precision_name() << "\n";
+        std::cout << "MPI ranks: " << dd.size() << "\n";
+        print_config(cfg);
+        std::cout << "Using " << init_name(cfg.init_type) << " initialization\n";
+        if (!cfg.use_cached || cfg.gravity_solver != "barnes_hut" || cfg.fixed_positions ||
+            cfg.verify || cfg.verify_interval > 0 ||
+            cfg.diagnostics_interval > 0 || cfg.audit_interval > 0 || !cfg.sweep.empty() ||
+            cfg.box_size > 0 || cfg.render_interval > 0 || !cfg.shm_name.empty() ||
+            cfg.density_kernel != "sph" || cfg.profile) {
+            std::cerr << "WARNING: MPI runs use the cached Barnes-Hut path only; star "
+                         "formation, fixed positions, periodic boxes, knn density, "
+                         "verification, diagnostics, audits, images, live snapshots, "
+                         "profiling and sweeps are ignored\n";
+        }
+    }
+
+    // counter-based ICs: every rank generates its own index range
+    const size_t N = cfg.num_particles;
+    const size_t first = N * size_t(dd.rank()) / size_t(dd.size());
+    const size_t last = N * size_t(dd.rank() + 1) / size_t(dd.size());
+    Particles P(last - first);
+    init_particle_range(P, cfg.init_type, cfg.seed, first, N);
+
+    RunResult result = run_simulation_mpi(P, cfg, dd);
+
+    if (root) {
+        std::cout << "distributed runtime: " << static_cast<long long>(result.runtime_ms)
+                  << " ms on " << dd.size() << " ranks\n";
+        std::cout << result.gas_particles << " gas particles; mean load imbalance "
+                  << result.load_imbalance << " (max/mean rank time), "
+                  << result.rebalances << " decompositions\n";
+        std::cout << "rank 0 tree-walk thread imbalance " << result.tree_imbalance
+                  << " (max/mean thread time)\n";
+    }
+    return 0;
+}
+
+#endif // STARFORM_USE_MPI
@@ -0,0 +1,228 @@
+#include "../include/shm_ring.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+namespace {
+
+constexpr uint32_t kRingVersion = 1;
+
+size_t align64(size_t n) { return (n + 63) & ~size_t(63); }
+
+// byte offsets of the blocks inside a slot
+struct SlotLayout {
+    size_t capacity;
+
+    size_t column(uint32_t c) const { return 64 + size_t(c) * align64(capacity * sizeof(float)); }
+    size_t id() const { return column(kRingColumns); }
+    size_t star(uint32_t c) const {
+        return id() + align64(capacity * sizeof(uint64_t)) + size_t(c) * kRingStars * sizeof(float);
+    }
+    size_t bytes() const { return align64(star(4)); }
+};
+
+// POSIX names start with one slash; config values may leave it out
+std::string shm_path(const std::string& name) {
+    return name.empty() || name[0] == '/' ? name : "/" + name;
+}
+
+}
+
+size_t SnapshotRing::segment_bytes(size_t capacity, uint32_t slots) {
+    return sizeof(RingHeader) + size_t(slots) * SlotLayout{capacity}.bytes();
+}
+
+SnapshotRing::SnapshotRing(const std::string& name, size_t capacity, uint32_t slots)
+    : name_(shm_path(name)), capacity_(capacity), slots_(slots < 2 ? 2 : slots) {
+    if (slots < 2) {
+        std::cerr << "WARNING: shm_slots must be at least 2, using 2\n";
+    }
+    bytes_ = segment_bytes(capacity_, slots_);
+
+    // start from a fresh segment so a viewer never sees a stale layout
+    shm_unlink(name_.c_str());
+    const int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        std::cerr << "ERROR: cannot create shared memory '" << name_ << "': "
+                  << std::strerror(errno) << "\n";
+        return;
+    }
+    void* base = MAP_FAILED;
+    if (ftruncate(fd, off_t(bytes_)) == 0) {
+        base = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    const int err = errno;
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "ERROR: cannot map " << bytes_ << " bytes of shared memory '" << name_
+                  << "': " << std::strerror(err) << "\n";
+        shm_unlink(name_.c_str());
+        return;
+    }
+    base_ = static_cast<uint8_t*>(base);
+
+    // ftruncate zero-fills: every slot starts at sequence 0 (empty)
+    RingHeader* header = new (base_) RingHeader;
+    header->version = kRingVersion;
+    header->slots = slots_;
+    header->capacity = capacity_;
+    header->slot_bytes = SlotLayout{capacity_}.bytes();
+    header->published.store(0, std::memory_order_relaxed);
+    for (uint32_t s = 0; s < slots_; ++s) {
+        SlotHeader* slot = new (base_ + sizeof(RingHeader) + s * header->slot_bytes) SlotHeader;
+        slot->sequence.store(0, std::memory_order_relaxed);
+    }
+    // the magic goes last: a viewer that sees it sees a complete header
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, kRingMagic, sizeof(kRingMagic));
+}
+
+SnapshotRing::~SnapshotRing() {
+    if (!base_) return;
+    munmap(base_, bytes_);
+    shm_unlink(name_.c_str());
+}
+
+bool SnapshotRing::publish(const Particles& P, const SinkParticles& S, uint64_t step, double time) {
+    if (!base_) return false;
+    RingHeader* header = reinterpret_cast<RingHeader*>(base_);
+    const uint64_t n = header->published.load(std::memory_order_relaxed);
+    const SlotLayout layout{capacity_};
+    uint8_t* slot_base = base_ + sizeof(RingHeader) + (n % slots_) * layout.bytes();
+    SlotHeader* slot = reinterpret_cast<SlotHeader*>(slot_base);
+
+    rows_.clear();
+    for (size_t i = 0; i < P.N; ++i) {
+        if (P.alive[i]) rows_.push_back(uint32_t(i));
+    }
+    const bool complete = rows_.size() <= capacity_;
+    if (!complete) rows_.resize(capacity_);
+    const size_t rows = rows_.size();
+    const size_t stars = std::min(S.size(), size_t(kRingStars));
+
+    // odd sequence: readers of this slot discard what they copy from here on
+    const uint64_t seq = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->step = step;
+    slot->time = time;
+    slot->rows = rows;
+    slot->stars = stars;
+    slot->total_stars = S.size();
+
+    const std::vector<real_t>* fields[kRingColumns] = {&P.x, &P.y, &P.z, &P.vx, &P.vy, &P.vz,
+                                                       &P.temperature, &P.density, &P.pressure};
+    for (uint32_t c = 0; c < kRingColumns; ++c) {
+        float* out = reinterpret_cast<float*>(slot_base + layout.column(c));
+        const real_t* in = fields[c]->data();
+        for (size_t k = 0; k < rows; ++k) out[k] = float(in[rows_[k]]);
+    }
+    uint64_t* ids = reinterpret_cast<uint64_t*>(slot_base + layout.id());
+    for (size_t k = 0; k < rows; ++k) ids[k] = P.id[rows_[k]];
+
+    float* star[4];
+    for (uint32_t c = 0; c < 4; ++c) star[c] = reinterpret_cast<float*>(slot_base + layout.star(c));
+    for (size_t k = 0; k < stars; ++k) {
+        const Star& s = S.stars[k];
+        star[0][k] = float(s.position.x);
+        star[1][k] = float(s.position.y);
+        star[2][k] = float(s.position.z);
+        star[3][k] = float(s.mass);
+    }
+
+    slot->sequence.store(seq + 2, std::memory_order_release);
+    header->published.store(n + 1, std::memory_order_release);
+    return complete;
+}
+
+SnapshotRingReader::SnapshotRingReader(const std::string& name) {
+    const std::string path = shm_path(name);
+    const int fd = shm_open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        std::cerr << "ERROR: cannot open shared memory '" << path << "': "
+                  << std::strerror(errno) << "\n";
+        return;
+    }
+    struct stat st;
+    void* base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(RingHeader)) {
+        base = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "ERROR: cannot map shared memory '" << path << "'\n";
+        return;
+    }
+    const RingHeader* header = static_cast<const RingHeader*>(base);
+    const size_t bytes = size_t(st.st_size);
+    if (std::memcmp(header->magic, kRingMagic, sizeof(kRingMagic)) != 0 ||
+        header->version != kRingVersion || header->slots == 0 ||
+        header->slot_bytes != SlotLayout{header->capacity}.bytes() ||
+        bytes < SnapshotRing::segment_bytes(header->capacity, header->slots)) {
+        std::cerr << "ERROR: '" << path << "' is not a snapshot ring\n";
+        munmap(base, bytes);
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    base_ = static_cast<const uint8_t*>(base);
+    bytes_ = bytes;
+}
+
+SnapshotRingReader::~SnapshotRingReader() {
+    if (base_) munmap(const_cast<uint8_t*>(base_), bytes_);
+}
+
+uint64_t SnapshotRingReader::published() const {
+    if (!base_) return 0;
+    return reinterpret_cast<const RingHeader*>(base_)->published.load(std::memory_order_acquire);
+}
+
+bool SnapshotRingReader::read_slot(uint32_t index, RingSnapshot& out) const {
+    const RingHeader* header = reinterpret_cast<const RingHeader*>(base_);
+    const SlotLayout layout{header->capacity};
+    const uint8_t* slot_base = base_ + sizeof(RingHeader) + index * header->slot_bytes;
+    const SlotHeader* slot = reinterpret_cast<const SlotHeader*>(slot_base);
+
+    const uint64_t before = slot->sequence.load(std::memory_order_acquire);
+    if (before == 0 || (before & 1)) return false; // empty or being written
+
+    // a torn slot can hold any counts; clamp them before sizing the copy
+    const size_t rows = std::min<uint64_t>(slot->rows, header->capacity);
+    const size_t stars = std::min<uint64_t>(slot->stars, kRingStars);
+    out.step = slot->step;
+    out.time = slot->time;
+    out.total_stars = slot->total_stars;
+    for (uint32_t c = 0; c < kRingColumns; ++c) {
+        const float* in = reinterpret_cast<const float*>(slot_base + layout.column(c));
+        out.columns[c].assign(in, in + rows);
+    }
+    const uint64_t* ids = reinterpret_cast<const uint64_t*>(slot_base + layout.id());
+    out.id.assign(ids, ids + rows);
+    std::vector<float>* star[4] = {&out.star_x, &out.star_y, &out.star_z, &out.star_mass};
+    for (uint32_t c = 0; c < 4; ++c) {
+        const float* in = reinterpret_cast<const float*>(slot_base + layout.star(c));
+        star[c]->assign(in, in + stars);
+    }
+
+    // the copy is good only if no write started in the meantime
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot->sequence.load(std::memory_order_relaxed) == before;
+}
+
+bool SnapshotRingReader::read_latest(RingSnapshot& out, int attempts) const {
+    if (!base_) return false;
+    const RingHeader* header = reinterpret_cast<const RingHeader*>(base_);
+    for (int a = 0; a < attempts; ++a) {
+        const uint64_t n = header->published.load(std::memory_order_acquire);
+        if (n == 0) return false;
+        if (read_slot(uint32_t((n - 1) % header->slots), out)) return true;
+    }
+    return false;
+}
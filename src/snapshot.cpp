@@ -0,0 +1,157 @@
+#include "../include/snapshot.hpp"
+#include "../include/init.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr char kMagic[8] = "SFSNAP1";
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kFloatFields = 8; // mass x y z vx vy vz temperature
+
+SnapshotHeader make_header(uint64_t N, uint64_t seed, double time) {
+    SnapshotHeader h;
+    std::memcpy(h.magic, kMagic, sizeof(h.magic));
+    h.version = kVersion;
+    h.num_fields = kFloatFields;
+    h.N = N;
+    h.seed = seed;
+    h.time = time;
+    return h;
+}
+
+// byte offset of element `first` of float block f (f == kFloatFields: IDs)
+std::streamoff block_offset(uint32_t f, uint64_t N, uint64_t first) {
+    const std::streamoff base = sizeof(SnapshotHeader) + std::streamoff(f) * N * sizeof(float);
+    return base + std::streamoff(first) * (f == kFloatFields ? sizeof(uint64_t) : sizeof(float));
+}
+
+template <class T>
+void write_at(std::ofstream& out, std::streamoff off, const std::vector<T>& v, size_t n) {
+    out.seekp(off);
+    out.write(reinterpret_cast<const char*>(v.data()), std::streamsize(n * sizeof(T)));
+}
+
+template <class T>
+bool read_block(std::ifstream& in, std::vector<T>& v, size_t n) {
+    v.resize(n);
+    in.read(reinterpret_cast<char*>(v.data()), std::streamsize(n * sizeof(T)));
+    return bool(in);
+}
+
+} // namespace
+
+
+bool write_snapshot(const Particles& P, const std::string& filename, double time) {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "ERROR: Could not open file for writing: " << filename << "\n";
+        return false;
+    }
+
+    std::vector<size_t> live;
+    live.reserve(P.N);
+    for (size_t i = 0; i < P.N; ++i)
+        if (P.alive[i]) live.push_back(i);
+    const size_t n = live.size();
+
+    const SnapshotHeader h = make_header(n, 0, time);
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+    const std::vector<real_t>* fields[kFloatFields] = {
+        &P.mass, &P.x, &P.y, &P.z, &P.vx, &P.vy, &P.vz, &P.temperature};
+    std::vector<float> block(n);
+    for (const std::vector<real_t>* f : fields) {
+        for (size_t k = 0; k < n; ++k) block[k] = float((*f)[live[k]]);
+        out.write(reinterpret_cast<const char*>(block.data()), std::streamsize(n * sizeof(float)));
+    }
+    std::vector<uint64_t> ids(n);
+    for (size_t k = 0; k < n; ++k) ids[k] = P.id[live[k]];
+    out.write(reinterpret_cast<const char*>(ids.data()), std::streamsize(n * sizeof(uint64_t)));
+    return bool(out);
+}
+
+
+bool read_snapshot(const std::string& filename, Particles& P, double* time) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "ERROR: Could not open snapshot: " << filename << "\n";
+        return false;
+    }
+
+    SnapshotHeader h;
+    in.read(reinterpret_cast<char*>(&h), sizeof(h));
+    if (!in || std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 ||
+        h.version != kVersion || h.num_fields != kFloatFields) {
+        std::cerr << "ERROR: Not a version " << kVersion << " snapshot: " << filename << "\n";
+        return false;
+    }
+
+    const size_t n = static_cast<size_t>(h.N);
+    Particles Q(n);
+    std::vector<real_t>* fields[kFloatFields] = {
+        &Q.mass, &Q.x, &Q.y, &Q.z, &Q.vx, &Q.vy, &Q.vz, &Q.temperature};
+    std::vector<float> block;
+    for (std::vector<real_t>* f : fields) {
+        if (!read_block(in, block, n)) {
+            std::cerr << "ERROR: Truncated snapshot: " << filename << "\n";
+            return false;
+        }
+        for (size_t k = 0; k < n; ++k) (*f)[k] = real_t(block[k]);
+    }
+    if (!read_block(in, Q.id, n)) {
+        std::cerr << "ERROR: Truncated snapshot: " << filename << "\n";
+        return false;
+    }
+
+    P = std::move(Q);
+    if (time) *time = h.time;
+    return true;
+}
+
+
+bool stream_initial_conditions(const std::string& filename, int version_type,
+                               size_t N, uint64_t seed, size_t chunk) {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "ERROR: Could not open file for writing: " << filename << "\n";
+        return false;
+    }
+    if (version_type < 1 || version_type > 7) version_type = 1;
+    chunk = std::max<size_t>(chunk, 1);
+
+    const SnapshotHeader h = make_header(N, seed, 0.0);
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+    // one chunk of every field at a time
+    std::vector<float> block[kFloatFields];
+    for (auto& b : block) b.resize(std::min(chunk, N));
+    std::vector<uint64_t> ids(std::min(chunk, N));
+
+    for (size_t first = 0; first < N; first += chunk) {
+        const size_t n = std::min(chunk, N - first);
+
+        #pragma omp parallel for schedule(static)
+        for (long k = 0; k < static_cast<long>(n); ++k) {
+            const size_t i = first + size_t(k);
+            const InitState s = init_state(version_type, i, N, seed);
+            block[0][k] = 1.0f; // unit mass, as in Particles
+            block[1][k] = float(s.x);  block[2][k] = float(s.y);  block[3][k] = float(s.z);
+            block[4][k] = float(s.vx); block[5][k] = float(s.vy); block[6][k] = float(s.vz);
+            block[7][k] = 1.0f; // initial temperature
+            ids[k] = i;
+        }
+
+        for (uint32_t f = 0; f < kFloatFields; ++f)
+            write_at(out, block_offset(f, N, first), block[f], n);
+        write_at(out, block_offset(kFloatFields, N, first), ids, n);
+        if (!out) {
+            std::cerr << "ERROR: Failed writing snapshot: " << filename << "\n";
+            return false;
+        }
+    }
+    return true;
+}
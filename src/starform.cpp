@@ -1,5 +1,7 @@
 #include "../include/starform.hpp"
 #include <algorithm>
+#include <atomic>
+#include <new>
 #include <iostream>
 
 inline Vec3 get_pos(const Particles& P, size_t i) {
@@ -10,81 +12,255 @@ inline Vec3 get_vel(const Particles& P, size_t i) {
     return Vec3(P.vx[i], P.vy[i], P.vz[i]);
 }
 
-int StarFormation::count_neighbors(const Particles& P, int idx) const {
+// Optimization 2
+// Neighbour count (excluding self) and mass inside neighbor_radius
+// (including self) in one pass over the cell list.
+uint32_t StarFormation::neighbor_stats(const Particles& P, int idx, int& count, real_t& rho) const {
+    count = 0;
+    rho = real_t(0);
     if (!P.alive[idx]) return 0;
 
-    Vec3 xi = get_pos(P, idx);
-    float R2 = neighbor_radius * neighbor_radius;
-    int count = 0;
+    real_t xi = P.x[idx]; real_t yi = P.y[idx]; real_t zi = P.z[idx];
+    real_t R2 = neighbor_radius * neighbor_radius;
+    acc_t mass = 0;
+    int inside = 0;
+    uint32_t visited = 0;
 
-    for (size_t j = 0; j < P.N; j++) {
-        if (j == (size_t)idx) continue;
-        if (!P.alive[j]) continue;
+    grid_.for_each_candidate(xi, yi, zi, [&](uint32_t j) {
+        visited++;
+        real_t dx = P.x[j] - xi; real_t dy = P.y[j] - yi; real_t dz = P.z[j] - zi;
+        real_t dist2 = dx*dx + dy*dy + dz*dz;
+        if (dist2 < R2) {
+            mass += P.mass[j];
+            inside++;
+        }
+    });
 
-        Vec3 xj = get_pos(P, j);
-        float dist2 = (xj - xi).length2();
-        if (dist2 < R2) count++;
-    }
-    return count;
+    // self is always inside; it counts towards the mass but not the neighbours
+    count = inside - 1;
+    rho = real_t(mass);
+    return visited;
 }
 
 
-// Optimization 2
-float StarFormation::compute_local_density(const Particles& P, int idx) const {
-    if (!P.alive[idx]) return 0.0f;
-    // Vec3 xi = get_pos(P, idx);
-    float xi = P.x[idx]; float yi = P.y[idx]; float zi = P.z[idx]; // 
-
-    float R2 = neighbor_radius * neighbor_radius;
-    float rho = 0.0f;
-    int neighbor_count = 0;
-
-    for (size_t j = 0; j < P.N; j++) {
-        if (!P.alive[j]) continue;
-        // Vec3 xj = get_pos(P, j);
-        float xj = P.x[j]; float yj = P.y[j]; float zj = P.z[j];
-        float dist2 = (xj - xi)*(xj - xi) + (yj - yi)*(yj - yi) + (zj - zi)*(zj - zi);
-
-        // float dist2 = (xj - xi).length2();
-        if (dist2 < R2) {
-            rho += P.mass[j];
-            neighbor_count++;
+const std::vector<int>& StarFormation::detect_star_candidates(const Particles& P,
+                                                             ScratchArena& scratch) const {
+    candidates_.clear();
+    diverged_ = !grid_.build(P, neighbor_radius);
+    if (diverged_) return candidates_;
+
+    const long N = static_cast<long>(P.N);
+    uint8_t* is_candidate = scratch.alloc<uint8_t>(N, 0);
+
+    // dense regions cost far more per particle than the outskirts: split
+    // the cell order on last call's candidate counts (uniform at first)
+    const std::vector<uint32_t>& order = grid_.items();
+    const uint32_t* costs = nullptr;
+    if (visits_.size() == P.N) {
+        cost_.resize(order.size());
+        for (size_t s = 0; s < order.size(); ++s) cost_[s] = visits_[order[s]];
+        costs = cost_.data();
+    } else {
+        visits_.assign(P.N, 0);
+    }
+
+    loop_.run(order.size(), costs, [&](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; ++s) {
+            const uint32_t i = order[s];
+            int nn;
+            real_t rho;
+            visits_[i] = neighbor_stats(P, i, nn, rho);
+
+            if (nn >= (int)min_neighbors && rho >= min_density)
+                is_candidate[i] = 1;
         }
+    });
+
+    for (long i = 0; i < N; i++) {
+        if (is_candidate[i]) candidates_.push_back(i);
     }
-    // Avoid division by zero / too low density
-    if (neighbor_count == 0) {
-        rho = 1e-5f;  // tiny floor density
+    return candidates_;
+}
+
+// lock-free union-find: find with path halving, link larger root under smaller
+static int uf_find(std::atomic<int>* parent, int x) {
+    for (;;) {
+        int p = parent[x].load(std::memory_order_relaxed);
+        if (p == x) return x;
+        int gp = parent[p].load(std::memory_order_relaxed);
+        if (p != gp) parent[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+        x = gp;
+    }
+}
+
+static void uf_unite(std::atomic<int>* parent, int a, int b) {
+    for (;;) {
+        a = uf_find(parent, a);
+        b = uf_find(parent, b);
+        if (a == b) return;
+        if (a < b) std::swap(a, b);
+        int expected = a;
+        if (parent[a].compare_exchange_strong(expected, b)) return;
     }
-    return rho;
 }
 
+std::vector<StarCluster> StarFormation::detect_star_clusters(const Particles& P,
+                                                            ScratchArena& scratch) const {
+    std::vector<StarCluster> clusters;
+    find_star_groups(P, scratch, clusters);
+    measure_clusters(P, clusters);
+    return clusters;
+}
 
-std::vector<int> StarFormation::detect_star_candidates(const Particles& P) const {
-    std::vector<int> candidates;
-    candidates.reserve(P.N);
+void StarFormation::find_star_groups(const Particles& P, ScratchArena& scratch,
+                                     std::vector<StarCluster>& clusters) const {
+    clusters.clear();
+    // builds grid_ and flags candidates
+    const std::vector<int>& candidates = detect_star_candidates(P, scratch);
+    const long C = static_cast<long>(candidates.size());
+    if (C == 0) return;
 
-    for (size_t i = 0; i < P.N; i++) {
-        if (!P.alive[i]) continue;
+    // candidate slot of every particle (-1 for non-candidates)
+    int* slot = scratch.alloc<int>(P.N, -1);
+    for (long c = 0; c < C; ++c) slot[candidates[c]] = static_cast<int>(c);
+
+    std::atomic<int>* parent = scratch.alloc<std::atomic<int>>(C);
+    for (long c = 0; c < C; ++c) new (&parent[c]) std::atomic<int>(static_cast<int>(c));
+
+    const real_t R2 = neighbor_radius * neighbor_radius;
 
-        int nn = count_neighbors(P, i);
-        float rho = compute_local_density(P, i);
+    // link every candidate pair closer than the linking length
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (long c = 0; c < C; ++c) {
+        const int i = candidates[c];
+        const real_t xi = P.x[i], yi = P.y[i], zi = P.z[i];
+        grid_.for_each_candidate(xi, yi, zi, [&](uint32_t j) {
+            const int sj = slot[j];
+            if (sj <= c) return; // each pair once, candidates only
+            real_t dx = P.x[j] - xi; real_t dy = P.y[j] - yi; real_t dz = P.z[j] - zi;
+            if (dx*dx + dy*dy + dz*dz < R2) uf_unite(parent, static_cast<int>(c), sj);
+        });
+    }
 
-        if (nn >= (int)min_neighbors && rho >= min_density)
-            candidates.push_back(i);
+    // one cluster per root, in order of first member
+    int* cluster_of = scratch.alloc<int>(C, -1); // by root
+    int* root_of = scratch.alloc<int>(C);
+    for (long c = 0; c < C; ++c) {
+        const int root = uf_find(parent, static_cast<int>(c));
+        root_of[c] = root;
+        if (cluster_of[root] < 0) {
+            cluster_of[root] = static_cast<int>(clusters.size());
+            clusters.push_back(StarCluster{real_t(0), Vec3{}, Vec3{}, {}});
+        }
+        clusters[cluster_of[root]].members.count++;
     }
 
-    return candidates;
+    // members cluster by cluster in one array, in candidate order
+    const size_t K = clusters.size();
+    int* members = scratch.alloc<int>(C);
+    size_t* next = scratch.alloc<size_t>(K);
+    size_t offset = 0;
+    for (size_t k = 0; k < K; ++k) {
+        next[k] = offset;
+        clusters[k].members.first = members + offset;
+        offset += clusters[k].members.count;
+    }
+    for (long c = 0; c < C; ++c) members[next[cluster_of[root_of[c]]]++] = candidates[c];
+}
+
+void StarFormation::measure_clusters(const Particles& P, std::vector<StarCluster>& clusters) const {
+    // per-cluster mass, centre of mass and velocity
+    const long K = static_cast<long>(clusters.size());
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (long k = 0; k < K; ++k) {
+        StarCluster& cl = clusters[k];
+        acc_t m = 0, cx = 0, cy = 0, cz = 0, px = 0, py = 0, pz = 0;
+        for (int i : cl.members) {
+            m  += P.mass[i];
+            cx += acc_t(P.mass[i]) * P.x[i];
+            cy += acc_t(P.mass[i]) * P.y[i];
+            cz += acc_t(P.mass[i]) * P.z[i];
+            px += acc_t(P.mass[i]) * P.vx[i];
+            py += acc_t(P.mass[i]) * P.vy[i];
+            pz += acc_t(P.mass[i]) * P.vz[i];
+        }
+        cl.mass = real_t(m);
+        cl.com = Vec3(real_t(cx / m), real_t(cy / m), real_t(cz / m));
+        cl.velocity = Vec3(real_t(px / m), real_t(py / m), real_t(pz / m));
+    }
 }
 
 void StarFormation::form_stars(
     Particles& P,
-    const std::vector<int>& idxs,
-    float current_time
+    SinkParticles& sinks,
+    const std::vector<StarCluster>& clusters,
+    real_t current_time
 ) {
-    for (int idx : idxs) {
-        if (!P.alive[idx]) continue;
+    // most massive clusters seed stars first, ties in cluster order
+    order_.resize(clusters.size());
+    for (size_t k = 0; k < order_.size(); ++k) order_[k] = k;
+    std::sort(order_.begin(), order_.end(), [&](size_t a, size_t b) {
+        if (clusters[a].mass != clusters[b].mass) return clusters[a].mass > clusters[b].mass;
+        return a < b;
+    });
+
+    const real_t R2 = accretion_radius * accretion_radius;
+
+    for (size_t k : order_) {
+        const StarCluster& cl = clusters[k];
+
+        bool near_star = false;
+        for (const Star& s : sinks.stars) {
+            if ((s.position - cl.com).length2() < R2) { near_star = true; break; }
+        }
+        if (near_star) continue;
+
+        // the whole group collapses into one star; its gas leaves the arrays
+        sinks.add(Star(cl.mass, cl.com, cl.velocity, current_time, P.id[cl.members.front()]));
+        for (int idx : cl.members) {
+            P.is_star[idx] = true;
+            P.alive[idx] = false;
+        }
+    }
+}
+
+size_t StarFormation::accrete(Particles& P, SinkParticles& sinks, ScratchArena& scratch) const {
+    const long N = static_cast<long>(P.N);
+    const size_t S = sinks.size();
+    if (S == 0) return 0;
+
+    const real_t R2 = accretion_radius * accretion_radius;
+
+    // nearest star inside the accretion radius for every gas particle
+    int* target = scratch.alloc<int>(N, -1);
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < N; ++i) {
+        if (!P.alive[i]) continue;
+        Vec3 xi = get_pos(P, i);
+        real_t best = R2;
+        for (size_t s = 0; s < S; ++s) {
+            real_t d2 = (sinks.stars[s].position - xi).length2();
+            if (d2 < best) { best = d2; target[i] = static_cast<int>(s); }
+        }
+    }
 
-        // mark particle as a part of the star
-        P.is_star[idx] = true;
+    // serial merge keeps the result independent of thread count
+    size_t accreted = 0;
+    for (long i = 0; i < N; ++i) {
+        if (target[i] < 0) continue;
+        Star& s = sinks.stars[target[i]];
+        const real_t m = P.mass[i];
+        const real_t M = s.mass + m;
+        Vec3 com = s.position * s.mass;
+        com += get_pos(P, i) * m;
+        Vec3 mom = s.velocity * s.mass;
+        mom += get_vel(P, i) * m;
+        s.position = com / M;
+        s.velocity = mom / M;
+        s.mass = M;
+        P.is_star[i] = true;
+        P.alive[i] = false;
+        accreted++;
     }
+    return accreted;
 }
@@ -2,36 +2,217 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <functional>
+#include <vector>
+#include <algorithm>
 
-Config load_config(const std::string &filename) {
-    Config cfg;
+namespace {
+
+bool parse_value(const std::string& s, double& out) {
+    try { size_t n; out = std::stod(s, &n); return n == s.size(); }
+    catch (...) { return false; }
+}
+
+bool parse_value(const std::string& s, int& out) {
+    try { size_t n; out = std::stoi(s, &n); return n == s.size(); }
+    catch (...) { return false; }
+}
+
+bool parse_value(const std::string& s, size_t& out) {
+    // stoull accepts "-1" and wraps it around
+    if (s.find('-') != std::string::npos) return false;
+    try { size_t n; out = static_cast<size_t>(std::stoull(s, &n)); return n == s.size(); }
+    catch (...) { return false; }
+}
+
+bool parse_value(const std::string& s, bool& out) {
+    if (s == "1" || s == "true" || s == "yes" || s == "on")  { out = true;  return true; }
+    if (s == "0" || s == "false" || s == "no" || s == "off") { out = false; return true; }
+    return false;
+}
+
+bool parse_value(const std::string& s, std::string& out) {
+    out = s;
+    return true;
+}
+
+template <class T>
+std::string format_value(const T& v) {
+    std::ostringstream os;
+    os << std::boolalpha << v;
+    return os.str();
+}
+
+struct Field {
+    const char* key;
+    std::function<bool(Config&, const std::string&)> set;
+    std::function<std::string(const Config&)> get;
+};
+
+template <class T>
+Field field(const char* key, T Config::*member) {
+    return Field{
+        key,
+        [member](Config& c, const std::string& v) { return parse_value(v, c.*member); },
+        [member](const Config& c) { return format_value(c.*member); }
+    };
+}
+
+const std::vector<Field>& fields() {
+    static const std::vector<Field> table = {
+        field("timestep", &Config::timestep),
+        field("num_steps", &Config::num_steps),
+        field("grid_points", &Config::grid_points),
+        field("initial_density", &Config::initial_density),
+        field("initial_temperature", &Config::initial_temperature),
+        field("gravitational_constant", &Config::G),
+        field("output_interval", &Config::output_interval),
+        field("num_particles", &Config::num_particles),
+        field("init_type", &Config::init_type),
+        field("seed", &Config::seed),
+        field("fixed_positions", &Config::fixed_positions),
+        field("ic_input", &Config::ic_input),
+        field("ic_output", &Config::ic_output),
+        field("ic_chunk", &Config::ic_chunk),
+        field("smoothing_length", &Config::smoothing_length),
+        field("softening", &Config::softening),
+        field("neighbor_radius", &Config::neighbor_radius),
+        field("density_threshold", &Config::density_threshold),
+        field("min_neighbors", &Config::min_neighbors),
+        field("accretion_radius", &Config::accretion_radius),
+        field("eos", &Config::eos),
+        field("eos_rho_crit", &Config::eos_rho_crit),
+        field("cooling", &Config::cooling),
+        field("cooling_coefficient", &Config::cooling_coefficient),
+        field("cooling_floor", &Config::cooling_floor),
+        field("use_cached", &Config::use_cached),
+        field("gravity_solver", &Config::gravity_solver),
+        field("theta", &Config::theta),
+        field("pm_grid", &Config::pm_grid),
+        field("pm_split", &Config::pm_split),
+        field("box_size", &Config::box_size),
+        field("density_kernel", &Config::density_kernel),
+        field("knn_neighbors", &Config::knn_neighbors),
+        field("num_threads", &Config::num_threads),
+        field("task_graph", &Config::task_graph),
+        field("compact_interval", &Config::compact_interval),
+        field("diagnostics_interval", &Config::diagnostics_interval),
+        field("audit_interval", &Config::audit_interval),
+        field("audit_samples", &Config::audit_samples),
+        field("profile", &Config::profile),
+        field("profile_peak_gflops", &Config::profile_peak_gflops),
+        field("profile_peak_bandwidth", &Config::profile_peak_bandwidth),
+        field("mpi_rebalance_interval", &Config::mpi_rebalance_interval),
+        field("mpi_imbalance_tolerance", &Config::mpi_imbalance_tolerance),
+        field("sweep", &Config::sweep),
+        field("ensemble_groups", &Config::ensemble_groups),
+        field("output_dir", &Config::output_dir),
+        field("output_format", &Config::output_format),
+        field("output_tolerance", &Config::output_tolerance),
+        field("keyframe_interval", &Config::keyframe_interval),
+        field("decompress_frames", &Config::decompress_frames),
+        field("render_interval", &Config::render_interval),
+        field("render_size", &Config::render_size),
+        field("render_axis", &Config::render_axis),
+        field("render_quantity", &Config::render_quantity),
+        field("render_format", &Config::render_format),
+        field("render_extent", &Config::render_extent),
+        field("shm_name", &Config::shm_name),
+        field("shm_interval", &Config::shm_interval),
+        field("shm_slots", &Config::shm_slots),
+        field("shm_capacity", &Config::shm_capacity),
+        field("verify", &Config::verify),
+        field("verify_interval", &Config::verify_interval),
+        field("verify_abort_l2", &Config::verify_abort_l2),
+        field("reference_csv", &Config::reference_csv),
+    };
+    return table;
+}
+
+std::string trim(const std::string& s) {
+    const char* ws = " \t\r\n";
+    size_t b = s.find_first_not_of(ws);
+    if (b == std::string::npos) return "";
+    size_t e = s.find_last_not_of(ws);
+    return s.substr(b, e - b + 1);
+}
+
+bool read_config_file(Config& cfg, const std::string& filename) {
     std::ifstream file(filename);
-    std::string line;
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Could not open config file: " << filename << "\n";
+        return false;
+    }
 
+    bool ok = true;
+    std::string line;
     while (std::getline(file, line)) {
-        if (line.empty() || line[0] == '#') continue;
-        std::istringstream iss(line);
-        std::string key;
-        if (std::getline(iss, key, '=')) {
-            std::string value;
-            if (std::getline(iss, value)) {
-                if (key.find("timestep") != std::string::npos)
-                    cfg.timestep = std::stod(value);
-                else if (key.find("num_steps") != std::string::npos)
-                    cfg.num_steps = std::stoi(value);
-                else if (key.find("grid_points") != std::string::npos)
-                    cfg.grid_points = std::stoi(value);
-                else if (key.find("initial_density") != std::string::npos)
-                    cfg.initial_density = std::stod(value);
-                else if (key.find("initial_temperature") != std::string::npos)
-                    cfg.initial_temperature = std::stod(value);
-                else if (key.find("gravitational_constant") != std::string::npos)
-                    cfg.G = std::stod(value);
-                else if (key.find("output_interval") != std::string::npos)
-                    cfg.output_interval = std::stoi(value);
-            }
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            std::cerr << "WARNING: ignoring config line without '=': " << line << "\n";
+            continue;
         }
+        ok &= set_config_value(cfg, trim(line.substr(0, eq)), trim(line.substr(eq + 1)));
     }
+    return ok;
+}
+
+} // namespace
 
+bool set_config_value(Config& cfg, const std::string& key, const std::string& value) {
+    for (const Field& f : fields()) {
+        if (key != f.key) continue;
+        if (f.set(cfg, value)) return true;
+        std::cerr << "WARNING: bad value for " << key << ": '" << value << "'\n";
+        return false;
+    }
+    std::cerr << "WARNING: unknown config key: " << key << "\n";
+    return false;
+}
+
+Config load_config(const std::string &filename) {
+    Config cfg;
+    read_config_file(cfg, filename);
     return cfg;
 }
+
+bool apply_cli_overrides(Config& cfg, int argc, char** argv) {
+    bool ok = true;
+
+    // the config file goes first so command line values win
+    for (int a = 1; a < argc; ++a) {
+        std::string arg = argv[a];
+        if (arg.rfind("--config=", 0) == 0) {
+            ok &= read_config_file(cfg, arg.substr(9));
+        } else if (arg == "--config" && a + 1 < argc) {
+            ok &= read_config_file(cfg, argv[++a]);
+        }
+    }
+
+    for (int a = 1; a < argc; ++a) {
+        std::string arg = argv[a];
+        if (arg == "--config") { ++a; continue; }
+        if (arg.rfind("--config=", 0) == 0) continue;
+        if (arg.rfind("--", 0) != 0) {
+            std::cerr << "WARNING: ignoring argument: " << arg << "\n";
+            ok = false;
+            continue;
+        }
+        arg = arg.substr(2);
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos) {
+            ok &= set_config_value(cfg, arg, "true"); // bare flag
+        } else {
+            ok &= set_config_value(cfg, arg.substr(0, eq), arg.substr(eq + 1));
+        }
+    }
+    return ok;
+}
+
+void print_config(const Config& cfg) {
+    std::cout << "=== Run configuration ===\n";
+    for (const Field& f : fields())
+        std::cout << "  " << f.key << " = " << f.get(cfg) << "\n";
+}
@@ -1,10 +1,12 @@
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <vector>
 #include <cmath>
+#include <cstdlib>
 #include "../include/particles.hpp"
 #include "../include/vec3.hpp"
+#include "../include/verify.hpp"
+#include "../include/parallel.hpp"
 
 // -------------------------------------------------------
 // Load reference 2-column CSV (radius, density)
@@ -23,46 +25,103 @@ bool load_reference_csv(const std::string& filename,
     while (std::getline(f, line)) {
         if (line.size() == 0) continue;
 
-        std::stringstream ss(line);
-        float r, rho;
-        char comma;
-
-        if (ss >> r >> comma >> rho) {
-            radius.push_back(r);
-            density.push_back(rho);
-        }
+        // "r,rho": parse in place, skip headers and malformed lines
+        const char* s = line.c_str();
+        char* end = nullptr;
+        float r = std::strtof(s, &end);
+        if (end == s) continue;
+        while (*end == ' ' || *end == '\t') ++end;
+        if (*end != ',') continue;
+        s = end + 1;
+        float rho = std::strtof(s, &end);
+        if (end == s) continue;
+
+        radius.push_back(r);
+        density.push_back(rho);
     }
 
     return true;
 }
 
 // -------------------------------------------------------
-// Compute radial density from your particle data
+// Centre of mass of the alive particles
 // -------------------------------------------------------
-std::vector<float> compute_radial_profile(const Particles& P,
-                                           int bins,
-                                           float max_r)
+Vec3 center_of_mass(const Particles& P)
 {
-    std::vector<float> mass_in_bin(bins, 0.0);
+    acc_t m = 0, mx = 0, my = 0, mz = 0;
+    const long N = static_cast<long>(P.N);
 
-    // Accumulate mass in each radial bin
-    for (size_t i = 0; i < P.N; ++i) {
+    #pragma omp parallel for reduction(+:m,mx,my,mz) schedule(static)
+    for (long i = 0; i < N; ++i) {
         if (!P.alive[i]) continue;
+        m  += P.mass[i];
+        mx += acc_t(P.mass[i]) * P.x[i];
+        my += acc_t(P.mass[i]) * P.y[i];
+        mz += acc_t(P.mass[i]) * P.z[i];
+    }
 
-        float r = std::sqrt(P.x[i]*P.x[i] +
-                             P.y[i]*P.y[i] +
-                             P.z[i]*P.z[i]);
+    if (m <= 0) return Vec3();
+    return Vec3(real_t(mx / m), real_t(my / m), real_t(mz / m));
+}
 
-        int b = std::min(int((r / max_r) * bins), bins - 1);
+// -------------------------------------------------------
+// Compute radial density from your particle data
+// -------------------------------------------------------
+std::vector<float> compute_radial_profile(const Particles& P,
+                                           int bins,
+                                           float max_r)
+{
+    return compute_radial_profile(P, bins, max_r, center_of_mass(P));
+}
 
-        // If you have equal-mass particles:
-        mass_in_bin[b] += P.mass[i];  // or 1.0f if equal mass
+std::vector<float> compute_radial_profile(const Particles& P,
+                                           int bins,
+                                           float max_r,
+                                           const Vec3& center,
+                                           size_t* non_finite)
+{
+    const int threads = par_max_threads();
+    const long N = static_cast<long>(P.N);
+    size_t skipped = 0;
+
+    // one private histogram per thread, summed afterwards
+    std::vector<acc_t> partial(size_t(threads) * bins, acc_t(0));
+
+    #pragma omp parallel
+    {
+        acc_t* mass_in_bin = &partial[size_t(par_thread_id()) * bins];
+
+        // Accumulate mass in each radial bin
+        #pragma omp for schedule(static) reduction(+:skipped)
+        for (long i = 0; i < N; ++i) {
+            if (!P.alive[i]) continue;
+
+            const real_t dx = P.x[i] - center.x;
+            const real_t dy = P.y[i] - center.y;
+            const real_t dz = P.z[i] - center.z;
+            float r = std::sqrt(dx*dx + dy*dy + dz*dz);
+
+            // a diverged run: NaN or infinite radii have no bin
+            if (!std::isfinite(r)) {
+                skipped++;
+                continue;
+            }
+            // clamped as a float, so huge radii never overflow the int
+            const float x = (r / max_r) * bins;
+            int b = x < float(bins - 1) ? int(x) : bins - 1;
+
+            mass_in_bin[b] += P.mass[i];
+        }
     }
+    if (non_finite) *non_finite = skipped;
 
     // Convert mass in each shell to density
     std::vector<float> rho_shell(bins, 0.0);
 
     for (int k = 0; k < bins; ++k) {
+        acc_t mass = 0;
+        for (int t = 0; t < threads; ++t) mass += partial[size_t(t) * bins + k];
+
         float r_lo = (float)k     / bins * max_r;
         float r_hi = (float)(k+1) / bins * max_r;
 
@@ -70,7 +129,7 @@ std::vector<float> compute_radial_profile(const Particles& P,
                      (r_hi*r_hi*r_hi - r_lo*r_lo*r_lo);
 
         if (vol > 0.0)
-            rho_shell[k] = mass_in_bin[k] / vol;
+            rho_shell[k] = float(mass / vol);
     }
 
     return rho_shell;
@@ -80,10 +139,6 @@ std::vector<float> compute_radial_profile(const Particles& P,
 // -------------------------------------------------------
 // Compute L1 / L2 / Linf error values
 // -------------------------------------------------------
-struct ErrorMetrics {
-    float L1, L2, Linf;
-};
-
 ErrorMetrics compute_error_metrics(const std::vector<float>& sim,
                                    const std::vector<float>& ref)
 {
@@ -104,28 +159,55 @@ ErrorMetrics compute_error_metrics(const std::vector<float>& sim,
     };
 }
 
+// -------------------------------------------------------
+// Profile comparison without printing (ensemble members)
+// -------------------------------------------------------
+bool compute_verification_metrics(const Particles& P,
+                                  const std::string& reference_csv,
+                                  ErrorMetrics& E,
+                                  int* bins_out)
+{
+    ReferenceProfile ref;
+    if (!ref.load(reference_csv))
+        return false;
+
+    E = ref.compare(P);
+    if (bins_out) *bins_out = int(ref.radius.size());
+    return true;
+}
+
+// -------------------------------------------------------
+// Time series of in-line checks as CSV
+// -------------------------------------------------------
+bool write_verification_series(const std::vector<VerificationSample>& series,
+                               const std::string& filename)
+{
+    std::ofstream f(filename);
+    if (!f.is_open()) {
+        std::cerr << "ERROR: Could not open file for writing: " << filename << "\n";
+        return false;
+    }
+    f << "step,time,L1,L2,Linf\n";
+    for (const VerificationSample& s : series)
+        f << s.step << "," << s.time << "," << s.error.L1 << ","
+          << s.error.L2 << "," << s.error.Linf << "\n";
+    return true;
+}
+
 // -------------------------------------------------------
 // Top-level verification function
 // -------------------------------------------------------
 void verify_against_reference(const Particles& P,
                               const std::string& reference_csv)
 {
-    std::vector<float> r_ref, rho_ref;
+    ErrorMetrics E;
+    int bins = 0;
 
-    if (!load_reference_csv(reference_csv, r_ref, rho_ref)) {
+    if (!compute_verification_metrics(P, reference_csv, E, &bins)) {
         std::cerr << "Verification aborted — reference file missing.\n";
         return;
     }
 
-    int bins = r_ref.size();
-    float max_r = r_ref.back();
-
-    std::vector<float> rho_sim =
-        compute_radial_profile(P, bins, max_r);
-
-    ErrorMetrics E =
-        compute_error_metrics(rho_sim, rho_ref);
-
     std::cout << "\n=== Verification Report ===\n";
     std::cout << "Reference: " << reference_csv << "\n";
     std::cout << "Particles: " << P.N << "\n";
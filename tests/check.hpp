@@ -0,0 +1,15 @@
+// check.hpp
+// Pass/fail reporting shared by the standalone tests: check() prints one
+// PASS or FAIL line and counts the failures, and main() returns
+// failures == 0 ? 0 : 1.
+#pragma once
+
+#include <iostream>
+#include <string>
+
+inline int failures = 0;
+
+inline void check(bool ok, const std::string& what) {
+    if (!ok) failures++;
+    std::cout << (ok ? "PASS: " : "FAIL: ") << what << "\n";
+}
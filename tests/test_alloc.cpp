@@ -0,0 +1,215 @@
+// Heap-allocation test of the step loop. Build and run with
+//   make run_test_alloc
+// Global operator new is replaced by a counting version. After a few
+// warm-up steps (scratch slabs and reused buffers reach their working
+// size) a step must not allocate at all, on every gravity/solver path.
+// Steps that form a star are excluded: the star grows the sink list. The
+// star stage alone must not allocate while it finds clusters that form
+// nothing.
+// Also runs an ensemble in two groups, where each member's arena belongs to
+// one thread of the outer team.
+#include "../include/particles.hpp"
+#include "../include/config.hpp"
+#include "../include/run.hpp"
+#include "../include/init.hpp"
+#include "../include/arena.hpp"
+#include "../include/ensemble.hpp"
+#include "../include/starform.hpp"
+#include "check.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <iostream>
+#include <string>
+#include <filesystem>
+#include <cmath>
+
+static std::atomic<bool> counting{false};
+static std::atomic<size_t> allocations{0};
+
+static void* counted_alloc(size_t n, size_t align = 0) {
+    if (counting.load(std::memory_order_relaxed)) allocations++;
+    void* p = nullptr;
+    if (align > alignof(std::max_align_t)) {
+        if (posix_memalign(&p, align, n ? n : 1) != 0) p = nullptr;
+    } else {
+        p = std::malloc(n ? n : 1);
+    }
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t n) { return counted_alloc(n); }
+void* operator new[](size_t n) { return counted_alloc(n); }
+void* operator new(size_t n, std::align_val_t a) { return counted_alloc(n, size_t(a)); }
+void* operator new[](size_t n, std::align_val_t a) { return counted_alloc(n, size_t(a)); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+// allocations per step after `warmup` steps (max over the measured steps)
+static size_t steady_state_allocations(const Config& cfg, size_t warmup) {
+    Particles P(cfg.num_particles);
+    init_particles(P, cfg.init_type, cfg.seed);
+    size_t worst = 0;
+    size_t stars = 0;
+    const StepHook hook = [&](size_t t) {
+        counting = false;
+        if (t >= warmup) worst = std::max(worst, allocations.load());
+        allocations = 0;
+        counting = true;
+    };
+    allocations = 0;
+    counting = true;
+    RunResult result = run_simulation(P, cfg, hook);
+    counting = false;
+    stars = result.sinks.size();
+    if (stars > 0) std::cout << "  (" << stars << " stars formed)\n";
+    return worst;
+}
+
+// Star stage on a shell of gas around a star: every particle is a
+// candidate and the shell is one cluster, but its centre of mass lies
+// inside the star's accretion radius and its gas outside, so nothing forms
+// and nothing is accreted. Returns the allocations of the last pass.
+static size_t cluster_allocations(size_t& candidates, size_t& clusters, size_t& stars) {
+    const size_t n = 64;
+    Particles P(n);
+    for (size_t i = 0; i < n; ++i) {
+        // Fibonacci sphere of radius 0.3
+        const double z = 1.0 - (2.0 * double(i) + 1.0) / double(n);
+        const double r = std::sqrt(1.0 - z * z), phi = 2.399963229728653 * double(i);
+        P.x[i] = real_t(0.3 * r * std::cos(phi));
+        P.y[i] = real_t(0.3 * r * std::sin(phi));
+        P.z[i] = real_t(0.3 * z);
+        P.mass[i] = real_t(1);
+    }
+    StarFormation SF(real_t(0.7), 8, real_t(5), real_t(0.1));
+    SinkParticles sinks;
+    sinks.add(Star(real_t(1), Vec3{}, Vec3{}, real_t(0)));
+
+    ScratchArena scratch;
+    std::vector<StarCluster> found;
+    size_t last = 0;
+    for (int pass = 0; pass < 5; ++pass) {
+        scratch.reset();
+        allocations = 0;
+        counting = true;
+        SF.find_star_groups(P, scratch, found);
+        candidates = 0;
+        for (const StarCluster& cl : found) candidates += cl.members.size();
+        SF.measure_clusters(P, found);
+        SF.form_stars(P, sinks, found, real_t(0));
+        SF.accrete(P, sinks, scratch);
+        counting = false;
+        last = allocations;
+    }
+    clusters = found.size();
+    stars = sinks.size();
+    return last;
+}
+
+int main() {
+    // ---- arena: overflow folds into the slab, then no more heap use -----
+    {
+        ScratchArena arena(64);
+        for (int step = 0; step < 3; ++step) {
+            arena.reset();
+            counting = true;
+            allocations = 0;
+            double* a = arena.alloc<double>(1000, 1.0);
+            int* b = arena.alloc<int>(500, -1);
+            counting = false;
+            const bool ok = a[999] == 1.0 && b[499] == -1 &&
+                            reinterpret_cast<uintptr_t>(a) % alignof(double) == 0;
+            if (step == 2) {
+                check(ok && allocations == 0, "arena serves a repeated step from one slab");
+            }
+        }
+    }
+
+    // ---- arena of a thread in an outer team (ensemble members) ------------
+    {
+        Config ens;
+        ens.num_particles = 300;
+        ens.num_steps = 3;
+        ens.num_threads = 2;
+        ens.ensemble_groups = 2; // one thread per member
+        ens.sweep = "density_threshold:5,50,500";
+        ens.output_dir = "test_alloc_ensemble";
+        Particles P(ens.num_particles);
+        init_particles(P, ens.init_type, ens.seed);
+        const std::vector<EnsembleMember> members = run_ensemble(P, ens);
+        std::filesystem::remove_all(ens.output_dir);
+        check(members.size() == 3, "ensemble members in two groups share no arena slab");
+    }
+
+    // ---- star stage with candidates but no formation ----------------------
+    {
+        size_t candidates = 0, clusters = 0, stars = 0;
+        const size_t n = cluster_allocations(candidates, clusters, stars);
+        check(candidates == 64 && clusters == 1 && stars == 1,
+              "shell around a star: 64 candidates, 1 cluster, no new star");
+        check(n == 0, "star stage without formation allocates nothing (" +
+                      std::to_string(n) + ")");
+    }
+
+    // ---- step loop --------------------------------------------------------
+    Config base;
+    base.num_particles = 800;
+    base.num_steps = 20;
+    base.init_type = 1;
+    base.output_interval = 0;
+    base.density_threshold = 1e30; // no star formation events
+
+    const size_t warmup = 5;
+
+    Config cfg = base;
+    cfg.use_cached = false;
+    size_t n = steady_state_allocations(cfg, warmup);
+    check(n == 0, "reference path step allocates nothing (" + std::to_string(n) + ")");
+
+    cfg = base;
+    cfg.use_cached = true;
+    cfg.gravity_solver = "direct";
+    n = steady_state_allocations(cfg, warmup);
+    check(n == 0, "cached direct path step allocates nothing (" + std::to_string(n) + ")");
+
+    cfg = base;
+    cfg.use_cached = true;
+    cfg.gravity_solver = "barnes_hut";
+    n = steady_state_allocations(cfg, warmup);
+    check(n == 0, "cached Barnes-Hut path step allocates nothing (" + std::to_string(n) + ")");
+
+    cfg = base;
+    cfg.use_cached = true;
+    cfg.gravity_solver = "treepm";
+    cfg.pm_grid = 16;
+    cfg.box_size = 1.0;
+    n = steady_state_allocations(cfg, warmup);
+    check(n == 0, "periodic TreePM path step allocates nothing (" + std::to_string(n) + ")");
+
+    // kNN density: the k-d tree keeps its buffers between steps
+    cfg = base;
+    cfg.use_cached = true;
+    cfg.gravity_solver = "barnes_hut";
+    cfg.density_kernel = "knn";
+    n = steady_state_allocations(cfg, warmup);
+    check(n == 0, "kNN density step allocates nothing (" + std::to_string(n) + ")");
+
+    // stars accreting gas every step: accretion scratch comes from the arena
+    cfg = base;
+    cfg.use_cached = true;
+    cfg.gravity_solver = "barnes_hut";
+    cfg.init_type = 2;
+    cfg.density_threshold = 5.0;
+    n = steady_state_allocations(cfg, 10);
+    check(n == 0, "accreting steps allocate nothing (" + std::to_string(n) + ")");
+
+    return failures == 0 ? 0 : 1;
+}
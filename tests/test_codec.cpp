@@ -0,0 +1,168 @@
+// Compressed frame output test. Build and run with
+//   make run_test_codec
+// Checks:
+//   - rANS round-trips skewed, uniform and single-symbol data
+//   - a run of frames (keyframes and delta frames, with particles dying,
+//     compaction and new stars) decodes to the same rows, with every value
+//     within output_tolerance
+//   - a delta frame cannot be decoded without its predecessors
+//   - the frames are several times smaller than the CSV frames
+#include "../include/particles.hpp"
+#include "../include/stars.hpp"
+#include "../include/codec.hpp"
+#include "../include/init.hpp"
+#include "check.hpp"
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <filesystem>
+#include <limits>
+
+static bool rans_round_trip(const std::vector<uint8_t>& in) {
+    std::vector<uint8_t> coded, out(in.size());
+    rans_encode(in.data(), in.size(), coded);
+    const uint8_t* p = coded.data();
+    return rans_decode(p, coded.data() + coded.size(), out.data(), out.size()) &&
+           p == coded.data() + coded.size() && out == in;
+}
+
+static void test_rans() {
+    std::vector<uint8_t> skewed(10000), uniform(10000), single(500, 7);
+    for (size_t i = 0; i < skewed.size(); ++i) {
+        skewed[i] = uint8_t((i * i) % 97 < 80 ? 0 : i % 5);
+        uniform[i] = uint8_t((i * 2654435761u) >> 7);
+    }
+    check(rans_round_trip(skewed) && rans_round_trip(uniform) && rans_round_trip(single),
+          "rANS round-trips skewed, uniform and single-symbol data");
+
+    std::vector<uint8_t> coded;
+    rans_encode(skewed.data(), skewed.size(), coded);
+    check(coded.size() < skewed.size() / 4, "rANS compresses a skewed byte stream");
+}
+
+// the rows the CSV writer would produce for (P, S)
+static FrameTable expected_rows(const Particles& P, const SinkParticles& S) {
+    FrameTable t;
+    auto row = [&](uint64_t id, bool star, const double v[FrameTable::kColumns]) {
+        t.id.push_back(id);
+        t.is_star.push_back(star ? 1 : 0);
+        for (int c = 0; c < FrameTable::kColumns; ++c) t.col[c].push_back(v[c]);
+    };
+    for (size_t i = 0; i < P.N; ++i) {
+        if (!P.alive[i]) continue;
+        const double v[] = {P.x[i], P.y[i], P.z[i], P.vx[i], P.vy[i], P.vz[i],
+                            P.temperature[i], P.density[i], P.pressure[i]};
+        row(P.id[i], false, v);
+    }
+    for (const Star& s : S.stars) {
+        const double v[] = {s.position.x, s.position.y, s.position.z,
+                            s.velocity.x, s.velocity.y, s.velocity.z, 0, 0, 0};
+        row(s.id, true, v);
+    }
+    return t;
+}
+
+// largest error of a decoded frame relative to its allowed error (the
+// tolerance, or float rounding of the column's largest value); < 0 if the
+// rows differ
+static double worst_error(const FrameTable& got, const FrameTable& want, double tolerance) {
+    if (got.id != want.id || got.is_star != want.is_star) return -1.0;
+    double worst = 0.0;
+    for (int c = 0; c < FrameTable::kColumns; ++c) {
+        double largest = 0.0;
+        for (double v : want.col[c]) largest = std::max(largest, std::abs(v));
+        const double bound = std::max(tolerance, 0.5 * largest * double(std::numeric_limits<real_t>::epsilon()));
+        for (size_t r = 0; r < want.rows(); ++r)
+            worst = std::max(worst, std::abs(got.col[c][r] - want.col[c][r]) / bound);
+    }
+    return worst;
+}
+
+static void test_frames() {
+    namespace fs = std::filesystem;
+    const fs::path dir = fs::temp_directory_path() / "starform_test_codec";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    const double tolerance = 5e-6, dt = 0.001;
+    const int frames = 25;
+    Particles P(2000);
+    init_particles(P, 3, 42);
+    for (size_t i = 0; i < P.N; ++i) {
+        P.temperature[i] = real_t(10.0 + 5.0 * std::sin(double(i)));
+        P.density[i] = real_t(1e4 * (1.0 + double(i % 13)));
+        P.pressure[i] = real_t(P.temperature[i] * P.density[i]);
+    }
+    SinkParticles S;
+
+    FrameEncoder encoder(tolerance, 10);
+    std::vector<FrameTable> want;
+    size_t csv_bytes = 0;
+    for (int f = 0; f < frames; ++f) {
+        const std::string base = (dir / ("frame_" + std::to_string(f))).string();
+        if (!encoder.write(base + ".sfz", P, S, f * dt)) break;
+        want.push_back(expected_rows(P, S));
+        P.write_csv(base + ".ref.csv");
+        S.append_csv(base + ".ref.csv");
+        csv_bytes += size_t(fs::file_size(base + ".ref.csv"));
+
+        // evolve: drift, a smooth velocity and thermo change, and now and
+        // then a star forms out of a gas particle that is then removed
+        for (size_t i = 0; i < P.N; ++i) {
+            P.x[i] += real_t(P.vx[i] * dt);
+            P.y[i] += real_t(P.vy[i] * dt);
+            P.z[i] += real_t(P.vz[i] * dt);
+            P.vx[i] -= real_t(P.x[i] * dt);
+            P.vy[i] -= real_t(P.y[i] * dt);
+            P.vz[i] -= real_t(P.z[i] * dt);
+            P.temperature[i] *= real_t(1.0 - 0.01 * dt);
+            P.density[i] *= real_t(1.0 + 0.5 * dt);
+            P.pressure[i] = real_t(P.temperature[i] * P.density[i]);
+        }
+        if (f % 4 == 3) {
+            const size_t i = size_t(f) * 37 % P.N;
+            if (P.alive[i]) {
+                S.add(Star(P.mass[i], Vec3{P.x[i], P.y[i], P.z[i]}, Vec3{P.vx[i], P.vy[i], P.vz[i]},
+                           real_t(f * dt), P.id[i]));
+                P.alive[i] = false;
+            }
+        }
+        for (Star& s : S.stars) s.position.x += s.velocity.x * real_t(dt);
+        if (f == 12) P.compact();
+    }
+
+    FrameDecoder decoder;
+    FrameTable got;
+    double worst = 0.0;
+    bool decoded = true;
+    for (int f = 0; f < frames && decoded; ++f) {
+        decoded = decoder.read((dir / ("frame_" + std::to_string(f) + ".sfz")).string(), got);
+        const double e = decoded ? worst_error(got, want[size_t(f)], tolerance) : -1.0;
+        if (e < 0.0) decoded = false;
+        worst = std::max(worst, e);
+    }
+    std::cout << "  largest error / allowed error " << worst << "\n";
+    check(decoded, "every frame decodes to the CSV rows, through compaction and new stars");
+    check(decoded && worst <= 1.0 + 1e-9, "decoded values are within output_tolerance");
+
+    FrameDecoder fresh;
+    check(!fresh.read((dir / "frame_5.sfz").string(), got), "a delta frame alone is rejected");
+    check(fresh.read((dir / "frame_10.sfz").string(), got) &&
+          fresh.read((dir / "frame_11.sfz").string(), got) &&
+          worst_error(got, want[11], tolerance) >= 0.0,
+          "decoding can start at any keyframe");
+
+    const double ratio = double(csv_bytes) / double(encoder.bytes());
+    std::cout << "  " << encoder.bytes() << " bytes compressed vs " << csv_bytes
+              << " bytes of CSV (" << ratio << "x)\n";
+    check(ratio > 4.0, "compressed frames are over 4x smaller than CSV");
+    fs::remove_all(dir);
+}
+
+int main() {
+    test_rans();
+    test_frames();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+// Tabulated EOS and cooling test. Build and run with
+//   make run_test_eos
+// Checks:
+//   - fast_log2 / fast_exp2 against libm, and fast_log2 for x <= 0
+//   - table lookups against the closed forms they are built from
+//   - the ideal-gas table reproduces P = rho T, and T = 0 gives P = 0
+//   - molecular cooling relaxes towards the floor without overshooting
+// and prints the lookup time against the closed forms.
+#include "../include/particles.hpp"
+#include "../include/eos.hpp"
+#include "../include/physics.hpp"
+#include "../include/philox.hpp"
+#include "check.hpp"
+#include <iostream>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+
+static void test_fast_math() {
+    double worst_log = 0.0, worst_exp = 0.0;
+    for (int k = 0; k < 200000; ++k) {
+        const double y = -60.0 + 120.0 * k / 200000.0;
+        const float x = float(std::exp2(y));
+        // relative to the magnitude: the float result itself rounds
+        const double l = std::log2(double(x));
+        worst_log = std::max(worst_log, std::abs(double(fast_log2(x)) - l) / std::max(1.0, std::abs(l)));
+        const double e = std::exp2(double(float(y)));
+        worst_exp = std::max(worst_exp, std::abs(double(fast_exp2(float(y))) - e) / e);
+    }
+    std::cout << "  fast_log2 worst error " << worst_log << ", fast_exp2 worst rel error "
+              << worst_exp << "\n";
+    check(worst_log < 1e-6 && worst_exp < 1e-6, "fast_log2 and fast_exp2 match libm");
+    check(fast_log2(-8.0f) == fast_log2(8.0f) && fast_log2(0.0f) < -120.0f,
+          "fast_log2 of a negative x is log2|x|, of 0 very negative");
+}
+
+static void test_table(bool barotropic, bool molecular) {
+    const EosTable eos(barotropic, 1e4, molecular, 1e-3, 0.1);
+    double err_p = 0.0, err_c = 0.0, err_r = 0.0;
+    CounterRng rng(7, 0);
+    for (int k = 0; k < 100000; ++k) {
+        // log-uniform over the grid, off the nodes
+        const double rho = std::exp2(rng.uniform(-9.0, 29.0));
+        const double T = std::exp2(rng.uniform(-9.0, 16.0));
+        const EosSample s = eos.lookup(real_t(rho), real_t(T));
+        const double rho_r = double(real_t(rho)), T_r = double(real_t(T));
+        const double p = eos.exact_pressure(rho_r, T_r), c = eos.exact_sound_speed(rho_r, T_r);
+        err_p = std::max(err_p, std::abs(double(s.pressure) - p) / p);
+        err_p = std::max(err_p, std::abs(double(eos.pressure(real_t(rho), real_t(T))) - p) / p);
+        err_c = std::max(err_c, std::abs(double(eos.sound_speed(real_t(rho), real_t(T))) - c) / c);
+        if (molecular) {
+            const double r = eos.exact_cooling_rate(rho_r, T_r);
+            err_r = std::max(err_r, std::abs(double(s.cooling_rate) - r) / r);
+        }
+    }
+    const std::string name = std::string(barotropic ? "barotropic" : "ideal") +
+                             (molecular ? " + molecular" : "");
+    std::cout << "  " << name << ": worst relative error P " << err_p << ", c " << err_c
+              << ", rate " << err_r << "\n";
+    // two nodes per octave: the stiffening near rho_crit is the worst case
+    const double tol = barotropic ? 5e-3 : 1e-5;
+    check(err_p < tol && err_c < tol, name + ": pressure and sound speed match");
+    // ~ T^1.7 / (1 + rho / rho_crit) is curved in log space only near rho_crit
+    if (molecular) check(err_r < 1e-2, name + ": cooling rate matches");
+}
+
+static void test_edges() {
+    const EosTable eos(true, 1e4, true, 1e-3, 0.1);
+    check(eos.lookup(real_t(100), real_t(0)).pressure == real_t(0) &&
+          eos.lookup(real_t(0), real_t(1)).pressure == real_t(0),
+          "T = 0 or rho = 0 gives no pressure");
+}
+
+static void test_cooling() {
+    const EosTable eos(false, 1e4, true, 1e-3, 0.1);
+    Particles P(4);
+    const real_t T0[4] = {real_t(0.05), real_t(1), real_t(10), real_t(1000)};
+    for (size_t i = 0; i < P.N; ++i) {
+        P.density[i] = real_t(1e5);
+        P.temperature[i] = T0[i];
+    }
+    // a step much longer than the cooling time
+    const real_t dt = real_t(10);
+    update_physics(P, dt, &eos);
+    bool ok = P.temperature[0] == T0[0]; // below the floor: untouched
+    for (size_t i = 1; i < P.N; ++i) {
+        ok = ok && P.temperature[i] >= eos.floor_temperature() && P.temperature[i] < T0[i];
+        ok = ok && P.pressure[i] > real_t(0);
+    }
+    check(ok, "molecular cooling stays above the floor for long steps");
+
+    // short step: dT = -rate (T - floor) dt
+    Particles Q(1);
+    Q.density[0] = real_t(1e3);
+    Q.temperature[0] = real_t(2);
+    const real_t small = real_t(1e-4);
+    const double rate = eos.exact_cooling_rate(1e3, 2.0);
+    update_physics(Q, small, &eos);
+    const double expect = 2.0 - rate * (2.0 - 0.1) * double(small);
+    check(std::abs(double(Q.temperature[0]) - expect) < 1e-3 * (2.0 - expect),
+          "short steps follow dT/dt = -rate (T - floor)");
+}
+
+static void bench() {
+    const EosTable eos(true, 1e4, true, 1e-3, 0.1);
+    const size_t n = 1 << 20;
+    std::vector<real_t> rho(n), T(n);
+    CounterRng rng(11, 0);
+    for (size_t i = 0; i < n; ++i) {
+        rho[i] = real_t(std::exp2(rng.uniform(-5.0, 25.0)));
+        T[i] = real_t(std::exp2(rng.uniform(-5.0, 10.0)));
+    }
+    double sum_table = 0.0, sum_exact = 0.0;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < n; ++i) {
+        const EosSample s = eos.lookup(rho[i], T[i]);
+        sum_table += double(s.pressure) + double(s.cooling_rate);
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < n; ++i) {
+        sum_exact += eos.exact_pressure(rho[i], T[i]) + eos.exact_cooling_rate(rho[i], T[i]);
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    const double ms_table = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    const double ms_exact = std::chrono::duration<double, std::milli>(t2 - t1).count();
+    std::cout << "  " << n << " lookups: table " << ms_table << " ms, closed forms " << ms_exact
+              << " ms (checksums " << sum_table << ", " << sum_exact << ")\n";
+}
+
+int main() {
+    test_fast_math();
+    test_table(false, false);
+    test_table(true, false);
+    test_table(true, true);
+    test_edges();
+    test_cooling();
+    bench();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,180 @@
+// k-d tree kNN density test. Build and run with
+//   make run_test_knn
+// Checks:
+//   - tree queries return the same neighbours as a brute-force search, in
+//     open and periodic boxes
+//   - a uniform lattice gets its density, the same for every particle in a
+//     periodic box
+//   - a linear velocity field gets its exact divergence and curl
+//   - the density follows a Plummer profile from the core to the halo
+// and prints the time against the fixed-h SPH sum.
+#include "../include/particles.hpp"
+#include "../include/density.hpp"
+#include "../include/kdtree.hpp"
+#include "../include/init.hpp"
+#include "../include/philox.hpp"
+#include "check.hpp"
+#include <iostream>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// squared distances of the k nearest alive particles to i, brute force
+static std::vector<double> brute_force(const Particles& P, size_t i, size_t k) {
+    std::vector<double> d2;
+    for (size_t j = 0; j < P.N; ++j) {
+        if (!P.alive[j]) continue;
+        double d[3] = {double(P.x[j] - P.x[i]), double(P.y[j] - P.y[i]), double(P.z[j] - P.z[i])};
+        if (P.periodic()) {
+            for (double& c : d) c -= P.period * std::nearbyint(c / P.period);
+        }
+        d2.push_back(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    }
+    std::sort(d2.begin(), d2.end());
+    d2.resize(std::min(k, d2.size()));
+    return d2;
+}
+
+static void test_queries(bool periodic) {
+    Particles P(3000);
+    CounterRng rng(21, 0);
+    for (size_t i = 0; i < P.N; ++i) {
+        // clustered: half in a small clump
+        const double s = i % 2 ? 1.0 : 0.1;
+        P.x[i] = real_t(0.5 + s * (rng.uniform() - 0.5));
+        P.y[i] = real_t(0.5 + s * (rng.uniform() - 0.5));
+        P.z[i] = real_t(0.5 + s * (rng.uniform() - 0.5));
+        if (i % 17 == 0) P.alive[i] = false;
+    }
+    if (periodic) P.period = 1.0;
+
+    KdTree tree;
+    tree.build(P);
+    const size_t k = 40;
+    bool ok = tree.size() == P.N - P.num_dead();
+    KdTree::Neighbor nb[k];
+    for (size_t i = 0; ok && i < P.N; i += 7) {
+        const size_t found = tree.nearest(P.x[i], P.y[i], P.z[i], k, nb);
+        std::vector<double> got;
+        for (size_t m = 0; m < found; ++m) {
+            ok = ok && P.alive[nb[m].index];
+            got.push_back(double(nb[m].d2));
+        }
+        std::sort(got.begin(), got.end());
+        const std::vector<double> want = brute_force(P, i, k);
+        ok = ok && got.size() == want.size();
+        for (size_t m = 0; ok && m < got.size(); ++m) {
+            ok = std::abs(got[m] - want[m]) <= 1e-6 * (want[m] + 1e-12);
+        }
+    }
+    check(ok, std::string(periodic ? "periodic" : "open") +
+                  " box: tree neighbours match brute force");
+}
+
+static void test_lattice() {
+    // 16^3 unit masses on the unit lattice: rho = 4096
+    Particles P(4096);
+    init_particles(P, 1, 1);
+    P.period = 1.0;
+    compute_density_kNN(P, 32);
+    double lo = 1e300, hi = 0.0;
+    for (size_t i = 0; i < P.N; ++i) {
+        lo = std::min(lo, double(P.density[i]));
+        hi = std::max(hi, double(P.density[i]));
+    }
+    std::cout << "  periodic lattice: density " << lo << " .. " << hi << " (exact 4096)\n";
+    check(hi - lo < 1e-4 * hi, "periodic lattice: every particle gets the same density");
+    check(std::abs(lo / 4096.0 - 1.0) < 0.1, "periodic lattice: the density is within 10%");
+}
+
+static void test_linear_field() {
+    Particles P(3000);
+    init_particles(P, 3, 11);
+    const double A[3][3] = {{-0.7, 0.3, 0.1}, {0.5, 0.2, -0.4}, {0.2, 0.6, -0.9}};
+    for (size_t i = 0; i < P.N; ++i) {
+        const double d[3] = {P.x[i] - 0.5, P.y[i] - 0.5, P.z[i] - 0.5};
+        P.vx[i] = real_t(A[0][0] * d[0] + A[0][1] * d[1] + A[0][2] * d[2]);
+        P.vy[i] = real_t(A[1][0] * d[0] + A[1][1] * d[1] + A[1][2] * d[2]);
+        P.vz[i] = real_t(A[2][0] * d[0] + A[2][1] * d[1] + A[2][2] * d[2]);
+    }
+    compute_density_kNN(P, 32);
+    const double divv = A[0][0] + A[1][1] + A[2][2];
+    const double wx = A[2][1] - A[1][2], wy = A[0][2] - A[2][0], wz = A[1][0] - A[0][1];
+    const double curl = std::sqrt(wx * wx + wy * wy + wz * wz);
+    double div_err = 0.0, curl_err = 0.0;
+    for (size_t i = 0; i < P.N; ++i) {
+        div_err = std::max(div_err, std::abs(double(P.divv[i]) - divv));
+        curl_err = std::max(curl_err, std::abs(double(P.curlv[i]) - curl));
+    }
+    std::cout << "  linear field: worst div error " << div_err << ", curl error " << curl_err << "\n";
+    check(div_err < 1e-4 * std::abs(divv) && curl_err < 1e-4 * curl,
+          "linear field: exact divergence and curl");
+}
+
+static double median(std::vector<double> v) {
+    if (v.empty()) return 0.0;
+    std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+    return v[v.size() / 2];
+}
+
+static void test_plummer() {
+    // a = 0.1, total mass N (see init.cpp)
+    Particles P(20000);
+    init_particles(P, 6, 3);
+    const double a = 0.1;
+    const double rho0 = 3.0 * double(P.N) / (4.0 * M_PI * a * a * a);
+    auto ratios = [&](double r_lo, double r_hi) {
+        std::vector<double> out;
+        for (size_t i = 0; i < P.N; ++i) {
+            const double dx = P.x[i] - 0.5, dy = P.y[i] - 0.5, dz = P.z[i] - 0.5;
+            const double r = std::sqrt(dx * dx + dy * dy + dz * dz);
+            if (r < r_lo || r >= r_hi) continue;
+            const double exact = rho0 * std::pow(1.0 + r * r / (a * a), -2.5);
+            out.push_back(double(P.density[i]) / exact);
+        }
+        return median(out);
+    };
+
+    compute_density_sph(P, real_t(0.03));
+    const double sph_core = ratios(0.0, a), sph_halo = ratios(3 * a, 6 * a);
+    compute_density_kNN(P, 64);
+    const double knn_core = ratios(0.0, a), knn_halo = ratios(3 * a, 6 * a);
+    std::cout << "  Plummer density / exact (median): fixed-h SPH core " << sph_core
+              << ", halo " << sph_halo << "; kNN core " << knn_core << ", halo " << knn_halo << "\n";
+    // The sampling is random (Poisson), not relaxed: the k - 1 neighbours
+    // within 2 h add (k - 1) m / V on average and the self term W(0) adds
+    // (32 / 3) m / V, against (k - 2) m / V for the true density.
+    const double poisson = (64.0 - 1.0 + 32.0 / 3.0) / (64.0 - 2.0);
+    check(std::abs(knn_core / poisson - 1.0) < 0.1 && std::abs(knn_halo / poisson - 1.0) < 0.1,
+          "Plummer sphere: kNN density follows the profile in core and halo");
+}
+
+static void bench() {
+    Particles P(20000);
+    init_particles(P, 6, 5);
+    auto t0 = std::chrono::high_resolution_clock::now();
+    compute_density_sph(P, real_t(0.03));
+    auto t1 = std::chrono::high_resolution_clock::now();
+    KdTree tree;
+    compute_density_kNN(P, tree, 32); // sizes the tree's buffers
+    auto t2 = std::chrono::high_resolution_clock::now();
+    compute_density_kNN(P, tree, 32);
+    auto t3 = std::chrono::high_resolution_clock::now();
+    const double ms_sph = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    const double ms_first = std::chrono::duration<double, std::milli>(t2 - t1).count();
+    const double ms_knn = std::chrono::duration<double, std::milli>(t3 - t2).count();
+    std::cout << "  " << P.N << " particles: SPH sum " << ms_sph << " ms, kNN (k = 32) "
+              << ms_knn << " ms (first call " << ms_first << " ms)\n";
+}
+
+int main() {
+    test_queries(false);
+    test_queries(true);
+    test_lattice();
+    test_linear_field();
+    test_plummer();
+    bench();
+    return failures == 0 ? 0 : 1;
+}
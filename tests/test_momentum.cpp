@@ -37,28 +37,25 @@ int main() {
     // Time step
     float dt = 0.0001f;
 
-    // Allocate force cache using Vec3
-    std::vector<Vec3> force_cache(N);
-
     // Integrate 10000 steps
     for (int i = 0; i < 10000; ++i) {
-        compute_gravity_cached(P, force_cache);  // fills force_cache
+        compute_gravity_cached_optimized(P);  // fills P.ax/ay/az
         // Half-step velocity + full-step position
         for (size_t j = 0; j < N; ++j) {
-            P.vx[j] += 0.5f * force_cache[j].x * dt;
-            P.vy[j] += 0.5f * force_cache[j].y * dt;
-            P.vz[j] += 0.5f * force_cache[j].z * dt;
+            P.vx[j] += 0.5f * P.ax[j] * dt;
+            P.vy[j] += 0.5f * P.ay[j] * dt;
+            P.vz[j] += 0.5f * P.az[j] * dt;
 
             P.x[j] += P.vx[j] * dt;
             P.y[j] += P.vy[j] * dt;
             P.z[j] += P.vz[j] * dt;
         }
         // Recompute forces for second half-step velocity update
-        compute_gravity_cached(P, force_cache);
+        compute_gravity_cached_optimized(P);
         for (size_t j = 0; j < N; ++j) {
-            P.vx[j] += 0.5f * force_cache[j].x * dt;
-            P.vy[j] += 0.5f * force_cache[j].y * dt;
-            P.vz[j] += 0.5f * force_cache[j].z * dt;
+            P.vx[j] += 0.5f * P.ax[j] * dt;
+            P.vy[j] += 0.5f * P.ay[j] * dt;
+            P.vz[j] += 0.5f * P.az[j] * dt;
         }
     }
 
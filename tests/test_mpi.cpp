@@ -0,0 +1,153 @@
+// Multi-rank test of the domain decomposition. Build and run with
+//   make MPI=1 run_test_mpi NP=4
+// Checks, against a single-process reference on the gathered particles:
+//   - decomposition keeps every particle exactly once, in disjoint key ranges
+//   - LET gravity matches direct summation to tree accuracy
+//   - halo SPH densities match the full density sum
+//   - cost-weighted rebalancing evens out the per-rank cost
+#include "../include/particles.hpp"
+#include "../include/domain.hpp"
+#include "../include/bh.hpp"
+#include "../include/density.hpp"
+#include "../include/init.hpp"
+#include <mpi.h>
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+static int failures = 0;
+
+static void check(bool ok, const char* what, int rank) {
+    if (!ok) failures++;
+    if (rank == 0) std::cout << (ok ? "PASS: " : "FAIL: ") << what << "\n";
+}
+
+// positions and masses of all ranks' particles, on every rank
+static void gather_all(const Particles& P, MPI_Comm comm, std::vector<double>& all) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    std::vector<double> mine;
+    for (size_t i = 0; i < P.N; ++i) {
+        mine.insert(mine.end(), {double(P.x[i]), double(P.y[i]), double(P.z[i]), double(P.mass[i])});
+    }
+    int n = int(mine.size());
+    std::vector<int> counts(size), displs(size);
+    MPI_Allgather(&n, 1, MPI_INT, counts.data(), 1, MPI_INT, comm);
+    int total = 0;
+    for (int r = 0; r < size; ++r) { displs[r] = total; total += counts[r]; }
+    all.resize(total);
+    MPI_Allgatherv(mine.data(), n, MPI_DOUBLE, all.data(), counts.data(), displs.data(),
+                   MPI_DOUBLE, comm);
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(&argc, &argv);
+    DomainDecomposition dd(MPI_COMM_WORLD);
+    const int rank = dd.rank();
+
+    const size_t N = 4000;
+    const real_t theta = real_t(0.5), soft = real_t(0.01), h = real_t(0.03);
+    const size_t first = N * rank / dd.size(), last = N * (rank + 1) / dd.size();
+    Particles P(last - first);
+    init_particle_range(P, 2, 123, first, N); // clustered
+    std::vector<real_t> cost(P.N, real_t(1));
+
+    // ---- decomposition -------------------------------------------------
+    dd.decompose(P, cost);
+    dd.update_boxes(P);
+    unsigned long long id_sum = 0;
+    for (size_t i = 0; i < P.N; ++i) id_sum += P.id[i];
+    MPI_Allreduce(MPI_IN_PLACE, &id_sum, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    check(dd.global_count(P) == N && id_sum == N * (N - 1) / 2,
+          "every particle owned exactly once", rank);
+
+    uint64_t kmin = UINT64_MAX, kmax = 0;
+    for (size_t i = 0; i < P.N; ++i) {
+        const uint64_t k = dd.key_of(P.x[i], P.y[i], P.z[i]);
+        kmin = std::min(kmin, k);
+        kmax = std::max(kmax, k);
+    }
+    std::vector<uint64_t> ranges(2 * dd.size());
+    uint64_t mine[2] = {kmin, kmax};
+    MPI_Allgather(mine, 2, MPI_UINT64_T, ranges.data(), 2, MPI_UINT64_T, MPI_COMM_WORLD);
+    bool ordered = true;
+    uint64_t prev_max = 0;
+    for (int r = 0; r < dd.size(); ++r) {
+        if (ranges[2 * r] == UINT64_MAX) continue; // empty rank
+        if (ranges[2 * r] < prev_max) ordered = false;
+        prev_max = ranges[2 * r + 1];
+    }
+    check(ordered, "ranks own disjoint, ordered Morton key ranges", rank);
+
+    // ---- gravity through the locally essential tree ----------------------
+    std::vector<double> all;
+    gather_all(P, MPI_COMM_WORLD, all);
+    const size_t n_local = P.N;
+    BarnesHutSolver local_tree(P, theta, soft);
+    local_tree.build(P);
+    const size_t n_let = dd.import_essential_tree(P, local_tree);
+    BarnesHutSolver tree(P, theta, soft);
+    tree.build(P);
+    tree.compute_accelerations(P);
+    P.resize(n_local);
+
+    double err2 = 0;
+    for (size_t i = 0; i < P.N; ++i) {
+        double ex = 0, ey = 0, ez = 0;
+        for (size_t j = 0; j < all.size(); j += 4) {
+            const double dx = all[j] - P.x[i], dy = all[j + 1] - P.y[i], dz = all[j + 2] - P.z[i];
+            const double r2 = dx*dx + dy*dy + dz*dz + double(soft) * soft;
+            const double f = all[j + 3] / (r2 * std::sqrt(r2));
+            ex += f * dx; ey += f * dy; ez += f * dz;
+        }
+        const double e = std::sqrt(std::pow(P.ax[i] - ex, 2) + std::pow(P.ay[i] - ey, 2) +
+                                   std::pow(P.az[i] - ez, 2)) / std::sqrt(ex*ex + ey*ey + ez*ez);
+        err2 += e * e;
+    }
+    double n_sum = double(P.N);
+    MPI_Allreduce(MPI_IN_PLACE, &err2, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &n_sum, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    const double rms = std::sqrt(err2 / n_sum);
+    if (rank == 0) std::cout << "  LET gravity rms relative error " << rms
+                             << " (rank 0 imported " << n_let << " point masses)\n";
+    check(rms < 0.01, "LET gravity matches direct summation", rank);
+
+    // ---- SPH density through the halo ------------------------------------
+    dd.import_halo(P, real_t(2) * h);
+    compute_density_sph(P, h);
+    dd.refresh_halo_density(P, n_local);
+    P.resize(n_local);
+    double max_rel = 0;
+    for (size_t i = 0; i < P.N; ++i) {
+        double rho = 0;
+        for (size_t j = 0; j < all.size(); j += 4) {
+            const double r = std::sqrt(std::pow(all[j] - P.x[i], 2) + std::pow(all[j + 1] - P.y[i], 2) +
+                                       std::pow(all[j + 2] - P.z[i], 2));
+            const double q = r / h, sigma = 1.0 / (M_PI * h * h * h);
+            if (q < 1) rho += all[j + 3] * sigma * (1 - 1.5 * q * q + 0.75 * q * q * q);
+            else if (q < 2) rho += all[j + 3] * sigma * 0.25 * std::pow(2 - q, 3);
+        }
+        max_rel = std::max(max_rel, std::abs(P.density[i] - rho) / rho);
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &max_rel, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    check(max_rel < 1e-4, "halo SPH density matches the full sum", rank);
+
+    // ---- cost-weighted rebalancing ---------------------------------------
+    // make rank 0's current particles ten times as expensive
+    cost.assign(P.N, real_t(rank == 0 ? 10 : 1));
+    double before = 0;
+    for (real_t c : cost) before += c;
+    const double imbalance_before = dd.imbalance(before);
+    dd.decompose(P, cost);
+    double after = 0;
+    for (real_t c : cost) after += c;
+    const double imbalance_after = dd.imbalance(after);
+    if (rank == 0) std::cout << "  cost imbalance " << imbalance_before << " -> "
+                             << imbalance_after << "\n";
+    check(dd.size() == 1 || imbalance_after < std::min(imbalance_before, 1.25),
+          "rebalancing evens out the measured cost", rank);
+
+    MPI_Finalize();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+// Performance counter and roofline test. Build and run with
+//   make run_test_perf
+// Checks:
+//   - counters open or are reported missing with a reason, and the task
+//     clock (a software event) follows the CPU time of a busy loop
+//   - the profiler accumulates calls, time and modelled work per phase
+//   - the pair-sweep model streams sources once only while they fit in cache,
+//     and a stream in cache costs no memory traffic
+//   - the measured roofline ceilings are positive
+//   - a profiled run writes profile.csv with a row per step phase and the
+//     same frames as an unprofiled run
+#include "../include/perfcounters.hpp"
+#include "../include/particles.hpp"
+#include "../include/config.hpp"
+#include "../include/run.hpp"
+#include "../include/init.hpp"
+#include "../include/parallel.hpp"
+#include "check.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+// about `seconds` of arithmetic on the calling thread
+static double spin(double seconds) {
+    const double t0 = par_wtime();
+    double x = 1.0;
+    while (par_wtime() - t0 < seconds) {
+        for (int k = 0; k < 10000; ++k) x = x * 0.9999999 + 1e-7;
+    }
+    return x;
+}
+
+static void test_counters() {
+    PerfCounters pc(1);
+    std::cout << "  events:";
+    for (int e = 0; e < kNumPerfEvents; ++e) {
+        std::cout << " " << perf_event_name(e) << (pc.available(e) ? "" : " (missing)");
+    }
+    std::cout << "\n";
+    if (!pc.any_hardware()) std::cout << "  no hardware events: " << pc.unavailable_reason() << "\n";
+    check(pc.any_hardware() || !pc.unavailable_reason().empty(),
+          "missing hardware counters come with a reason");
+
+    double before[kNumPerfEvents], after[kNumPerfEvents];
+    pc.read(before);
+    const double x = spin(0.05);
+    pc.read(after);
+    bool ok = x > 0.0;
+    for (int e = 0; e < kNumPerfEvents; ++e) {
+        ok = ok && (pc.available(e) ? after[e] >= before[e] : after[e] == 0.0);
+    }
+    check(ok, "counts never decrease, and missing events read 0");
+    if (pc.available(kPerfTaskClock)) {
+        const double cpu = (after[kPerfTaskClock] - before[kPerfTaskClock]) * 1e-9;
+        std::cout << "  task clock over a 50 ms loop: " << cpu * 1e3 << " ms\n";
+        check(cpu > 0.025 && cpu < 0.2, "task clock follows the CPU time of a busy loop");
+    }
+    if (pc.available(kPerfCycles) && pc.available(kPerfInstructions)) {
+        const double ipc = (after[kPerfInstructions] - before[kPerfInstructions]) /
+                           (after[kPerfCycles] - before[kPerfCycles]);
+        std::cout << "  IPC of the loop: " << ipc << "\n";
+        check(ipc > 0.05 && ipc < 10.0, "cycles and instructions give a plausible IPC");
+    }
+}
+
+static void test_profiler() {
+    PhaseProfiler prof(1);
+    const size_t a = prof.add("modelled", [] { return KernelCost{1e6, 4e5}; });
+    const size_t b = prof.add("plain");
+    const size_t c = prof.add("short", [] { return KernelCost{1e3, 1e3}; });
+    for (int k = 0; k < 3; ++k) {
+        prof.begin(a);
+        spin(0.01);
+        prof.end(a);
+    }
+    prof.begin(b);
+    prof.end(b);
+    prof.begin(c);
+    prof.end(c);
+    const MachinePeaks peaks{10.0, 5.0, 8e6};
+    const std::string csv = "test_perf_profile.csv";
+    check(prof.write_csv(csv, peaks), "profile CSV is written");
+
+    std::ifstream f(csv);
+    std::string header, line;
+    std::getline(f, header);
+    std::vector<std::vector<std::string>> rows;
+    while (std::getline(f, line)) {
+        std::vector<std::string> cells;
+        std::stringstream s(line);
+        std::string cell;
+        while (std::getline(s, cell, ',')) cells.push_back(cell);
+        rows.push_back(cells);
+    }
+    std::filesystem::remove(csv);
+    const bool shape = rows.size() == 3 && rows[0].size() >= 5 && rows[1].size() >= 5;
+    check(shape && rows[0][0] == "modelled" && rows[0][1] == "3" && rows[1][1] == "1",
+          "phases count their calls");
+    check(shape && std::stod(rows[0][2]) > 0.025 && std::stod(rows[0][2]) < 0.2,
+          "phases accumulate their wall time");
+    check(shape && std::stod(rows[0][3]) == 3e6 && std::stod(rows[0][4]) == 1.2e6 &&
+              std::stod(rows[1][3]) == 0.0,
+          "the model is evaluated once per call");
+
+    std::ostringstream report;
+    prof.report(report, peaks);
+    std::cout << report.str();
+    // 2.5 flop/byte, right of the ridge at 10 / 5 = 2 flop/byte
+    check(report.str().find("compute") != std::string::npos, "the report places the phase on the roofline");
+    // a phase far below a millisecond: no rates from the clock's granularity
+    std::istringstream lines(report.str());
+    bool empty_roof = false;
+    while (std::getline(lines, line)) {
+        std::istringstream cells(line);
+        std::vector<std::string> c;
+        std::string cell;
+        while (cells >> cell) c.push_back(cell);
+        if (c.size() == 13 && c[0] == "short") {
+            empty_roof = c[4] == "-" && c[5] == "-" && c[6] == "-" && c[7] == "-" && c[8] == "-";
+        }
+    }
+    check(empty_roof, "sub-millisecond phases are left off the roofline");
+}
+
+static void test_models() {
+    // 1000 sources of 20 bytes fit in a 1 MB cache: streamed once
+    KernelCost fit = pair_sweep_cost(1000, 1e6, 20, 20, 24, 1e6);
+    check(fit.flops == 2e7 && fit.bytes == 1000 * 20 + 1000 * 24,
+          "pair sweep: sources that fit in cache are read once");
+    // they do not fit in 10 kB: read once per pair
+    KernelCost spill = pair_sweep_cost(1000, 1e6, 20, 20, 24, 1e4);
+    check(spill.bytes == 1e6 * 20 + 1000 * 24, "pair sweep: sources beyond the cache are re-read");
+    KernelCost s = stream_cost(100, 3, 16, 1e3);
+    check(s.flops == 300 && s.bytes == 1600, "stream: a pass beyond the cache reaches memory");
+    KernelCost resident = stream_cost(100, 3, 16, 1e6);
+    check(resident.flops == 300 && resident.bytes == 0, "stream: a pass in cache costs no memory traffic");
+}
+
+static void test_peaks() {
+    const MachinePeaks given = measure_peaks(12.5, 7.0);
+    check(given.gflops == 12.5 && given.bandwidth == 7.0, "given ceilings are used as they are");
+    const MachinePeaks m = measure_peaks();
+    std::cout << "  measured: " << m.gflops << " GFLOP/s, " << m.bandwidth << " GB/s, LLC "
+              << m.cache_bytes / 1048576.0 << " MB\n";
+    check(m.gflops > 0.0 && m.bandwidth > 0.0 && m.cache_bytes > 0.0,
+          "measured ceilings are positive");
+}
+
+static std::string read_file(const std::string& name) {
+    std::ifstream f(name);
+    std::stringstream s;
+    s << f.rdbuf();
+    return s.str();
+}
+
+static void test_run(bool cached) {
+    Config cfg;
+    cfg.num_particles = 400;
+    cfg.num_steps = 4;
+    cfg.use_cached = cached;
+    cfg.profile_peak_gflops = 10.0; // skip the measurement
+    cfg.profile_peak_bandwidth = 5.0;
+    const std::string plain = "test_perf_plain", profiled = "test_perf_profiled";
+    for (bool profile : {false, true}) {
+        cfg.profile = profile;
+        cfg.output_dir = profile ? profiled : plain;
+        Particles P(cfg.num_particles);
+        init_particles(P, cfg.init_type, cfg.seed);
+        run_simulation(P, cfg);
+    }
+    const std::string csv = read_file(profiled + "/profile.csv");
+    const char* phases[] = {"gravity", "density", "pressure_forces", "output"};
+    bool ok = !csv.empty();
+    for (const char* p : phases) ok = ok && csv.find(std::string("\n") + p + ",4,") != std::string::npos;
+    const std::string path = cached ? "cached" : "reference";
+    check(ok, path + " path: profile.csv has a row per phase, one call per step");
+    bool same = true;
+    for (int t = 0; t < cfg.num_steps; ++t) {
+        const std::string frame = "/frame_" + std::to_string(t) + ".csv";
+        same = same && read_file(plain + frame) == read_file(profiled + frame) &&
+               !read_file(plain + frame).empty();
+    }
+    check(same, path + " path: profiling leaves the frames unchanged");
+    std::filesystem::remove_all(plain);
+    std::filesystem::remove_all(profiled);
+}
+
+int main() {
+    test_counters();
+    test_profiler();
+    test_models();
+    test_peaks();
+    test_run(false);
+    test_run(true);
+    return failures == 0 ? 0 : 1;
+}
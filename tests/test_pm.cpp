@@ -0,0 +1,162 @@
+// Particle-mesh gravity test. Build and run with
+//   make run_test_pm
+// Checks:
+//   - the FFT matches a naive DFT and inverts exactly
+//   - open-boundary PM and TreePM forces match direct summation
+//   - in a periodic box, a lattice with a small sinusoidal displacement psi
+//     (a Zel'dovich wave) feels a = 4 pi G rho psi, for PM and TreePM
+#include "../include/particles.hpp"
+#include "../include/fft.hpp"
+#include "../include/pm.hpp"
+#include "../include/bh.hpp"
+#include "../include/gravity.hpp"
+#include "../include/init.hpp"
+#include "check.hpp"
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+// rms relative error of P.ax/ay/az against (ex, ey, ez)
+static double rms_error(const Particles& P, const std::vector<double>& ex,
+                        const std::vector<double>& ey, const std::vector<double>& ez) {
+    double err2 = 0;
+    for (size_t i = 0; i < P.N; ++i) {
+        const double e = std::sqrt(std::pow(P.ax[i] - ex[i], 2) + std::pow(P.ay[i] - ey[i], 2) +
+                                   std::pow(P.az[i] - ez[i], 2));
+        const double a = std::sqrt(ex[i] * ex[i] + ey[i] * ey[i] + ez[i] * ez[i]);
+        err2 += (e / a) * (e / a);
+    }
+    return std::sqrt(err2 / double(P.N));
+}
+
+static void test_fft() {
+    const size_t n = 8;
+    std::vector<cplx> a(n * n * n), b;
+    for (size_t i = 0; i < a.size(); ++i)
+        a[i] = cplx(std::sin(0.37 * double(i)), std::cos(1.3 * double(i * i % 17)));
+    b = a;
+    Fft3D fft(n);
+    fft.forward(b.data());
+
+    double max_err = 0;
+    for (size_t k = 0; k < a.size(); ++k) {
+        const size_t kx = k % n, ky = (k / n) % n, kz = k / (n * n);
+        cplx sum = 0;
+        for (size_t j = 0; j < a.size(); ++j) {
+            const size_t jx = j % n, jy = (j / n) % n, jz = j / (n * n);
+            const double phase = -2.0 * M_PI * double(kx * jx + ky * jy + kz * jz) / double(n);
+            sum += a[j] * cplx(std::cos(phase), std::sin(phase));
+        }
+        max_err = std::max(max_err, std::abs(sum - b[k]));
+    }
+    check(max_err < 1e-9, "3D FFT matches the naive DFT");
+
+    fft.inverse(b.data());
+    double round_trip = 0;
+    for (size_t i = 0; i < a.size(); ++i) round_trip = std::max(round_trip, std::abs(a[i] - b[i]));
+    check(round_trip < 1e-12, "inverse FFT undoes the forward FFT");
+}
+
+static void test_open_boundaries() {
+    const real_t G = 1, soft = real_t(0.01);
+
+    // pure PM resolves a mesh cell: sparse particles, many cells apart
+    Particles S(64);
+    for (size_t i = 0; i < S.N; ++i) {
+        S.x[i] = real_t(std::fmod(0.618034 * double(i) + 0.1, 1.0));
+        S.y[i] = real_t(std::fmod(0.754878 * double(i * i) + 0.3, 1.0));
+        S.z[i] = real_t(std::fmod(0.569840 * double(i * 7 + 3), 1.0));
+    }
+    Particles SD = S;
+    compute_gravity_cached_optimized(SD, G, soft);
+    PMSolver pm(64);
+    pm.fit(S);
+    pm.compute_accelerations(S, G);
+    const double pm_rms = rms_error(S, std::vector<double>(SD.ax.begin(), SD.ax.end()),
+                                    std::vector<double>(SD.ay.begin(), SD.ay.end()),
+                                    std::vector<double>(SD.az.begin(), SD.az.end()));
+    std::cout << "  open PM rms relative error " << pm_rms << "\n";
+    check(pm_rms < 0.05, "open-boundary PM matches direct summation beyond a few cells");
+
+    // TreePM resolves everything the tree does
+    Particles P(2000);
+    init_particles(P, 2, 123); // clustered
+    for (size_t i = 0; i < P.N; ++i) P.mass[i] = real_t(1.0 / double(P.N));
+    Particles D = P;
+    compute_gravity_cached_optimized(D, G, soft);
+    std::vector<double> ex(D.ax.begin(), D.ax.end()), ey(D.ay.begin(), D.ay.end()),
+                        ez(D.az.begin(), D.az.end());
+
+    PMSolver long_range(32, 0.0, 1.25);
+    BarnesHutSolver tree(P, real_t(0.5), soft);
+    long_range.fit(P);
+    tree.set_short_range(real_t(long_range.split_radius()));
+    tree.build(P);
+    tree.compute_accelerations(P, G);
+    long_range.compute_accelerations(P, G, nullptr, true);
+    const double treepm_rms = rms_error(P, ex, ey, ez);
+    std::cout << "  open TreePM rms relative error " << treepm_rms << "\n";
+    check(treepm_rms < 0.01, "open-boundary TreePM matches direct summation");
+}
+
+// lattice in the unit box displaced by psi_x = A sin(2 pi x0); returns the
+// rms error of a_x against 4 pi G rho psi relative to its amplitude, and
+// the largest transverse acceleration in the same units
+static void zeldovich(bool treepm, double& rms, double& transverse) {
+    const size_t side = 16;
+    const double A = 0.01, G = 1.0, rho = 1.0, amp = 4.0 * M_PI * G * rho * A;
+    Particles P(side * side * side);
+    P.period = 1.0;
+    std::vector<double> psi(P.N);
+    for (size_t i = 0; i < P.N; ++i) {
+        const double x0 = (double(i % side) + 0.5) / double(side);
+        psi[i] = A * std::sin(2.0 * M_PI * x0);
+        P.x[i] = real_t(x0 + psi[i]);
+        P.y[i] = real_t((double((i / side) % side) + 0.5) / double(side));
+        P.z[i] = real_t((double(i / (side * side)) + 0.5) / double(side));
+        P.mass[i] = real_t(rho / double(P.N));
+    }
+    P.wrap_periodic();
+
+    if (treepm) {
+        PMSolver pm(16, 1.0, 1.25);
+        BarnesHutSolver tree(P, real_t(0.5), real_t(1e-4));
+        pm.fit(P);
+        tree.set_short_range(real_t(pm.split_radius()), real_t(P.period));
+        tree.build(P);
+        tree.compute_accelerations(P, real_t(G));
+        pm.compute_accelerations(P, real_t(G), nullptr, true);
+    } else {
+        PMSolver pm(16, 1.0);
+        pm.fit(P);
+        pm.compute_accelerations(P, real_t(G));
+    }
+
+    double err2 = 0;
+    transverse = 0;
+    for (size_t i = 0; i < P.N; ++i) {
+        err2 += std::pow((P.ax[i] - amp / A * psi[i]) / amp, 2);
+        transverse = std::max({transverse, std::abs(double(P.ay[i])) / amp,
+                               std::abs(double(P.az[i])) / amp});
+    }
+    rms = std::sqrt(err2 / double(P.N));
+}
+
+static void test_periodic() {
+    double rms, transverse;
+    zeldovich(false, rms, transverse);
+    std::cout << "  periodic PM: rms " << rms << ", transverse " << transverse << "\n";
+    check(rms < 0.03 && transverse < 0.03, "periodic PM reproduces the Zel'dovich wave force");
+    zeldovich(true, rms, transverse);
+    std::cout << "  periodic TreePM: rms " << rms << ", transverse " << transverse << "\n";
+    check(rms < 0.03 && transverse < 0.03, "periodic TreePM reproduces the Zel'dovich wave force");
+}
+
+int main() {
+    test_fft();
+    test_open_boundaries();
+    test_periodic();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+// In-situ renderer test. Build and run with
+//   make run_test_render
+// Checks:
+//   - the projected kernel integrates to 1 over the plane
+//   - the image holds the mass of the particles in view, whether a particle
+//     covers many pixels or less than one
+//   - the image does not depend on the thread count (band ownership)
+//   - a single particle renders symmetrically around its position
+//   - PNG and PPM files carry the right signature and size
+#include "../include/particles.hpp"
+#include "../include/stars.hpp"
+#include "../include/render.hpp"
+#include "../include/init.hpp"
+#include "../include/parallel.hpp"
+#include "check.hpp"
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <filesystem>
+
+static double image_mass(const FrameRenderer& R) {
+    double sum = 0.0;
+    for (double s : R.sigma()) sum += s;
+    return sum * R.pixel() * R.pixel();
+}
+
+static void test_kernel() {
+    // int_0^2 F(q) 2 pi q dq by the midpoint rule
+    const int n = 20000;
+    double sum = 0.0;
+    for (int k = 0; k < n; ++k) {
+        const double q = 2.0 * (k + 0.5) / n;
+        sum += FrameRenderer::projected_kernel(q) * 2.0 * M_PI * q * (2.0 / n);
+    }
+    std::cout << "  projected kernel integral " << sum << "\n";
+    check(std::abs(sum - 1.0) < 1e-3, "projected kernel is normalized");
+}
+
+static void test_mass_and_threads() {
+    Particles P(3000);
+    init_particles(P, 2, 7);
+    SinkParticles S;
+    double mass = 0.0;
+    for (size_t i = 0; i < P.N; ++i) mass += double(P.mass[i]);
+
+    for (const double h : {0.03, 0.0005}) { // footprints of many pixels, and sub-pixel
+        FrameRenderer R(128, 'z', false, 0.0);
+        R.render(P, S, real_t(h));
+        const double m = image_mass(R);
+        std::cout << "  h = " << h << ": image mass " << m << " of " << mass << "\n";
+        check(std::abs(m - mass) < 1e-9 * mass, "image holds the particle mass (h = " +
+                                                std::to_string(h) + ")");
+    }
+
+    const int threads = par_max_threads();
+    FrameRenderer one(200, 'x', true, 0.0), many(200, 'x', true, 0.0);
+    par_set_num_threads(1);
+    one.render(P, S, real_t(0.03));
+    par_set_num_threads(4);
+    many.render(P, S, real_t(0.03));
+    par_set_num_threads(threads);
+    check(one.sigma() == many.sigma() && one.rgb() == many.rgb(),
+          "image is identical with 1 and 4 threads");
+}
+
+static void test_single_particle() {
+    Particles P(1);
+    P.x[0] = real_t(0.5);
+    P.y[0] = real_t(0.5);
+    P.z[0] = real_t(0.5);
+    P.mass[0] = real_t(1);
+    SinkParticles S;
+    FrameRenderer R(64, 'z', false, 1.0); // unit view centred on the particle
+    R.render(P, S, real_t(0.1));
+
+    const int n = R.size();
+    const std::vector<double>& s = R.sigma();
+    double asym = 0.0, peak = 0.0;
+    for (int r = 0; r < n; ++r) {
+        for (int c = 0; c < n; ++c) {
+            const double v = s[size_t(r) * n + c];
+            peak = std::max(peak, v);
+            asym = std::max({asym, std::abs(v - s[size_t(n - 1 - r) * n + c]),
+                             std::abs(v - s[size_t(c) * n + r])});
+        }
+    }
+    const double centre = s[size_t(n / 2) * n + n / 2];
+    check(asym < 1e-9 * peak && centre == peak, "a single particle renders symmetrically");
+    // the peak of the projected kernel is F(0) / h^2
+    const double expect = FrameRenderer::projected_kernel(0.0) / (0.1 * 0.1);
+    check(std::abs(peak - expect) < 0.02 * expect, "peak column density matches F(0) / h^2");
+}
+
+static void test_files() {
+    namespace fs = std::filesystem;
+    const fs::path dir = fs::temp_directory_path() / "starform_test_render";
+    fs::create_directories(dir);
+
+    Particles P(500);
+    init_particles(P, 3, 3);
+    SinkParticles S;
+    S.add(Star(real_t(1), Vec3{P.x[0], P.y[0], P.z[0]}, Vec3{}, real_t(0), 0));
+    FrameRenderer R(96, 'y', false, 0.0);
+    R.render(P, S, real_t(0.05));
+
+    const std::string png = (dir / "image.png").string(), ppm = (dir / "image.ppm").string();
+    check(R.write(png) && R.write(ppm), "PNG and PPM are written");
+
+    std::ifstream f(png, std::ios::binary);
+    std::vector<unsigned char> head(24);
+    f.read(reinterpret_cast<char*>(head.data()), 24);
+    const unsigned char sig[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    auto be32 = [&](int at) {
+        return uint32_t(head[at]) << 24 | uint32_t(head[at + 1]) << 16 |
+               uint32_t(head[at + 2]) << 8 | uint32_t(head[at + 3]);
+    };
+    check(std::equal(sig, sig + 8, head.begin()) && be32(16) == 96 && be32(20) == 96,
+          "PNG signature and size");
+    const auto raw = 3 * 96 * 96;
+    check(fs::file_size(ppm) == size_t(raw) + std::string("P6\n96 96\n255\n").size(),
+          "PPM holds the raw pixels");
+    check(fs::file_size(png) < size_t(raw), "PNG is compressed");
+    fs::remove_all(dir);
+}
+
+int main() {
+    test_kernel();
+    test_mass_and_threads();
+    test_single_particle();
+    test_files();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+// Shared-memory snapshot ring test. Build and run with
+//   make run_test_shm
+// Checks:
+//   - a published snapshot reads back column by column (alive rows only)
+//   - the reader follows the newest slot as the ring wraps around
+//   - particles past the capacity are left out and reported
+//   - a reader racing a writer never accepts a torn snapshot
+// and prints the publish time.
+#include "../include/particles.hpp"
+#include "../include/stars.hpp"
+#include "../include/shm_ring.hpp"
+#include "check.hpp"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+// a name no other test run uses
+static std::string ring_name(const char* what) {
+    return "/starform_test_" + std::string(what) + "_" + std::to_string(getpid());
+}
+
+// every value of every particle set to v (ids stay i)
+static void fill(Particles& P, real_t v) {
+    for (size_t i = 0; i < P.N; ++i) {
+        P.x[i] = P.y[i] = P.z[i] = v;
+        P.vx[i] = P.vy[i] = P.vz[i] = v;
+        P.temperature[i] = P.density[i] = P.pressure[i] = v;
+    }
+}
+
+static void test_round_trip() {
+    const std::string name = ring_name("round_trip");
+    Particles P(100);
+    for (size_t i = 0; i < P.N; ++i) {
+        P.x[i] = real_t(i);
+        P.y[i] = real_t(2 * i);
+        P.z[i] = real_t(3 * i);
+        P.vx[i] = real_t(-1.0 * i);
+        P.vy[i] = real_t(0.5 * i);
+        P.vz[i] = real_t(0.25 * i);
+        P.temperature[i] = real_t(10 + i);
+        P.density[i] = real_t(20 + i);
+        P.pressure[i] = real_t(30 + i);
+        P.id[i] = 1000 + i;
+    }
+    P.alive[7] = false;
+    P.alive[50] = false;
+    SinkParticles S;
+    S.add(Star(real_t(2.5), Vec3{1, 2, 3}, Vec3{}, real_t(0), 7));
+
+    SnapshotRing ring(name, P.N, 3);
+    SnapshotRingReader reader(name);
+    RingSnapshot snap;
+    check(ring.ok() && reader.ok() && !reader.read_latest(snap), "an empty ring has no snapshot");
+
+    ring.publish(P, S, 12, 0.5);
+    bool ok = reader.read_latest(snap) && snap.step == 12 && snap.time == 0.5 &&
+              snap.rows() == P.N - 2 && snap.total_stars == 1 && snap.star_x.size() == 1;
+    size_t k = 0;
+    for (size_t i = 0; ok && i < P.N; ++i) {
+        if (!P.alive[i]) continue;
+        const std::vector<real_t>* fields[kRingColumns] = {&P.x, &P.y, &P.z, &P.vx, &P.vy, &P.vz,
+                                                           &P.temperature, &P.density, &P.pressure};
+        for (uint32_t c = 0; c < kRingColumns; ++c) {
+            ok = ok && snap.columns[c][k] == float((*fields[c])[i]);
+        }
+        ok = ok && snap.id[k] == P.id[i];
+        ++k;
+    }
+    ok = ok && snap.star_x[0] == 1.0f && snap.star_y[0] == 2.0f && snap.star_z[0] == 3.0f &&
+         snap.star_mass[0] == 2.5f;
+    check(ok, "a snapshot reads back column by column");
+}
+
+static void test_wraparound() {
+    const std::string name = ring_name("wrap");
+    Particles P(10);
+    SinkParticles S;
+    SnapshotRing ring(name, P.N, 3);
+    SnapshotRingReader reader(name);
+    bool ok = true;
+    for (uint64_t step = 0; step < 10; ++step) {
+        fill(P, real_t(step));
+        ring.publish(P, S, step, double(step));
+        RingSnapshot snap;
+        ok = ok && reader.read_latest(snap) && snap.step == step &&
+             snap.columns[0][0] == float(step) && reader.published() == step + 1;
+    }
+    check(ok, "the reader follows the newest slot around the ring");
+}
+
+static void test_capacity() {
+    const std::string name = ring_name("capacity");
+    Particles P(50);
+    SinkParticles S;
+    SnapshotRing ring(name, 20, 2);
+    SnapshotRingReader reader(name);
+    const bool complete = ring.publish(P, S, 0, 0.0);
+    RingSnapshot snap;
+    check(!complete && reader.read_latest(snap) && snap.rows() == 20,
+          "particles past the capacity are left out");
+}
+
+static void test_torn_reads() {
+    const std::string name = ring_name("race");
+    Particles P(20000);
+    SinkParticles S;
+    SnapshotRing ring(name, P.N, 2);
+    SnapshotRingReader reader(name);
+
+    // the writer publishes frames in which every value is the frame number;
+    // a torn snapshot would mix two frames
+    std::atomic<bool> done{false};
+    std::atomic<long> accepted{0}, torn{0};
+    std::thread viewer([&] {
+        RingSnapshot snap;
+        while (!done.load()) {
+            if (!reader.read_latest(snap, 1)) continue;
+            const float v = float(snap.step);
+            bool same = snap.rows() == P.N;
+            for (uint32_t c = 0; same && c < kRingColumns; ++c) {
+                for (float x : snap.columns[c]) same = same && x == v;
+            }
+            (same ? accepted : torn)++;
+        }
+    });
+    const int frames = 2000;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (int f = 0; f < frames; ++f) {
+        fill(P, real_t(f));
+        ring.publish(P, S, uint64_t(f), double(f));
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    // let the viewer see the last frame
+    while (accepted.load() == 0) std::this_thread::yield();
+    done = true;
+    viewer.join();
+
+    const double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    std::cout << "  " << frames << " frames of " << P.N << " particles: fill + publish "
+              << ms / frames << " ms per frame; viewer accepted " << accepted.load()
+              << ", torn " << torn.load() << "\n";
+    check(torn.load() == 0, "a racing reader never accepts a torn snapshot");
+}
+
+int main() {
+    test_round_trip();
+    test_wraparound();
+    test_capacity();
+    test_torn_reads();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+// Star-group test. Build and run with
+//   make run_test_starform
+// Compares find_star_groups (cell list, parallel union-find) with a
+// brute-force O(N^2) search and grouping on a clustered cloud with some
+// dead particles, at 1, 2, 4 and 8 threads. Candidates, cluster order and
+// members must match exactly. Masses are equal, so the neighbour mass does
+// not depend on the summation order.
+#include "../include/particles.hpp"
+#include "../include/starform.hpp"
+#include "../include/arena.hpp"
+#include "../include/init.hpp"
+#include "../include/parallel.hpp"
+#include "check.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using Groups = std::vector<std::vector<int>>;
+
+// candidates by direct counting, grouped by flood fill over all candidate
+// pairs; clusters in order of first member, members ascending
+static Groups brute_force(const Particles& P, const StarFormation& SF) {
+    const real_t R2 = SF.neighbor_radius * SF.neighbor_radius;
+    auto close = [&](size_t i, size_t j) {
+        real_t dx = P.x[j] - P.x[i]; real_t dy = P.y[j] - P.y[i]; real_t dz = P.z[j] - P.z[i];
+        return dx*dx + dy*dy + dz*dz < R2;
+    };
+
+    std::vector<int> candidates;
+    for (size_t i = 0; i < P.N; ++i) {
+        if (!P.alive[i]) continue;
+        int inside = 0;
+        acc_t mass = 0;
+        for (size_t j = 0; j < P.N; ++j) {
+            if (P.alive[j] && close(i, j)) { inside++; mass += P.mass[j]; }
+        }
+        if (inside - 1 >= int(SF.min_neighbors) && real_t(mass) >= SF.min_density)
+            candidates.push_back(int(i));
+    }
+
+    const size_t C = candidates.size();
+    std::vector<int> group(C, -1);
+    Groups groups;
+    for (size_t c = 0; c < C; ++c) {
+        if (group[c] >= 0) continue;
+        group[c] = int(groups.size());
+        std::vector<size_t> todo(1, c), members;
+        while (!todo.empty()) {
+            const size_t a = todo.back();
+            todo.pop_back();
+            members.push_back(a);
+            for (size_t b = 0; b < C; ++b) {
+                if (group[b] < 0 && close(candidates[a], candidates[b])) {
+                    group[b] = group[c];
+                    todo.push_back(b);
+                }
+            }
+        }
+        groups.emplace_back();
+        for (size_t c2 = 0; c2 < C; ++c2)
+            if (group[c2] == group[c]) groups.back().push_back(candidates[c2]);
+    }
+    return groups;
+}
+
+static Groups cell_list(const Particles& P, const StarFormation& SF, ScratchArena& scratch) {
+    std::vector<StarCluster> clusters;
+    SF.find_star_groups(P, scratch, clusters);
+    Groups groups;
+    for (const StarCluster& cl : clusters) groups.emplace_back(cl.members.begin(), cl.members.end());
+    return groups;
+}
+
+int main() {
+    Particles P(3000);
+    init_particles(P, 2, 5);
+    for (size_t i = 0; i < P.N; ++i) {
+        P.mass[i] = real_t(1.0 / 3000.0);
+        if (i % 11 == 3) P.alive[i] = 0;
+    }
+    StarFormation SF(real_t(0.015), 3, real_t(5.0 / 3000.0)); // many small groups
+
+    const Groups expected = brute_force(P, SF);
+    size_t candidates = 0, largest = 0;
+    for (const std::vector<int>& g : expected) {
+        candidates += g.size();
+        largest = std::max(largest, g.size());
+    }
+    std::cout << "  brute force: " << candidates << " candidates in " << expected.size()
+              << " groups (largest " << largest << ")\n";
+    check(expected.size() > 10 && largest > 1, "the cloud has many multi-particle groups");
+
+    for (int threads : {1, 2, 4, 8}) {
+        par_set_num_threads(threads);
+        StarFormation sf = SF;
+        ScratchArena scratch;
+        // the second call splits the work on the first call's costs
+        bool same = true;
+        for (int call = 0; call < 2; ++call) {
+            scratch.reset();
+            same = same && cell_list(P, sf, scratch) == expected;
+        }
+        check(same, "find_star_groups matches brute force with " + std::to_string(threads) +
+                    (threads == 1 ? " thread" : " threads"));
+    }
+    par_set_num_threads(1);
+    return failures == 0 ? 0 : 1;
+}
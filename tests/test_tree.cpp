@@ -0,0 +1,104 @@
+// Barnes-Hut tree test. Build and run with
+//   make run_test_tree
+// Checks:
+//   - a tree built by one thread and by eight (different task splits)
+//     has the same nodes, and gives the same accelerations bit for bit
+//   - the walk error against direct summation stays within bounds for
+//     several opening angles, and shrinks with theta
+#include "../include/particles.hpp"
+#include "../include/bh.hpp"
+#include "../include/audit.hpp"
+#include "../include/init.hpp"
+#include "../include/parallel.hpp"
+#include "check.hpp"
+#include <iostream>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// one node as written by for_each_node, compared bytewise
+struct NodeRecord {
+    real_t center[3], half, mass, com[3];
+    uint32_t first, count;
+    int children;
+};
+
+static std::vector<NodeRecord> nodes_of(const BarnesHutSolver& bh) {
+    std::vector<NodeRecord> out;
+    bh.for_each_node([&](const Vec3& c, real_t half, real_t mass, const Vec3& com,
+                         uint32_t first, uint32_t count, int children) {
+        NodeRecord r;
+        std::memset(&r, 0, sizeof(r));
+        r.center[0] = c.x; r.center[1] = c.y; r.center[2] = c.z;
+        r.half = half;
+        r.mass = mass;
+        r.com[0] = com.x; r.com[1] = com.y; r.com[2] = com.z;
+        r.first = first;
+        r.count = count;
+        r.children = children;
+        out.push_back(r);
+    });
+    return out;
+}
+
+static void test_parallel_build(const Particles& P0) {
+    const real_t theta = real_t(0.6), soft = real_t(0.01);
+    std::vector<NodeRecord> nodes[2];
+    Particles P[2] = {P0, P0};
+    const int threads[2] = {1, 8};
+    for (int r = 0; r < 2; ++r) {
+        par_set_num_threads(threads[r]);
+        BarnesHutSolver bh(P[r], theta, soft);
+        bh.build(P[r]);
+        nodes[r] = nodes_of(bh);
+        bh.compute_accelerations(P[r]);
+    }
+    par_set_num_threads(1);
+
+    std::cout << "  " << nodes[0].size() << " nodes\n";
+    check(nodes[0].size() > 1 && nodes[0].size() == nodes[1].size() &&
+          std::memcmp(nodes[0].data(), nodes[1].data(),
+                      nodes[0].size() * sizeof(NodeRecord)) == 0,
+          "1- and 8-thread builds give identical nodes");
+
+    bool same = true;
+    for (size_t i = 0; i < P0.N; ++i) {
+        same = same && P[0].ax[i] == P[1].ax[i] && P[0].ay[i] == P[1].ay[i] &&
+               P[0].az[i] == P[1].az[i];
+    }
+    check(same, "1- and 8-thread builds give identical accelerations");
+}
+
+static void test_theta_error(const Particles& P0) {
+    const real_t soft = real_t(0.01);
+    const double thetas[3] = {0.3, 0.6, 0.9};
+    const double bounds[3] = {2e-3, 1.5e-2, 4.5e-2}; // rms relative error
+    const char* labels[3] = {"theta 0.3: rms error below 0.002",
+                             "theta 0.6: rms error below 0.015",
+                             "theta 0.9: rms error below 0.045"};
+    double last = 0.0;
+    bool shrinks = true;
+    for (int k = 0; k < 3; ++k) {
+        Particles P = P0;
+        BarnesHutSolver bh(P, real_t(thetas[k]), soft);
+        bh.build(P);
+        bh.compute_accelerations(P);
+        const ForceAudit a = audit_forces(P, P.ax.data(), P.ay.data(), P.az.data(),
+                                          512, 7, 0, real_t(1), soft);
+        std::cout << "  theta " << thetas[k] << ": rms " << a.rms << ", p99 " << a.p99
+                  << ", max " << a.max << "\n";
+        check(a.samples == 512 && a.rms < bounds[k], labels[k]);
+        shrinks = shrinks && a.rms > last;
+        last = a.rms;
+    }
+    check(shrinks, "the walk error grows with theta");
+}
+
+int main() {
+    // clustered: deep, uneven subtrees, so the task split matters
+    Particles P(20000);
+    init_particles(P, 2, 42);
+    test_parallel_build(P);
+    test_theta_error(P);
+    return failures == 0 ? 0 : 1;
+}
@@ -115,8 +115,7 @@ int main() {
     P.x[0] = -1.0f; P.y[0] = 0.0f; P.z[0] = 0.0f;
     P.x[1] =  1.0f; P.y[1] = 0.0f; P.z[1] = 0.0f;
 
-    std::cout << "N=" << P.N << " | acc_cache size=" << P.acc_cache.size() 
-          << " | r2_cache size=" << P.r2_cache.size() << "\n";
+    std::cout << "N=" << P.N << "\n";
 
 
     // Initialize acceleration vectors
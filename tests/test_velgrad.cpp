@@ -0,0 +1,120 @@
+// Velocity divergence and curl from the density pass. Build and run with
+//   make run_test_velgrad
+// Checks:
+//   - a linear velocity field gets its exact divergence and curl, also at
+//     the ragged edge of the cloud (the gradient correction)
+//   - a rigid rotation has no divergence and curl 2 |Omega|
+//   - the density itself is the plain SPH sum
+//   - a contracting cloud heats up and an expanding one cools
+#include "../include/particles.hpp"
+#include "../include/density.hpp"
+#include "../include/thermo.hpp"
+#include "../include/init.hpp"
+#include "check.hpp"
+#include <iostream>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// v = A (x - c) for every particle
+static void set_linear(Particles& P, const double A[3][3]) {
+    for (size_t i = 0; i < P.N; ++i) {
+        const double d[3] = {P.x[i] - 0.5, P.y[i] - 0.5, P.z[i] - 0.5};
+        P.vx[i] = real_t(A[0][0] * d[0] + A[0][1] * d[1] + A[0][2] * d[2]);
+        P.vy[i] = real_t(A[1][0] * d[0] + A[1][1] * d[1] + A[1][2] * d[2]);
+        P.vz[i] = real_t(A[2][0] * d[0] + A[2][1] * d[1] + A[2][2] * d[2]);
+    }
+}
+
+static double max_error(const std::vector<real_t>& a, size_t N, double expect) {
+    double worst = 0.0;
+    for (size_t i = 0; i < N; ++i) worst = std::max(worst, std::abs(double(a[i]) - expect));
+    return worst;
+}
+
+static void test_linear_field() {
+    Particles P(2000);
+    init_particles(P, 3, 11);
+    const real_t h = real_t(0.05);
+
+    // shear, compression and rotation together
+    const double A[3][3] = {{-0.7, 0.3, 0.1}, {0.5, 0.2, -0.4}, {0.2, 0.6, -0.9}};
+    set_linear(P, A);
+    compute_density_sph(P, h);
+
+    const double divv = A[0][0] + A[1][1] + A[2][2];
+    const double wx = A[2][1] - A[1][2], wy = A[0][2] - A[2][0], wz = A[1][0] - A[0][1];
+    const double curl = std::sqrt(wx * wx + wy * wy + wz * wz);
+    const double div_err = max_error(P.divv, P.N, divv);
+    const double curl_err = max_error(P.curlv, P.N, curl);
+    std::cout << "  div v " << divv << ": worst error " << div_err << "\n";
+    std::cout << "  |curl v| " << curl << ": worst error " << curl_err << "\n";
+    check(div_err < 1e-4 * std::abs(divv), "linear field: exact divergence");
+    check(curl_err < 1e-4 * curl, "linear field: exact curl");
+}
+
+static void test_rotation() {
+    Particles P(2000);
+    init_particles(P, 3, 5);
+    const double w = 2.0; // about z
+    const double A[3][3] = {{0, -w, 0}, {w, 0, 0}, {0, 0, 0}};
+    set_linear(P, A);
+    compute_density_sph(P, real_t(0.05));
+    const double div_err = max_error(P.divv, P.N, 0.0);
+    const double curl_err = max_error(P.curlv, P.N, 2.0 * w);
+    std::cout << "  rotation: worst |div v| " << div_err << ", worst curl error " << curl_err << "\n";
+    check(div_err < 1e-4 * w && curl_err < 1e-4 * w, "rigid rotation: no divergence, curl 2 w");
+}
+
+static void test_density_unchanged() {
+    Particles P(500);
+    init_particles(P, 2, 9);
+    const real_t h = real_t(0.08);
+    compute_density_sph(P, h);
+
+    // reference: the plain kernel sum in the same order
+    double worst = 0.0;
+    for (size_t i = 0; i < P.N; ++i) {
+        acc_t rho = 0;
+        for (size_t j = 0; j < P.N; ++j) {
+            const real_t dx = P.x[j] - P.x[i], dy = P.y[j] - P.y[i], dz = P.z[j] - P.z[i];
+            const real_t q = std::sqrt(dx * dx + dy * dy + dz * dz) / h;
+            const real_t sigma = real_t(1.0 / M_PI) / (h * h * h);
+            real_t W = 0;
+            if (q < real_t(1)) W = sigma * (real_t(1) - real_t(1.5) * q * q + real_t(0.75) * q * q * q);
+            else if (q < real_t(2)) W = sigma * real_t(0.25) * (real_t(2) - q) * (real_t(2) - q) * (real_t(2) - q);
+            rho += acc_t(P.mass[j] * W);
+        }
+        worst = std::max(worst, std::abs(double(rho) - double(P.density[i])) / double(rho));
+    }
+    check(worst < 1e-5, "density is the plain SPH sum");
+}
+
+static void test_heating() {
+    for (const double sign : {-1.0, 1.0}) {
+        Particles P(1000);
+        init_particles(P, 3, 3);
+        const double A[3][3] = {{sign, 0, 0}, {0, sign, 0}, {0, 0, sign}};
+        set_linear(P, A);
+        compute_density_sph(P, real_t(0.05));
+        double before = 0.0, after = 0.0;
+        for (size_t i = 0; i < P.N; ++i) before += double(P.temperature[i]);
+        update_thermodynamics(P, real_t(0.01));
+        for (size_t i = 0; i < P.N; ++i) after += double(P.temperature[i]);
+        // dT/dt = -(gamma - 1) T div v with div v = 3 sign
+        const double expect = before * (1.0 - (2.0 / 3.0) * 3.0 * sign * 0.01);
+        std::cout << "  div v = " << 3 * sign << ": mean T " << before / P.N << " -> "
+                  << after / P.N << "\n";
+        check(std::abs(after - expect) < 0.02 * std::abs(expect - before),
+              sign < 0 ? "contraction heats the gas" : "expansion cools the gas");
+    }
+}
+
+int main() {
+    test_linear_field();
+    test_rotation();
+    test_density_unchanged();
+    test_heating();
+    return failures == 0 ? 0 : 1;
+}
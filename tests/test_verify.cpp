@@ -0,0 +1,101 @@
+// In-line verification test. Build and run with
+//   make run_test_verify
+// Checks:
+//   - the radial profile bins every finite radius, huge ones in the last bin
+//   - NaN and infinite positions are left out and counted, not binned
+//   - a diverged state compares with an infinite error
+//   - a run that diverges stops as aborted on both paths, without a crash
+#include "../include/particles.hpp"
+#include "../include/verify.hpp"
+#include "../include/config.hpp"
+#include "../include/run.hpp"
+#include "../include/init.hpp"
+#include "check.hpp"
+#include <iostream>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <vector>
+
+// n unit masses on the x axis at 0.5, 1.5, ... (one per bin of width 1)
+static Particles line(size_t n) {
+    Particles P(n);
+    for (size_t i = 0; i < n; ++i) {
+        P.x[i] = real_t(0.5 + double(i));
+        P.y[i] = P.z[i] = real_t(0);
+        P.mass[i] = real_t(1);
+    }
+    return P;
+}
+
+static double shell_mass(const std::vector<float>& rho, float max_r) {
+    double m = 0.0;
+    const int bins = int(rho.size());
+    for (int k = 0; k < bins; ++k) {
+        const double lo = double(k) / bins * max_r, hi = double(k + 1) / bins * max_r;
+        m += rho[k] * (4.0 * M_PI / 3.0) * (hi * hi * hi - lo * lo * lo);
+    }
+    return m;
+}
+
+static void test_profile() {
+    const Vec3 origin(0, 0, 0);
+    Particles P = line(4);
+    P.x[3] = real_t(1e18); // far outside, and beyond int range once scaled
+    size_t non_finite = 0;
+    std::vector<float> rho = compute_radial_profile(P, 4, 4.0f, origin, &non_finite);
+    check(non_finite == 0 && std::abs(shell_mass(rho, 4.0f) - 4.0) < 1e-3 && rho[3] > 0.0f,
+          "huge radii go to the last bin");
+
+    P.x[1] = std::numeric_limits<real_t>::quiet_NaN();
+    P.y[2] = std::numeric_limits<real_t>::infinity();
+    rho = compute_radial_profile(P, 4, 4.0f, origin, &non_finite);
+    check(non_finite == 2 && std::abs(shell_mass(rho, 4.0f) - 2.0) < 1e-3,
+          "NaN and infinite positions are counted, not binned");
+
+    P.alive[1] = 0;
+    P.alive[2] = 0;
+    rho = compute_radial_profile(P, 4, 4.0f, origin, &non_finite);
+    check(non_finite == 0, "dead particles are not counted");
+}
+
+static void test_compare() {
+    ReferenceProfile ref;
+    ref.radius = {1.0f, 2.0f, 3.0f, 4.0f};
+    ref.density = {1.0f, 1.0f, 1.0f, 1.0f};
+
+    Particles P = line(4);
+    const ErrorMetrics ok = ref.compare(P);
+    check(std::isfinite(ok.L1) && std::isfinite(ok.L2) && std::isfinite(ok.Linf),
+          "a finite state has a finite error");
+
+    P.z[2] = std::numeric_limits<real_t>::quiet_NaN(); // also makes the centre NaN
+    const ErrorMetrics bad = ref.compare(P);
+    std::cout << "  diverged state: L2 " << bad.L2 << "\n";
+    check(std::isinf(bad.L1) && std::isinf(bad.L2) && std::isinf(bad.Linf),
+          "a diverged state has an infinite error");
+}
+
+static void test_diverged_run(bool cached) {
+    Config cfg;
+    cfg.num_particles = 400;
+    cfg.num_steps = 5;
+    cfg.output_interval = 0;
+    cfg.use_cached = cached;
+
+    Particles P(cfg.num_particles);
+    init_particles(P, cfg.init_type, cfg.seed);
+    P.x[7] = std::numeric_limits<real_t>::quiet_NaN();
+    const RunResult r = run_simulation(P, cfg);
+    check(r.aborted && r.steps < size_t(cfg.num_steps),
+          std::string("a diverged run is aborted (") + (cached ? "cached" : "reference") + " path)");
+}
+
+int main() {
+    test_profile();
+    test_compare();
+    test_diverged_run(false);
+    test_diverged_run(true);
+    return failures == 0 ? 0 : 1;
+}